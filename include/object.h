@@ -28,6 +28,8 @@
 #define __OBJECT_H__
 
 #include "sb6mfile.h"
+#include "sb7cull.h"
+#include "sb7sbm.h"
 
 #ifndef SB6M_FILETYPES_ONLY
 
@@ -39,6 +41,25 @@ namespace sb7
 class object
 {
 public:
+    enum
+    {
+        // Leave quantized attributes quantized on the GPU. Vertex shaders
+        // then decode them with the functions in quantized_glsl.
+        keep_quantized              = 0x00000001,
+
+        // Keep positions and indices in memory for get_cpu_positions() and
+        // get_cpu_indices()
+        keep_cpu_copy               = 0x00000002
+    };
+
+    // Generic attribute slots through which render_sub_object passes the
+    // position scale and bias of the sub-object being drawn
+    enum
+    {
+        position_scale_location     = 14,
+        position_bias_location      = 15
+    };
+
     object();
     ~object();
 
@@ -66,9 +87,94 @@ public:
         }
     }
 
+    void get_sub_object_dequant(unsigned int index, SB6M_SCALE_BIAS &sb) const
+    {
+        static const SB6M_SCALE_BIAS identity = { { 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f } };
+
+        if (index >= num_sub_objects || !quantized)
+        {
+            sb = identity;
+        }
+        else
+        {
+            sb = sub_object[index].dequant;
+        }
+    }
+
+    void get_sub_object_bounds(unsigned int index, sbm::bounds &b) const
+    {
+        if (index >= num_sub_objects)
+        {
+            b = sbm::bounds();
+        }
+        else
+        {
+            b = sub_object[index].bounds;
+        }
+    }
+
+    // Files with a meshlet chunk can have their sub-objects culled in
+    // pieces. cull_meshlets() writes commands for the meshlets that are in
+    // view and facing eye, with planes from extract_frustum_planes() and
+    // eye in the object's space, and returns how many. Upload them to the
+    // bound GL_DRAW_INDIRECT_BUFFER and draw them with
+    // render_meshlets_indirect().
+    unsigned int get_meshlet_count(unsigned int object_index) const
+    {
+        return meshlets.get_meshlet_count(object_index);
+    }
+
+    unsigned int cull_meshlets(unsigned int object_index,
+                               const float planes[6][4],
+                               const float eye[3],
+                               draw_elements_indirect_command * commands,
+                               unsigned int instance_count = 1,
+                               unsigned int base_instance = 0) const
+    {
+        return meshlets.cull(object_index, planes, eye, commands, instance_count, base_instance);
+    }
+
+    void render_meshlets_indirect(unsigned int object_index,
+                                  GLsizei draw_count,
+                                  GLintptr indirect_offset = 0);
+
+    // Indexed objects can pick a level of detail for each of many instances
+    // and write the commands that draw them, to go to the bound
+    // GL_DRAW_INDIRECT_BUFFER and glMultiDrawElementsIndirect with this
+    // object's VAO and index type. Level zero is the sub-object itself;
+    // files with an LOD chunk add simplified levels. spheres are in view
+    // space; see lod_selector::select() for the rest.
+    unsigned int get_lod_count(unsigned int object_index) const
+    {
+        return lods.get_level_count(object_index);
+    }
+
+    void select_lods(const float * spheres,
+                     const unsigned int * sub_objects,
+                     unsigned int count,
+                     float pixel_scale,
+                     float threshold,
+                     draw_elements_indirect_command * commands,
+                     unsigned int base_instance = 0) const
+    {
+        lods.select(spheres, sub_objects, count, pixel_scale, threshold, commands, base_instance);
+    }
+
+    // With keep_cpu_copy, the object's positions as three floats per vertex,
+    // dequantized, and its indices as 32-bit values that sub-object and
+    // level of detail ranges index into, in order if the file has none.
+    // They're for the routines in sb7mesh.h, to work out once what a
+    // geometry shader would otherwise derive every frame.
+    const float * get_cpu_positions() const             { return cpu_positions.empty() ? NULL : &cpu_positions[0]; }
+    unsigned int get_cpu_vertex_count() const           { return (unsigned int)(cpu_positions.size() / 3); }
+    const unsigned int * get_cpu_indices() const        { return cpu_indices.empty() ? NULL : &cpu_indices[0]; }
+    unsigned int get_cpu_index_count() const            { return (unsigned int)cpu_indices.size(); }
+
     unsigned int get_sub_object_count() const           { return num_sub_objects; }
     GLuint       get_vao() const                        { return vao; }
-    void load(const char * filename);
+    GLenum       get_index_type() const                 { return index_type; }
+    bool is_quantized() const                           { return quantized; }
+    bool load(const char * filename, unsigned int flags = 0);
     void free();
 
 private:
@@ -76,13 +182,56 @@ private:
     GLuint                  vao;
     GLuint                  index_type;
     GLuint                  index_offset;
+    bool                    quantized;
 
-    enum { MAX_SUB_OBJECTS = 256 };
+    object(const object&);
+    object& operator=(const object&);
+
+    void bind_sub_object(unsigned int object_index);
+    void keep_cpu_data(const sbm::file_desc& desc);
+
+    struct sub_object_t
+    {
+        unsigned int        first;
+        unsigned int        count;
+        sbm::bounds         bounds;
+        SB6M_SCALE_BIAS     dequant;
+    };
 
     unsigned int            num_sub_objects;
-    SB6M_SUB_OBJECT_DECL    sub_object[MAX_SUB_OBJECTS];
+    sub_object_t *          sub_object;
+    meshlet_culler          meshlets;
+    lod_selector            lods;
+    std::vector<float>          cpu_positions;
+    std::vector<unsigned int>   cpu_indices;
 };
 
+// Declarations for vertex shaders drawing objects loaded with keep_quantized.
+// Positions are sbm_position(position.xyz), octahedral normals are
+// sbm_octahedral(normal.xy) and octahedral tangents, which keep the sign of
+// their w in z, are sbm_tangent(tangent.xyz).
+static const char quantized_glsl[] =
+    "layout (location = 14) in vec3 sbm_position_scale;                         \n"
+    "layout (location = 15) in vec3 sbm_position_bias;                          \n"
+    "                                                                           \n"
+    "vec3 sbm_position(vec3 q)                                                  \n"
+    "{                                                                          \n"
+    "    return q * sbm_position_scale + sbm_position_bias;                     \n"
+    "}                                                                          \n"
+    "                                                                           \n"
+    "vec3 sbm_octahedral(vec2 e)                                                \n"
+    "{                                                                          \n"
+    "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));                           \n"
+    "    if (n.z < 0.0)                                                         \n"
+    "        n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0))); \n"
+    "    return normalize(n);                                                   \n"
+    "}                                                                          \n"
+    "                                                                           \n"
+    "vec4 sbm_tangent(vec3 e)                                                   \n"
+    "{                                                                          \n"
+    "    return vec4(sbm_octahedral(e.xy), e.z < 0.0 ? -1.0 : 1.0);             \n"
+    "}                                                                          \n";
+
 }
 
 #endif /* SB6M_FILETYPES_ONLY */
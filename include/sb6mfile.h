@@ -41,7 +41,10 @@ typedef enum SB6M_CHUNK_TYPE_t
     SB6M_CHUNK_TYPE_VERTEX_ATTRIBS  = SB6M_FOURCC('A','T','R','B'),
     SB6M_CHUNK_TYPE_SUB_OBJECT_LIST = SB6M_FOURCC('O','L','S','T'),
     SB6M_CHUNK_TYPE_COMMENT         = SB6M_FOURCC('C','M','N','T'),
-    SB6M_CHUNK_TYPE_DATA            = SB6M_FOURCC('D','A','T','A')
+    SB6M_CHUNK_TYPE_DATA            = SB6M_FOURCC('D','A','T','A'),
+    SB6M_CHUNK_TYPE_QUANTIZATION    = SB6M_FOURCC('Q','U','N','T'),
+    SB6M_CHUNK_TYPE_MESHLETS        = SB6M_FOURCC('M','S','H','L'),
+    SB6M_CHUNK_TYPE_LOD_LIST        = SB6M_FOURCC('L','O','D','S')
 } SB6M_CHUNK_TYPE;
 
 typedef struct SB6M_HEADER_t
@@ -128,6 +131,103 @@ typedef struct SB6M_CHUNK_SUB_OBJECT_LIST_t
     SB6M_SUB_OBJECT_DECL        sub_object[1];
 } SB6M_CHUNK_SUB_OBJECT_LIST;
 
+/*
+ * Attributes stored in a reduced form. POSITION attributes are unsigned
+ * normalized and are scaled and biased by the entry for the sub-object
+ * being drawn. OCTAHEDRAL attributes are unit vectors folded onto the
+ * octahedron and stored as two signed normalized components.
+ * OCTAHEDRAL_SIGN attributes are four component tangents: xyz is stored
+ * as for OCTAHEDRAL and a third component holds the sign of w as -1 or 1.
+ * Attributes such as half float texture coordinates need no entry; their
+ * type says everything.
+ *
+ * The chunk holds attrib_count SB6M_QUANTIZED_ATTRIB followed by
+ * scale_bias_count SB6M_SCALE_BIAS, one per sub-object.
+ */
+typedef enum SB6M_ATTRIB_ENCODING_t
+{
+    SB6M_ATTRIB_ENCODING_NONE           = 0,
+    SB6M_ATTRIB_ENCODING_POSITION       = 1,
+    SB6M_ATTRIB_ENCODING_OCTAHEDRAL     = 2,
+    SB6M_ATTRIB_ENCODING_OCTAHEDRAL_SIGN = 3
+} SB6M_ATTRIB_ENCODING;
+
+typedef struct SB6M_QUANTIZED_ATTRIB_t
+{
+    unsigned int                attrib;
+    unsigned int                encoding;
+} SB6M_QUANTIZED_ATTRIB;
+
+typedef struct SB6M_SCALE_BIAS_t
+{
+    float                       scale[3];
+    float                       bias[3];
+} SB6M_SCALE_BIAS;
+
+typedef struct SB6M_CHUNK_QUANTIZATION_t
+{
+    SB6M_CHUNK_HEADER           header;
+    unsigned int                attrib_count;
+    unsigned int                scale_bias_count;
+} SB6M_CHUNK_QUANTIZATION;
+
+/*
+ * Clusters of at most 64 vertices and 124 triangles, for culling parts of
+ * a sub-object. Each meshlet is a run of count indices starting at first,
+ * inside the sub-object it belongs to, so it can be drawn on its own.
+ * Meshlets are sorted by sub-object. The sphere encloses the meshlet's
+ * vertices. Every triangle faces away from any eye position for which
+ * dot(normalize(cone_apex - eye), cone_axis) > cone_cutoff; a cutoff of
+ * one or more means the triangles face too many ways for that to happen.
+ * Bounds are in the same space as unquantized positions.
+ */
+typedef struct SB6M_MESHLET_DECL_t
+{
+    unsigned int                first;
+    unsigned int                count;
+    unsigned int                sub_object;
+    unsigned int                vertex_count;
+    float                       center[3];
+    float                       radius;
+    float                       cone_apex[3];
+    float                       cone_cutoff;
+    float                       cone_axis[3];
+    unsigned int                reserved;
+} SB6M_MESHLET_DECL;
+
+#define SB6M_MESHLET_MAX_VERTICES               64
+#define SB6M_MESHLET_MAX_TRIANGLES              124
+
+typedef struct SB6M_CHUNK_MESHLETS_t
+{
+    SB6M_CHUNK_HEADER           header;
+    unsigned int                count;
+    SB6M_MESHLET_DECL           meshlet[1];
+} SB6M_CHUNK_MESHLETS;
+
+/*
+ * Simplified levels of detail. Level zero of each sub-object is the
+ * sub-object itself; every level listed here is a further range of
+ * indices that draws it with fewer triangles from the same vertices.
+ * error is how far, in the units of unquantized positions, the level's
+ * surface strays from the original. Levels are sorted by sub-object and
+ * then by increasing error.
+ */
+typedef struct SB6M_LOD_DECL_t
+{
+    unsigned int                sub_object;
+    unsigned int                first;
+    unsigned int                count;
+    float                       error;
+} SB6M_LOD_DECL;
+
+typedef struct SB6M_CHUNK_LOD_LIST_t
+{
+    SB6M_CHUNK_HEADER           header;
+    unsigned int                count;
+    SB6M_LOD_DECL               lod[1];
+} SB6M_CHUNK_LOD_LIST;
+
 typedef struct SB6M_CHUNK_COMMENT_t
 {
     SB6M_CHUNK_HEADER           header;
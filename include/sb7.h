@@ -45,6 +45,7 @@
 #include "GLFW/glfw3.h"
 
 #include "sb7ext.h"
+#include "shader.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -53,6 +54,9 @@
 namespace sb7
 {
 
+class shader_watcher;
+struct shader_stage;
+
 class application
 {
 private:
@@ -64,8 +68,17 @@ private:
                                         const GLchar* message,
                                         GLvoid* userParam);
 
+    // See watchProgram()
+    bool updateWatchedPrograms();
+    void stopWatchingPrograms();
+
 public:
-    application() {}
+    application()
+        : watcher(NULL),
+          watcher_window(NULL)
+    {
+    }
+
     virtual ~application() {}
     virtual void run(sb7::application* the_app)
     {
@@ -156,6 +169,11 @@ public:
             }
         }
 
+        if (info.flags.program_cache)
+        {
+            sb7::program::set_binary_cache("shadercache");
+        }
+
         startup();
 
         do
@@ -165,12 +183,23 @@ public:
             glfwSwapBuffers(window);
             glfwPollEvents();
 
+            // Between frames, so nothing is drawn with half the new set
+            if (watcher && updateWatchedPrograms())
+            {
+                onShadersReloaded();
+            }
+
             running &= (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_RELEASE);
             running &= (glfwWindowShouldClose(window) != GL_TRUE);
         } while (running);
 
         shutdown();
 
+        if (watcher)
+        {
+            stopWatchingPrograms();
+        }
+
         glfwDestroyWindow(window);
         glfwTerminate();
     }
@@ -190,6 +219,7 @@ public:
         info.samples = 0;
         info.flags.all = 0;
         info.flags.cursor = 1;
+        info.flags.program_cache = 1;
 #ifdef _DEBUG
         info.flags.debug = 1;
 #endif
@@ -241,6 +271,13 @@ public:
 
     }
 
+    // Called between frames after watched programs have been rebuilt, to
+    // look up their uniform locations again
+    virtual void onShadersReloaded()
+    {
+
+    }
+
     virtual void onDebugMessage(GLenum source,
                                 GLenum type,
                                 GLuint id,
@@ -254,6 +291,12 @@ public:
 #endif /* _WIN32 */
     }
 
+    // Rebuilds *program in the background whenever one of its shader files
+    // (or anything they #include) changes, and replaces it between frames.
+    // A rebuild that fails leaves the old program in place. Does nothing
+    // where files can't be watched.
+    void watchProgram(GLuint * program, const sb7::shader_stage * stages, unsigned int stage_count);
+
     void getMousePosition(int& x, int& y)
     {
         double dx, dy;
@@ -282,6 +325,7 @@ public:
                 unsigned int    stereo      : 1;
                 unsigned int    debug       : 1;
                 unsigned int    robust      : 1;
+                unsigned int    program_cache : 1;
             };
             unsigned int        all;
         } flags;
@@ -291,6 +335,8 @@ protected:
     APPINFO     info;
     static      sb7::application * app;
     GLFWwindow* window;
+    sb7::shader_watcher * watcher;
+    GLFWwindow* watcher_window;
 
     static void glfw_onResize(GLFWwindow* window, int w, int h)
     {
@@ -0,0 +1,175 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7CULL_H__
+#define __SB7CULL_H__
+
+#include <stddef.h>
+
+#include "sb6mfile.h"
+
+namespace sb7
+{
+
+// One entry of a GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+struct draw_elements_indirect_command
+{
+    unsigned int            count;
+    unsigned int            instance_count;
+    unsigned int            first_index;
+    int                     base_vertex;
+    unsigned int            base_instance;
+};
+
+// The left, right, bottom, top, near and far planes of the view volume of
+// a column-major model-view-projection matrix, in model space. Points p
+// inside all of them have dot(p, plane.xyz) + plane.w >= 0.
+void extract_frustum_planes(const float mvp[16], float planes[6][4]);
+
+// Culls the meshlets of an .sbm file against a view on the CPU, four at a
+// time with SSE where it's available. Nothing here touches GL, so it can
+// run on any thread and be timed without a context.
+class meshlet_culler
+{
+public:
+    meshlet_culler();
+    ~meshlet_culler();
+
+    // Copies meshlets sorted by sub-object. first_index is where the file's
+    // indices start in the element buffer, in indices, and is added to every
+    // command.
+    void load(const SB6M_MESHLET_DECL * meshlets,
+              unsigned int count,
+              unsigned int sub_object_count,
+              unsigned int first_index);
+    void free();
+
+    unsigned int get_meshlet_count(unsigned int sub_object) const;
+
+    // Writes a command for each meshlet of a sub-object that intersects the
+    // view volume and has a triangle facing eye, both in model space, and
+    // returns the number written. commands needs room for
+    // get_meshlet_count(sub_object) entries. cull_scalar() gives the same
+    // results without SIMD.
+    unsigned int cull(unsigned int sub_object,
+                      const float planes[6][4],
+                      const float eye[3],
+                      draw_elements_indirect_command * commands,
+                      unsigned int instance_count = 1,
+                      unsigned int base_instance = 0) const;
+    unsigned int cull_scalar(unsigned int sub_object,
+                             const float planes[6][4],
+                             const float eye[3],
+                             draw_elements_indirect_command * commands,
+                             unsigned int instance_count = 1,
+                             unsigned int base_instance = 0) const;
+
+private:
+    meshlet_culler(const meshlet_culler&);
+    meshlet_culler& operator=(const meshlet_culler&);
+
+    // Four meshlets with each value in its own array so that one SSE
+    // register holds it for all of them. Unused slots never pass.
+    struct block
+    {
+        float               center_x[4];
+        float               center_y[4];
+        float               center_z[4];
+        float               radius[4];
+        float               apex_x[4];
+        float               apex_y[4];
+        float               apex_z[4];
+        float               axis_x[4];
+        float               axis_y[4];
+        float               axis_z[4];
+        float               cutoff[4];
+        unsigned int        first_index[4];
+        unsigned int        count[4];
+    };
+
+    block *                 blocks;
+    unsigned int *          first_block;        // num_sub_objects + 1 entries
+    unsigned int *          meshlet_count;
+    unsigned int            num_sub_objects;
+};
+
+// Picks a level of detail for each instance of an .sbm file's sub-objects
+// from how big its simplification error would look on screen, and writes
+// the command that draws it. Like meshlet_culler, it never touches GL.
+class lod_selector
+{
+public:
+    lod_selector();
+    ~lod_selector();
+
+    // Level zero of each sub-object is the whole sub-object, which the
+    // radius of its bounding sphere goes with. Further levels come from
+    // lods, sorted as in the file. first_index is added to every command.
+    void load(const SB6M_SUB_OBJECT_DECL * sub_objects,
+              const float * radii,
+              unsigned int sub_object_count,
+              const SB6M_LOD_DECL * lods,
+              unsigned int lod_count,
+              unsigned int first_index);
+    void free();
+
+    unsigned int get_level_count(unsigned int sub_object) const;
+
+    // spheres holds the view space center and radius of each instance, four
+    // floats apiece, and sub_objects which sub-object it is (all zero if
+    // NULL). pixel_scale is the projected size in pixels of one unit at a
+    // distance of one, which is the viewport height times proj[1][1] over
+    // two. Each instance gets the coarsest level whose error covers no more
+    // than threshold pixels, drawn as one instance numbered base_instance
+    // plus its index. chosen receives the levels picked if it isn't NULL.
+    void select(const float * spheres,
+                const unsigned int * sub_objects,
+                unsigned int count,
+                float pixel_scale,
+                float threshold,
+                draw_elements_indirect_command * commands,
+                unsigned int base_instance = 0,
+                unsigned char * chosen = NULL) const;
+
+private:
+    lod_selector(const lod_selector&);
+    lod_selector& operator=(const lod_selector&);
+
+    struct level
+    {
+        unsigned int        first_index;
+        unsigned int        count;
+        float               error;              // Relative to the sub-object's radius
+    };
+
+    level *                 levels;
+    unsigned int *          first_level;        // num_sub_objects + 1 entries
+    unsigned int            num_sub_objects;
+};
+
+}
+
+#endif /* __SB7CULL_H__ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7HASH_H__
+#define __SB7HASH_H__
+
+#include <stddef.h>
+#include <string.h>
+
+namespace sb7
+{
+
+typedef unsigned long long hash_t;
+
+// 64 bit non-cryptographic hash, used to key caches on content. Works on
+// eight bytes at a time so hashing a large asset costs far less than
+// uploading it. The result is the same on every run and every platform
+// of the same endianness, so it is fine to store on disk.
+inline hash_t hash(const void * data, size_t size, hash_t seed = 0)
+{
+    const hash_t prime = 0x9E3779B97F4A7C15ull;
+    const unsigned char * ptr = (const unsigned char *)data;
+    hash_t h = seed ^ (size * prime);
+    hash_t w;
+
+    while (size >= 8)
+    {
+        memcpy(&w, ptr, 8);
+        w *= 0xC2B2AE3D27D4EB4Full;
+        w = (w << 31) | (w >> 33);
+        h ^= w * prime;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+        ptr += 8;
+        size -= 8;
+    }
+
+    w = 0;
+    memcpy(&w, ptr, size);
+    h ^= (w * 0xC2B2AE3D27D4EB4Full) ^ size;
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+inline hash_t hash(const char * str, hash_t seed = 0)
+{
+    return hash(str, strlen(str), seed);
+}
+
+}
+
+#endif /* __SB7HASH_H__ */
@@ -1,6 +1,11 @@
 #ifndef __SB6KTX_H__
 #define __SB6KTX_H__
 
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
 namespace sb7
 {
 
@@ -34,7 +39,161 @@ union keyvaluepair
     unsigned char       rawbytes[4];
 };
 
+// Where one mip level lives in the file and how big it is. Offsets are from
+// the start of the file. For supercompressed files, offset is where the
+// level would be if the file were unpacked, and the packed record is at
+// packed_offset.
+struct level_layout
+{
+    unsigned int        width;
+    unsigned int        height;
+    unsigned int        depth;
+    unsigned int        layers;             // Array elements * faces
+    size_t              offset;             // Start of the level's image data
+    size_t              face_size;          // Bytes for one face / array element, excluding padding
+    size_t              face_stride;        // Distance between consecutive faces in the file
+    size_t              size;               // Bytes for the whole level, excluding mipPadding
+    unsigned int        image_size;         // Value of the level's imageSize field
+    size_t              packed_offset;      // Start of the level's chunk table, if supercompressed
+    size_t              packed_size;        // Bytes in the chunk table and chunks
+};
+
+enum { max_levels = 17 };
+
+// Image data may be split into independently LZ4 compressed chunks, which
+// a file declares with the key below and the value "LZ4". Each level's
+// imageSize then gives the size of a record holding the uncompressed chunk
+// size, the chunk count, the packed size of each chunk and then the chunks.
+// A chunk whose packed size equals its unpacked size is stored as is.
+enum
+{
+    supercompression_none,
+    supercompression_lz4
+};
+
+static const char supercompression_key[] = "sb7.supercompression";
+static const size_t pack_chunk_size = 256 * 1024;
+
+// Everything needed to allocate and fill a texture, derived purely from the
+// file contents. Filling one in never touches GL, so it is safe to do on
+// any thread.
+struct texture_desc
+{
+    header              h;                  // Header in native byte order
+    unsigned int        target;
+    bool                swap;               // File was written with the opposite endianness
+    bool                generate_mips;      // File holds only the base level
+    unsigned int        supercompression;
+    unsigned int        storage_levels;     // Levels to allocate
+    unsigned int        levels;             // Levels stored in the file
+    size_t              data_offset;        // Start of image data (after key/value pairs)
+    size_t              data_size;          // Bytes of (unpacked) image data, including imageSize fields and padding
+    level_layout        level[max_levels];
+};
+
+// One face of one array element of one mip level
+struct image_desc
+{
+    unsigned int        level;
+    unsigned int        layer;
+    unsigned int        face;
+    unsigned int        width;
+    unsigned int        height;
+    unsigned int        depth;
+    size_t              offset;             // From the start of the file
+    size_t              size;
+};
+
+struct key_value
+{
+    std::string         key;
+    std::string         value;              // Raw bytes, including any terminator
+};
+
+struct texture_info
+{
+    texture_desc                desc;
+    std::vector<image_desc>     images;     // Ordered as stored: level, then layer, then face
+    std::vector<key_value>      key_values;
+    size_t                      file_size;
+};
+
+extern const unsigned char identifier[12];
+
+// Validation and layout only; none of these touch GL and all of them are
+// safe to call concurrently from any thread. Every offset and size is
+// checked against the size of the file.
+bool parse(const void * data, size_t size, texture_desc& desc);
+bool layout(texture_desc& desc);
+unsigned int pixel_size(unsigned int format, unsigned int type);
+bool block_info(unsigned int internalformat,
+                unsigned int& block_width,
+                unsigned int& block_height,
+                unsigned int& block_bytes);
+bool inspect(const void * data, size_t size, texture_info& info);
+bool inspect(const char * filename, texture_info& info);
+const char * find_key(const texture_info& info, const char * key);
+
+// Software decoding of block compressed formats (RGTC and S3TC) for
+// drivers that can't sample them directly. transcode() decodes every level
+// from a data section to 8 bit RGBA and returns a new[]'d data section laid
+// out as described by out; decompress() handles a single level of slices.
+bool can_transcode(unsigned int internalformat);
+const unsigned int * transcode_formats(unsigned int& count);
+void decompress(unsigned int internalformat,
+                const void * src,
+                unsigned int width,
+                unsigned int height,
+                unsigned int slices,
+                void * dst);
+unsigned char * transcode(const texture_desc& desc, const void * src_data, texture_desc& out);
+
+// Unpacking. unpack() fills a data section (data_size bytes, laid out as
+// for write()) and unpack_level() a single level, copying from plain files
+// and decompressing chunks in parallel from supercompressed ones. Both fail
+// if a chunk is corrupt. pack_level() builds a level's record for write().
+bool unpack(const texture_desc& desc, const void * file_data, void * data);
+bool unpack_level(const texture_desc& desc, const void * file_data, unsigned int level, void * dst);
+void pack_level(const texture_desc& desc,
+                unsigned int level,
+                const void * src,
+                std::vector<unsigned char>& packed);
+
+bool is_supported(unsigned int target, unsigned int internalformat);
+unsigned int allocate(const texture_desc& desc, unsigned int tex = 0);
+void upload_level(const texture_desc& desc, unsigned int level, const void * data);
+
+// Levels can also go up a piece at a time: rows (of blocks) for 2D and 1D
+// array textures, faces for cube maps and slices or layers for the rest.
+// data always points at the start of the level.
+unsigned int level_parts(const texture_desc& desc, unsigned int level);
+size_t part_size(const texture_desc& desc, unsigned int level);
+void upload_level_parts(const texture_desc& desc,
+                        unsigned int level,
+                        unsigned int first,
+                        unsigned int count,
+                        const void * data);
+
 unsigned int load(const char * filename, unsigned int tex = 0);
+unsigned int load_from_memory(const void * data, size_t size, unsigned int tex = 0);
+// As load_from_memory(), for a file that has already been through parse()
+unsigned int load_parsed(const texture_desc& desc, const void * data, unsigned int tex = 0);
+
+// Writing. init_header fills in everything but the dimensions; once those
+// are set, layout() says where each level goes. write() takes the image
+// data section (data_size bytes, levels at level[n].offset - data_offset)
+// and fills in the imageSize fields and any key/value pairs itself.
+void init_header(header& h, unsigned int internalformat, unsigned int format, unsigned int type);
+bool write(const char * filename,
+           const texture_desc& desc,
+           const void * data,
+           const std::vector<key_value> * key_values = nullptr);
+
+// Describe an existing texture and read it back into a buffer laid out for
+// write(). If a pixel pack buffer is bound, data is an offset into it.
+bool describe(unsigned int target, unsigned int tex, texture_desc& desc);
+void download_levels(const texture_desc& desc, unsigned int tex, void * data);
+
 bool save(const char * filename, unsigned int target, unsigned int tex);
 
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7KTXCACHE_H__
+#define __SB7KTXCACHE_H__
+
+#include "sb7hash.h"
+
+#include <GL/glcorearb.h>
+
+#include <sb7mappedfile.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+// Shares textures between everything that asks for the same file. Entries
+// are keyed by path (and revalidated against the file's modification time
+// and size) and by a hash of the file contents, so the same image under two
+// names is only uploaded once. A hash match is confirmed by comparing the
+// files byte for byte before the texture is shared.
+//
+// Every acquire() must be matched by a release(). Textures nobody holds are
+// kept around in least-recently-used order until the byte budget is
+// exceeded, at which point the oldest are deleted. A budget of zero keeps
+// everything until clear() is called.
+class cache
+{
+public:
+    cache();
+    ~cache();
+
+    GLuint acquire(const char * filename);
+    void release(GLuint texture);
+
+    void set_budget(size_t bytes);
+    size_t resident_bytes() const                       { return total_bytes; }
+
+    // Deletes every texture, referenced or not. Context must be current.
+    void clear();
+
+private:
+    struct entry
+    {
+        std::vector<std::string>    paths;
+        hash_t                      content_hash;
+        size_t                      file_size;
+        GLuint                      texture;
+        unsigned int                refs;
+        size_t                      bytes;
+        bool                        in_lru;
+        std::list<entry *>::iterator lru_position;
+    };
+
+    // What a path looked like on disk when it was last resolved
+    struct path_entry
+    {
+        entry *                     e;
+        long long                   mtime;
+        long long                   file_size;
+    };
+
+    cache(const cache&);
+    cache& operator=(const cache&);
+
+    bool same_contents(const entry * e, const mapped_file& file) const;
+    void forget_path(const std::string& path);
+    void evict(size_t budget);
+    void destroy(entry * e);
+
+    std::unordered_map<std::string, path_entry> by_path;
+    std::unordered_multimap<hash_t, entry *>    by_hash;
+    std::unordered_map<GLuint, entry *>         by_texture;
+    std::list<entry *>                          unused;         // Oldest first
+    size_t                                      budget;
+    size_t                                      total_bytes;
+};
+
+}
+
+}
+
+#endif /* __SB7KTXCACHE_H__ */
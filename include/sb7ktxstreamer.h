@@ -0,0 +1,157 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7KTXSTREAMER_H__
+#define __SB7KTXSTREAMER_H__
+
+#include "sb7ktx.h"
+#include "sb7threadpool.h"
+
+#include <GL/glcorearb.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+// Loads KTX files in the background. Opening, validating and parsing each
+// file happens on a pool of worker threads, which also copy the image data
+// into a ring of persistently mapped pixel unpack buffers. The render thread
+// only issues the glTexStorage / glTexSubImage calls for whatever has
+// arrived, from update(), and fences each staging segment so it can be
+// reused once the GPU has consumed it.
+//
+// load() hands back a texture name immediately; the texture is incomplete
+// (and samples as black) until its data has been uploaded.
+//
+// save() works the other way around: every level is read back into a pixel
+// pack buffer and fenced, and once the GPU has written it a worker thread
+// serializes it to disk. Nothing waits on the GPU in the meantime.
+class streamer
+{
+public:
+    typedef void (*callback)(GLuint texture, bool success, void * userdata);
+
+    streamer();
+    ~streamer();
+
+    // Both must be called with the context current.
+    void init(unsigned int num_threads = 0,
+              size_t segment_size = 8 * 1024 * 1024,
+              unsigned int num_segments = 4);
+    void shutdown();
+
+    // Progressive loads send the smallest levels first and raise
+    // GL_TEXTURE_BASE_LEVEL as each finer level lands, so the texture is
+    // usable (if blurry) after the first batch.
+    GLuint load(const char * filename,
+                callback fn = nullptr,
+                void * userdata = nullptr,
+                GLuint tex = 0,
+                bool progressive = false);
+
+    bool save(const char * filename,
+              GLenum target,
+              GLuint tex,
+              callback fn = nullptr,
+              void * userdata = nullptr);
+
+    // Call once per frame from the render thread. Leaves GL_PIXEL_UNPACK_BUFFER
+    // unbound, but may change the texture binding of the active unit.
+    void update();
+
+    // Caps the bytes update() hands to GL in one frame; zero means no limit.
+    // Levels are split into rows or layers to stay close to the budget.
+    void set_upload_budget(size_t bytes)                { upload_budget = bytes; }
+
+    unsigned int pending() const                        { return num_pending; }
+
+private:
+    struct request;
+    struct batch;
+    struct readback;
+
+    struct readback_buffer
+    {
+        GLuint                  name;
+        size_t                  size;
+        unsigned char *         ptr;                // Only while mapped
+        bool                    busy;
+    };
+
+    streamer(const streamer&);
+    streamer& operator=(const streamer&);
+
+    batch * new_batch(request * req);
+    void process(request * req);
+    int acquire_segment();
+    void release_segment(int segment);
+    void submit_batch(batch * b);
+    bool upload_batch(batch * b, size_t allowance, size_t& uploaded);
+    int acquire_readback_buffer(size_t size);
+    void start_write(readback * rb);
+    void finish_write(readback * rb);
+
+    thread_pool                 workers;
+
+    // Staging ring, split into equally sized segments. Segments in
+    // free_segments may be written by workers; the others are either being
+    // filled or waiting on their fence.
+    GLuint                      staging_buffer;
+    unsigned char *             staging_ptr;
+    size_t                      segment_size;
+    std::vector<GLsync>         fences;
+    std::vector<int>            free_segments;
+    std::condition_variable     segment_available;
+
+    // Compressed formats the driver lacks; workers decode these to RGBA8
+    std::vector<unsigned int>   unsupported_formats;
+
+    // Pack buffers for save(). The render thread owns these; a buffer is
+    // busy from the readback until its file has been written.
+    std::vector<readback_buffer> readback_buffers;
+    std::deque<readback *>      readbacks;
+    bool                        persistent;
+
+    std::mutex                  lock;
+    std::deque<batch *>         ready;
+    std::deque<batch *>         uploading;          // Render thread only; partly uploaded batches first
+    size_t                      upload_budget;
+    std::deque<readback *>      written;
+    bool                        stopping;
+    unsigned int                num_pending;
+};
+
+}
+
+}
+
+#endif /* __SB7KTXSTREAMER_H__ */
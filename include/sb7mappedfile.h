@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7MAPPEDFILE_H__
+#define __SB7MAPPEDFILE_H__
+
+#include <stddef.h>
+
+namespace sb7
+{
+
+// Read-only view of an entire file. The contents are paged in by the OS on
+// demand, so callers can hand pointers into the mapping straight to GL
+// without first copying the file into a heap buffer.
+class mapped_file
+{
+public:
+    mapped_file();
+    ~mapped_file();
+
+    bool open(const char * filename);
+    void close();
+
+    const unsigned char *   data() const                { return ptr; }
+    size_t                  size() const                { return length; }
+    bool                    is_open() const             { return ptr != nullptr; }
+
+private:
+    mapped_file(const mapped_file&);
+    mapped_file& operator=(const mapped_file&);
+
+    const unsigned char *   ptr;
+    size_t                  length;
+#ifdef _WIN32
+    void *                  file_handle;
+    void *                  mapping_handle;
+#else
+    int                     fd;
+#endif
+};
+
+}
+
+#endif /* __SB7MAPPEDFILE_H__ */
@@ -0,0 +1,242 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7MESH_H__
+#define __SB7MESH_H__
+
+#include <stddef.h>
+
+namespace sb7
+{
+
+namespace mesh
+{
+
+// Geometry processing on plain index and vertex arrays. Nothing here
+// touches GL or any file format, so it's usable from tools and from
+// loaders on any thread. Indices are always 32-bit and describe a
+// triangle list.
+
+// Post-transform cache behavior of an index buffer on a FIFO cache.
+// acmr is misses per triangle (0.5 is ideal for large regular meshes,
+// 3 is worst), atvr is misses per referenced vertex (1 is ideal).
+struct cache_stats
+{
+    unsigned int    triangles;
+    unsigned int    vertices;               // Distinct vertices referenced
+    unsigned int    misses;
+    float           acmr;
+    float           atvr;
+};
+
+cache_stats analyze_vertex_cache(const unsigned int * indices,
+                                 size_t index_count,
+                                 size_t vertex_count,
+                                 unsigned int cache_size);
+
+// Reorders triangles for post-transform cache locality using Forsyth's
+// linear-speed scoring. dst may not alias indices.
+void optimize_vertex_cache(unsigned int * dst,
+                           const unsigned int * indices,
+                           size_t index_count,
+                           size_t vertex_count);
+
+// Splits a cache-optimized index buffer into clusters and sorts them so
+// that outward-facing clusters are drawn first, which lets early depth
+// testing reject more of what follows. Clusters are only split where that
+// costs no more than threshold times the cluster's own ACMR (1.05 keeps
+// nearly all of the cache efficiency). positions is xyz, position_stride
+// floats apart. dst may not alias indices.
+void optimize_overdraw(unsigned int * dst,
+                       const unsigned int * indices,
+                       size_t index_count,
+                       const float * positions,
+                       size_t position_stride,
+                       size_t vertex_count,
+                       unsigned int cache_size,
+                       float threshold);
+
+// Builds a remap table that renumbers vertices in the order in which the
+// indices first use them, so vertex fetch walks memory forwards. Unused
+// vertices map to ~0u. Returns the number of vertices that are used.
+size_t optimize_vertex_fetch_remap(unsigned int * remap,
+                                   const unsigned int * indices,
+                                   size_t index_count,
+                                   size_t vertex_count);
+
+// Builds a remap table that maps each vertex to the first vertex with
+// identical bytes, numbered in order of first appearance. Returns the
+// number of distinct vertices.
+size_t generate_vertex_remap(unsigned int * remap,
+                             const void * vertices,
+                             size_t vertex_count,
+                             size_t vertex_size);
+
+// A cluster of triangles small enough to cull on its own. first and count
+// locate its indices in the buffer build_meshlets() wrote. The sphere
+// encloses its vertices and every triangle faces away from eye positions
+// where dot(normalize(cone_apex - eye), cone_axis) > cone_cutoff. Cones of
+// meshlets whose triangles face too many ways have a cutoff of 1.
+struct meshlet
+{
+    unsigned int    first;
+    unsigned int    count;
+    unsigned int    vertex_count;
+    float           center[3];
+    float           radius;
+    float           cone_apex[3];
+    float           cone_axis[3];
+    float           cone_cutoff;
+};
+
+// Groups triangles into meshlets of at most max_vertices distinct vertices
+// and max_triangles triangles, growing each from its neighbours so that
+// the bounds stay tight, and writes the triangles to dst meshlet by
+// meshlet. Each meshlet's triangles are then ordered for the vertex cache.
+// meshlets needs room for build_meshlets_bound() entries. Returns the
+// number of meshlets. dst may not alias indices.
+size_t build_meshlets_bound(size_t index_count,
+                            unsigned int max_vertices,
+                            unsigned int max_triangles);
+size_t build_meshlets(meshlet * meshlets,
+                      unsigned int * dst,
+                      const unsigned int * indices,
+                      size_t index_count,
+                      const float * positions,
+                      size_t position_stride,
+                      size_t vertex_count,
+                      unsigned int max_vertices,
+                      unsigned int max_triangles);
+
+// Simplifies a triangle list by collapsing edges, cheapest first by the
+// quadric error metric, until at most target_index_count indices remain or
+// the next collapse would move the surface further than max_error. Vertices
+// only ever move onto their neighbours, so the result draws from the same
+// vertex buffer. Vertices on open edges and on attribute seams (vertices
+// that share a position) don't move at all. error receives how far the
+// surface moved, if it isn't NULL. dst may alias indices. Returns the
+// number of indices written.
+size_t simplify(unsigned int * dst,
+                const unsigned int * indices,
+                size_t index_count,
+                const float * positions,
+                size_t position_stride,
+                size_t vertex_count,
+                size_t target_index_count,
+                float max_error,
+                float * error);
+
+// Smooth normals: each vertex gets the sum of the normals of the triangles
+// around its position, weighted by the angle of their corner there.
+// Vertices that share a position get the same normal. normals receives
+// three floats per vertex. Triangles are counter-clockwise from the front.
+void generate_normals(float * normals,
+                      const unsigned int * indices,
+                      size_t index_count,
+                      const float * positions,
+                      size_t position_stride,
+                      size_t vertex_count);
+
+// Tangents for normal mapping, compatible with MikkTSpace: each corner's
+// direction of increasing u is made orthogonal to the vertex normal and
+// summed weighted by the corner's angle. tangents receives four floats per
+// vertex, where w is the sign to give bitangent = w * cross(normal,
+// tangent). Like MikkTSpace, this needs vertices to be split where the
+// texture is mirrored; a vertex whose triangles disagree gets the sign
+// most of its corners have.
+void generate_tangents(float * tangents,
+                       const unsigned int * indices,
+                       size_t index_count,
+                       const float * positions,
+                       size_t position_stride,
+                       const float * normals,
+                       size_t normal_stride,
+                       const float * texcoords,
+                       size_t texcoord_stride,
+                       size_t vertex_count);
+
+// Flat normals, three floats per triangle. Triangles with no area get
+// zero.
+void generate_face_normals(float * normals,
+                           const unsigned int * indices,
+                           size_t index_count,
+                           const float * positions,
+                           size_t position_stride);
+
+// Bounds of the vertices that indices refer to. compute_box() finds the
+// axis-aligned box; compute_sphere() finds a sphere with Ritter's method,
+// usually much tighter than the one around the box and within a few
+// percent of the smallest, and falls back to the box's sphere when that is
+// smaller. Both give zeros for no indices.
+void compute_box(float min[3],
+                 float max[3],
+                 const unsigned int * indices,
+                 size_t index_count,
+                 const float * positions,
+                 size_t position_stride);
+void compute_sphere(float center[3],
+                    float * radius,
+                    const unsigned int * indices,
+                    size_t index_count,
+                    const float * positions,
+                    size_t position_stride);
+
+// Index buffer for GL_TRIANGLES_ADJACENCY: for each triangle a, b, c it
+// writes a, ab, b, bc, c, ca, where ab is the far vertex of the triangle
+// across edge ab. Edges are matched by position so that vertices split
+// along seams still connect. An edge with no neighbour gets the
+// triangle's own opposite vertex, which geometry shaders can test for.
+// dst receives index_count * 2 indices.
+void build_adjacency(unsigned int * dst,
+                     const unsigned int * indices,
+                     size_t index_count,
+                     const float * positions,
+                     size_t position_stride,
+                     size_t vertex_count);
+
+// Unit vectors folded onto an octahedron and flattened to two components
+// in [-1, 1]. encode_octahedral() produces bits-bit signed normalized codes,
+// choosing whichever neighbouring code decodes closest to n rather than
+// simply rounding.
+void encode_octahedral(const float n[3], unsigned int bits, int e[2]);
+void decode_octahedral(const float e[2], float n[3]);
+
+// Applies a remap table. Vertices that map to ~0u are dropped.
+void remap_indices(unsigned int * dst,
+                   const unsigned int * indices,
+                   size_t index_count,
+                   const unsigned int * remap);
+void remap_vertices(void * dst,
+                    const void * vertices,
+                    size_t vertex_count,
+                    size_t vertex_size,
+                    const unsigned int * remap);
+
+}
+
+}
+
+#endif /* __SB7MESH_H__ */
@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7OBJECTPOOL_H__
+#define __SB7OBJECTPOOL_H__
+
+#include <vector>
+
+#include "sb7cull.h"
+#include "sb7sbm.h"
+
+namespace sb7
+{
+
+// First-fit allocator for ranges of some resource counted in units, such
+// as vertices of an arena. Free ranges are kept sorted and merged with
+// their neighbours when released. It never touches GL.
+class free_list
+{
+public:
+    enum
+    {
+        invalid                     = 0xFFFFFFFF
+    };
+
+    free_list();
+
+    // Throws away every allocation and frees the whole capacity
+    void reset(unsigned int capacity);
+
+    // Adds units to the end of the managed range
+    void grow(unsigned int new_capacity);
+
+    // Returns the offset of count units, or invalid if no free range is
+    // big enough. Zero units always succeed at offset zero.
+    unsigned int allocate(unsigned int count);
+    void release(unsigned int offset, unsigned int count);
+
+    unsigned int get_capacity() const           { return capacity; }
+    unsigned int get_free_count() const;
+    unsigned int get_largest_free() const;
+
+private:
+    struct range
+    {
+        unsigned int        offset;
+        unsigned int        count;
+    };
+
+    std::vector<range>      ranges;
+    unsigned int            capacity;
+};
+
+}
+
+#ifndef SB6M_FILETYPES_ONLY
+
+#include <GL/glcorearb.h>
+
+namespace sb7
+{
+
+// Loads many .sbm files into one vertex buffer and one element buffer that
+// share a VAO, so a scene binds that once and can be drawn with a single
+// glMultiDrawElementsIndirect. Every model is converted to the pool's
+// vertex layout: attribute i of the file goes to slot i as
+// attrib_sizes[i] floats, and quantized files are expanded. Indices are
+// 32-bit and relative to each model's first vertex, which is passed as the
+// base vertex. The arenas double in size when a model doesn't fit.
+class object_pool
+{
+public:
+    enum
+    {
+        invalid_model               = 0xFFFFFFFF
+    };
+
+    object_pool();
+    ~object_pool();
+
+    bool init(const unsigned int * attrib_sizes,
+              unsigned int attrib_count,
+              unsigned int vertex_capacity = 65536,
+              unsigned int index_capacity = 262144);
+    void free();
+
+    // Returns a handle to the model, or invalid_model if the file can't be
+    // loaded. unload() gives its space back to the arenas.
+    unsigned int load(const char * filename);
+    void unload(unsigned int model);
+
+    unsigned int get_sub_object_count(unsigned int model) const;
+    void get_sub_object_bounds(unsigned int model, unsigned int index, sbm::bounds &b) const;
+
+    // Fills in a command that draws one sub-object, for the pool's own
+    // draws or for a GL_DRAW_INDIRECT_BUFFER
+    void get_draw_command(unsigned int model,
+                          unsigned int index,
+                          draw_elements_indirect_command &command,
+                          unsigned int instance_count = 1,
+                          unsigned int base_instance = 0) const;
+
+    // bind() makes the pool's VAO current. render_sub_object() doesn't
+    // bind it again, so a run of draws from the pool only binds it once.
+    void bind() const;
+    void render_sub_object(unsigned int model,
+                           unsigned int index,
+                           unsigned int instance_count = 1,
+                           unsigned int base_instance = 0) const;
+    void render_indirect(GLsizei draw_count, GLintptr indirect_offset = 0) const;
+
+    GLuint       get_vao() const                { return vao; }
+    GLenum       get_index_type() const         { return GL_UNSIGNED_INT; }
+    unsigned int get_vertex_capacity() const    { return vertices.get_capacity(); }
+    unsigned int get_index_capacity() const     { return indices.get_capacity(); }
+
+private:
+    object_pool(const object_pool&);
+    object_pool& operator=(const object_pool&);
+
+    bool reserve(free_list& arena, GLuint& buffer,
+                 unsigned int count, unsigned int unit_size, unsigned int& offset);
+    void set_vertex_format();
+
+    struct sub_object_t
+    {
+        unsigned int        first;              // Relative to the model's first index
+        unsigned int        count;
+        sbm::bounds         bounds;
+    };
+
+    struct model_t
+    {
+        bool                in_use;
+        unsigned int        first_vertex;
+        unsigned int        vertex_count;
+        unsigned int        first_index;
+        unsigned int        index_count;
+        std::vector<sub_object_t> sub_objects;
+    };
+
+    GLuint                  vao;
+    GLuint                  vertex_buffer;
+    GLuint                  index_buffer;
+    free_list               vertices;
+    free_list               indices;
+    std::vector<unsigned int> attrib_sizes;
+    unsigned int            vertex_size;
+    std::vector<model_t>    models;
+};
+
+}
+
+#endif /* SB6M_FILETYPES_ONLY */
+
+#endif /* __SB7OBJECTPOOL_H__ */
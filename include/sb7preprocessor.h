@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#ifndef __SB7PREPROCESSOR_H__
+#define __SB7PREPROCESSOR_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sb7hash.h"
+
+namespace sb7
+{
+
+// The part of GLSL preprocessing that GL leaves to the application, done
+// on the CPU without needing a context: #include "file" lines are replaced
+// by the file (relative to the including one), and #defines are inserted
+// after the #version line so one source can be built several ways. A file
+// containing #pragma once is only included the first time. #line
+// directives keep line numbers in GL's logs right, with the source string
+// number indexing output::files. Everything else, #ifdef included, is left
+// for GL's own preprocessor.
+//
+// Files are read once and kept, so expanding many variants of a shader
+// only touches the disk for the first. expand() may be called from several
+// threads at once, but the global defines mustn't change meanwhile.
+//
+// Sets of defines are strings of NAME or NAME=value separated by spaces,
+// like "NORMAL_MAP SAMPLES=4". NAME alone defines NAME as 1.
+class preprocessor
+{
+public:
+    struct output
+    {
+        std::string             source;
+        std::vector<std::string> files;             // By source string number
+        hash_t                  hash;               // Of source
+    };
+
+    preprocessor();
+
+    // Defines for every expansion. Sets passed to expand() override these.
+    void define(const char * name, const char * value = "1");
+    void undefine(const char * name);
+
+    // Uses text as the contents of filename from now on, as if read from
+    // disk
+    void add_file(const char * filename, const char * text);
+
+    // Forgets a cached file so it is read again next time. NULL forgets
+    // them all.
+    void invalidate(const char * filename = NULL);
+
+    // Returns false, having printed why, if a file can't be read or
+    // includes nest too deeply. defines may be NULL.
+    bool expand(const char * filename, const char * defines, output& out);
+
+    // Every combination of one choice from each of options, as sets of
+    // defines. An empty choice defines nothing, so { "", "NORMAL_MAP" }
+    // makes a switch. Combinations are in order, the last set changing
+    // fastest.
+    static std::vector<std::string> permutations(const std::vector<std::vector<std::string> >& options);
+
+private:
+    typedef std::vector<std::pair<std::string, std::string> > define_list;
+
+    preprocessor(const preprocessor&);
+    preprocessor& operator=(const preprocessor&);
+
+    bool get_file(const std::string& filename, std::string& text);
+    bool include(const std::string& filename,
+                 const char * text,
+                 const char * end,
+                 unsigned int line,
+                 output& out,
+                 std::vector<std::string>& once,
+                 int depth);
+
+    define_list                 defines;
+    std::map<std::string, std::string> files;
+    std::mutex                  lock;
+};
+
+}
+
+#endif /* __SB7PREPROCESSOR_H__ */
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#ifndef __SB7PROGRAMBATCH_H__
+#define __SB7PROGRAMBATCH_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glcorearb.h>
+
+#include "sb7preprocessor.h"
+#include "sb7threadpool.h"
+
+namespace sb7
+{
+
+// One shader of a program, as taken by program_batch::add() and
+// application::watchProgram()
+struct shader_stage
+{
+    shader_stage(const char * _filename, GLenum _type, const char * _defines = NULL)
+        : filename(_filename), type(_type), defines(_defines)
+    {
+    }
+
+    const char *            filename;
+    GLenum                  type;
+    const char *            defines;                // Optional, see sb7::preprocessor
+};
+
+// Builds a set of programs from shader files without waiting on any of
+// them in turn. Worker threads read the files and run them through a
+// sb7::preprocessor while the render thread hands each program to GL as
+// soon as its sources are in, compiling and linking without asking how it
+// went. With GL_KHR_parallel_shader_compile (or the ARB version) the
+// driver is asked to compile on as many threads as it likes.
+//
+// Status is only queried when a program is first bound with use(), or
+// when check() is called, which is also when errors are printed. Programs
+// in the binary cache (see sb7::program::set_binary_cache()) are loaded
+// from it and skip compiling altogether.
+//
+// The batch owns its programs. free() deletes them and must be called with
+// the context current; the destructor only stops the workers. free() also
+// empties the preprocessor's file cache, so programs added again after it
+// see any edits.
+class program_batch
+{
+public:
+    typedef shader_stage stage;
+
+    program_batch();
+    ~program_batch();
+
+    // Returns the index of a new program, to be built by the next submit()
+    unsigned int add(const stage * stages, unsigned int stage_count);
+
+    // Must be called with the context current. Returns once every program
+    // added since the last submit() has been handed to GL.
+    void submit();
+
+    // Zero until submitted. The program may still be compiling.
+    GLuint get_program(unsigned int index) const;
+
+    // True once the driver has finished with a program, so that use() or
+    // check() won't wait. Always true without the parallel compile
+    // extension.
+    bool is_ready(unsigned int index) const;
+
+    // Waits for a program if need be and returns whether it linked,
+    // printing the logs the first time if it didn't
+    bool check(unsigned int index);
+
+    // Binds a program, checking it first the first time. Failed programs
+    // bind zero. Returns the program bound.
+    GLuint use(unsigned int index);
+
+    unsigned int get_program_count() const              { return (unsigned int)programs.size(); }
+
+    // For defines common to every program. Don't change it while a
+    // submit() is running.
+    preprocessor& get_preprocessor()                    { return source; }
+
+    void free();
+
+private:
+    struct stage_t
+    {
+        std::string             filename;
+        GLenum                  type;
+        std::string             defines;
+        std::string             source;
+        bool                    read;               // Set by a worker, with source
+        std::vector<std::string> files;             // By #line source string number
+        GLuint                  shader;
+    };
+
+    struct program_t
+    {
+        std::vector<stage_t>    stages;
+        unsigned int            pending;            // Stages not read yet
+        GLuint                  name;
+        bool                    submitted;
+        bool                    checked;
+        bool                    linked;
+        bool                    from_cache;
+    };
+
+    program_batch(const program_batch&);
+    program_batch& operator=(const program_batch&);
+
+    void read_stage(unsigned int program, unsigned int stage);
+    void build(program_t& p);
+
+    // Elements are never added while workers are running, so they can
+    // hold on to indices
+    std::vector<program_t>      programs;
+    preprocessor                source;
+    thread_pool                 workers;
+    std::mutex                  lock;
+    std::condition_variable     stage_read;
+    bool                        parallel_compile;
+};
+
+}
+
+#endif /* __SB7PROGRAMBATCH_H__ */
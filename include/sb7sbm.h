@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7SBM_H__
+#define __SB7SBM_H__
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "sb6mfile.h"
+
+namespace sb7
+{
+
+namespace sbm
+{
+
+// Pointers into a validated .sbm file. Chunks that are absent are NULL.
+// When the file has a DATA chunk, its payload is the whole vertex buffer
+// and vertex and index offsets are relative to it; otherwise they are
+// relative to the start of the file.
+struct file_desc
+{
+    const SB6M_HEADER *                 header;
+    const SB6M_VERTEX_ATTRIB_CHUNK *    vertex_attribs;
+    const SB6M_CHUNK_VERTEX_DATA *      vertex_data;
+    const SB6M_CHUNK_INDEX_DATA *       index_data;
+    const SB6M_CHUNK_SUB_OBJECT_LIST *  sub_objects;
+    const SB6M_DATA_CHUNK *             data;
+    const SB6M_CHUNK_QUANTIZATION *     quantization;
+    const SB6M_QUANTIZED_ATTRIB *       quantized_attribs;
+    const SB6M_SCALE_BIAS *             scale_bias;     // One per sub-object
+    const SB6M_CHUNK_MESHLETS *         meshlets;
+    const SB6M_CHUNK_LOD_LIST *         lods;
+
+    const unsigned char *               vertices;       // Start of vertex data
+    size_t                              vertex_size;    // Bytes of vertex data
+    const unsigned char *               indices;        // Start of index data, or NULL
+    size_t                              index_size;     // Bytes of index data
+    unsigned int                        vertex_count;   // Zero if the file doesn't say
+    unsigned int                        index_count;
+    unsigned int                        max_index;
+    unsigned int                        sub_object_count;
+};
+
+// Bounding volumes of a set of vertices, in the space of the position
+// attribute. The sphere is centered on the box and encloses every vertex.
+struct bounds
+{
+    float                               center[3];
+    float                               radius;
+    float                               min[3];
+    float                               max[3];
+};
+
+// A whole .sbm file decoded into separate, tightly packed attribute arrays
+// and 32-bit indices, for tools that rewrite meshes. Sub-objects index
+// into indices when the mesh is indexed and into the vertices otherwise.
+struct attrib_array
+{
+    SB6M_VERTEX_ATTRIB_DECL             decl;           // stride and data_offset are unused
+    unsigned int                        element_size;
+    std::vector<unsigned char>          data;
+};
+
+struct mesh
+{
+    std::vector<attrib_array>           attribs;
+    unsigned int                        vertex_count;
+    bool                                indexed;
+    std::vector<unsigned int>           indices;
+    std::vector<SB6M_SUB_OBJECT_DECL>   sub_objects;
+    std::vector<SB6M_QUANTIZED_ATTRIB>  quantized;
+    std::vector<SB6M_SCALE_BIAS>        scale_bias;     // One per sub-object if quantized
+    std::vector<SB6M_MESHLET_DECL>      meshlets;       // Only valid for this index order
+    std::vector<SB6M_LOD_DECL>          lods;           // Ranges of indices after the sub-objects'
+};
+
+// Validation only; never touches GL. Every chunk, offset and count is
+// checked against the size of the file, and every attribute is checked
+// to stay within the vertex data for every vertex.
+bool parse(const void * data, size_t size, file_desc& desc);
+
+unsigned int index_size(unsigned int index_type);
+unsigned int narrowest_index_type(unsigned int max_index);
+
+// Copies a parsed file's indices out as index_type, which must be able to
+// hold desc.max_index
+void convert_indices(const file_desc& desc, unsigned int index_type, std::vector<unsigned char>& out);
+unsigned int attrib_size(unsigned int size, unsigned int type);
+
+// Reads one attribute of one vertex as floats, applying normalization as
+// GL would. Missing components are filled with 0, 0, 0, 1.
+void decode_attrib(const SB6M_VERTEX_ATTRIB_DECL& decl, const void * data, float value[4]);
+void read_attrib(const file_desc& desc, unsigned int attrib, unsigned int vertex, float value[4]);
+
+// Returns how an attribute of a parsed file is quantized
+unsigned int attrib_encoding(const file_desc& desc, unsigned int attrib);
+
+// Bounds of the vertices used by the draw of count vertices or indices
+// starting at first. Attribute 0 is taken to be the position, scaled and
+// biased by dequant if it isn't NULL.
+void compute_bounds(const file_desc& desc, unsigned int first, unsigned int count, bounds& b,
+                    const SB6M_SCALE_BIAS * dequant = NULL);
+
+// Conversion between parsed files and meshes. pack_vertices() interleaves
+// the attributes, aligning each to its component size and the stride to
+// four bytes. write() does the same and stores indices in the smallest
+// type that can hold them.
+void extract(const file_desc& desc, mesh& m);
+bool load(const char * filename, mesh& m);
+void pack_vertices(const mesh& m,
+                   std::vector<unsigned char>& data,
+                   std::vector<SB6M_VERTEX_ATTRIB_DECL>& decls);
+bool write(const char * filename, const mesh& m);
+
+// Quantizes float attributes: a three component attribute 0 to 16-bit
+// positions scaled and biased per sub-object, three component attributes
+// named like normals or tangents to octahedral 2 x normal_bits (8 or 16),
+// four component tangents to the same plus the sign of w, and two
+// component attributes named like texture coordinates to half floats.
+// Sub-objects that share vertices share one scale and bias. Positions with
+// a w are left as they are. dequantize() turns the scaled positions and
+// octahedral vectors back into floats.
+void quantize(mesh& m, unsigned int normal_bits);
+void dequantize(mesh& m);
+
+}
+
+}
+
+#endif /* __SB7SBM_H__ */
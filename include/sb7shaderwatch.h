@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#ifndef __SB7SHADERWATCH_H__
+#define __SB7SHADERWATCH_H__
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glcorearb.h>
+
+#include "sb7preprocessor.h"
+#include "sb7programbatch.h"
+
+namespace sb7
+{
+
+// Rebuilds programs when their shader files change without holding up
+// the frame. A worker thread waits on inotify for writes to the
+// directories holding the files and everything they #include, then runs
+// them through a sb7::preprocessor and compiles and links them again on a
+// context shared with the main one. update(), called between frames,
+// swaps the finished programs into place and deletes the old ones. A
+// program that fails to build is reported and the old one kept.
+//
+// Only Linux has an implementation. Elsewhere start() fails and nothing
+// is watched.
+class shader_watcher
+{
+public:
+    shader_watcher();
+    ~shader_watcher();
+
+    // Whether start() can work on this platform at all
+    static bool is_supported();
+
+    // make_current(true) is called on the worker thread when it starts, to
+    // bind a context shared with the one update() runs on, and
+    // make_current(false) when it stops, to release it
+    bool start(const std::function<void (bool)>& make_current);
+
+    // Must be called with the context current, as programs built but not
+    // swapped in yet are deleted
+    void stop();
+
+    // Rebuilds *program from stages whenever one of their files changes.
+    // *program is only written by update().
+    void watch(GLuint * program, const program_batch::stage * stages, unsigned int stage_count);
+    void unwatch(GLuint * program);
+
+    // Swaps in programs rebuilt since the last call. Returns how many, so
+    // the caller knows to look up uniform locations again.
+    unsigned int update();
+
+private:
+    struct entry
+    {
+        GLuint *                program;
+        std::vector<std::string> filenames;         // By stage
+        std::vector<GLenum>     types;
+        std::vector<std::string> defines;
+        std::vector<std::string> files;             // Every file read to build it
+    };
+
+    struct result
+    {
+        GLuint *                program;
+        GLuint                  name;
+    };
+
+    shader_watcher(const shader_watcher&);
+    shader_watcher& operator=(const shader_watcher&);
+
+    void run(std::function<void (bool)> make_current);
+    void add_watches(const std::vector<std::string>& files);
+    GLuint build(const entry& e, std::vector<std::string>& files);
+
+    std::vector<entry>          entries;
+    std::vector<result>         finished;
+    // Path prefixes by watch descriptor. One directory can be reached by
+    // several paths, as in "a/" and "a/b/../".
+    std::map<int, std::vector<std::string> > directories;
+    preprocessor                source;
+    std::thread                 worker;
+    std::mutex                  lock;
+    bool                        running;
+    int                         notify_fd;
+};
+
+}
+
+#endif /* __SB7SHADERWATCH_H__ */
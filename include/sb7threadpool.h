@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7THREADPOOL_H__
+#define __SB7THREADPOOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sb7
+{
+
+// A handful of worker threads pulling jobs off a shared FIFO. Jobs must not
+// touch GL; anything that needs the context is handed back to the render
+// thread by the job itself.
+class thread_pool
+{
+public:
+    thread_pool();
+    ~thread_pool();
+
+    // Zero threads means one fewer than the number of hardware threads (but
+    // always at least one), leaving a core for the render thread.
+    void start(unsigned int num_threads = 0);
+
+    // Runs any jobs still in the queue, then joins the workers.
+    void stop();
+
+    void submit(const std::function<void()>& job);
+
+    unsigned int thread_count() const                   { return (unsigned int)threads.size(); }
+
+private:
+    thread_pool(const thread_pool&);
+    thread_pool& operator=(const thread_pool&);
+
+    void worker();
+
+    std::vector<std::thread>                threads;
+    std::deque<std::function<void()>>       jobs;
+    std::mutex                              lock;
+    std::condition_variable                 wake;
+    bool                                    stopping;
+};
+
+}
+
+#endif /* __SB7THREADPOOL_H__ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#ifndef __SB7UNIFORMS_H__
+#define __SB7UNIFORMS_H__
+
+#include <string>
+#include <vector>
+
+#include <GL/glcorearb.h>
+
+#include "sb7hash.h"
+#include "vmath.h"
+
+namespace sb7
+{
+
+// GL type of each C++ type the setters take. vmath's vector and matrix
+// classes go by their base, which is also what their arithmetic returns.
+template <typename T> struct uniform_type : uniform_type<typename T::base> { };
+
+template <> struct uniform_type<float>                          { static const GLenum value = GL_FLOAT; };
+template <> struct uniform_type<vmath::vecN<float, 2> >         { static const GLenum value = GL_FLOAT_VEC2; };
+template <> struct uniform_type<vmath::vecN<float, 3> >         { static const GLenum value = GL_FLOAT_VEC3; };
+template <> struct uniform_type<vmath::vecN<float, 4> >         { static const GLenum value = GL_FLOAT_VEC4; };
+template <> struct uniform_type<int>                            { static const GLenum value = GL_INT; };
+template <> struct uniform_type<vmath::vecN<int, 2> >           { static const GLenum value = GL_INT_VEC2; };
+template <> struct uniform_type<vmath::vecN<int, 3> >           { static const GLenum value = GL_INT_VEC3; };
+template <> struct uniform_type<vmath::vecN<int, 4> >           { static const GLenum value = GL_INT_VEC4; };
+template <> struct uniform_type<unsigned int>                   { static const GLenum value = GL_UNSIGNED_INT; };
+template <> struct uniform_type<vmath::vecN<unsigned int, 2> >  { static const GLenum value = GL_UNSIGNED_INT_VEC2; };
+template <> struct uniform_type<vmath::vecN<unsigned int, 3> >  { static const GLenum value = GL_UNSIGNED_INT_VEC3; };
+template <> struct uniform_type<vmath::vecN<unsigned int, 4> >  { static const GLenum value = GL_UNSIGNED_INT_VEC4; };
+template <> struct uniform_type<vmath::matNM<float, 2, 2> >     { static const GLenum value = GL_FLOAT_MAT2; };
+template <> struct uniform_type<vmath::matNM<float, 3, 3> >     { static const GLenum value = GL_FLOAT_MAT3; };
+template <> struct uniform_type<vmath::matNM<float, 4, 4> >     { static const GLenum value = GL_FLOAT_MAT4; };
+
+// Every active uniform and uniform block of a program, read once after it
+// links, in place of glGetUniformLocation() calls. Names are looked up in
+// an open addressed hash table; an array can be found by its name with or
+// without "[0]". Block members go by the names GL gives them, which start
+// with the block's name.
+//
+// The setters only record values, and only mark a uniform dirty if its
+// value changed. flush() sends what changed: plain uniforms with one
+// glUniform*() call each, and the members of every block into one buffer,
+// a ring of frames kept mapped (with GL_ARB_buffer_storage) so that a
+// frame's blocks go in with a memcpy and no call into GL besides binding
+// them. Once any block has changed, every block is copied to the next
+// frame, and frames are fenced, so the CPU never writes over what the GPU
+// may still be reading.
+//
+// Setting a uniform that isn't active or has a different type does
+// nothing and returns false, as with location -1. Ints also set bools and
+// samplers.
+class uniform_cache
+{
+public:
+    struct uniform
+    {
+        std::string             name;
+        GLenum                  type;
+        GLint                   size;               // Array elements
+        GLint                   location;           // -1 in a block
+        GLint                   block;              // Index into blocks or -1
+        GLint                   offset;             // Into the block or the plain values
+        GLint                   array_stride;
+        GLint                   matrix_stride;
+        bool                    row_major;
+        bool                    dirty;
+    };
+
+    struct block
+    {
+        std::string             name;
+        GLuint                  binding;
+        GLint                   size;
+        GLint                   slot;               // Offset into each frame of the ring
+        GLint                   bound;              // Offset of the latest copy in the ring
+        std::vector<unsigned char> data;
+        bool                    dirty;
+    };
+
+    uniform_cache();
+    ~uniform_cache();
+
+    // Reads program's uniforms, forgetting any values set before. Blocks
+    // sharing a binding point are given one each.
+    void reflect(GLuint program);
+
+    // Index of a uniform, or -1 if it isn't active
+    int find(const char * name) const;
+
+    template <typename T>
+    bool set(int index, const T * values, int count)    { return set_values(index, uniform_type<T>::value, values, count); }
+
+    template <typename T>
+    bool set(int index, const T& value)                 { return set_values(index, uniform_type<T>::value, &value, 1); }
+
+    template <typename T>
+    bool set(const char * name, const T& value)         { return set(find(name), value); }
+
+    // Sends whatever changed since the last flush. The program must be in
+    // use, for the plain uniforms.
+    void flush();
+
+    // Deletes the ring buffer. Needs the context current.
+    void free();
+
+    unsigned int get_uniform_count() const              { return (unsigned int)uniforms.size(); }
+    const uniform& get_uniform(unsigned int index) const { return uniforms[index]; }
+
+    unsigned int get_block_count() const                { return (unsigned int)blocks.size(); }
+    const block& get_block(unsigned int index) const    { return blocks[index]; }
+
+private:
+    enum
+    {
+        ring_frames = 3
+    };
+
+    struct table_entry
+    {
+        hash_t                  key;
+        int                     index;              // Into uniforms, -1 if empty
+    };
+
+    uniform_cache(const uniform_cache&);
+    uniform_cache& operator=(const uniform_cache&);
+
+    bool set_values(int index, GLenum type, const void * values, int count);
+    void insert(const std::string& name, int index);
+    void create_ring();
+
+    std::vector<uniform>        uniforms;
+    std::vector<block>          blocks;
+    std::vector<table_entry>    table;              // Size is a power of two
+    std::vector<unsigned char>  values;             // Of the plain uniforms, packed
+    std::vector<int>            dirty;              // Plain uniforms to send
+
+    GLuint                      ring;
+    GLint                       frame_size;
+    unsigned char *             ring_ptr;           // NULL without persistent mapping
+    GLsync                      fences[ring_frames];
+    int                         frame;
+};
+
+}
+
+#endif /* __SB7UNIFORMS_H__ */
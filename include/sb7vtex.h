@@ -0,0 +1,312 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __SB7VTEX_H__
+#define __SB7VTEX_H__
+
+#include "sb7ktx.h"
+#include "sb7mappedfile.h"
+#include "sb7threadpool.h"
+
+#include <GL/glcorearb.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace sb7
+{
+
+// Virtual texturing on top of ARB_sparse_texture. The image lives in a KTX
+// file on disk and only the pages that feedback says are visible are
+// committed and uploaded, within a fixed page budget.
+//
+// page_table, residency_cache and tile_reader never touch GL and are safe
+// to drive from tests or tools; texture and feedback_buffer tie them to a
+// sparse texture and a feedback render target.
+namespace vtex
+{
+
+// A page is identified by its level and its position in pages within that
+// level, packed into 32 bits. Feedback shaders write key + 1 so that zero
+// can mean "nothing here".
+typedef unsigned int page_key;
+
+inline page_key make_key(unsigned int level, unsigned int x, unsigned int y)
+{
+    return (level << 24) | ((y & 0xFFF) << 12) | (x & 0xFFF);
+}
+
+inline unsigned int key_level(page_key key)                 { return key >> 24; }
+inline unsigned int key_x(page_key key)                     { return key & 0xFFF; }
+inline unsigned int key_y(page_key key)                     { return (key >> 12) & 0xFFF; }
+
+class page_table
+{
+public:
+    enum state
+    {
+        non_resident,
+        loading,
+        resident
+    };
+
+    page_table();
+
+    // Levels from tail_level down are the mip tail, which the sparse
+    // texture commits as a unit and which is always resident.
+    bool init(unsigned int width,
+              unsigned int height,
+              unsigned int page_width,
+              unsigned int page_height,
+              unsigned int levels,
+              unsigned int tail_level);
+
+    unsigned int levels() const                             { return num_levels; }
+    unsigned int tail_level() const                         { return tail; }
+    unsigned int page_width() const                         { return page_w; }
+    unsigned int page_height() const                        { return page_h; }
+    unsigned int pages_x(unsigned int level) const          { return level < num_levels ? dims[level * 2] : 0; }
+    unsigned int pages_y(unsigned int level) const          { return level < num_levels ? dims[level * 2 + 1] : 0; }
+
+    bool valid(page_key key) const;
+    bool in_tail(page_key key) const                        { return key_level(key) >= tail; }
+    page_key parent(page_key key) const;
+
+    state get(page_key key) const;
+    void set(page_key key, state s);
+
+    // The finest level at which a level 0 page and everything coarser
+    // covering it is resident. Shaders can clamp their LOD to this so that
+    // they never sample uncommitted memory.
+    unsigned int min_level(unsigned int x, unsigned int y) const;
+    void build_min_level_map(std::vector<unsigned char>& map) const;
+
+    // Set whenever residency changes
+    bool dirty() const                                      { return changed; }
+    void clear_dirty()                                      { changed = false; }
+
+private:
+    unsigned int                                num_levels;
+    unsigned int                                tail;
+    unsigned int                                page_w;
+    unsigned int                                page_h;
+    std::vector<unsigned int>                   dims;
+    std::vector<std::vector<unsigned char> >    states;
+    bool                                        changed;
+};
+
+// Decides what to load and what to throw away. Feedback for a frame is
+// passed to request(); schedule() then hands out the most urgent missing
+// pages (coarsest first, so there is always something to fall back to) and
+// make_resident() finds room for each one as it arrives by evicting the
+// least recently used pages that weren't seen this frame.
+class residency_cache
+{
+public:
+    residency_cache();
+
+    void init(page_table * table, unsigned int budget_pages);
+    void set_budget(unsigned int pages)                     { budget = pages; }
+    unsigned int resident_pages() const                     { return (unsigned int)lru.size(); }
+
+    void begin_frame();
+    void request(page_key key);
+    void request_feedback(const unsigned int * texels, size_t count);
+    void schedule(std::vector<page_key>& loads, unsigned int max_loads);
+
+    // Returns false if everything resident is still in use, in which case
+    // the page is dropped and will be asked for again.
+    bool make_resident(page_key key, std::vector<page_key>& evicted);
+    void cancel(page_key key);
+
+    bool oldest(page_key& key) const;
+
+private:
+    struct entry
+    {
+        page_key                key;
+        unsigned int            frame;
+    };
+
+    void touch(page_key key);
+
+    page_table *                                            table;
+    unsigned int                                            budget;
+    unsigned int                                            frame;
+    std::list<entry>                                        lru;            // Most recent first
+    std::unordered_map<page_key, std::list<entry>::iterator> positions;
+    std::unordered_set<page_key>                            wanted;
+};
+
+// Reads pages out of an uncompressed 2D KTX. Files may store each level
+// tile by tile (declared with the sb7.tiles key, see write_tiled()) so that
+// a page is one contiguous read, or row by row as usual. Reads only touch
+// the file mapping and may run on any number of threads at once.
+class tile_reader
+{
+public:
+    tile_reader();
+
+    bool open(const char * filename, unsigned int page_width, unsigned int page_height);
+    void close();
+
+    const ktx::file::texture_desc& desc() const             { return d; }
+    unsigned int pixel_size() const                         { return texel_size; }
+    size_t page_bytes() const                               { return (size_t)page_w * page_h * texel_size; }
+    bool tiled() const                                      { return tile_major; }
+
+    // A page is written tightly packed at page_width x page_height; pages
+    // that hang off the edge of the level are padded with zeros.
+    bool read_page(page_key key, void * dst) const;
+    // A whole level, tightly packed
+    bool read_level(unsigned int level, void * dst) const;
+
+private:
+    tile_reader(const tile_reader&);
+    tile_reader& operator=(const tile_reader&);
+
+    void read_region(unsigned int level,
+                     unsigned int x, unsigned int y,
+                     unsigned int width, unsigned int height,
+                     unsigned char * dst, size_t dst_stride) const;
+
+    mapped_file                 file;
+    ktx::file::texture_desc     d;
+    unsigned int                texel_size;
+    unsigned int                page_w;
+    unsigned int                page_h;
+    unsigned int                tile_w;             // Storage tiles; need not match the pages
+    unsigned int                tile_h;
+    bool                        tile_major;
+};
+
+// Writes data (laid out as for ktx::file::write()) with each level stored
+// tile by tile. Edge tiles only hold the texels inside the level, so each
+// level is exactly width * height texels with no row padding.
+bool write_tiled(const char * filename,
+                 const ktx::file::texture_desc& desc,
+                 const void * data,
+                 unsigned int tile_width,
+                 unsigned int tile_height);
+
+// A sparse texture backed by a tile_reader. Pages are read on worker
+// threads; update() commits and uploads whatever has arrived and releases
+// whatever was evicted to make room for it.
+class texture
+{
+public:
+    texture();
+    ~texture();
+
+    // Context must be current for all of these.
+    bool init(const char * filename, unsigned int budget_pages, unsigned int num_threads = 1);
+    void shutdown();
+    void update(unsigned int max_loads = 16, unsigned int max_uploads = 16);
+
+    void feedback(const unsigned int * texels, size_t count);
+
+    GLuint name() const                                     { return tex; }
+    // R8 texture with one texel per level 0 page holding its min_level()
+    GLuint min_level_texture() const                        { return min_level_tex; }
+
+    const page_table& pages() const                         { return table; }
+    residency_cache& cache()                                { return residency; }
+
+private:
+    struct tile
+    {
+        page_key                key;
+        unsigned char *         data;
+        bool                    ok;
+    };
+
+    texture(const texture&);
+    texture& operator=(const texture&);
+
+    void commit(page_key key, GLboolean commit);
+
+    tile_reader                 reader;
+    page_table                  table;
+    residency_cache             residency;
+    thread_pool                 workers;
+
+    GLuint                      tex;
+    GLuint                      min_level_tex;
+    unsigned int                in_flight;
+
+    std::mutex                  lock;
+    std::vector<tile>           arrived;
+    std::vector<page_key>       loads;
+    std::vector<page_key>       evicted;
+    std::vector<unsigned char>  min_levels;
+};
+
+// Low resolution R32UI render target for the feedback pass, read back
+// asynchronously. Two frames of readbacks are kept in flight so collect()
+// never stalls.
+class feedback_buffer
+{
+public:
+    feedback_buffer();
+    ~feedback_buffer();
+
+    bool init(unsigned int width, unsigned int height);
+    void shutdown();
+
+    // Binds and clears the framebuffer and sets the viewport
+    void bind();
+    // Starts reading back what was rendered; leaves the framebuffer bound
+    void read();
+    // Hands the oldest finished readback, if any, to the texture
+    bool collect(texture& vt);
+
+    unsigned int width() const                              { return w; }
+    unsigned int height() const                             { return h; }
+
+private:
+    enum { num_buffers = 2 };
+
+    feedback_buffer(const feedback_buffer&);
+    feedback_buffer& operator=(const feedback_buffer&);
+
+    unsigned int                w;
+    unsigned int                h;
+    GLuint                      fbo;
+    GLuint                      color;
+    GLuint                      depth;
+    GLuint                      buffers[num_buffers];
+    GLsync                      fences[num_buffers];
+    unsigned int                next;
+};
+
+}
+
+}
+
+#endif /* __SB7VTEX_H__ */
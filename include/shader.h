@@ -28,6 +28,21 @@ GLuint from_string(const char * source,
 namespace program
 {
 
+// Programs linked by link_from_shaders() are saved in directory as
+// binaries and loaded from there next time instead of being linked again.
+// Entries are keyed on the source and type of each shader and the GL
+// vendor, renderer and version, so a changed shader or driver just misses.
+// The directory is created if it doesn't exist, and entries are written
+// whole under a temporary name and then renamed, so processes can share
+// it. NULL turns caching off, which is the default.
+void set_binary_cache(const char * directory);
+
+// The cache for code that links programs its own way. load_cached()
+// returns a linked program for these shader sources, or zero if there's
+// none or caching is off; save_cached() stores a program that linked.
+GLuint load_cached(const GLenum * types, const char * const * sources, int shader_count);
+void save_cached(GLuint program, const GLenum * types, const char * const * sources, int shader_count);
+
 GLuint link_from_shaders(const GLuint * shaders,
                          int shader_count,
                          bool delete_shaders,
@@ -25,6 +25,7 @@
 #include <shader.h>
 #include <vmath.h>
 #include <sb7textoverlay.h>
+#include <sb7programbatch.h>
 
 class cubicbezier_app : public sb7::application
 {
@@ -67,6 +68,7 @@ protected:
 
     void load_shaders();
     void onKey(int key, int action);
+    void onShadersReloaded();
 
     struct
     {
@@ -88,7 +90,22 @@ protected:
 
 void cubicbezier_app::startup()
 {
+    static const sb7::program_batch::stage tess_stages[] =
+    {
+        { "media/shaders/cubicbezier/cubicbezier.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/cubicbezier/cubicbezier.tcs.glsl", GL_TESS_CONTROL_SHADER },
+        { "media/shaders/cubicbezier/cubicbezier.tes.glsl", GL_TESS_EVALUATION_SHADER },
+        { "media/shaders/cubicbezier/cubicbezier.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+    static const sb7::program_batch::stage draw_cp_stages[] =
+    {
+        { "media/shaders/cubicbezier/draw-control-points.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/cubicbezier/draw-control-points.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+
     load_shaders();
+    watchProgram(&tess_program, tess_stages, 4);
+    watchProgram(&draw_cp_program, draw_cp_stages, 2);
 
     glGenVertexArrays(1, &patch_vao);
     glBindVertexArray(patch_vao);
@@ -241,10 +258,6 @@ void cubicbezier_app::load_shaders()
 
     tess_program = sb7::program::link_from_shaders(shaders, 4, true);
 
-    uniforms.patch.mv_matrix = glGetUniformLocation(tess_program, "mv_matrix");
-    uniforms.patch.proj_matrix = glGetUniformLocation(tess_program, "proj_matrix");
-    uniforms.patch.mvp = glGetUniformLocation(tess_program, "mvp");
-
     if (draw_cp_program)
         glDeleteProgram(draw_cp_program);
 
@@ -253,6 +266,15 @@ void cubicbezier_app::load_shaders()
 
     draw_cp_program = sb7::program::link_from_shaders(shaders, 2, true);
 
+    onShadersReloaded();
+}
+
+void cubicbezier_app::onShadersReloaded()
+{
+    uniforms.patch.mv_matrix = glGetUniformLocation(tess_program, "mv_matrix");
+    uniforms.patch.proj_matrix = glGetUniformLocation(tess_program, "proj_matrix");
+    uniforms.patch.mvp = glGetUniformLocation(tess_program, "mvp");
+
     uniforms.control_point.draw_color = glGetUniformLocation(draw_cp_program, "draw_color");
     uniforms.control_point.mvp = glGetUniformLocation(draw_cp_program, "mvp");
 }
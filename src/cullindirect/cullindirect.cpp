@@ -131,9 +131,12 @@ void cullindirect_app::startup()
 
     for (i = 0; i < CANDIDATE_COUNT; i++)
     {
+        sb7::sbm::bounds bounds;
+
         object.get_sub_object_info(i % object.get_sub_object_count(), first, count);
-        pDraws[i].sphereCenter = vmath::vec3(0.0f);
-        pDraws[i].sphereRadius = 4.0f;
+        object.get_sub_object_bounds(i % object.get_sub_object_count(), bounds);
+        pDraws[i].sphereCenter = vmath::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+        pDraws[i].sphereRadius = bounds.radius;
         pDraws[i].firstVertex = first;
         pDraws[i].vertexCount = count;
     }
@@ -27,6 +27,7 @@
 #include <object.h>
 #include <shader.h>
 #include <sb7ktx.h>
+#include <sb7programbatch.h>
 
 enum
 {
@@ -164,7 +165,7 @@ protected:
 
         glUnmapBuffer(GL_UNIFORM_BUFFER);
 
-        glUseProgram(use_nm ? render_program_nm : render_program);
+        programs.use(use_nm ? render_program_nm : render_program);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, tex_diffuse);
@@ -188,11 +189,18 @@ protected:
 
         if (vis_mode == VIS_OFF)
         {
-            glUseProgram(light_program);
+            programs.use(light_program);
         }
         else
         {
-            glUseProgram(vis_program);
+            // Looked up once the program has been checked on first use;
+            // asking straight after submit() would wait for the compile
+            const GLuint program = programs.use(vis_program);
+            if (program != vis_program_name)
+            {
+                vis_program_name = program;
+                loc_vis_mode = glGetUniformLocation(program, "vis_mode");
+            }
             glUniform1i(loc_vis_mode, vis_mode);
         }
 
@@ -231,61 +239,44 @@ protected:
     {
         glDeleteTextures(3, &gbuffer_tex[0]);
         glDeleteFramebuffers(1, &gbuffer);
-        glDeleteProgram(render_program);
-        glDeleteProgram(light_program);
+        programs.free();
     }
 
     void load_shaders()
     {
-        if (render_program)
-            glDeleteProgram(render_program);
-        if (light_program)
-            glDeleteProgram(light_program);
-            GLuint vs, fs;
-
-        vs = sb7::shader::load("media/shaders/deferredshading/render.vs.glsl", GL_VERTEX_SHADER);
-        fs = sb7::shader::load("media/shaders/deferredshading/render.fs.glsl", GL_FRAGMENT_SHADER);
-
-        render_program = glCreateProgram();
-        glAttachShader(render_program, vs);
-        glAttachShader(render_program, fs);
-        glLinkProgram(render_program);
-
-        glDeleteShader(vs);
-        glDeleteShader(fs);
-
-        vs = sb7::shader::load("media/shaders/deferredshading/render-nm.vs.glsl", GL_VERTEX_SHADER);
-        fs = sb7::shader::load("media/shaders/deferredshading/render-nm.fs.glsl", GL_FRAGMENT_SHADER);
-
-        render_program_nm = glCreateProgram();
-        glAttachShader(render_program_nm, vs);
-        glAttachShader(render_program_nm, fs);
-        glLinkProgram(render_program_nm);
-
-        glDeleteShader(vs);
-        glDeleteShader(fs);
-
-        vs = sb7::shader::load("media/shaders/deferredshading/light.vs.glsl", GL_VERTEX_SHADER);
-        fs = sb7::shader::load("media/shaders/deferredshading/light.fs.glsl", GL_FRAGMENT_SHADER);
-
-        light_program = glCreateProgram();
-        glAttachShader(light_program, vs);
-        glAttachShader(light_program, fs);
-        glLinkProgram(light_program);
-
-        glDeleteShader(fs);
+        static const sb7::program_batch::stage render_stages[] =
+        {
+            { "media/shaders/deferredshading/render.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/deferredshading/render.fs.glsl", GL_FRAGMENT_SHADER }
+        };
+        static const sb7::program_batch::stage render_nm_stages[] =
+        {
+            { "media/shaders/deferredshading/render-nm.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/deferredshading/render-nm.fs.glsl", GL_FRAGMENT_SHADER }
+        };
+        static const sb7::program_batch::stage light_stages[] =
+        {
+            { "media/shaders/deferredshading/light.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/deferredshading/light.fs.glsl", GL_FRAGMENT_SHADER }
+        };
+        static const sb7::program_batch::stage vis_stages[] =
+        {
+            { "media/shaders/deferredshading/light.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/deferredshading/render-vis.fs.glsl", GL_FRAGMENT_SHADER }
+        };
 
-        fs = sb7::shader::load("media/shaders/deferredshading/render-vis.fs.glsl", GL_FRAGMENT_SHADER);
+        // All four compile at once; each is checked when first used
+        programs.free();
 
-        vis_program = glCreateProgram();
-        glAttachShader(vis_program, vs);
-        glAttachShader(vis_program, fs);
-        glLinkProgram(vis_program);
+        render_program = programs.add(render_stages, 2);
+        render_program_nm = programs.add(render_nm_stages, 2);
+        light_program = programs.add(light_stages, 2);
+        vis_program = programs.add(vis_stages, 2);
 
-        loc_vis_mode = glGetUniformLocation(vis_program, "vis_mode");
+        programs.submit();
 
-        glDeleteShader(vs);
-        glDeleteShader(fs);
+        vis_program_name = 0;
+        loc_vis_mode = -1;
     }
 
     virtual void onKey(int key, int action)
@@ -321,7 +312,9 @@ protected:
 
     sb7::object object;
 
-    GLuint      render_program;
+    sb7::program_batch programs;
+
+    GLuint      render_program;         // Indices into programs
     GLuint      render_program_nm;
     GLuint      render_transform_ubo;
 
@@ -329,6 +322,7 @@ protected:
     GLuint      light_ubo;
 
     GLuint      vis_program;
+    GLuint      vis_program_name;       // That loc_vis_mode belongs to
     GLint       loc_vis_mode;
 
     GLuint      tex_diffuse;
@@ -24,6 +24,7 @@
 #include <sb7.h>
 #include <vmath.h>
 #include <sb7ktx.h>
+#include <sb7ktxstreamer.h>
 #include <shader.h>
 
 class dflandscape_app : public sb7::application
@@ -47,9 +48,13 @@ public:
 
     void startup()
     {
-        map_texture = sb7::ktx::file::load("media/textures/psycho-map-df-sm.ktx");
-        grass_texture = sb7::ktx::file::load("media/textures/mossygrass.ktx");
-        rocks_texture = sb7::ktx::file::load("media/textures/rocks.ktx");
+        // Smallest mips go up first; the rest stream in a few MB at a time
+        loader.init();
+        loader.set_upload_budget(4 * 1024 * 1024);
+
+        map_texture = loader.load("media/textures/psycho-map-df-sm.ktx", nullptr, nullptr, 0, true);
+        grass_texture = loader.load("media/textures/mossygrass.ktx", nullptr, nullptr, 0, true);
+        rocks_texture = loader.load("media/textures/rocks.ktx", nullptr, nullptr, 0, true);
 
         glBindTexture(GL_TEXTURE_2D, map_texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -67,7 +72,11 @@ public:
 
     void shutdown()
     {
+        loader.shutdown();
+
         glDeleteTextures(1, &map_texture);
+        glDeleteTextures(1, &grass_texture);
+        glDeleteTextures(1, &rocks_texture);
     }
 
     void render(double currentTime)
@@ -101,7 +110,9 @@ public:
         };
 
         vmath::mat4 transform;
-        
+
+        loader.update();
+
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, map_texture);
         glActiveTexture(GL_TEXTURE1);
@@ -155,6 +166,8 @@ private:
 
     GLuint      vao;
 
+    sb7::ktx::streamer  loader;
+
     enum RENDER_MODE
     {
         MODE_LOGO,
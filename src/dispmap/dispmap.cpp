@@ -23,6 +23,7 @@
 
 #include <sb7.h>
 #include <sb7ktx.h>
+#include <sb7ktxstreamer.h>
 #include <vmath.h>
 #include <shader.h>
 
@@ -61,9 +62,12 @@ public:
 
         glEnable(GL_CULL_FACE);
 
-        tex_displacement = sb7::ktx::file::load("media/textures/terragen1.ktx");
-        glActiveTexture(GL_TEXTURE1);
-        tex_color = sb7::ktx::file::load("media/textures/terragen_color.ktx");
+        // Smallest mips go up first; the rest stream in a few MB at a time
+        loader.init();
+        loader.set_upload_budget(4 * 1024 * 1024);
+
+        tex_displacement = loader.load("media/textures/terragen1.ktx", nullptr, nullptr, 0, true);
+        tex_color = loader.load("media/textures/terragen_color.ktx", nullptr, nullptr, 0, true);
     }
 
     virtual void render(double currentTime)
@@ -81,6 +85,14 @@ public:
         float r = sinf(t * 5.37f) * 15.0f + 16.0f;
         float h = cosf(t * 4.79f) * 2.0f + 3.2f;
 
+        loader.update();
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, tex_displacement);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, tex_color);
+        glActiveTexture(GL_TEXTURE0);
+
         glViewport(0, 0, info.windowWidth, info.windowHeight);
         glClearBufferfv(GL_COLOR, 0, black);
         glClearBufferfv(GL_DEPTH, 0, &one);
@@ -113,6 +125,10 @@ public:
 
     virtual void shutdown()
     {
+        loader.shutdown();
+
+        glDeleteTextures(1, &tex_displacement);
+        glDeleteTextures(1, &tex_color);
         glDeleteVertexArrays(1, &vao);
         glDeleteProgram(program);
     }
@@ -149,6 +165,7 @@ private:
     GLuint          vao;
     GLuint          tex_displacement;
     GLuint          tex_color;
+    sb7::ktx::streamer loader;
     float           dmap_depth;
     bool            enable_displacement;
     bool            wireframe;
@@ -170,19 +187,14 @@ void dispmap_app::load_shaders()
     if (program)
         glDeleteProgram(program);
 
-    GLuint vs = sb7::shader::load("media/shaders/dispmap/dispmap.vs.glsl", GL_VERTEX_SHADER);
-    GLuint tcs = sb7::shader::load("media/shaders/dispmap/dispmap.tcs.glsl", GL_TESS_CONTROL_SHADER);
-    GLuint tes = sb7::shader::load("media/shaders/dispmap/dispmap.tes.glsl", GL_TESS_EVALUATION_SHADER);
-    GLuint fs = sb7::shader::load("media/shaders/dispmap/dispmap.fs.glsl", GL_FRAGMENT_SHADER);
-
-    program = glCreateProgram();
+    GLuint shaders[4];
 
-    glAttachShader(program, vs);
-    glAttachShader(program, tcs);
-    glAttachShader(program, tes);
-    glAttachShader(program, fs);
+    shaders[0] = sb7::shader::load("media/shaders/dispmap/dispmap.vs.glsl", GL_VERTEX_SHADER);
+    shaders[1] = sb7::shader::load("media/shaders/dispmap/dispmap.tcs.glsl", GL_TESS_CONTROL_SHADER);
+    shaders[2] = sb7::shader::load("media/shaders/dispmap/dispmap.tes.glsl", GL_TESS_EVALUATION_SHADER);
+    shaders[3] = sb7::shader::load("media/shaders/dispmap/dispmap.fs.glsl", GL_FRAGMENT_SHADER);
 
-    glLinkProgram(program);
+    program = sb7::program::link_from_shaders(shaders, 4, true);
 
     uniforms.mv_matrix = glGetUniformLocation(program, "mv_matrix");
     uniforms.mvp_matrix = glGetUniformLocation(program, "mvp_matrix");
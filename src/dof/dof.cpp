@@ -24,7 +24,7 @@
 #include <sb7.h>
 #include <vmath.h>
 
-#include <object.h>
+#include <sb7objectpool.h>
 #include <sb7ktx.h>
 #include <shader.h>
 #include <sb7textoverlay.h>
@@ -88,9 +88,10 @@ protected:
     GLuint          temp_tex;
 
     enum { OBJECT_COUNT = 5 };
+    sb7::object_pool    pool;
     struct
     {
-        sb7::object     obj;
+        unsigned int    obj;
         vmath::mat4     model_matrix;
         vmath::vec4     diffuse_albedo;
     } objects[OBJECT_COUNT];
@@ -132,9 +133,13 @@ void dof_app::startup()
         vmath::vec4(0.8f, 0.2f, 0.1f, 1.0f),
     };
 
+    static const unsigned int layout[] = { 4, 3 };
+
+    pool.init(layout, 2);
+
     for (i = 0; i < OBJECT_COUNT; i++)
     {
-        objects[i].obj.load(object_names[i]);
+        objects[i].obj = pool.load(object_names[i]);
         objects[i].diffuse_albedo = object_colors[i];
     }
 
@@ -278,12 +283,13 @@ void dof_app::render_scene(double currentTime)
     glClearBufferfv(GL_DEPTH, 0, ones);
 
     int i;
+    pool.bind();
     for (i = 0; i < OBJECT_COUNT; i++)
     {
         vmath::mat4& model_matrix = objects[i].model_matrix;
         glUniformMatrix4fv(uniforms.view.mv_matrix, 1, GL_FALSE, camera_view_matrix * objects[i].model_matrix);
         glUniform3fv(uniforms.view.diffuse_albedo, 1, objects[i].diffuse_albedo);
-        objects[0].obj.render();
+        pool.render_sub_object(objects[0].obj, 0);
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -27,6 +27,14 @@
 #include <object.h>
 #include <shader.h>
 #include <sb7ktx.h>
+#include <sb7ktxcache.h>
+
+static const char * const envmap_names[] =
+{
+    "media/textures/envmaps/spheremap1.ktx",
+    "media/textures/envmaps/spheremap2.ktx",
+    "media/textures/envmaps/spheremap3.ktx"
+};
 
 class envmapsphere_app: public sb7::application
 {
@@ -48,10 +56,9 @@ protected:
 
     virtual void startup()
     {
-        envmaps[0] = sb7::ktx::file::load("media/textures/envmaps/spheremap1.ktx");
-        envmaps[1] = sb7::ktx::file::load("media/textures/envmaps/spheremap2.ktx");
-        envmaps[2] = sb7::ktx::file::load("media/textures/envmaps/spheremap3.ktx");
-        tex_envmap = envmaps[envmap_index];
+        // Only the map on screen is held; the others stay in the cache once
+        // they've been seen, so cycling back to one doesn't reload it
+        tex_envmap = envmaps.acquire(envmap_names[envmap_index]);
 
         object.load("media/objects/dragon.sbm");
 
@@ -89,7 +96,8 @@ protected:
     virtual void shutdown()
     {
         glDeleteProgram(render_prog);
-        glDeleteTextures(3, envmaps);
+        envmaps.release(tex_envmap);
+        envmaps.clear();
     }
 
     void load_shaders()
@@ -123,8 +131,9 @@ protected:
                 case 'R': load_shaders();
                     break;
                 case 'E':
+                    envmaps.release(tex_envmap);
                     envmap_index = (envmap_index + 1) % 3;
-                    tex_envmap = envmaps[envmap_index];
+                    tex_envmap = envmaps.acquire(envmap_names[envmap_index]);
                     break;
             }
         }
@@ -134,7 +143,7 @@ protected:
     GLuint          render_prog;
 
     GLuint          tex_envmap;
-    GLuint          envmaps[3];
+    sb7::ktx::cache envmaps;
     int             envmap_index;
 
     struct
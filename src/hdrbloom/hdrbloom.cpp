@@ -26,6 +26,7 @@
 #include <sb7ktx.h>
 #include <shader.h>
 #include <object.h>
+#include <sb7programbatch.h>
 
 #include <string>
 static void print_shader_log(GLuint shader)
@@ -164,9 +165,7 @@ public:
 
     void shutdown(void)
     {
-        glDeleteProgram(program_render);
-        glDeleteProgram(program_filter);
-        glDeleteProgram(program_resolve);
+        programs.free();
         glDeleteVertexArrays(1, &vao);
         glDeleteTextures(1, &tex_src);
         glDeleteTextures(1, &tex_lut);
@@ -177,6 +176,7 @@ public:
         static const GLfloat black[] = { 0.0f, 0.0f, 0.0f, 1.0f };
         static const GLfloat one = 1.0f;
         int i;
+        GLuint program;
         static double last_time = 0.0;
         static double total_time = 0.0;
 
@@ -195,7 +195,15 @@ public:
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LESS);
 
-        glUseProgram(program_render);
+        // Uniforms are looked up once a program has been checked on first
+        // use; asking straight after submit() would wait for the compile
+        program = programs.use(program_render);
+        if (program != uniforms.scene.program)
+        {
+            uniforms.scene.program = program;
+            uniforms.scene.bloom_thresh_min = glGetUniformLocation(program, "bloom_thresh_min");
+            uniforms.scene.bloom_thresh_max = glGetUniformLocation(program, "bloom_thresh_max");
+        }
 
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo_transform);
         struct transforms_t
@@ -224,7 +232,7 @@ public:
 
         glDisable(GL_DEPTH_TEST);
 
-        glUseProgram(program_filter);
+        programs.use(program_filter);
 
         glBindVertexArray(vao);
 
@@ -240,7 +248,14 @@ public:
 
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-        glUseProgram(program_resolve);
+        program = programs.use(program_resolve);
+        if (program != uniforms.resolve.program)
+        {
+            uniforms.resolve.program = program;
+            uniforms.resolve.exposure = glGetUniformLocation(program, "exposure");
+            uniforms.resolve.bloom_factor = glGetUniformLocation(program, "bloom_factor");
+            uniforms.resolve.scene_factor = glGetUniformLocation(program, "scene_factor");
+        }
 
         glUniform1f(uniforms.resolve.exposure, exposure);
         if (show_prefilter)
@@ -322,39 +337,39 @@ public:
 
     void load_shaders()
     {
-        struct
+        static const sb7::program_batch::stage render_stages[] =
         {
-            GLuint vs;
-            GLuint fs;
-        } shaders;
-
-        if (program_render)
-            glDeleteProgram(program_render);
-
-        shaders.vs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-scene.vs.glsl", GL_VERTEX_SHADER);
-        shaders.fs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-scene.fs.glsl", GL_FRAGMENT_SHADER);
-        program_render = sb7::program::link_from_shaders(&shaders.vs, 2, true);
-
-        uniforms.scene.bloom_thresh_min = glGetUniformLocation(program_render, "bloom_thresh_min");
-        uniforms.scene.bloom_thresh_max = glGetUniformLocation(program_render, "bloom_thresh_max");
+            { "media/shaders/hdrbloom/hdrbloom-scene.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/hdrbloom/hdrbloom-scene.fs.glsl", GL_FRAGMENT_SHADER }
+        };
+        static const sb7::program_batch::stage filter_stages[] =
+        {
+            { "media/shaders/hdrbloom/hdrbloom-filter.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/hdrbloom/hdrbloom-filter.fs.glsl", GL_FRAGMENT_SHADER }
+        };
+        static const sb7::program_batch::stage resolve_stages[] =
+        {
+            { "media/shaders/hdrbloom/hdrbloom-resolve.vs.glsl", GL_VERTEX_SHADER },
+            { "media/shaders/hdrbloom/hdrbloom-resolve.fs.glsl", GL_FRAGMENT_SHADER }
+        };
 
-        if (program_filter)
-            glDeleteProgram(program_filter);
+        programs.free();
 
-        shaders.vs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-filter.vs.glsl", GL_VERTEX_SHADER);
-        shaders.fs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-filter.fs.glsl", GL_FRAGMENT_SHADER);
-        program_filter = sb7::program::link_from_shaders(&shaders.vs, 2, true);
+        program_render = programs.add(render_stages, 2);
+        program_filter = programs.add(filter_stages, 2);
+        program_resolve = programs.add(resolve_stages, 2);
 
-        if (program_resolve)
-            glDeleteProgram(program_resolve);
+        programs.submit();
 
-        shaders.vs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-resolve.vs.glsl", GL_VERTEX_SHADER);
-        shaders.fs = sb7::shader::load("media/shaders/hdrbloom/hdrbloom-resolve.fs.glsl", GL_FRAGMENT_SHADER);
-        program_resolve = sb7::program::link_from_shaders(&shaders.vs, 2, true);
+        // Looked up again the first time each program is used
+        uniforms.scene.program = 0;
+        uniforms.scene.bloom_thresh_min = -1;
+        uniforms.scene.bloom_thresh_max = -1;
 
-        uniforms.resolve.exposure = glGetUniformLocation(program_resolve, "exposure");
-        uniforms.resolve.bloom_factor = glGetUniformLocation(program_resolve, "bloom_factor");
-        uniforms.resolve.scene_factor = glGetUniformLocation(program_resolve, "scene_factor");
+        uniforms.resolve.program = 0;
+        uniforms.resolve.exposure = -1;
+        uniforms.resolve.bloom_factor = -1;
+        uniforms.resolve.scene_factor = -1;
     }
 
 private:
@@ -369,7 +384,8 @@ private:
     GLuint      tex_depth;
     GLuint      tex_filter[2];
 
-    GLuint      program_render;
+    sb7::program_batch programs;
+    GLuint      program_render;         // Indices into programs
     GLuint      program_filter;
     GLuint      program_resolve;
     GLuint      vao;
@@ -387,11 +403,13 @@ private:
     {
         struct
         {
+            GLuint program;         // That the locations belong to
             int bloom_thresh_min;
             int bloom_thresh_max;
         } scene;
         struct
         {
+            GLuint program;
             int exposure;
             int bloom_factor;
             int scene_factor;
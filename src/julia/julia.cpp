@@ -22,6 +22,7 @@
  */
 
 #include <sb7.h>
+#include <sb7uniforms.h>
 
 #include <cmath>
 
@@ -227,9 +228,10 @@ private:
 
         glLinkProgram(program);
 
-        uniforms.zoom   = glGetUniformLocation(program, "zoom");
-        uniforms.offset = glGetUniformLocation(program, "offset");
-        uniforms.C      = glGetUniformLocation(program, "C");
+        uniforms.reflect(program);
+        uniform_index.C = uniforms.find("C");
+        uniform_index.offset = uniforms.find("offset");
+        uniform_index.zoom = uniforms.find("zoom");
 
         glDeleteShader(vs);
         glDeleteShader(fs);
@@ -254,14 +256,14 @@ private:
 
         r = t + time_offset;
 
-        float C[2] = { (sinf(r * 0.1f) + cosf(r * 0.23f)) * 0.5f, (cosf(r * 0.13f) + sinf(r * 0.21f)) * 0.5f };
-        float offset[2] = { x_offset, y_offset };
+        vmath::vec2 C((sinf(r * 0.1f) + cosf(r * 0.23f)) * 0.5f, (cosf(r * 0.13f) + sinf(r * 0.21f)) * 0.5f);
 
         glUseProgram(program);
 
-        glUniform2fv(uniforms.C, 1, C);
-        glUniform2fv(uniforms.offset, 1, offset);
-        glUniform1f(uniforms.zoom, zoom);
+        uniforms.set(uniform_index.C, C);
+        uniforms.set(uniform_index.offset, vmath::vec2(x_offset, y_offset));
+        uniforms.set(uniform_index.zoom, zoom);
+        uniforms.flush();
 
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
     }
@@ -319,6 +321,7 @@ private:
         glDeleteTextures(1, &palette_texture);
         glDeleteVertexArrays(1, &vao);
         glDeleteProgram(program);
+        uniforms.free();
     }
 
 private:
@@ -326,12 +329,14 @@ private:
     GLuint      vao;
     GLuint      palette_texture;
 
+    sb7::uniform_cache uniforms;
+
     struct
     {
-        GLint   zoom;
-        GLint   offset;
-        GLint   C;
-    } uniforms;
+        int     C;
+        int     offset;
+        int     zoom;
+    } uniform_index;                // Into uniforms, found once per link
 
     bool paused;
     float time_offset;
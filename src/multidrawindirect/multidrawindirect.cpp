@@ -25,6 +25,8 @@
 #include <shader.h>
 #include <object.h>
 #include <vmath.h>
+#include <sb7uniforms.h>
+#include <sb7programbatch.h>
 
 enum
 {
@@ -44,6 +46,10 @@ class multidrawindirect_app : public sb7::application
 public:
     multidrawindirect_app()
         : render_program(0),
+          lod_spheres(NULL),
+          lod_radii(NULL),
+          lod_sub_objects(NULL),
+          has_lods(false),
           mode(MODE_MULTIDRAW),
           paused(false),
           vsync(false)
@@ -64,9 +70,13 @@ public:
 
     void render(double currentTime);
 
+    void shutdown();
+
 protected:
+    void select_lods(float t, const vmath::mat4& view_matrix, const vmath::mat4& proj_matrix);
     void load_shaders();
     void onKey(int key, int action);
+    void onShadersReloaded();
 
     GLuint              render_program;
 
@@ -75,20 +85,32 @@ protected:
     GLuint              indirect_draw_buffer;
     GLuint              draw_index_buffer;
 
+    // Indexed copy of the asteroids with levels of detail, from
+    // "sbmtool lod -i". Each frame picks a level per asteroid on the CPU.
+    sb7::object         lod_object;
+    GLuint              lod_draw_buffer;
+    float *             lod_spheres;
+    float *             lod_radii;
+    unsigned int *      lod_sub_objects;
+    bool                has_lods;
+
+    sb7::uniform_cache  uniforms;
+
     struct
     {
-        GLint           time;
-        GLint           view_matrix;
-        GLint           proj_matrix;
-        GLint           viewproj_matrix;
-    } uniforms;
+        int             time;
+        int             view_matrix;
+        int             proj_matrix;
+        int             viewproj_matrix;
+    } uniform_index;                        // Into uniforms, found on each reload
 
     enum MODE
     {
         MODE_FIRST,
         MODE_MULTIDRAW = 0,
         MODE_SEPARATE_DRAWS,
-        MODE_MAX = MODE_SEPARATE_DRAWS
+        MODE_LOD,
+        MODE_MAX = MODE_LOD
     };
 
     MODE                mode;
@@ -100,7 +122,14 @@ void multidrawindirect_app::startup()
 {
     int i;
 
+    static const sb7::program_batch::stage render_stages[] =
+    {
+        { "media/shaders/multidrawindirect/render.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/multidrawindirect/render.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+
     load_shaders();
+    watchProgram(&render_program, render_stages, 2);
 
     object.load("media/objects/asteroids.sbm");
 
@@ -155,6 +184,47 @@ void multidrawindirect_app::startup()
     glVertexAttribDivisor(10, 1);
     glEnableVertexAttribArray(10);
 
+    // The LOD version is optional, so only offer its mode when it's there
+    // and actually has more than one level
+    has_lods = lod_object.load("media/objects/asteroids_lod.sbm") &&
+               lod_object.get_lod_count(0) > 1;
+
+    if (has_lods)
+    {
+        sb7::sbm::bounds b;
+
+        lod_spheres = new float[NUM_DRAWS * 4];
+        lod_radii = new float[lod_object.get_sub_object_count()];
+        lod_sub_objects = new unsigned int[NUM_DRAWS];
+
+        // Asteroids spin around their origin, so take a sphere there that
+        // holds the bounding sphere wherever it turns to
+        for (i = 0; i < (int)lod_object.get_sub_object_count(); i++)
+        {
+            lod_object.get_sub_object_bounds(i, b);
+            lod_radii[i] = vmath::length(vmath::vec3(b.center[0], b.center[1], b.center[2])) + b.radius;
+        }
+
+        for (i = 0; i < NUM_DRAWS; i++)
+        {
+            lod_sub_objects[i] = i % lod_object.get_sub_object_count();
+        }
+
+        glBindVertexArray(lod_object.get_vao());
+        glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer);
+        glVertexAttribIPointer(10, 1, GL_UNSIGNED_INT, 0, NULL);
+        glVertexAttribDivisor(10, 1);
+        glEnableVertexAttribArray(10);
+
+        glGenBuffers(1, &lod_draw_buffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, lod_draw_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     NUM_DRAWS * sizeof(sb7::draw_elements_indirect_command),
+                     NULL,
+                     GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_draw_buffer);
+    }
+
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 
@@ -192,10 +262,22 @@ void multidrawindirect_app::render(double currentTime)
 
     glUseProgram(render_program);
 
-    glUniform1f(uniforms.time, t);
-    glUniformMatrix4fv(uniforms.view_matrix, 1, GL_FALSE, view_matrix);
-    glUniformMatrix4fv(uniforms.proj_matrix, 1, GL_FALSE, proj_matrix);
-    glUniformMatrix4fv(uniforms.viewproj_matrix, 1, GL_FALSE, proj_matrix * view_matrix);
+    uniforms.set(uniform_index.time, t);
+    uniforms.set(uniform_index.view_matrix, view_matrix);
+    uniforms.set(uniform_index.proj_matrix, proj_matrix);
+    uniforms.set(uniform_index.viewproj_matrix, proj_matrix * view_matrix);
+    uniforms.flush();
+
+    if (mode == MODE_LOD)
+    {
+        select_lods(t, view_matrix, proj_matrix);
+
+        glBindVertexArray(lod_object.get_vao());
+        glMultiDrawElementsIndirect(GL_TRIANGLES, lod_object.get_index_type(), NULL, NUM_DRAWS, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_draw_buffer);
+
+        return;
+    }
 
     glBindVertexArray(object.get_vao());
 
@@ -217,6 +299,62 @@ void multidrawindirect_app::render(double currentTime)
     }
 }
 
+void multidrawindirect_app::shutdown()
+{
+    if (has_lods)
+    {
+        glDeleteBuffers(1, &lod_draw_buffer);
+        lod_object.free();
+    }
+
+    delete [] lod_spheres;
+    delete [] lod_radii;
+    delete [] lod_sub_objects;
+
+    uniforms.free();
+}
+
+// Places each asteroid the same way render.vs.glsl does, as a sphere in
+// view space, and lets the object write a draw for the coarsest level that
+// stays within a pixel of the full model
+void multidrawindirect_app::select_lods(float t, const vmath::mat4& view_matrix, const vmath::mat4& proj_matrix)
+{
+    int i;
+
+    t *= 0.1f;
+
+    for (i = 0; i < NUM_DRAWS; i++)
+    {
+        const float f = float(i) / 30.0f;
+        const float a = t * 0.5f + f * 5.0f;
+        const float d = 260.0f + 30.0f * cosf((f - floorf(f)) * 3.141592653589793f);
+        const vmath::vec4 p = view_matrix[0] * (d * cosf(a)) +
+                              view_matrix[1] * (5.0f * sinf(f * 123.123f)) +
+                              view_matrix[2] * (d * sinf(a)) +
+                              view_matrix[3];
+        const float scale = vmath::max(0.65f + cosf(f * 1.1f) * 0.2f, 0.65f + cosf(f * 1.3f) * 0.2f);
+
+        lod_spheres[i * 4 + 0] = p[0];
+        lod_spheres[i * 4 + 1] = p[1];
+        lod_spheres[i * 4 + 2] = p[2];
+        lod_spheres[i * 4 + 3] = lod_radii[lod_sub_objects[i]] * scale;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, lod_draw_buffer);
+
+    sb7::draw_elements_indirect_command * cmd = (sb7::draw_elements_indirect_command *)
+        glMapBufferRange(GL_DRAW_INDIRECT_BUFFER,
+                         0,
+                         NUM_DRAWS * sizeof(sb7::draw_elements_indirect_command),
+                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    lod_object.select_lods(lod_spheres, lod_sub_objects, NUM_DRAWS,
+                           info.windowHeight * proj_matrix[1][1] * 0.5f, 1.0f,
+                           cmd);
+
+    glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+}
+
 void multidrawindirect_app::load_shaders()
 {
     GLuint shaders[2];
@@ -229,10 +367,17 @@ void multidrawindirect_app::load_shaders()
 
     render_program = sb7::program::link_from_shaders(shaders, 2, true);
 
-    uniforms.time            = glGetUniformLocation(render_program, "time");
-    uniforms.view_matrix     = glGetUniformLocation(render_program, "view_matrix");
-    uniforms.proj_matrix     = glGetUniformLocation(render_program, "proj_matrix");
-    uniforms.viewproj_matrix = glGetUniformLocation(render_program, "viewproj_matrix");
+    onShadersReloaded();
+}
+
+void multidrawindirect_app::onShadersReloaded()
+{
+    uniforms.reflect(render_program);
+
+    uniform_index.time = uniforms.find("time");
+    uniform_index.view_matrix = uniforms.find("view_matrix");
+    uniform_index.proj_matrix = uniforms.find("proj_matrix");
+    uniform_index.viewproj_matrix = uniforms.find("viewproj_matrix");
 }
 
 void multidrawindirect_app::onKey(int key, int action)
@@ -250,6 +395,8 @@ void multidrawindirect_app::onKey(int key, int action)
                 break;
             case 'D':
                 mode = MODE(mode + 1);
+                if (mode == MODE_LOD && !has_lods)
+                    mode = MODE(mode + 1);
                 if (mode > MODE_MAX)
                     mode = MODE_FIRST;
                 break;
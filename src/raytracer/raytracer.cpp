@@ -27,6 +27,7 @@
 #include <object.h>
 #include <sb7ktx.h>
 #include <shader.h>
+#include <sb7programbatch.h>
 
 class raytracer_app : public sb7::application
 {
@@ -55,6 +56,7 @@ protected:
     void startup();
     void render(double currentTime);
     void onKey(int key, int action);
+    void onShadersReloaded();
 
     /*
     void init()
@@ -148,7 +150,26 @@ void raytracer_app::startup()
 {
     int i;
 
+    static const sb7::program_batch::stage prepare_stages[] =
+    {
+        { "media/shaders/raytracer/trace-prepare.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/raytracer/trace-prepare.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+    static const sb7::program_batch::stage trace_stages[] =
+    {
+        { "media/shaders/raytracer/raytracer.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/raytracer/raytracer.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+    static const sb7::program_batch::stage blit_stages[] =
+    {
+        { "media/shaders/raytracer/blit.vs.glsl", GL_VERTEX_SHADER },
+        { "media/shaders/raytracer/blit.fs.glsl", GL_FRAGMENT_SHADER }
+    };
+
     load_shaders();
+    watchProgram(&prepare_program, prepare_stages, 2);
+    watchProgram(&trace_program, trace_stages, 2);
+    watchProgram(&blit_program, blit_stages, 2);
 
     glGenBuffers(1, &uniforms_buffer);
     glBindBuffer(GL_UNIFORM_BUFFER, uniforms_buffer);
@@ -503,10 +524,6 @@ void raytracer_app::load_shaders()
 
     prepare_program = sb7::program::link_from_shaders(shaders, 2, true);
 
-    uniforms.ray_origin = glGetUniformLocation(prepare_program, "ray_origin");
-    uniforms.ray_lookat = glGetUniformLocation(prepare_program, "ray_lookat");
-    uniforms.aspect = glGetUniformLocation(prepare_program, "aspect");
-
     shaders[0] = sb7::shader::load("media/shaders/raytracer/raytracer.vs.glsl", GL_VERTEX_SHADER);
     shaders[1] = sb7::shader::load("media/shaders/raytracer/raytracer.fs.glsl", GL_FRAGMENT_SHADER);
 
@@ -522,6 +539,15 @@ void raytracer_app::load_shaders()
         glDeleteProgram(blit_program);
 
     blit_program = sb7::program::link_from_shaders(shaders, 2, true);
+
+    onShadersReloaded();
+}
+
+void raytracer_app::onShadersReloaded()
+{
+    uniforms.ray_origin = glGetUniformLocation(prepare_program, "ray_origin");
+    uniforms.ray_lookat = glGetUniformLocation(prepare_program, "ray_lookat");
+    uniforms.aspect = glGetUniformLocation(prepare_program, "aspect");
 }
 
 DECLARE_MAIN(raytracer_app)
@@ -24,6 +24,7 @@
  */
 
 #include <sb7.h>
+#include <sb7shaderwatch.h>
 
 sb7::application * sb7::application::app = 0;
 
@@ -63,4 +64,51 @@ void APIENTRY sb7::application::debug_callback(GLenum source,
                                                GLvoid* userParam)
 {
     reinterpret_cast<application *>(userParam)->onDebugMessage(source, type, id, severity, length, message);
-}
\ No newline at end of file
+}
+
+void sb7::application::watchProgram(GLuint * program, const sb7::shader_stage * stages, unsigned int stage_count)
+{
+    if (!watcher)
+    {
+        if (!sb7::shader_watcher::is_supported())
+            return;
+
+        // The rebuilds happen on a hidden window's context, shared with
+        // the main one
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        watcher_window = glfwCreateWindow(1, 1, info.title, NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+
+        if (!watcher_window)
+            return;
+
+        GLFWwindow * context = watcher_window;
+
+        watcher = new sb7::shader_watcher;
+
+        if (!watcher->start([context](bool bind) { glfwMakeContextCurrent(bind ? context : NULL); }))
+        {
+            delete watcher;
+            watcher = NULL;
+            glfwDestroyWindow(watcher_window);
+            watcher_window = NULL;
+            return;
+        }
+    }
+
+    watcher->watch(program, stages, stage_count);
+}
+
+bool sb7::application::updateWatchedPrograms()
+{
+    return watcher->update() != 0;
+}
+
+void sb7::application::stopWatchingPrograms()
+{
+    watcher->stop();
+    delete watcher;
+    watcher = NULL;
+    glfwDestroyWindow(watcher_window);
+    watcher_window = NULL;
+}
@@ -0,0 +1,427 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sb7cull.h>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SB7_CULL_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace sb7
+{
+
+void extract_frustum_planes(const float mvp[16], float planes[6][4])
+{
+    int i, j;
+
+    // Each plane is the last row of the matrix plus or minus one of the
+    // others (Gribb and Hartmann)
+    for (i = 0; i < 6; i++)
+    {
+        const float sign = (i & 1) ? -1.0f : 1.0f;
+        const int row = i / 2;
+
+        for (j = 0; j < 4; j++)
+        {
+            planes[i][j] = mvp[j * 4 + 3] + sign * mvp[j * 4 + row];
+        }
+
+        const float length = sqrtf(planes[i][0] * planes[i][0] +
+                                   planes[i][1] * planes[i][1] +
+                                   planes[i][2] * planes[i][2]);
+
+        if (length > 0.0f)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                planes[i][j] /= length;
+            }
+        }
+    }
+}
+
+meshlet_culler::meshlet_culler()
+    : blocks(NULL),
+      first_block(NULL),
+      meshlet_count(NULL),
+      num_sub_objects(0)
+{
+
+}
+
+meshlet_culler::~meshlet_culler()
+{
+    free();
+}
+
+void meshlet_culler::load(const SB6M_MESHLET_DECL * meshlets,
+                          unsigned int count,
+                          unsigned int sub_object_count,
+                          unsigned int first_index)
+{
+    unsigned int i, sub, slot = 0, total = 0;
+
+    free();
+
+    num_sub_objects = sub_object_count;
+    first_block = new unsigned int[sub_object_count + 1];
+    meshlet_count = new unsigned int[sub_object_count];
+    memset(meshlet_count, 0, sub_object_count * sizeof(unsigned int));
+
+    for (i = 0; i < count; i++)
+    {
+        meshlet_count[meshlets[i].sub_object]++;
+    }
+
+    // Each sub-object starts a new block so that a sub-object can be
+    // culled on its own
+    for (sub = 0; sub < sub_object_count; sub++)
+    {
+        first_block[sub] = total;
+        total += (meshlet_count[sub] + 3) / 4;
+    }
+
+    first_block[sub_object_count] = total;
+    blocks = new block[total];
+
+    for (i = 0; i < total; i++)
+    {
+        block& b = blocks[i];
+        unsigned int lane;
+
+        for (lane = 0; lane < 4; lane++)
+        {
+            b.center_x[lane] = b.center_y[lane] = b.center_z[lane] = 0.0f;
+            b.radius[lane] = -HUGE_VALF;
+            b.apex_x[lane] = b.apex_y[lane] = b.apex_z[lane] = 0.0f;
+            b.axis_x[lane] = b.axis_y[lane] = b.axis_z[lane] = 0.0f;
+            b.cutoff[lane] = HUGE_VALF;
+            b.first_index[lane] = 0;
+            b.count[lane] = 0;
+        }
+    }
+
+    for (i = 0, sub = ~0u; i < count; i++)
+    {
+        const SB6M_MESHLET_DECL& m = meshlets[i];
+
+        if (m.sub_object != sub)
+        {
+            sub = m.sub_object;
+            slot = first_block[sub] * 4;
+        }
+
+        block& b = blocks[slot / 4];
+        const unsigned int lane = slot % 4;
+
+        b.center_x[lane] = m.center[0];
+        b.center_y[lane] = m.center[1];
+        b.center_z[lane] = m.center[2];
+        b.radius[lane] = m.radius;
+        b.apex_x[lane] = m.cone_apex[0];
+        b.apex_y[lane] = m.cone_apex[1];
+        b.apex_z[lane] = m.cone_apex[2];
+        b.axis_x[lane] = m.cone_axis[0];
+        b.axis_y[lane] = m.cone_axis[1];
+        b.axis_z[lane] = m.cone_axis[2];
+        // Open cones are never culled, even where rounding would put the
+        // eye exactly on the axis
+        b.cutoff[lane] = m.cone_cutoff < 1.0f ? m.cone_cutoff : HUGE_VALF;
+        b.first_index[lane] = first_index + m.first;
+        b.count[lane] = m.count;
+
+        slot++;
+    }
+}
+
+void meshlet_culler::free()
+{
+    delete [] blocks;
+    delete [] first_block;
+    delete [] meshlet_count;
+
+    blocks = NULL;
+    first_block = NULL;
+    meshlet_count = NULL;
+    num_sub_objects = 0;
+}
+
+unsigned int meshlet_culler::get_meshlet_count(unsigned int sub_object) const
+{
+    return sub_object < num_sub_objects ? meshlet_count[sub_object] : 0;
+}
+
+unsigned int meshlet_culler::cull_scalar(unsigned int sub_object,
+                                         const float planes[6][4],
+                                         const float eye[3],
+                                         draw_elements_indirect_command * commands,
+                                         unsigned int instance_count,
+                                         unsigned int base_instance) const
+{
+    unsigned int i, lane, p;
+    unsigned int visible = 0;
+
+    if (sub_object >= num_sub_objects)
+        return 0;
+
+    for (i = first_block[sub_object]; i < first_block[sub_object + 1]; i++)
+    {
+        const block& b = blocks[i];
+
+        for (lane = 0; lane < 4; lane++)
+        {
+            bool inside = true;
+
+            for (p = 0; p < 6; p++)
+            {
+                const float distance = b.center_x[lane] * planes[p][0] +
+                                       b.center_y[lane] * planes[p][1] +
+                                       b.center_z[lane] * planes[p][2] +
+                                       planes[p][3];
+
+                inside = inside && distance + b.radius[lane] >= 0.0f;
+            }
+
+            const float dx = b.apex_x[lane] - eye[0];
+            const float dy = b.apex_y[lane] - eye[1];
+            const float dz = b.apex_z[lane] - eye[2];
+            const float d = dx * b.axis_x[lane] + dy * b.axis_y[lane] + dz * b.axis_z[lane];
+            const float length = sqrtf(dx * dx + dy * dy + dz * dz);
+
+            if (inside && !(d > b.cutoff[lane] * length))
+            {
+                draw_elements_indirect_command& cmd = commands[visible++];
+
+                cmd.count = b.count[lane];
+                cmd.instance_count = instance_count;
+                cmd.first_index = b.first_index[lane];
+                cmd.base_vertex = 0;
+                cmd.base_instance = base_instance;
+            }
+        }
+    }
+
+    return visible;
+}
+
+unsigned int meshlet_culler::cull(unsigned int sub_object,
+                                  const float planes[6][4],
+                                  const float eye[3],
+                                  draw_elements_indirect_command * commands,
+                                  unsigned int instance_count,
+                                  unsigned int base_instance) const
+{
+#ifdef SB7_CULL_SSE
+    __m128 plane[6][4];
+    unsigned int i, lane, p;
+    unsigned int visible = 0;
+
+    if (sub_object >= num_sub_objects)
+        return 0;
+
+    for (p = 0; p < 6; p++)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            plane[p][i] = _mm_set1_ps(planes[p][i]);
+        }
+    }
+
+    const __m128 eye_x = _mm_set1_ps(eye[0]);
+    const __m128 eye_y = _mm_set1_ps(eye[1]);
+    const __m128 eye_z = _mm_set1_ps(eye[2]);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (i = first_block[sub_object]; i < first_block[sub_object + 1]; i++)
+    {
+        const block& b = blocks[i];
+        const __m128 center_x = _mm_loadu_ps(b.center_x);
+        const __m128 center_y = _mm_loadu_ps(b.center_y);
+        const __m128 center_z = _mm_loadu_ps(b.center_z);
+        const __m128 radius = _mm_loadu_ps(b.radius);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+
+        for (p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_mul_ps(center_x, plane[p][0]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(center_y, plane[p][1]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(center_z, plane[p][2]));
+            distance = _mm_add_ps(distance, plane[p][3]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(b.apex_x), eye_x);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(b.apex_y), eye_y);
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(b.apex_z), eye_z);
+        __m128 d = _mm_mul_ps(dx, _mm_loadu_ps(b.axis_x));
+        d = _mm_add_ps(d, _mm_mul_ps(dy, _mm_loadu_ps(b.axis_y)));
+        d = _mm_add_ps(d, _mm_mul_ps(dz, _mm_loadu_ps(b.axis_z)));
+        __m128 length2 = _mm_mul_ps(dx, dx);
+        length2 = _mm_add_ps(length2, _mm_mul_ps(dy, dy));
+        length2 = _mm_add_ps(length2, _mm_mul_ps(dz, dz));
+        const __m128 back = _mm_cmpgt_ps(d, _mm_mul_ps(_mm_loadu_ps(b.cutoff), _mm_sqrt_ps(length2)));
+
+        int mask = _mm_movemask_ps(_mm_andnot_ps(back, inside));
+
+        for (lane = 0; mask != 0; lane++, mask >>= 1)
+        {
+            if (mask & 1)
+            {
+                draw_elements_indirect_command& cmd = commands[visible++];
+
+                cmd.count = b.count[lane];
+                cmd.instance_count = instance_count;
+                cmd.first_index = b.first_index[lane];
+                cmd.base_vertex = 0;
+                cmd.base_instance = base_instance;
+            }
+        }
+    }
+
+    return visible;
+#else
+    return cull_scalar(sub_object, planes, eye, commands, instance_count, base_instance);
+#endif
+}
+
+lod_selector::lod_selector()
+    : levels(NULL),
+      first_level(NULL),
+      num_sub_objects(0)
+{
+
+}
+
+lod_selector::~lod_selector()
+{
+    free();
+}
+
+void lod_selector::load(const SB6M_SUB_OBJECT_DECL * sub_objects,
+                        const float * radii,
+                        unsigned int sub_object_count,
+                        const SB6M_LOD_DECL * lods,
+                        unsigned int lod_count,
+                        unsigned int first_index)
+{
+    unsigned int i, sub, next = 0;
+
+    free();
+
+    num_sub_objects = sub_object_count;
+    first_level = new unsigned int[sub_object_count + 1];
+    levels = new level[sub_object_count + lod_count];
+
+    // Errors are stored as a fraction of the bounding radius so that the
+    // radius of each instance scales them
+    for (sub = 0, i = 0; sub < sub_object_count; sub++)
+    {
+        const float scale = radii[sub] > 0.0f ? 1.0f / radii[sub] : 0.0f;
+
+        first_level[sub] = next;
+        levels[next].first_index = first_index + sub_objects[sub].first;
+        levels[next].count = sub_objects[sub].count;
+        levels[next].error = 0.0f;
+        next++;
+
+        for (; i < lod_count && lods[i].sub_object == sub; i++)
+        {
+            levels[next].first_index = first_index + lods[i].first;
+            levels[next].count = lods[i].count;
+            levels[next].error = lods[i].error * scale;
+            next++;
+        }
+    }
+
+    first_level[sub_object_count] = next;
+}
+
+void lod_selector::free()
+{
+    delete [] levels;
+    delete [] first_level;
+
+    levels = NULL;
+    first_level = NULL;
+    num_sub_objects = 0;
+}
+
+unsigned int lod_selector::get_level_count(unsigned int sub_object) const
+{
+    return sub_object < num_sub_objects ? first_level[sub_object + 1] - first_level[sub_object] : 0;
+}
+
+void lod_selector::select(const float * spheres,
+                          const unsigned int * sub_objects,
+                          unsigned int count,
+                          float pixel_scale,
+                          float threshold,
+                          draw_elements_indirect_command * commands,
+                          unsigned int base_instance,
+                          unsigned char * chosen) const
+{
+    const float budget = threshold / pixel_scale;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        const float * s = spheres + i * 4;
+        const unsigned int sub = sub_objects != NULL ? sub_objects[i] : 0;
+        draw_elements_indirect_command& cmd = commands[i];
+
+        cmd.instance_count = 1;
+        cmd.base_vertex = 0;
+        cmd.base_instance = base_instance + i;
+
+        if (sub >= num_sub_objects)
+        {
+            cmd.count = 0;
+            cmd.first_index = 0;
+            if (chosen != NULL)
+                chosen[i] = 0;
+            continue;
+        }
+
+        // The nearest point of the sphere sets how much error can hide in
+        // a pixel. Errors are relative to the radius, which the instance's
+        // own radius scales back to view space.
+        const float distance = sqrtf(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]) - s[3];
+        const float allowed = distance > 0.0f && s[3] > 0.0f ? budget * distance / s[3] : 0.0f;
+        unsigned int l = first_level[sub + 1] - 1;
+
+        while (l > first_level[sub] && levels[l].error > allowed)
+            l--;
+
+        cmd.count = levels[l].count;
+        cmd.first_index = levels[l].first_index;
+
+        if (chosen != NULL)
+            chosen[i] = (unsigned char)(l - first_level[sub]);
+    }
+}
+
+}
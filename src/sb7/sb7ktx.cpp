@@ -22,6 +22,7 @@
  */
 
 #include "sb7ktx.h"
+#include "sb7mappedfile.h"
 
 #ifdef _MSC_VER
 #define _CRT_SECURE_NO_WARNINGS 1
@@ -34,6 +35,7 @@
 // #include <sb7.h>
 
 #include "GL/gl3w.h"
+#include "GL/glext.h"
 
 namespace sb7
 {
@@ -44,293 +46,569 @@ namespace ktx
 namespace file
 {
 
-static const unsigned char identifier[] =
+unsigned int allocate(const texture_desc& desc, unsigned int tex)
 {
-    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
-};
+    const header& h = desc.h;
 
-static const unsigned int swap32(const unsigned int u32)
-{
-    union
+    if (tex == 0)
     {
-        unsigned int u32;
-        unsigned char u8[4];
-    } a, b;
+        glGenTextures(1, &tex);
+    }
+
+    glBindTexture(desc.target, tex);
+
+    switch (desc.target)
+    {
+        case GL_TEXTURE_1D:
+            glTexStorage1D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth);
+            break;
+        case GL_TEXTURE_1D_ARRAY:
+            glTexStorage2D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth, h.arrayelements);
+            break;
+        case GL_TEXTURE_2D:
+        case GL_TEXTURE_CUBE_MAP:
+            glTexStorage2D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth, h.pixelheight);
+            break;
+        case GL_TEXTURE_3D:
+            glTexStorage3D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.pixeldepth);
+            break;
+        case GL_TEXTURE_2D_ARRAY:
+            glTexStorage3D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.arrayelements);
+            break;
+        case GL_TEXTURE_CUBE_MAP_ARRAY:
+            glTexStorage3D(desc.target, desc.storage_levels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.arrayelements * h.faces);
+            break;
+    }
+
+    return tex;
+}
+
+void upload_level(const texture_desc& desc, unsigned int level, const void * data)
+{
+    const header& h = desc.h;
+    const level_layout& l = desc.level[level];
+    const unsigned char * ptr = (const unsigned char *)data;
+    const bool compressed = (h.gltype == GL_NONE);
+    const GLenum target = desc.target;
+    unsigned int i;
+
+    // KTX rows are padded to four bytes, which matches GL's default unpack
+    // alignment. Big-endian files are swapped by GL as the data is consumed.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, (desc.swap && h.gltypesize > 1) ? GL_TRUE : GL_FALSE);
 
-    a.u32 = u32;
-    b.u8[0] = a.u8[3];
-    b.u8[1] = a.u8[2];
-    b.u8[2] = a.u8[1];
-    b.u8[3] = a.u8[0];
+    switch (target)
+    {
+        case GL_TEXTURE_1D:
+            if (compressed)
+                glCompressedTexSubImage1D(target, level, 0, l.width, h.glinternalformat, (GLsizei)l.size, ptr);
+            else
+                glTexSubImage1D(target, level, 0, l.width, h.glformat, h.gltype, ptr);
+            break;
+        case GL_TEXTURE_1D_ARRAY:
+            if (compressed)
+                glCompressedTexSubImage2D(target, level, 0, 0, l.width, l.layers, h.glinternalformat, (GLsizei)l.size, ptr);
+            else
+                glTexSubImage2D(target, level, 0, 0, l.width, l.layers, h.glformat, h.gltype, ptr);
+            break;
+        case GL_TEXTURE_2D:
+            if (compressed)
+                glCompressedTexSubImage2D(target, level, 0, 0, l.width, l.height, h.glinternalformat, (GLsizei)l.size, ptr);
+            else
+                glTexSubImage2D(target, level, 0, 0, l.width, l.height, h.glformat, h.gltype, ptr);
+            break;
+        case GL_TEXTURE_CUBE_MAP:
+            for (i = 0; i < l.layers; i++)
+            {
+                if (compressed)
+                    glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, l.width, l.height, h.glinternalformat, (GLsizei)l.face_size, ptr);
+                else
+                    glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, l.width, l.height, h.glformat, h.gltype, ptr);
+                ptr += l.face_stride;
+            }
+            break;
+        case GL_TEXTURE_3D:
+            if (compressed)
+                glCompressedTexSubImage3D(target, level, 0, 0, 0, l.width, l.height, l.depth, h.glinternalformat, (GLsizei)l.size, ptr);
+            else
+                glTexSubImage3D(target, level, 0, 0, 0, l.width, l.height, l.depth, h.glformat, h.gltype, ptr);
+            break;
+        case GL_TEXTURE_2D_ARRAY:
+        case GL_TEXTURE_CUBE_MAP_ARRAY:
+            if (compressed)
+                glCompressedTexSubImage3D(target, level, 0, 0, 0, l.width, l.height, l.layers, h.glinternalformat, (GLsizei)l.size, ptr);
+            else
+                glTexSubImage3D(target, level, 0, 0, 0, l.width, l.height, l.layers, h.glformat, h.gltype, ptr);
+            break;
+    }
 
-    return b.u32;
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
 }
 
-static const unsigned short swap16(const unsigned short u16)
+unsigned int level_parts(const texture_desc& desc, unsigned int level)
 {
-    union
+    const level_layout& l = desc.level[level];
+    unsigned int block_width, block_height, block_bytes;
+
+    switch (desc.target)
     {
-        unsigned short u16;
-        unsigned char u8[2];
-    } a, b;
+        case GL_TEXTURE_1D_ARRAY:
+            return desc.h.gltype == GL_NONE ? 1 : l.layers;
+        case GL_TEXTURE_2D:
+            if (desc.h.gltype != GL_NONE)
+                return l.height;
+            if (!block_info(desc.h.glinternalformat, block_width, block_height, block_bytes))
+                return 1;
+            return (l.height + block_height - 1) / block_height;
+        case GL_TEXTURE_3D:
+            return l.depth;
+        case GL_TEXTURE_CUBE_MAP:
+        case GL_TEXTURE_2D_ARRAY:
+        case GL_TEXTURE_CUBE_MAP_ARRAY:
+            return l.layers;
+        default:
+            return 1;
+    }
+}
+
+size_t part_size(const texture_desc& desc, unsigned int level)
+{
+    const level_layout& l = desc.level[level];
 
-    a.u16 = u16;
-    b.u8[0] = a.u8[1];
-    b.u8[1] = a.u8[0];
+    if (desc.target == GL_TEXTURE_CUBE_MAP)
+        return l.face_stride;
 
-    return b.u16;
+    return l.size / level_parts(desc, level);
 }
 
-static unsigned int calculate_stride(const header& h, unsigned int width, unsigned int pad = 4)
+void upload_level_parts(const texture_desc& desc,
+                        unsigned int level,
+                        unsigned int first,
+                        unsigned int count,
+                        const void * data)
 {
-    unsigned int channels = 0;
+    const header& h = desc.h;
+    const level_layout& l = desc.level[level];
+    const unsigned char * ptr = (const unsigned char *)data + first * part_size(desc, level);
+    const GLsizei size = (GLsizei)(count * part_size(desc, level));
+    const bool compressed = (h.gltype == GL_NONE);
+    const GLenum target = desc.target;
+    unsigned int block_width, block_height, block_bytes;
+    unsigned int i;
+
+    if (first == 0 && count == level_parts(desc, level))
+    {
+        upload_level(desc, level, data);
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, (desc.swap && h.gltypesize > 1) ? GL_TRUE : GL_FALSE);
 
-    switch (h.glbaseinternalformat)
+    switch (target)
     {
-        case GL_RED:    channels = 1;
+        case GL_TEXTURE_1D_ARRAY:
+            glTexSubImage2D(target, level, 0, first, l.width, count, h.glformat, h.gltype, ptr);
             break;
-        case GL_RG:     channels = 2;
+        case GL_TEXTURE_2D:
+            if (compressed)
+            {
+                // The last row of blocks may hang off the bottom of the level
+                block_info(h.glinternalformat, block_width, block_height, block_bytes);
+                const unsigned int y = first * block_height;
+                const unsigned int rows = (y + count * block_height < l.height) ? count * block_height : l.height - y;
+                glCompressedTexSubImage2D(target, level, 0, y, l.width, rows, h.glinternalformat, size, ptr);
+            }
+            else
+            {
+                glTexSubImage2D(target, level, 0, first, l.width, count, h.glformat, h.gltype, ptr);
+            }
             break;
-        case GL_BGR:
-        case GL_RGB:    channels = 3;
+        case GL_TEXTURE_CUBE_MAP:
+            for (i = first; i < first + count; i++)
+            {
+                if (compressed)
+                    glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, l.width, l.height, h.glinternalformat, (GLsizei)l.face_size, ptr);
+                else
+                    glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, l.width, l.height, h.glformat, h.gltype, ptr);
+                ptr += l.face_stride;
+            }
             break;
-        case GL_BGRA:
-        case GL_RGBA:   channels = 4;
+        case GL_TEXTURE_3D:
+        case GL_TEXTURE_2D_ARRAY:
+        case GL_TEXTURE_CUBE_MAP_ARRAY:
+            if (compressed)
+                glCompressedTexSubImage3D(target, level, 0, 0, first, l.width, l.height, count, h.glinternalformat, size, ptr);
+            else
+                glTexSubImage3D(target, level, 0, 0, first, l.width, l.height, count, h.glformat, h.gltype, ptr);
             break;
     }
 
-    unsigned int stride = h.gltypesize * channels * width;
+    glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+}
 
-    stride = (stride + (pad - 1)) & ~(pad - 1);
+extern
+unsigned int load(const char * filename, unsigned int tex)
+{
+    mapped_file file;
 
-    return stride;
+    if (!file.open(filename))
+        return 0;
+
+    // Image data is uploaded directly out of the mapping; nothing is copied
+    // into an intermediate buffer on the way to the driver.
+    return load_from_memory(file.data(), file.size(), tex);
 }
 
-static unsigned int calculate_face_size(const header& h)
+bool is_supported(unsigned int target, unsigned int internalformat)
 {
-    unsigned int stride = calculate_stride(h, h.pixelwidth);
+    GLint supported = GL_TRUE;
+
+    // Without ARB_internalformat_query2 there's nothing to ask, so assume
+    // the driver handles whatever it was given.
+    if (gl3wGetInternalformativ)
+    {
+        glGetInternalformativ(target, internalformat, GL_INTERNALFORMAT_SUPPORTED, 1, &supported);
+    }
 
-    return stride * h.pixelheight;
+    return supported == GL_TRUE;
 }
 
 extern
-unsigned int load(const char * filename, unsigned int tex)
+unsigned int load_from_memory(const void * ptr, size_t size, unsigned int tex)
 {
-    FILE * fp;
-    GLuint temp = 0;
-    GLuint retval = 0;
-    header h;
-    size_t data_start, data_end;
-    unsigned char * data;
-    GLenum target = GL_NONE;
-
-    fp = fopen(filename, "rb");
+    texture_desc desc;
 
-    if (!fp)
+    if (!parse(ptr, size, desc))
         return 0;
 
-    if (fread(&h, sizeof(h), 1, fp) != 1)
-        goto fail_read;
-
-    if (memcmp(h.identifier, identifier, sizeof(identifier)) != 0)
-        goto fail_header;
+    return load_parsed(desc, ptr, tex);
+}
 
-    if (h.endianness == 0x04030201)
+extern
+unsigned int load_parsed(const texture_desc& parsed, const void * ptr, unsigned int tex)
+{
+    const unsigned char * base = (const unsigned char *)ptr;
+    const unsigned char * data;
+    unsigned char * unpacked = nullptr;
+    unsigned char * decoded = nullptr;
+    GLuint buffer = 0;
+    texture_desc desc = parsed;
+    unsigned int level;
+
+    data = base + desc.data_offset;
+
+    // Fall back to decoding on the CPU if the driver can't take the data as is
+    if (can_transcode(desc.h.glinternalformat) &&
+        !is_supported(desc.target, desc.h.glinternalformat))
     {
-        // No swap needed
+        texture_desc compressed = desc;
+
+        if (desc.supercompression != supercompression_none)
+        {
+            unpacked = new unsigned char [desc.data_size];
+            if (!unpack(desc, ptr, unpacked))
+                goto fail;
+            data = unpacked;
+        }
+
+        decoded = transcode(compressed, data, desc);
+        if (!decoded)
+            goto fail;
+        data = decoded;
     }
-    else if (h.endianness == 0x01020304)
+    else if (desc.supercompression != supercompression_none)
     {
-        // Swap needed
-        h.endianness            = swap32(h.endianness);
-        h.gltype                = swap32(h.gltype);
-        h.gltypesize            = swap32(h.gltypesize);
-        h.glformat              = swap32(h.glformat);
-        h.glinternalformat      = swap32(h.glinternalformat);
-        h.glbaseinternalformat  = swap32(h.glbaseinternalformat);
-        h.pixelwidth            = swap32(h.pixelwidth);
-        h.pixelheight           = swap32(h.pixelheight);
-        h.pixeldepth            = swap32(h.pixeldepth);
-        h.arrayelements         = swap32(h.arrayelements);
-        h.faces                 = swap32(h.faces);
-        h.miplevels             = swap32(h.miplevels);
-        h.keypairbytes          = swap32(h.keypairbytes);
-    }
-    else
-    {
-        goto fail_header;
+        // Decompress straight into a pixel unpack buffer; data becomes an
+        // offset into it.
+        void * mapped;
+        bool ok;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, desc.data_size, nullptr, GL_STREAM_DRAW);
+        mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, desc.data_size,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        ok = mapped && unpack(desc, ptr, mapped);
+        if (mapped)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (!ok)
+            goto fail;
+        data = nullptr;
     }
 
-    // Guess target (texture type)
-    if (h.pixelheight == 0)
+    tex = allocate(desc, tex);
+
+    if (buffer)
     {
-        if (h.arrayelements == 0)
-        {
-            target = GL_TEXTURE_1D;
-        }
-        else
-        {
-            target = GL_TEXTURE_1D_ARRAY;
-        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
     }
-    else if (h.pixeldepth == 0)
+
+    for (level = 0; level < desc.levels; level++)
     {
-        if (h.arrayelements == 0)
-        {
-            if (h.faces == 0)
-            {
-                target = GL_TEXTURE_2D;
-            }
-            else
-            {
-                target = GL_TEXTURE_CUBE_MAP;
-            }
-        }
-        else
-        {
-            if (h.faces == 0)
-            {
-                target = GL_TEXTURE_2D_ARRAY;
-            }
-            else
-            {
-                target = GL_TEXTURE_CUBE_MAP_ARRAY;
-            }
-        }
+        const size_t offset = desc.level[level].offset - desc.data_offset;
+
+        upload_level(desc, level, buffer ? (const void *)offset : data + offset);
     }
-    else
+
+    if (buffer)
     {
-        target = GL_TEXTURE_3D;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
     }
 
-    // Check for insanity...
-    if (target == GL_NONE ||                                    // Couldn't figure out target
-        (h.pixelwidth == 0) ||                                  // Texture has no width???
-        (h.pixelheight == 0 && h.pixeldepth != 0))              // Texture has depth but no height???
+    delete [] decoded;
+    delete [] unpacked;
+
+    if (desc.generate_mips)
     {
-        goto fail_header;
+        glGenerateMipmap(desc.target);
     }
 
-    temp = tex;
-    if (tex == 0)
+    return tex;
+
+fail:
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+    delete [] decoded;
+    delete [] unpacked;
+
+    return 0;
+}
+
+// What glGetTexImage() hands back for a format when the driver can't be
+// asked (no ARB_internalformat_query2). Compressed formats only need their
+// base format, for the header.
+static const struct
+{
+    GLenum  internalformat;
+    GLenum  format;
+    GLenum  type;
+} image_formats[] =
+{
+    { GL_R8,                                    GL_RED,             GL_UNSIGNED_BYTE                    },
+    { GL_RG8,                                   GL_RG,              GL_UNSIGNED_BYTE                    },
+    { GL_RGB8,                                  GL_RGB,             GL_UNSIGNED_BYTE                    },
+    { GL_RGBA8,                                 GL_RGBA,            GL_UNSIGNED_BYTE                    },
+    { GL_SRGB8,                                 GL_RGB,             GL_UNSIGNED_BYTE                    },
+    { GL_SRGB8_ALPHA8,                          GL_RGBA,            GL_UNSIGNED_BYTE                    },
+    { GL_R16,                                   GL_RED,             GL_UNSIGNED_SHORT                   },
+    { GL_RG16,                                  GL_RG,              GL_UNSIGNED_SHORT                   },
+    { GL_RGBA16,                                GL_RGBA,            GL_UNSIGNED_SHORT                   },
+    { GL_R16F,                                  GL_RED,             GL_HALF_FLOAT                       },
+    { GL_RG16F,                                 GL_RG,              GL_HALF_FLOAT                       },
+    { GL_RGB16F,                                GL_RGB,             GL_HALF_FLOAT                       },
+    { GL_RGBA16F,                               GL_RGBA,            GL_HALF_FLOAT                       },
+    { GL_R32F,                                  GL_RED,             GL_FLOAT                            },
+    { GL_RG32F,                                 GL_RG,              GL_FLOAT                            },
+    { GL_RGB32F,                                GL_RGB,             GL_FLOAT                            },
+    { GL_RGBA32F,                               GL_RGBA,            GL_FLOAT                            },
+    { GL_R11F_G11F_B10F,                        GL_RGB,             GL_UNSIGNED_INT_10F_11F_11F_REV     },
+    { GL_RGB9_E5,                               GL_RGB,             GL_UNSIGNED_INT_5_9_9_9_REV         },
+    { GL_RGB10_A2,                              GL_RGBA,            GL_UNSIGNED_INT_2_10_10_10_REV      },
+    { GL_R8UI,                                  GL_RED_INTEGER,     GL_UNSIGNED_BYTE                    },
+    { GL_R32UI,                                 GL_RED_INTEGER,     GL_UNSIGNED_INT                     },
+    { GL_RGBA8UI,                               GL_RGBA_INTEGER,    GL_UNSIGNED_BYTE                    },
+    { GL_RGBA32UI,                              GL_RGBA_INTEGER,    GL_UNSIGNED_INT                     },
+    { GL_COMPRESSED_RED_RGTC1,                  GL_RED,             GL_NONE                             },
+    { GL_COMPRESSED_SIGNED_RED_RGTC1,           GL_RED,             GL_NONE                             },
+    { GL_COMPRESSED_RG_RGTC2,                   GL_RG,              GL_NONE                             },
+    { GL_COMPRESSED_SIGNED_RG_RGTC2,            GL_RG,              GL_NONE                             },
+    { GL_COMPRESSED_RGB_S3TC_DXT1_EXT,          GL_RGB,             GL_NONE                             },
+    { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,         GL_RGBA,            GL_NONE                             },
+    { GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,         GL_RGBA,            GL_NONE                             },
+    { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,         GL_RGBA,            GL_NONE                             },
+    { GL_COMPRESSED_RGBA_BPTC_UNORM,            GL_RGBA,            GL_NONE                             },
+    { GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,      GL_RGBA,            GL_NONE                             },
+    { GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,      GL_RGB,             GL_NONE                             },
+    { GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,    GL_RGB,             GL_NONE                             },
+    { GL_COMPRESSED_RGB8_ETC2,                  GL_RGB,             GL_NONE                             },
+    { GL_COMPRESSED_RGBA8_ETC2_EAC,             GL_RGBA,            GL_NONE                             }
+};
+
+static bool find_image_format(GLenum internalformat, GLint& format, GLint& type)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(image_formats) / sizeof(image_formats[0]); i++)
     {
-        glGenTextures(1, &tex);
+        if (image_formats[i].internalformat == internalformat)
+        {
+            format = image_formats[i].format;
+            type = image_formats[i].type;
+            return true;
+        }
     }
 
+    return false;
+}
+
+bool describe(unsigned int target, unsigned int tex, texture_desc& desc)
+{
+    // Cube maps have to be queried one face at a time
+    const GLenum query_target = (target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+    GLint width = 0, height = 0, depth = 0;
+    GLint internalformat = 0;
+    GLint compressed = GL_FALSE;
+    GLint immutable = GL_FALSE;
+    GLint levels = 0;
+    GLint format = GL_NONE;
+    GLint type = GL_NONE;
+    header& h = desc.h;
+
+    memset(&desc, 0, sizeof(desc));
+
     glBindTexture(target, tex);
 
-    data_start = ftell(fp) + h.keypairbytes;
-    fseek(fp, 0, SEEK_END);
-    data_end = ftell(fp);
-    fseek(fp, data_start, SEEK_SET);
+    glGetTexLevelParameteriv(query_target, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(query_target, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(query_target, 0, GL_TEXTURE_DEPTH, &depth);
+    glGetTexLevelParameteriv(query_target, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalformat);
+    glGetTexLevelParameteriv(query_target, 0, GL_TEXTURE_COMPRESSED, &compressed);
 
-    data = new unsigned char [data_end - data_start];
-    memset(data, 0, data_end - data_start);
+    if (width == 0)
+        return false;
 
-    fread(data, 1, data_end - data_start, fp);
+    glGetTexParameteriv(target, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
 
-    if (h.miplevels == 0)
+    if (immutable)
     {
-        h.miplevels = 1;
+        glGetTexParameteriv(target, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
     }
+    else
+    {
+        GLint w = width;
+
+        while (w != 0 && levels < max_levels)
+        {
+            levels++;
+            w = 0;
+            glGetTexLevelParameteriv(query_target, levels, GL_TEXTURE_WIDTH, &w);
+        }
+    }
+
+    // Ask the driver what it would hand back for this format, if it can be
+    // asked. Otherwise only formats we know can be saved.
+    if (gl3wGetInternalformativ)
+    {
+        glGetInternalformativ(target, internalformat, GL_GET_TEXTURE_IMAGE_FORMAT, 1, &format);
+        glGetInternalformativ(target, internalformat, GL_GET_TEXTURE_IMAGE_TYPE, 1, &type);
+    }
+    else if (!find_image_format(internalformat, format, type))
+    {
+        return false;
+    }
+
+    if (compressed)
+    {
+        init_header(h, internalformat, GL_NONE, GL_NONE);
+        h.glbaseinternalformat = format;
+    }
+    else
+    {
+        init_header(h, internalformat, format, type);
+    }
+
+    h.pixelwidth = width;
+    h.miplevels = levels;
 
     switch (target)
     {
         case GL_TEXTURE_1D:
-            glTexStorage1D(GL_TEXTURE_1D, h.miplevels, h.glinternalformat, h.pixelwidth);
-            glTexSubImage1D(GL_TEXTURE_1D, 0, 0, h.pixelwidth, h.glformat, h.glinternalformat, data);
+            break;
+        case GL_TEXTURE_1D_ARRAY:
+            h.arrayelements = height;
             break;
         case GL_TEXTURE_2D:
-            // glTexImage2D(GL_TEXTURE_2D, 0, h.glinternalformat, h.pixelwidth, h.pixelheight, 0, h.glformat, h.gltype, data);
-            if (h.gltype == GL_NONE)
-            {
-                glCompressedTexImage2D(GL_TEXTURE_2D, 0, h.glinternalformat, h.pixelwidth, h.pixelheight, 0, 420 * 380 / 2, data);
-            }
-            else
-            {
-                glTexStorage2D(GL_TEXTURE_2D, h.miplevels, h.glinternalformat, h.pixelwidth, h.pixelheight);
-                {
-                    unsigned char * ptr = data;
-                    unsigned int height = h.pixelheight;
-                    unsigned int width = h.pixelwidth;
-                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                    for (unsigned int i = 0; i < h.miplevels; i++)
-                    {
-                        glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, h.glformat, h.gltype, ptr);
-                        ptr += height * calculate_stride(h, width, 1);
-                        height >>= 1;
-                        width >>= 1;
-                        if (!height)
-                            height = 1;
-                        if (!width)
-                            width = 1;
-                    }
-                }
-            }
+            h.pixelheight = height;
             break;
-        case GL_TEXTURE_3D:
-            glTexStorage3D(GL_TEXTURE_3D, h.miplevels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.pixeldepth);
-            glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, h.pixelwidth, h.pixelheight, h.pixeldepth, h.glformat, h.gltype, data);
+        case GL_TEXTURE_CUBE_MAP:
+            h.pixelheight = height;
+            h.faces = 6;
             break;
-        case GL_TEXTURE_1D_ARRAY:
-            glTexStorage2D(GL_TEXTURE_1D_ARRAY, h.miplevels, h.glinternalformat, h.pixelwidth, h.arrayelements);
-            glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, 0, h.pixelwidth, h.arrayelements, h.glformat, h.gltype, data);
+        case GL_TEXTURE_3D:
+            h.pixelheight = height;
+            h.pixeldepth = depth;
             break;
         case GL_TEXTURE_2D_ARRAY:
-            glTexStorage3D(GL_TEXTURE_2D_ARRAY, h.miplevels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.arrayelements);
-            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, h.pixelwidth, h.pixelheight, h.arrayelements, h.glformat, h.gltype, data);
-            break;
-        case GL_TEXTURE_CUBE_MAP:
-            glTexStorage2D(GL_TEXTURE_CUBE_MAP, h.miplevels, h.glinternalformat, h.pixelwidth, h.pixelheight);
-            // glTexSubImage3D(GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, h.pixelwidth, h.pixelheight, h.faces, h.glformat, h.gltype, data);
-            {
-                unsigned int face_size = calculate_face_size(h);
-                for (unsigned int i = 0; i < h.faces; i++)
-                {
-                    glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, h.pixelwidth, h.pixelheight, h.glformat, h.gltype, data + face_size * i);
-                }
-            }
+            h.pixelheight = height;
+            h.arrayelements = depth;
             break;
         case GL_TEXTURE_CUBE_MAP_ARRAY:
-            glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, h.miplevels, h.glinternalformat, h.pixelwidth, h.pixelheight, h.arrayelements);
-            glTexSubImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0, h.pixelwidth, h.pixelheight, h.faces * h.arrayelements, h.glformat, h.gltype, data);
+            h.pixelheight = height;
+            h.arrayelements = depth / 6;
+            h.faces = 6;
             break;
-        default:                                               // Should never happen
-            goto fail_target;
+        default:
+            return false;
     }
 
-    if (h.miplevels == 1)
-    {
-        glGenerateMipmap(target);
-    }
+    return layout(desc) && desc.target == target;
+}
 
-    retval = tex;
+void download_levels(const texture_desc& desc, unsigned int tex, void * data)
+{
+    const header& h = desc.h;
+    const bool compressed = (h.gltype == GL_NONE);
+    unsigned int level;
+    unsigned int i;
 
-fail_target:
-    delete [] data;
+    glBindTexture(desc.target, tex);
+
+    // Same row padding as the file
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
-fail_header:;
-fail_read:;
-    fclose(fp);
+    for (level = 0; level < desc.levels; level++)
+    {
+        const level_layout& l = desc.level[level];
+        // data may be an offset into a bound pack buffer rather than a real
+        // pointer, so offsets are added as integers
+        size_t ptr = (size_t)data + (l.offset - desc.data_offset);
 
-    return retval;
+        if (desc.target == GL_TEXTURE_CUBE_MAP)
+        {
+            for (i = 0; i < l.layers; i++)
+            {
+                if (compressed)
+                    glGetCompressedTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, (void *)ptr);
+                else
+                    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, h.glformat, h.gltype, (void *)ptr);
+                ptr += l.face_stride;
+            }
+        }
+        else
+        {
+            if (compressed)
+                glGetCompressedTexImage(desc.target, level, (void *)ptr);
+            else
+                glGetTexImage(desc.target, level, h.glformat, h.gltype, (void *)ptr);
+        }
+    }
 }
 
 bool save(const char * filename, unsigned int target, unsigned int tex)
 {
-    header h;
+    texture_desc desc;
+    unsigned char * data;
+    bool result;
 
-    memset(&h, 0, sizeof(h));
-    memcpy(h.identifier, identifier, sizeof(identifier));
-    h.endianness = 0x04030201;
+    if (!describe(target, tex, desc))
+        return false;
 
-    glBindTexture(target, tex);
+    data = new unsigned char [desc.data_size];
 
-    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, (GLint *)&h.pixelwidth);
-    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, (GLint *)&h.pixelheight);
-    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, (GLint *)&h.pixeldepth);
+    // This stalls until the GPU has finished with the texture. Use
+    // ktx::streamer::save to capture without waiting.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    download_levels(desc, tex, data);
+
+    result = write(filename, desc, data);
+
+    delete [] data;
 
-    return true;
+    return result;
 }
 
 }
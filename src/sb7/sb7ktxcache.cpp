@@ -0,0 +1,298 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GL/gl3w.h"
+#include <sb7ktx.h>
+#include <sb7ktxcache.h>
+#include <sb7mappedfile.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+cache::cache()
+    : budget(0),
+      total_bytes(0)
+{
+
+}
+
+cache::~cache()
+{
+    // Deliberately doesn't touch GL; the context may already be gone.
+    // Call clear() at shutdown to free the textures.
+    while (!by_texture.empty())
+    {
+        delete by_texture.begin()->second;
+        by_texture.erase(by_texture.begin());
+    }
+}
+
+GLuint cache::acquire(const char * filename)
+{
+    struct stat st;
+    std::unordered_map<std::string, path_entry>::iterator p;
+    std::pair<std::unordered_multimap<hash_t, entry *>::iterator,
+              std::unordered_multimap<hash_t, entry *>::iterator> range;
+    file::texture_desc desc;
+    mapped_file file;
+    path_entry pe;
+    entry * e;
+    hash_t content_hash;
+
+    if (stat(filename, &st) != 0)
+        return 0;
+
+    p = by_path.find(filename);
+
+    if (p != by_path.end() &&
+        p->second.mtime == (long long)st.st_mtime &&
+        p->second.file_size == (long long)st.st_size)
+    {
+        e = p->second.e;
+        goto found;
+    }
+
+    // Either we've never seen this path or the file has changed since
+    if (!file.open(filename))
+        return 0;
+
+    content_hash = hash(file.data(), file.size());
+    range = by_hash.equal_range(content_hash);
+    e = nullptr;
+
+    for (; range.first != range.second; ++range.first)
+    {
+        if (same_contents(range.first->second, file))
+        {
+            e = range.first->second;
+            break;
+        }
+    }
+
+    if (!e)
+    {
+        if (!file::parse(file.data(), file.size(), desc))
+            return 0;
+
+        e = new entry;
+        e->content_hash = content_hash;
+        e->file_size = file.size();
+        e->refs = 0;
+        e->in_lru = false;
+        e->texture = file::load_parsed(desc, file.data());
+        e->bytes = desc.data_size;
+        if (desc.generate_mips)
+            e->bytes += e->bytes / 3;
+
+        if (e->texture == 0)
+        {
+            delete e;
+            return 0;
+        }
+
+        by_hash.insert(std::make_pair(content_hash, e));
+        by_texture[e->texture] = e;
+        total_bytes += e->bytes;
+    }
+
+    // Same contents as before (the file was just touched), or a new path for
+    // contents we already have
+    if (p != by_path.end() && p->second.e == e)
+    {
+        p->second.mtime = (long long)st.st_mtime;
+        p->second.file_size = (long long)st.st_size;
+        goto found;
+    }
+
+    forget_path(filename);
+
+    pe.e = e;
+    pe.mtime = (long long)st.st_mtime;
+    pe.file_size = (long long)st.st_size;
+    by_path[filename] = pe;
+    e->paths.push_back(filename);
+
+found:
+    if (e->refs++ == 0 && e->in_lru)
+    {
+        unused.erase(e->lru_position);
+        e->in_lru = false;
+    }
+
+    evict(budget);
+
+    return e->texture;
+}
+
+void cache::release(GLuint texture)
+{
+    std::unordered_map<GLuint, entry *>::iterator t = by_texture.find(texture);
+    entry * e;
+
+    if (t == by_texture.end())
+        return;
+
+    e = t->second;
+
+    if (e->refs == 0 || --e->refs != 0)
+        return;
+
+    // Nothing on disk refers to it any more, so it can never be hit again
+    if (e->paths.empty())
+    {
+        destroy(e);
+        return;
+    }
+
+    e->lru_position = unused.insert(unused.end(), e);
+    e->in_lru = true;
+
+    evict(budget);
+}
+
+void cache::set_budget(size_t bytes)
+{
+    budget = bytes;
+    evict(budget);
+}
+
+void cache::clear()
+{
+    while (!by_texture.empty())
+    {
+        destroy(by_texture.begin()->second);
+    }
+
+    by_path.clear();
+    unused.clear();
+}
+
+// The hash only says two files might be the same. Compare against a path
+// the entry was loaded from that still looks the way it did then; if none
+// does, there's nothing left to compare with and it isn't shared.
+bool cache::same_contents(const entry * e, const mapped_file& file) const
+{
+    std::unordered_map<std::string, path_entry>::const_iterator p;
+    mapped_file other;
+    struct stat st;
+    size_t i;
+
+    if (e->file_size != file.size())
+        return false;
+
+    for (i = 0; i < e->paths.size(); i++)
+    {
+        p = by_path.find(e->paths[i]);
+
+        if (p == by_path.end() ||
+            stat(e->paths[i].c_str(), &st) != 0 ||
+            p->second.mtime != (long long)st.st_mtime ||
+            p->second.file_size != (long long)st.st_size)
+        {
+            continue;
+        }
+
+        if (!other.open(e->paths[i].c_str()))
+            continue;
+
+        return other.size() == file.size() &&
+               memcmp(other.data(), file.data(), file.size()) == 0;
+    }
+
+    return false;
+}
+
+void cache::forget_path(const std::string& path)
+{
+    std::unordered_map<std::string, path_entry>::iterator p = by_path.find(path);
+    entry * e;
+
+    if (p == by_path.end())
+        return;
+
+    e = p->second.e;
+    by_path.erase(p);
+    e->paths.erase(std::find(e->paths.begin(), e->paths.end(), path));
+
+    if (e->paths.empty() && e->refs == 0)
+    {
+        destroy(e);
+    }
+}
+
+void cache::evict(size_t limit)
+{
+    if (limit == 0)
+        return;
+
+    while (total_bytes > limit && !unused.empty())
+    {
+        destroy(unused.front());
+    }
+}
+
+void cache::destroy(entry * e)
+{
+    std::pair<std::unordered_multimap<hash_t, entry *>::iterator,
+              std::unordered_multimap<hash_t, entry *>::iterator> range;
+    size_t i;
+
+    for (i = 0; i < e->paths.size(); i++)
+    {
+        by_path.erase(e->paths[i]);
+    }
+
+    if (e->in_lru)
+    {
+        unused.erase(e->lru_position);
+    }
+
+    range = by_hash.equal_range(e->content_hash);
+    for (; range.first != range.second; ++range.first)
+    {
+        if (range.first->second == e)
+        {
+            by_hash.erase(range.first);
+            break;
+        }
+    }
+
+    by_texture.erase(e->texture);
+    total_bytes -= e->bytes;
+
+    glDeleteTextures(1, &e->texture);
+
+    delete e;
+}
+
+}
+
+}
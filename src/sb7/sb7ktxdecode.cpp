@@ -0,0 +1,361 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sb7ktx.h"
+
+#include <cstring>
+
+// Only the enumerant values are needed here; decoding never calls GL.
+#include "GL/glcorearb.h"
+#include "GL/glext.h"
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+namespace file
+{
+
+// Formats we know how to decode, along with what they decode to
+static const struct
+{
+    unsigned int    compressed;
+    unsigned int    internalformat;
+    unsigned int    type;
+} transcode_table[] =
+{
+    { GL_COMPRESSED_RED_RGTC1,                  GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SIGNED_RED_RGTC1,           GL_RGBA8_SNORM,     GL_BYTE             },
+    { GL_COMPRESSED_RG_RGTC2,                   GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SIGNED_RG_RGTC2,            GL_RGBA8_SNORM,     GL_BYTE             },
+    { GL_COMPRESSED_RGB_S3TC_DXT1_EXT,          GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,         GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,         GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,         GL_RGBA8,           GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,         GL_SRGB8_ALPHA8,    GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,   GL_SRGB8_ALPHA8,    GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT,   GL_SRGB8_ALPHA8,    GL_UNSIGNED_BYTE    },
+    { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,   GL_SRGB8_ALPHA8,    GL_UNSIGNED_BYTE    }
+};
+
+static const unsigned int num_transcode_formats = sizeof(transcode_table) / sizeof(transcode_table[0]);
+
+// Division rounding to nearest, halves away from zero, for the signed
+// formats as well as the unsigned ones
+static inline int divide_rounded(int n, int d)
+{
+    return n >= 0 ? (n + d / 2) / d : -((d / 2 - n) / d);
+}
+
+// BC4 / RGTC1 single channel block. Eight bytes: two endpoints followed by
+// sixteen 3 bit indices. Works for both the signed and unsigned variants,
+// since the interpolation only depends on which endpoint is larger.
+template <typename T>
+static void decode_bc4(const unsigned char * block, T * dst, unsigned int dst_stride)
+{
+    T palette[8];
+    const int a0 = (T)block[0];
+    const int a1 = (T)block[1];
+    unsigned long long bits = 0;
+    int i;
+
+    palette[0] = (T)a0;
+    palette[1] = (T)a1;
+
+    if (a0 > a1)
+    {
+        for (i = 1; i < 7; i++)
+            palette[i + 1] = (T)divide_rounded((7 - i) * a0 + i * a1, 7);
+    }
+    else
+    {
+        const int lo = (T)-1 < 0 ? -127 : 0;
+        const int hi = (T)-1 < 0 ? 127 : 255;
+
+        for (i = 1; i < 5; i++)
+            palette[i + 1] = (T)divide_rounded((5 - i) * a0 + i * a1, 5);
+        palette[6] = (T)lo;
+        palette[7] = (T)hi;
+    }
+
+    for (i = 0; i < 6; i++)
+        bits |= (unsigned long long)block[2 + i] << (8 * i);
+
+    for (i = 0; i < 16; i++)
+    {
+        dst[i * dst_stride] = palette[bits & 7];
+        bits >>= 3;
+    }
+}
+
+static inline void expand_565(unsigned int c, int rgb[3])
+{
+    const int r = (c >> 11) & 0x1F;
+    const int g = (c >> 5) & 0x3F;
+    const int b = c & 0x1F;
+
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 colour block. Eight bytes: two 565 endpoints and sixteen 2 bit
+// indices. DXT3/5 always use the four colour mode; DXT1 switches to three
+// colours plus transparent black when c0 <= c1.
+static void decode_bc1(const unsigned char * block, unsigned char * dst, bool four_colors, bool punchthrough)
+{
+    unsigned char palette[4][4];
+    const unsigned int c0 = block[0] | (block[1] << 8);
+    const unsigned int c1 = block[2] | (block[3] << 8);
+    unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+    int e0[3], e1[3];
+    int i;
+
+    expand_565(c0, e0);
+    expand_565(c1, e1);
+
+    for (i = 0; i < 3; i++)
+    {
+        palette[0][i] = (unsigned char)e0[i];
+        palette[1][i] = (unsigned char)e1[i];
+
+        if (four_colors || c0 > c1)
+        {
+            palette[2][i] = (unsigned char)((2 * e0[i] + e1[i]) / 3);
+            palette[3][i] = (unsigned char)((e0[i] + 2 * e1[i]) / 3);
+        }
+        else
+        {
+            palette[2][i] = (unsigned char)((e0[i] + e1[i]) / 2);
+            palette[3][i] = 0;
+        }
+    }
+
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+    if (!four_colors && c0 <= c1 && punchthrough)
+        palette[3][3] = 0;
+
+    for (i = 0; i < 16; i++)
+    {
+        memcpy(dst + i * 4, palette[bits & 3], 4);
+        bits >>= 2;
+    }
+}
+
+// Decode one 4x4 block into a tightly packed 4x4 RGBA8 tile
+static void decode_block(unsigned int format, const unsigned char * block, unsigned char * tile)
+{
+    int i;
+
+    switch (format)
+    {
+        case GL_COMPRESSED_RED_RGTC1:
+            decode_bc4<unsigned char>(block, tile, 4);
+            for (i = 0; i < 16; i++)
+            {
+                tile[i * 4 + 1] = tile[i * 4 + 2] = 0;
+                tile[i * 4 + 3] = 255;
+            }
+            break;
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            decode_bc4<signed char>(block, (signed char *)tile, 4);
+            for (i = 0; i < 16; i++)
+            {
+                tile[i * 4 + 1] = tile[i * 4 + 2] = 0;
+                tile[i * 4 + 3] = 127;
+            }
+            break;
+        case GL_COMPRESSED_RG_RGTC2:
+            decode_bc4<unsigned char>(block, tile, 4);
+            decode_bc4<unsigned char>(block + 8, tile + 1, 4);
+            for (i = 0; i < 16; i++)
+            {
+                tile[i * 4 + 2] = 0;
+                tile[i * 4 + 3] = 255;
+            }
+            break;
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            decode_bc4<signed char>(block, (signed char *)tile, 4);
+            decode_bc4<signed char>(block + 8, (signed char *)tile + 1, 4);
+            for (i = 0; i < 16; i++)
+            {
+                tile[i * 4 + 2] = 0;
+                tile[i * 4 + 3] = 127;
+            }
+            break;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+            decode_bc1(block, tile, false, false);
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            decode_bc1(block, tile, false, true);
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            decode_bc1(block + 8, tile, true, false);
+            for (i = 0; i < 16; i++)
+            {
+                const int a = (block[i >> 1] >> ((i & 1) * 4)) & 0xF;
+                tile[i * 4 + 3] = (unsigned char)(a | (a << 4));
+            }
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            decode_bc1(block + 8, tile, true, false);
+            decode_bc4<unsigned char>(block, tile + 3, 4);
+            break;
+    }
+}
+
+bool can_transcode(unsigned int internalformat)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_transcode_formats; i++)
+    {
+        if (transcode_table[i].compressed == internalformat)
+            return true;
+    }
+
+    return false;
+}
+
+const unsigned int * transcode_formats(unsigned int& count)
+{
+    static unsigned int formats[num_transcode_formats];
+    unsigned int i;
+
+    for (i = 0; i < num_transcode_formats; i++)
+    {
+        formats[i] = transcode_table[i].compressed;
+    }
+
+    count = num_transcode_formats;
+
+    return formats;
+}
+
+void decompress(unsigned int internalformat,
+                const void * src,
+                unsigned int width,
+                unsigned int height,
+                unsigned int slices,
+                void * dst)
+{
+    const unsigned int block_bytes = (internalformat == GL_COMPRESSED_RG_RGTC2 ||
+                                      internalformat == GL_COMPRESSED_SIGNED_RG_RGTC2 ||
+                                      internalformat == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT ||
+                                      internalformat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+                                      internalformat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT ||
+                                      internalformat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT) ? 16 : 8;
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const int block_rows = blocks_y * slices;
+    const size_t row_pitch = (size_t)width * 4;
+    const size_t slice_pitch = row_pitch * height;
+    int row;
+
+    // Every row of blocks is independent, so spread them across cores
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < block_rows; row++)
+    {
+        const unsigned int slice = row / blocks_y;
+        const unsigned int by = row % blocks_y;
+        const unsigned char * block = (const unsigned char *)src + (size_t)row * blocks_x * block_bytes;
+        unsigned char * out = (unsigned char *)dst + slice * slice_pitch + by * 4 * row_pitch;
+        unsigned char tile[16 * 4];
+        int bx;
+
+        for (bx = 0; bx < blocks_x; bx++)
+        {
+            const unsigned int x0 = bx * 4;
+            const unsigned int w = (width - x0) < 4 ? (width - x0) : 4;
+            const unsigned int h = (height - by * 4) < 4 ? (height - by * 4) : 4;
+            unsigned int y;
+
+            decode_block(internalformat, block, tile);
+
+            // Blocks on the right and bottom edges hang off the image
+            for (y = 0; y < h; y++)
+            {
+                memcpy(out + y * row_pitch + x0 * 4, tile + y * 16, w * 4);
+            }
+
+            block += block_bytes;
+        }
+    }
+}
+
+unsigned char * transcode(const texture_desc& desc, const void * src_data, texture_desc& out)
+{
+    const unsigned char * base = (const unsigned char *)src_data;
+    unsigned char * data;
+    unsigned int level;
+    unsigned int i;
+
+    for (i = 0; i < num_transcode_formats; i++)
+    {
+        if (transcode_table[i].compressed == desc.h.glinternalformat)
+            break;
+    }
+
+    if (i == num_transcode_formats || desc.h.gltype != GL_NONE)
+        return nullptr;
+
+    out = desc;
+    out.h.glinternalformat = transcode_table[i].internalformat;
+    out.h.glbaseinternalformat = GL_RGBA;
+    out.h.glformat = GL_RGBA;
+    out.h.gltype = transcode_table[i].type;
+    out.h.gltypesize = 1;
+    out.swap = false;
+    out.supercompression = supercompression_none;
+
+    if (!layout(out))
+        return nullptr;
+
+    data = new unsigned char [out.data_size];
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        const level_layout& src = desc.level[level];
+        const level_layout& dst = out.level[level];
+
+        decompress(desc.h.glinternalformat,
+                   base + (src.offset - desc.data_offset),
+                   src.width, src.height, src.depth * src.layers,
+                   data + (dst.offset - out.data_offset));
+    }
+
+    return data;
+}
+
+}
+
+}
+
+}
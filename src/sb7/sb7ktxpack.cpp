@@ -0,0 +1,403 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sb7ktx.h"
+
+#include <cstring>
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+namespace file
+{
+
+// LZ4 block format. Each sequence is a token (literal length in the top
+// nibble, match length - 4 in the bottom), any extra length bytes, the
+// literals, a 16 bit offset and any extra match length bytes. The last
+// sequence is literals only.
+enum
+{
+    min_match       = 4,
+    last_literals   = 5,        // The last five bytes are always literals
+    match_limit     = 12,       // No match may start closer than this to the end
+    hash_bits       = 16,
+    max_offset      = 65535
+};
+
+static inline unsigned int read32(const unsigned char * ptr)
+{
+    unsigned int v;
+
+    memcpy(&v, ptr, sizeof(v));
+
+    return v;
+}
+
+static inline bool put_length(unsigned char *& op, const unsigned char * end, size_t length)
+{
+    while (length >= 255)
+    {
+        if (op == end)
+            return false;
+        *op++ = 255;
+        length -= 255;
+    }
+
+    if (op == end)
+        return false;
+    *op++ = (unsigned char)length;
+
+    return true;
+}
+
+static bool put_sequence(unsigned char *& op,
+                         const unsigned char * end,
+                         const unsigned char * literals,
+                         size_t num_literals,
+                         size_t offset,
+                         size_t match_length)
+{
+    const size_t lit_code = num_literals < 15 ? num_literals : 15;
+    const size_t match_code = match_length == 0 ? 0 : ((match_length - min_match) < 15 ? (match_length - min_match) : 15);
+
+    if (op == end)
+        return false;
+    *op++ = (unsigned char)((lit_code << 4) | match_code);
+
+    if (lit_code == 15 && !put_length(op, end, num_literals - 15))
+        return false;
+
+    if ((size_t)(end - op) < num_literals)
+        return false;
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    // The final sequence has no match
+    if (match_length == 0)
+        return true;
+
+    if (end - op < 2)
+        return false;
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+
+    if (match_code == 15 && !put_length(op, end, match_length - min_match - 15))
+        return false;
+
+    return true;
+}
+
+// Greedy single-probe compressor. Returns the compressed size, or zero if
+// the result wouldn't fit in capacity bytes.
+static size_t lz4_compress(const unsigned char * src, size_t size, unsigned char * dst, size_t capacity)
+{
+    std::vector<unsigned int> table(1 << hash_bits, 0);
+    unsigned char * op = dst;
+    const unsigned char * end = dst + capacity;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    if (size > match_limit)
+    {
+        const size_t limit = size - match_limit;
+        const size_t match_end = size - last_literals;
+
+        while (ip < limit)
+        {
+            const unsigned int seq = read32(src + ip);
+            const unsigned int h = (seq * 2654435761u) >> (32 - hash_bits);
+            const size_t ref = table[h];
+            size_t length;
+
+            // Positions are stored plus one so that zero means empty
+            table[h] = (unsigned int)(ip + 1);
+
+            if (ref == 0 || ip - (ref - 1) > max_offset || read32(src + ref - 1) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            length = min_match;
+            while (ip + length < match_end && src[ref - 1 + length] == src[ip + length])
+                length++;
+
+            if (!put_sequence(op, end, src + anchor, ip - anchor, ip - (ref - 1), length))
+                return 0;
+
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!put_sequence(op, end, src + anchor, size - anchor, 0, 0))
+        return 0;
+
+    return op - dst;
+}
+
+static inline bool get_length(const unsigned char *& ip, const unsigned char * end, size_t& length)
+{
+    unsigned char b;
+
+    do
+    {
+        if (ip == end)
+            return false;
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+// Every read and write is bounds checked; corrupt input fails rather than
+// running off either buffer. The output must be filled exactly.
+static bool lz4_decompress(const unsigned char * src, size_t src_size, unsigned char * dst, size_t dst_size)
+{
+    const unsigned char * ip = src;
+    const unsigned char * ip_end = src + src_size;
+    unsigned char * op = dst;
+    unsigned char * op_end = dst + dst_size;
+
+    for (;;)
+    {
+        unsigned int token;
+        size_t length;
+        size_t offset;
+        const unsigned char * match;
+
+        if (ip == ip_end)
+            return false;
+        token = *ip++;
+
+        length = token >> 4;
+        if (length == 15 && !get_length(ip, ip_end, length))
+            return false;
+
+        if (length > (size_t)(ip_end - ip) || length > (size_t)(op_end - op))
+            return false;
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        if (ip == ip_end)
+            return op == op_end;
+
+        if (ip_end - ip < 2)
+            return false;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return false;
+
+        length = token & 15;
+        if (length == 15 && !get_length(ip, ip_end, length))
+            return false;
+        length += min_match;
+
+        if (length > (size_t)(op_end - op))
+            return false;
+
+        match = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else
+        {
+            // Overlapping copies repeat the last offset bytes
+            while (length--)
+                *op++ = *match++;
+        }
+    }
+}
+
+struct chunk
+{
+    const unsigned char *   src;
+    size_t                  packed_size;
+    unsigned char *         dst;
+    size_t                  size;
+};
+
+static unsigned int read_u32(const texture_desc& desc, const unsigned char * ptr)
+{
+    unsigned int v = read32(ptr);
+
+    if (desc.swap)
+        v = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+
+    return v;
+}
+
+// Find every chunk of a level. parse() has already checked the table, so
+// this just follows it.
+static void collect_chunks(const texture_desc& desc,
+                           const unsigned char * base,
+                           unsigned int level,
+                           unsigned char * dst,
+                           std::vector<chunk>& chunks)
+{
+    const level_layout& l = desc.level[level];
+    const unsigned char * table = base + l.packed_offset;
+    const size_t chunk_size = read_u32(desc, table);
+    const unsigned int num_chunks = read_u32(desc, table + 4);
+    const unsigned char * src = table + 8 + num_chunks * 4;
+    unsigned int i;
+
+    for (i = 0; i < num_chunks; i++)
+    {
+        chunk c;
+
+        c.src = src;
+        c.packed_size = read_u32(desc, table + 8 + i * 4);
+        c.dst = dst + i * chunk_size;
+        c.size = (l.size - i * chunk_size) < chunk_size ? (l.size - i * chunk_size) : chunk_size;
+        chunks.push_back(c);
+
+        src += c.packed_size;
+    }
+}
+
+static bool unpack_chunks(const std::vector<chunk>& chunks)
+{
+    const int num_chunks = (int)chunks.size();
+    int failed = 0;
+    int i;
+
+#pragma omp parallel for schedule(dynamic) reduction(|:failed)
+    for (i = 0; i < num_chunks; i++)
+    {
+        const chunk& c = chunks[i];
+
+        if (c.packed_size == c.size)
+            memcpy(c.dst, c.src, c.size);
+        else if (!lz4_decompress(c.src, c.packed_size, c.dst, c.size))
+            failed |= 1;
+    }
+
+    return failed == 0;
+}
+
+bool unpack_level(const texture_desc& desc, const void * file_data, unsigned int level, void * dst)
+{
+    const unsigned char * base = (const unsigned char *)file_data;
+    std::vector<chunk> chunks;
+
+    if (desc.supercompression == supercompression_none)
+    {
+        memcpy(dst, base + desc.level[level].offset, desc.level[level].size);
+        return true;
+    }
+
+    collect_chunks(desc, base, level, (unsigned char *)dst, chunks);
+
+    return unpack_chunks(chunks);
+}
+
+bool unpack(const texture_desc& desc, const void * file_data, void * data)
+{
+    const unsigned char * base = (const unsigned char *)file_data;
+    unsigned char * dst = (unsigned char *)data;
+    std::vector<chunk> chunks;
+    unsigned int level;
+
+    if (desc.supercompression == supercompression_none)
+    {
+        for (level = 0; level < desc.levels; level++)
+        {
+            memcpy(dst + (desc.level[level].offset - desc.data_offset), base + desc.level[level].offset, desc.level[level].size);
+        }
+
+        return true;
+    }
+
+    // Gather the chunks of every level first so that the small levels at
+    // the end of the chain don't each get a parallel section of their own.
+    for (level = 0; level < desc.levels; level++)
+    {
+        collect_chunks(desc, base, level, dst + (desc.level[level].offset - desc.data_offset), chunks);
+    }
+
+    return unpack_chunks(chunks);
+}
+
+void pack_level(const texture_desc& desc,
+                unsigned int level,
+                const void * src,
+                std::vector<unsigned char>& packed)
+{
+    const level_layout& l = desc.level[level];
+    const unsigned char * data = (const unsigned char *)src;
+    const int num_chunks = (int)((l.size + pack_chunk_size - 1) / pack_chunk_size);
+    std::vector<std::vector<unsigned char> > chunks(num_chunks);
+    unsigned int header[2];
+    int i;
+
+#pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < num_chunks; i++)
+    {
+        const size_t offset = i * pack_chunk_size;
+        const size_t size = (l.size - offset) < pack_chunk_size ? (l.size - offset) : pack_chunk_size;
+        std::vector<unsigned char>& out = chunks[i];
+        size_t packed_size;
+
+        // Anything that doesn't shrink is stored as is
+        out.resize(size);
+        packed_size = lz4_compress(data + offset, size, &out[0], size - 1);
+
+        if (packed_size)
+            out.resize(packed_size);
+        else
+            memcpy(&out[0], data + offset, size);
+    }
+
+    header[0] = (unsigned int)pack_chunk_size;
+    header[1] = (unsigned int)num_chunks;
+
+    packed.assign((const unsigned char *)header, (const unsigned char *)(header + 2));
+
+    for (i = 0; i < num_chunks; i++)
+    {
+        const unsigned int packed_size = (unsigned int)chunks[i].size();
+
+        packed.insert(packed.end(), (const unsigned char *)&packed_size, (const unsigned char *)(&packed_size + 1));
+    }
+
+    for (i = 0; i < num_chunks; i++)
+    {
+        packed.insert(packed.end(), chunks[i].begin(), chunks[i].end());
+    }
+}
+
+}
+
+}
+
+}
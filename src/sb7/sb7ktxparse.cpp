@@ -0,0 +1,864 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sb7ktx.h"
+#include "sb7mappedfile.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Only the enumerant values are needed here; nothing in this file calls GL,
+// so it can be used by tools that never create a context.
+#include "GL/glcorearb.h"
+#include "GL/glext.h"
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+namespace file
+{
+
+const unsigned char identifier[12] =
+{
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+static unsigned int swap32(const unsigned int u32)
+{
+    union
+    {
+        unsigned int u32;
+        unsigned char u8[4];
+    } a, b;
+
+    a.u32 = u32;
+    b.u8[0] = a.u8[3];
+    b.u8[1] = a.u8[2];
+    b.u8[2] = a.u8[1];
+    b.u8[3] = a.u8[0];
+
+    return b.u32;
+}
+
+// Largest dimension / layer count we're prepared to believe. Anything bigger
+// than this is either corrupt or beyond what any implementation can store.
+static const unsigned int max_dimension = 65536;
+
+static bool get_block_info(unsigned int internalformat,
+                           unsigned int& block_width,
+                           unsigned int& block_height,
+                           unsigned int& block_bytes)
+{
+    block_width = 4;
+    block_height = 4;
+
+    switch (internalformat)
+    {
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_SRGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_R11_EAC:
+        case GL_COMPRESSED_SIGNED_R11_EAC:
+            block_bytes = 8;
+            return true;
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+        case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+        case GL_COMPRESSED_RG11_EAC:
+        case GL_COMPRESSED_SIGNED_RG11_EAC:
+            block_bytes = 16;
+            return true;
+    }
+
+    // ASTC formats are all 16 bytes per block, with a variety of footprints
+    if ((internalformat >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR && internalformat <= GL_COMPRESSED_RGBA_ASTC_12x12_KHR) ||
+        (internalformat >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR && internalformat <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR))
+    {
+        static const unsigned char astc_footprint[][2] =
+        {
+            { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+            { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+        };
+        unsigned int index = internalformat - (internalformat >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR ?
+                                               GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR :
+                                               GL_COMPRESSED_RGBA_ASTC_4x4_KHR);
+
+        block_width = astc_footprint[index][0];
+        block_height = astc_footprint[index][1];
+        block_bytes = 16;
+
+        return true;
+    }
+
+    return false;
+}
+
+static unsigned int get_pixel_size(unsigned int format, unsigned int type)
+{
+    unsigned int components = 0;
+    unsigned int component_size = 0;
+
+    // Packed types hold an entire pixel in a single element
+    switch (type)
+    {
+        case GL_UNSIGNED_BYTE_3_3_2:
+        case GL_UNSIGNED_BYTE_2_3_3_REV:
+            return 1;
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_5_6_5_REV:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+        case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+            return 2;
+        case GL_UNSIGNED_INT_8_8_8_8:
+        case GL_UNSIGNED_INT_8_8_8_8_REV:
+        case GL_UNSIGNED_INT_10_10_10_2:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+        case GL_UNSIGNED_INT_5_9_9_9_REV:
+        case GL_UNSIGNED_INT_24_8:
+            return 4;
+        case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+            return 8;
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            component_size = 1;
+            break;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            component_size = 2;
+            break;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            component_size = 4;
+            break;
+        default:
+            return 0;
+    }
+
+    switch (format)
+    {
+        case GL_RED:
+        case GL_GREEN:
+        case GL_BLUE:
+        case GL_RED_INTEGER:
+        case GL_GREEN_INTEGER:
+        case GL_BLUE_INTEGER:
+        case GL_DEPTH_COMPONENT:
+        case GL_STENCIL_INDEX:
+            components = 1;
+            break;
+        case GL_RG:
+        case GL_RG_INTEGER:
+            components = 2;
+            break;
+        case GL_RGB:
+        case GL_BGR:
+        case GL_RGB_INTEGER:
+        case GL_BGR_INTEGER:
+            components = 3;
+            break;
+        case GL_RGBA:
+        case GL_BGRA:
+        case GL_RGBA_INTEGER:
+        case GL_BGRA_INTEGER:
+            components = 4;
+            break;
+    }
+
+    return components * component_size;
+}
+
+static unsigned int calculate_max_levels(const header& h)
+{
+    unsigned int size = h.pixelwidth;
+    unsigned int levels = 0;
+
+    if (h.pixelheight > size)
+        size = h.pixelheight;
+    if (h.pixeldepth > size)
+        size = h.pixeldepth;
+
+    while (size)
+    {
+        levels++;
+        size >>= 1;
+    }
+
+    return levels;
+}
+
+static unsigned int get_type_size(unsigned int type)
+{
+    switch (type)
+    {
+        case GL_NONE:
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+        case GL_UNSIGNED_BYTE_3_3_2:
+        case GL_UNSIGNED_BYTE_2_3_3_REV:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_5_6_5_REV:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+        case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+// Lay out the image data following the KTX 1.1 rules:
+//
+//  for each mip level
+//      UInt32 imageSize
+//      for each array element
+//          for each face
+//              for each z slice
+//                  rows of pixels (padded to 4 bytes) or rows of blocks
+//              cubePadding (non-array cube maps only)
+//      mipPadding
+//
+// Only the header is consulted; nothing here reads image data.
+static bool calculate_layout(texture_desc& desc)
+{
+    const header& h = desc.h;
+    const bool compressed = (h.gltype == GL_NONE);
+    const bool cube_non_array = (h.faces == 6 && h.arrayelements == 0);
+    unsigned int block_width = 1;
+    unsigned int block_height = 1;
+    unsigned int element_size = 0;
+    unsigned long long offset = desc.data_offset;
+    unsigned int level;
+
+    if (compressed)
+    {
+        if (h.glformat != GL_NONE ||
+            !get_block_info(h.glinternalformat, block_width, block_height, element_size))
+            return false;
+    }
+    else
+    {
+        element_size = get_pixel_size(h.glformat, h.gltype);
+
+        if (element_size == 0)
+            return false;
+    }
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        level_layout& l = desc.level[level];
+        unsigned long long row_size;
+        unsigned long long face_size;
+        unsigned long long level_size;
+        unsigned int faces = h.faces ? h.faces : 1;
+        unsigned int elements = h.arrayelements ? h.arrayelements : 1;
+
+        l.width = h.pixelwidth >> level;
+        l.height = h.pixelheight >> level;
+        l.depth = h.pixeldepth >> level;
+        if (!l.width)
+            l.width = 1;
+        if (!l.height)
+            l.height = 1;
+        if (!l.depth)
+            l.depth = 1;
+        l.layers = faces * elements;
+
+        row_size = (unsigned long long)((l.width + block_width - 1) / block_width) * element_size;
+        if (!compressed)
+            row_size = (row_size + 3) & ~3ull;
+        face_size = row_size * ((l.height + block_height - 1) / block_height) * l.depth;
+        level_size = (cube_non_array ? ((face_size + 3) & ~3ull) : face_size) * l.layers;
+
+        // imageSize is a 32 bit field, so no level can be bigger than that
+        if (level_size > 0xFFFFFFFFull)
+            return false;
+
+        l.face_size = (size_t)face_size;
+        l.face_stride = (size_t)(cube_non_array ? ((face_size + 3) & ~3ull) : face_size);
+        l.size = (size_t)level_size;
+        l.image_size = (unsigned int)(cube_non_array ? face_size : level_size);
+
+        offset += 4;
+        l.offset = (size_t)offset;
+        offset = (offset + level_size + 3) & ~3ull;
+
+        if (offset != (size_t)offset)
+            return false;
+    }
+
+    desc.data_size = (size_t)(offset - desc.data_offset);
+
+    return true;
+}
+
+// Check every level against the stored imageSize and against the end of
+// the data so that nothing is handed to GL until the whole file is known
+// to be sound.
+static bool validate_layout(const texture_desc& desc,
+                            const unsigned char * base,
+                            size_t size)
+{
+    unsigned int level;
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        const level_layout& l = desc.level[level];
+        unsigned int image_size;
+
+        if (l.offset > size || l.size > size - l.offset)
+            return false;
+
+        memcpy(&image_size, base + l.offset - 4, sizeof(image_size));
+        if (desc.swap)
+            image_size = swap32(image_size);
+
+        if (image_size != l.image_size)
+            return false;
+    }
+
+    return true;
+}
+
+bool layout(texture_desc& desc)
+{
+    const header& h = desc.h;
+
+    desc.target = GL_NONE;
+
+    // Guess target (texture type)
+    if (h.pixelheight == 0)
+    {
+        if (h.arrayelements == 0)
+        {
+            desc.target = GL_TEXTURE_1D;
+        }
+        else
+        {
+            desc.target = GL_TEXTURE_1D_ARRAY;
+        }
+    }
+    else if (h.pixeldepth == 0)
+    {
+        if (h.arrayelements == 0)
+        {
+            if (h.faces != 6)
+            {
+                desc.target = GL_TEXTURE_2D;
+            }
+            else
+            {
+                desc.target = GL_TEXTURE_CUBE_MAP;
+            }
+        }
+        else
+        {
+            if (h.faces != 6)
+            {
+                desc.target = GL_TEXTURE_2D_ARRAY;
+            }
+            else
+            {
+                desc.target = GL_TEXTURE_CUBE_MAP_ARRAY;
+            }
+        }
+    }
+    else
+    {
+        desc.target = GL_TEXTURE_3D;
+    }
+
+    // Check for insanity...
+    if (desc.target == GL_NONE ||                               // Couldn't figure out target
+        (h.pixelwidth == 0) ||                                  // Texture has no width???
+        (h.pixelheight == 0 && h.pixeldepth != 0) ||            // Texture has depth but no height???
+        (h.pixelwidth > max_dimension) ||                       // Texture is unreasonably large???
+        (h.pixelheight > max_dimension) ||
+        (h.pixeldepth > max_dimension) ||
+        (h.arrayelements > max_dimension) ||
+        (h.faces != 0 && h.faces != 1 && h.faces != 6))         // Texture has a strange number of faces???
+    {
+        return false;
+    }
+
+    desc.data_offset = sizeof(h) + h.keypairbytes;
+
+    // A level count of zero means the file only holds the base level and
+    // the rest of the chain should be generated at load time.
+    desc.storage_levels = calculate_max_levels(h);
+    desc.generate_mips = false;
+
+    if (h.miplevels == 0)
+    {
+        desc.generate_mips = true;
+        desc.levels = 1;
+    }
+    else if (h.miplevels <= desc.storage_levels)
+    {
+        desc.storage_levels = desc.levels = h.miplevels;
+    }
+    else
+    {
+        return false;
+    }
+
+    return calculate_layout(desc);
+}
+
+static bool parse_key_values(const texture_desc& desc,
+                             const unsigned char * ptr,
+                             std::vector<key_value>& key_values)
+{
+    const unsigned char * end = ptr + desc.h.keypairbytes;
+
+    while (ptr < end)
+    {
+        unsigned int kv_size;
+        const unsigned char * key;
+        const unsigned char * terminator;
+        key_value kv;
+
+        if (end - ptr < 4)
+            return false;
+
+        memcpy(&kv_size, ptr, sizeof(kv_size));
+        if (desc.swap)
+            kv_size = swap32(kv_size);
+        ptr += 4;
+
+        if (kv_size > (size_t)(end - ptr))
+            return false;
+
+        key = ptr;
+        terminator = (const unsigned char *)memchr(key, 0, kv_size);
+
+        // Every key must be a NUL terminated string inside its own record
+        if (!terminator)
+            return false;
+
+        kv.key.assign((const char *)key, terminator - key);
+        kv.value.assign(terminator + 1, key + kv_size);
+        key_values.push_back(kv);
+
+        // Each record is padded to a multiple of four bytes
+        kv_size = (kv_size + 3) & ~3u;
+        if (kv_size > (size_t)(end - ptr))
+            kv_size = (unsigned int)(end - ptr);
+        ptr += kv_size;
+    }
+
+    return true;
+}
+
+// Supercompressed files store each level as a chunk table followed by the
+// packed chunks. Walk the levels, recording where each one's record is and
+// checking the table against the record and the record against the file.
+static bool validate_packed_layout(texture_desc& desc,
+                                   const unsigned char * base,
+                                   size_t size)
+{
+    size_t offset = desc.data_offset;
+    unsigned int level;
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        level_layout& l = desc.level[level];
+        unsigned int packed_size;
+        unsigned int chunk_size;
+        unsigned int num_chunks;
+        unsigned long long total;
+        unsigned int i;
+
+        if (offset > size || size - offset < 4)
+            return false;
+
+        memcpy(&packed_size, base + offset, sizeof(packed_size));
+        if (desc.swap)
+            packed_size = swap32(packed_size);
+
+        l.packed_offset = offset + 4;
+        l.packed_size = packed_size;
+
+        if (l.packed_size > size - l.packed_offset || l.packed_size < 8)
+            return false;
+
+        memcpy(&chunk_size, base + l.packed_offset, sizeof(chunk_size));
+        memcpy(&num_chunks, base + l.packed_offset + 4, sizeof(num_chunks));
+        if (desc.swap)
+        {
+            chunk_size = swap32(chunk_size);
+            num_chunks = swap32(num_chunks);
+        }
+
+        if (chunk_size == 0 ||
+            num_chunks != (l.size + chunk_size - 1) / chunk_size ||
+            num_chunks > (l.packed_size - 8) / 4)
+        {
+            return false;
+        }
+
+        total = 8 + (unsigned long long)num_chunks * 4;
+        for (i = 0; i < num_chunks; i++)
+        {
+            unsigned int chunk;
+
+            memcpy(&chunk, base + l.packed_offset + 8 + i * 4, sizeof(chunk));
+            if (desc.swap)
+                chunk = swap32(chunk);
+            total += chunk;
+        }
+
+        if (total > l.packed_size)
+            return false;
+
+        offset = (l.packed_offset + l.packed_size + 3) & ~(size_t)3;
+    }
+
+    return true;
+}
+
+unsigned int pixel_size(unsigned int format, unsigned int type)
+{
+    return get_pixel_size(format, type);
+}
+
+bool block_info(unsigned int internalformat,
+                unsigned int& block_width,
+                unsigned int& block_height,
+                unsigned int& block_bytes)
+{
+    return get_block_info(internalformat, block_width, block_height, block_bytes);
+}
+
+bool parse(const void * ptr, size_t size, texture_desc& desc)
+{
+    const unsigned char * base = (const unsigned char *)ptr;
+    header& h = desc.h;
+
+    memset(&desc, 0, sizeof(desc));
+
+    if (size < sizeof(h))
+        return false;
+
+    memcpy(&h, base, sizeof(h));
+
+    if (memcmp(h.identifier, identifier, sizeof(identifier)) != 0)
+        return false;
+
+    if (h.endianness == 0x04030201)
+    {
+        // No swap needed
+    }
+    else if (h.endianness == 0x01020304)
+    {
+        // Swap needed
+        desc.swap = true;
+        h.endianness            = swap32(h.endianness);
+        h.gltype                = swap32(h.gltype);
+        h.gltypesize            = swap32(h.gltypesize);
+        h.glformat              = swap32(h.glformat);
+        h.glinternalformat      = swap32(h.glinternalformat);
+        h.glbaseinternalformat  = swap32(h.glbaseinternalformat);
+        h.pixelwidth            = swap32(h.pixelwidth);
+        h.pixelheight           = swap32(h.pixelheight);
+        h.pixeldepth            = swap32(h.pixeldepth);
+        h.arrayelements         = swap32(h.arrayelements);
+        h.faces                 = swap32(h.faces);
+        h.miplevels             = swap32(h.miplevels);
+        h.keypairbytes          = swap32(h.keypairbytes);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (h.keypairbytes > size - sizeof(h))                      // Key/value data runs off the end of the file
+        return false;
+
+    if (!layout(desc))
+        return false;
+
+    // Supercompression is declared with a key/value pair. A file with
+    // malformed key/value data is still loadable, it just can't declare it.
+    if (h.keypairbytes != 0)
+    {
+        std::vector<key_value> key_values;
+        size_t i;
+
+        if (parse_key_values(desc, base + sizeof(h), key_values))
+        {
+            for (i = 0; i < key_values.size(); i++)
+            {
+                if (key_values[i].key != supercompression_key)
+                    continue;
+
+                if (key_values[i].value.compare(0, std::string::npos, "LZ4", 4) == 0)
+                    desc.supercompression = supercompression_lz4;
+                else
+                    return false;
+            }
+        }
+    }
+
+    if (desc.supercompression != supercompression_none)
+        return validate_packed_layout(desc, base, size);
+
+    return validate_layout(desc, base, size);
+}
+
+bool inspect(const void * data, size_t size, texture_info& info)
+{
+    const unsigned char * base = (const unsigned char *)data;
+    const texture_desc& desc = info.desc;
+    unsigned int level;
+    unsigned int layer;
+    unsigned int face;
+
+    info.images.clear();
+    info.key_values.clear();
+    info.file_size = size;
+
+    if (!parse(data, size, info.desc))
+        return false;
+
+    if (!parse_key_values(desc, base + sizeof(header), info.key_values))
+        return false;
+
+    const unsigned int faces = desc.h.faces ? desc.h.faces : 1;
+    const unsigned int layers = desc.h.arrayelements ? desc.h.arrayelements : 1;
+
+    info.images.reserve(desc.levels * faces * layers);
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        const level_layout& l = desc.level[level];
+        size_t offset = l.offset;
+
+        for (layer = 0; layer < layers; layer++)
+        {
+            for (face = 0; face < faces; face++)
+            {
+                image_desc image;
+
+                image.level = level;
+                image.layer = layer;
+                image.face = face;
+                image.width = l.width;
+                image.height = l.height;
+                image.depth = l.depth;
+                image.offset = offset;
+                image.size = l.face_size;
+
+                info.images.push_back(image);
+
+                offset += l.face_stride;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool inspect(const char * filename, texture_info& info)
+{
+    mapped_file file;
+
+    if (!file.open(filename))
+        return false;
+
+    // Only the pages holding the header, key/value data and level size
+    // fields are actually touched.
+    return inspect(file.data(), file.size(), info);
+}
+
+const char * find_key(const texture_info& info, const char * key)
+{
+    size_t i;
+
+    for (i = 0; i < info.key_values.size(); i++)
+    {
+        if (info.key_values[i].key == key)
+        {
+            const std::string& value = info.key_values[i].value;
+
+            // Values that are strings carry their own terminator
+            if (value.empty() || value[value.size() - 1] != '\0')
+                return nullptr;
+
+            return value.c_str();
+        }
+    }
+
+    return nullptr;
+}
+
+void init_header(header& h,
+                 unsigned int internalformat,
+                 unsigned int format,
+                 unsigned int type)
+{
+    memset(&h, 0, sizeof(h));
+    memcpy(h.identifier, identifier, sizeof(identifier));
+    h.endianness = 0x04030201;
+    h.glinternalformat = internalformat;
+    h.glformat = format;
+    h.gltype = type;
+    h.gltypesize = get_type_size(type);
+    h.glbaseinternalformat = format;
+    h.faces = 1;
+}
+
+bool write(const char * filename,
+           const texture_desc& desc,
+           const void * data,
+           const std::vector<key_value> * key_values)
+{
+    static const unsigned char padding[4] = { 0, 0, 0, 0 };
+    const unsigned char * base = (const unsigned char *)data;
+    header h = desc.h;
+    unsigned int kv_bytes = 0;
+    unsigned int level;
+    std::vector<key_value> packed_key_values;
+    std::vector<unsigned char> packed;
+    size_t i;
+    FILE * fp;
+    bool ok = true;
+
+    // Supercompressed files declare themselves, so make sure the key is there
+    if (desc.supercompression != supercompression_none)
+    {
+        key_value kv;
+
+        if (key_values)
+        {
+            for (i = 0; i < key_values->size(); i++)
+            {
+                if ((*key_values)[i].key != supercompression_key)
+                    packed_key_values.push_back((*key_values)[i]);
+            }
+        }
+
+        kv.key = supercompression_key;
+        kv.value.assign("LZ4", 4);
+        packed_key_values.push_back(kv);
+        key_values = &packed_key_values;
+    }
+
+    if (key_values)
+    {
+        for (i = 0; i < key_values->size(); i++)
+        {
+            const key_value& kv = (*key_values)[i];
+            kv_bytes += 4 + (((unsigned int)(kv.key.size() + 1 + kv.value.size()) + 3) & ~3u);
+        }
+    }
+
+    // The caller's layout assumed its own key/value size; the image data is
+    // written relative to wherever it lands now.
+    h.keypairbytes = kv_bytes;
+
+    fp = fopen(filename, "wb");
+
+    if (!fp)
+        return false;
+
+    ok &= fwrite(&h, sizeof(h), 1, fp) == 1;
+
+    if (key_values)
+    {
+        for (i = 0; i < key_values->size(); i++)
+        {
+            const key_value& kv = (*key_values)[i];
+            unsigned int kv_size = (unsigned int)(kv.key.size() + 1 + kv.value.size());
+
+            ok &= fwrite(&kv_size, 4, 1, fp) == 1;
+            ok &= fwrite(kv.key.c_str(), kv.key.size() + 1, 1, fp) == 1;
+            if (!kv.value.empty())
+                ok &= fwrite(kv.value.data(), kv.value.size(), 1, fp) == 1;
+            ok &= fwrite(padding, (4 - (kv_size & 3)) & 3, 1, fp) <= 1;
+        }
+    }
+
+    for (level = 0; ok && level < desc.levels; level++)
+    {
+        const level_layout& l = desc.level[level];
+
+        if (desc.supercompression != supercompression_none)
+        {
+            unsigned int packed_size;
+
+            pack_level(desc, level, base + (l.offset - desc.data_offset), packed);
+            packed_size = (unsigned int)packed.size();
+
+            ok &= fwrite(&packed_size, 4, 1, fp) == 1;
+            ok &= fwrite(&packed[0], packed.size(), 1, fp) == 1;
+            ok &= fwrite(padding, (4 - (packed.size() & 3)) & 3, 1, fp) <= 1;
+            continue;
+        }
+
+        ok &= fwrite(&l.image_size, 4, 1, fp) == 1;
+        ok &= fwrite(base + (l.offset - desc.data_offset), l.size, 1, fp) == 1;
+        ok &= fwrite(padding, (4 - (l.size & 3)) & 3, 1, fp) <= 1;
+    }
+
+    ok &= fclose(fp) == 0;
+
+    if (!ok)
+        remove(filename);
+
+    return ok;
+}
+
+}
+
+}
+
+}
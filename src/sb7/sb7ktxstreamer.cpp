@@ -0,0 +1,731 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GL/gl3w.h"
+#include <sb7ext.h>
+#include <sb7ktxstreamer.h>
+#include <sb7mappedfile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace sb7
+{
+
+namespace ktx
+{
+
+struct streamer::request
+{
+    std::string             filename;
+    GLuint                  texture;
+    callback                fn;
+    void *                  userdata;
+    mapped_file             file;
+    file::texture_desc      desc;
+    unsigned char *         decoded;            // Software decoded data section, if any
+    bool                    allocated;
+    bool                    progressive;
+    unsigned int            base_level;         // Finest level uploaded so far, when progressive
+
+    const unsigned char * level_data(unsigned int level) const
+    {
+        const size_t offset = desc.level[level].offset;
+
+        return decoded ? decoded + (offset - desc.data_offset) : file.data() + offset;
+    }
+};
+
+// A run of levels from one request that can be uploaded together. Levels
+// that fit are staged in a segment of the ring; a level larger than a
+// segment is uploaded straight from the file mapping (segment == -1).
+struct streamer::batch
+{
+    request *               req;
+    int                     segment;
+    unsigned int            num_levels;
+    unsigned int            level[file::max_levels];
+    size_t                  offset[file::max_levels];
+    bool                    last;
+    bool                    ok;                 // Set on the last batch: whether the request loaded
+    unsigned int            next_level;         // Upload progress, in levels of this batch
+    unsigned int            next_part;          // and parts of that level
+};
+
+struct streamer::readback
+{
+    std::string             filename;
+    GLuint                  texture;
+    callback                fn;
+    void *                  userdata;
+    file::texture_desc      desc;
+    int                     buffer;
+    GLsync                  fence;
+    bool                    ok;
+};
+
+// Fault in every page of a range so that the disk read happens here rather
+// than when the render thread hands the pointer to GL.
+static void touch_pages(const unsigned char * ptr, size_t size)
+{
+    volatile unsigned char sink = 0;
+    size_t i;
+
+    for (i = 0; i < size; i += 4096)
+    {
+        sink ^= ptr[i];
+    }
+
+    if (size)
+        sink ^= ptr[size - 1];
+}
+
+// The pool keeps the cores busy already, so the OpenMP loops in the
+// decoders and packers run serially on its threads rather than each job
+// starting a team of its own.
+static void run_kernels_serially()
+{
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+}
+
+streamer::streamer()
+    : staging_buffer(0),
+      staging_ptr(nullptr),
+      segment_size(0),
+      persistent(false),
+      upload_budget(0),
+      stopping(false),
+      num_pending(0)
+{
+
+}
+
+streamer::~streamer()
+{
+    shutdown();
+}
+
+void streamer::init(unsigned int num_threads, size_t seg_size, unsigned int num_segments)
+{
+    unsigned int i;
+
+    shutdown();
+
+    stopping = false;
+    segment_size = seg_size;
+
+    // Without buffer storage there's no persistent mapping for the workers
+    // to write into, so everything is uploaded from the file mappings and
+    // readbacks are mapped once they land.
+    persistent = gl3wIsSupported(4, 4) || sb6IsExtensionSupported("GL_ARB_buffer_storage");
+
+    if (num_segments != 0 && persistent)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glGenBuffers(1, &staging_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, segment_size * num_segments, nullptr, flags);
+        staging_ptr = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, segment_size * num_segments, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        fences.resize(num_segments, nullptr);
+        for (i = 0; i < num_segments; i++)
+        {
+            free_segments.push_back(i);
+        }
+    }
+
+    // Workers can't ask GL, so find out up front which of the formats we
+    // can decode in software the driver can't handle itself.
+    {
+        unsigned int count;
+        const unsigned int * formats = file::transcode_formats(count);
+
+        unsupported_formats.clear();
+        for (i = 0; i < count; i++)
+        {
+            if (!file::is_supported(GL_TEXTURE_2D, formats[i]))
+                unsupported_formats.push_back(formats[i]);
+        }
+    }
+
+    workers.start(num_threads);
+}
+
+void streamer::shutdown()
+{
+    size_t i;
+
+    // Captures that are still in flight get finished rather than dropped
+    while (!readbacks.empty())
+    {
+        readback * rb = readbacks.front();
+        readbacks.pop_front();
+        glClientWaitSync(rb->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        start_write(rb);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    segment_available.notify_all();
+    workers.stop();
+
+    while (!written.empty())
+    {
+        finish_write(written.front());
+        written.pop_front();
+    }
+
+    for (i = 0; i < readback_buffers.size(); i++)
+    {
+        if (persistent)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers[i].name);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &readback_buffers[i].name);
+    }
+
+    readback_buffers.clear();
+
+    // Anything that made it back but was never uploaded is simply dropped
+    uploading.insert(uploading.end(), ready.begin(), ready.end());
+    ready.clear();
+
+    while (!uploading.empty())
+    {
+        batch * b = uploading.front();
+        uploading.pop_front();
+        if (b->last)
+        {
+            delete [] b->req->decoded;
+            delete b->req;
+        }
+        delete b;
+    }
+
+    for (i = 0; i < fences.size(); i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    }
+
+    if (staging_buffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &staging_buffer);
+    }
+
+    fences.clear();
+    free_segments.clear();
+    staging_buffer = 0;
+    staging_ptr = nullptr;
+    num_pending = 0;
+}
+
+GLuint streamer::load(const char * filename, callback fn, void * userdata, GLuint tex, bool progressive)
+{
+    request * req = new request;
+
+    if (tex == 0)
+    {
+        glGenTextures(1, &tex);
+    }
+
+    req->filename = filename;
+    req->texture = tex;
+    req->fn = fn;
+    req->userdata = userdata;
+    req->decoded = nullptr;
+    req->allocated = false;
+    req->progressive = progressive;
+    req->base_level = 0;
+
+    num_pending++;
+
+    workers.submit([this, req]() { process(req); });
+
+    return tex;
+}
+
+streamer::batch * streamer::new_batch(request * req)
+{
+    batch * b = new batch;
+
+    b->req = req;
+    b->segment = -1;
+    b->num_levels = 0;
+    b->last = false;
+    b->ok = false;
+    b->next_level = 0;
+    b->next_part = 0;
+
+    return b;
+}
+
+void streamer::process(request * req)
+{
+    const file::texture_desc& desc = req->desc;
+    batch * b = new_batch(req);
+    size_t used = 0;
+    bool ok = false;
+    unsigned int i;
+
+    run_kernels_serially();
+
+    if (!req->file.open(req->filename.c_str()) ||
+        !file::parse(req->file.data(), req->file.size(), req->desc))
+    {
+        goto done;
+    }
+
+    if (std::find(unsupported_formats.begin(), unsupported_formats.end(),
+                  desc.h.glinternalformat) != unsupported_formats.end())
+    {
+        file::texture_desc compressed = desc;
+        unsigned char * unpacked = new unsigned char [desc.data_size];
+
+        if (file::unpack(desc, req->file.data(), unpacked))
+            req->decoded = file::transcode(compressed, unpacked, req->desc);
+        delete [] unpacked;
+
+        if (!req->decoded)
+            goto done;
+    }
+    else if (desc.supercompression != file::supercompression_none &&
+             (!staging_ptr || desc.level[0].size > segment_size))
+    {
+        // Some level has to be uploaded from client memory, so unpack the
+        // whole file. Otherwise levels are unpacked into the ring.
+        req->decoded = new unsigned char [desc.data_size];
+
+        if (!file::unpack(desc, req->file.data(), req->decoded))
+            goto done;
+    }
+
+    // Progressive loads go coarsest first so that something can be shown
+    // as soon as the first batch is uploaded
+    req->progressive = req->progressive && desc.levels > 1;
+
+    for (i = 0; i < desc.levels; i++)
+    {
+        const unsigned int level = req->progressive ? desc.levels - 1 - i : i;
+        const file::level_layout& l = desc.level[level];
+        const unsigned char * src = req->level_data(level);
+
+        if (staging_ptr && l.size <= segment_size)
+        {
+            if (b->segment == -1 || used + l.size > segment_size)
+            {
+                if (b->num_levels)
+                {
+                    submit_batch(b);
+                    b = new_batch(req);
+                }
+
+                b->segment = acquire_segment();
+                used = 0;
+
+                if (b->segment == -1)
+                    goto done;
+            }
+
+            if (req->decoded || desc.supercompression == file::supercompression_none)
+            {
+                memcpy(staging_ptr + b->segment * segment_size + used, src, l.size);
+            }
+            else if (!file::unpack_level(desc, req->file.data(), level, staging_ptr + b->segment * segment_size + used))
+            {
+                goto done;
+            }
+            b->level[b->num_levels] = level;
+            b->offset[b->num_levels] = used;
+            b->num_levels++;
+            used = (used + l.size + 15) & ~(size_t)15;
+        }
+        else
+        {
+            if (b->num_levels)
+            {
+                submit_batch(b);
+                b = new_batch(req);
+            }
+
+            touch_pages(src, l.size);
+
+            b->segment = -1;
+            b->level[0] = level;
+            b->offset[0] = 0;
+            b->num_levels = 1;
+            submit_batch(b);
+
+            b = new_batch(req);
+        }
+    }
+
+    ok = true;
+
+done:
+    // The outcome travels with the last batch and is published by the lock
+    // in submit_batch(). Earlier batches were staged whole, so the render
+    // thread uploads them without looking at it.
+    b->last = true;
+    b->ok = ok;
+    submit_batch(b);
+}
+
+int streamer::acquire_segment()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    int segment;
+
+    while (free_segments.empty() && !stopping)
+        segment_available.wait(guard);
+
+    if (stopping)
+        return -1;
+
+    segment = free_segments.back();
+    free_segments.pop_back();
+
+    return segment;
+}
+
+void streamer::release_segment(int segment)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        free_segments.push_back(segment);
+    }
+
+    segment_available.notify_one();
+}
+
+void streamer::submit_batch(batch * b)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ready.push_back(b);
+}
+
+// Uploads as much of a batch as the allowance (zero for no limit) permits,
+// always making some progress. Returns true once the batch is finished, at
+// which point it has been deleted.
+bool streamer::upload_batch(batch * b, size_t allowance, size_t& uploaded)
+{
+    request * req = b->req;
+
+    if (!b->last || b->ok)
+    {
+        if (!req->allocated)
+        {
+            file::allocate(req->desc, req->texture);
+            req->allocated = true;
+
+            // Nothing is there yet; each level raises this as it arrives
+            if (req->progressive)
+            {
+                req->base_level = req->desc.storage_levels - 1;
+                glTexParameteri(req->desc.target, GL_TEXTURE_BASE_LEVEL, req->base_level);
+            }
+        }
+
+        glBindTexture(req->desc.target, req->texture);
+
+        if (b->segment != -1)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+        }
+
+        while (b->next_level < b->num_levels)
+        {
+            const unsigned int level = b->level[b->next_level];
+            const unsigned int parts = file::level_parts(req->desc, level);
+            const size_t part = file::part_size(req->desc, level);
+            const void * data = (b->segment != -1) ? (const void *)(b->segment * segment_size + b->offset[b->next_level])
+                                                   : (const void *)req->level_data(level);
+            unsigned int count = parts - b->next_part;
+
+            if (allowance)
+            {
+                if (uploaded >= allowance)
+                    break;
+                if ((size_t)count * part > allowance - uploaded)
+                    count = (unsigned int)((allowance - uploaded) / part);
+
+                // A part bigger than the whole budget still has to go up
+                if (count == 0 && uploaded != 0)
+                    break;
+                if (count == 0)
+                    count = 1;
+            }
+
+            file::upload_level_parts(req->desc, level, b->next_part, count, data);
+            uploaded += (size_t)count * part;
+            b->next_part += count;
+
+            if (b->next_part == parts)
+            {
+                if (req->progressive && level < req->base_level)
+                {
+                    req->base_level = level;
+                    glTexParameteri(req->desc.target, GL_TEXTURE_BASE_LEVEL, level);
+                }
+
+                b->next_level++;
+                b->next_part = 0;
+            }
+        }
+
+        if (b->segment != -1)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        if (b->next_level < b->num_levels)
+            return false;
+
+        if (b->segment != -1)
+        {
+            fences[b->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+    else if (b->segment != -1)
+    {
+        // Failed part way through filling a segment
+        release_segment(b->segment);
+    }
+
+    if (b->last)
+    {
+        if (b->ok && req->desc.generate_mips)
+        {
+            glGenerateMipmap(req->desc.target);
+        }
+
+        num_pending--;
+
+        if (req->fn)
+        {
+            req->fn(req->texture, b->ok, req->userdata);
+        }
+
+        delete [] req->decoded;
+        delete req;
+    }
+
+    delete b;
+
+    return true;
+}
+
+bool streamer::save(const char * filename, GLenum target, GLuint tex, callback fn, void * userdata)
+{
+    readback * rb = new readback;
+
+    if (!file::describe(target, tex, rb->desc))
+    {
+        delete rb;
+        return false;
+    }
+
+    rb->filename = filename;
+    rb->texture = tex;
+    rb->fn = fn;
+    rb->userdata = userdata;
+    rb->ok = false;
+    rb->buffer = acquire_readback_buffer(rb->desc.data_size);
+
+    // Levels land in the buffer exactly where write() expects them
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers[rb->buffer].name);
+    file::download_levels(rb->desc, tex, (void *)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    readbacks.push_back(rb);
+    num_pending++;
+
+    return true;
+}
+
+int streamer::acquire_readback_buffer(size_t size)
+{
+    readback_buffer b;
+    size_t i;
+
+    for (i = 0; i < readback_buffers.size(); i++)
+    {
+        if (!readback_buffers[i].busy && readback_buffers[i].size >= size)
+        {
+            readback_buffers[i].busy = true;
+            return (int)i;
+        }
+    }
+
+    // Nothing free is big enough. Buffers are kept for reuse, since captures
+    // tend to be the same size every time.
+    b.size = size;
+    b.ptr = nullptr;
+    b.busy = true;
+
+    glGenBuffers(1, &b.name);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, b.name);
+
+    if (persistent)
+    {
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        b.ptr = (unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+    }
+    else
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback_buffers.push_back(b);
+
+    return (int)readback_buffers.size() - 1;
+}
+
+void streamer::start_write(readback * rb)
+{
+    readback_buffer& b = readback_buffers[rb->buffer];
+    const unsigned char * data;
+
+    glDeleteSync(rb->fence);
+    rb->fence = nullptr;
+
+    if (!persistent)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, b.name);
+        b.ptr = (unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rb->desc.data_size, GL_MAP_READ_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    data = b.ptr;
+
+    workers.submit([this, rb, data]()
+    {
+        run_kernels_serially();
+
+        rb->ok = data && file::write(rb->filename.c_str(), rb->desc, data);
+
+        std::lock_guard<std::mutex> guard(lock);
+        written.push_back(rb);
+    });
+}
+
+void streamer::finish_write(readback * rb)
+{
+    readback_buffer& b = readback_buffers[rb->buffer];
+
+    if (!persistent)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, b.name);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        b.ptr = nullptr;
+    }
+
+    b.busy = false;
+    num_pending--;
+
+    if (rb->fn)
+    {
+        rb->fn(rb->texture, rb->ok, rb->userdata);
+    }
+
+    delete rb;
+}
+
+void streamer::update()
+{
+    std::deque<readback *> finished;
+    size_t uploaded = 0;
+    size_t i;
+
+    // Recycle staging segments the GPU has finished reading from
+    for (i = 0; i < fences.size(); i++)
+    {
+        if (fences[i] && glClientWaitSync(fences[i], 0, 0) != GL_TIMEOUT_EXPIRED)
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+            release_segment((int)i);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uploading.insert(uploading.end(), ready.begin(), ready.end());
+        ready.clear();
+    }
+
+    // Batches go up strictly in order, a partly uploaded one first
+    while (!uploading.empty() && (upload_budget == 0 || uploaded < upload_budget))
+    {
+        if (!upload_batch(uploading.front(), upload_budget, uploaded))
+            break;
+        uploading.pop_front();
+    }
+
+    // Readbacks complete in the order they were issued
+    while (!readbacks.empty() &&
+           glClientWaitSync(readbacks.front()->fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+    {
+        start_write(readbacks.front());
+        readbacks.pop_front();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished.swap(written);
+    }
+
+    while (!finished.empty())
+    {
+        finish_write(finished.front());
+        finished.pop_front();
+    }
+}
+
+}
+
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * This code is part of the OpenGL SuperBible, 7th Edition.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <sb7mappedfile.h>
+
+namespace sb7
+{
+
+mapped_file::mapped_file()
+    : ptr(nullptr),
+      length(0),
+#ifdef _WIN32
+      file_handle(INVALID_HANDLE_VALUE),
+      mapping_handle(NULL)
+#else
+      fd(-1)
+#endif
+{
+
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool mapped_file::open(const char * filename)
+{
+    LARGE_INTEGER file_size;
+
+    close();
+
+    file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+        goto fail;
+
+    mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (mapping_handle == NULL)
+        goto fail;
+
+    ptr = (const unsigned char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+
+    if (ptr == NULL)
+        goto fail;
+
+    length = (size_t)file_size.QuadPart;
+
+    return true;
+
+fail:
+    close();
+
+    return false;
+}
+
+void mapped_file::close()
+{
+    if (ptr)
+        UnmapViewOfFile(ptr);
+    if (mapping_handle != NULL)
+        CloseHandle(mapping_handle);
+    if (file_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(file_handle);
+
+    ptr = nullptr;
+    length = 0;
+    mapping_handle = NULL;
+    file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool mapped_file::open(const char * filename)
+{
+    struct stat st;
+    void * p;
+
+    close();
+
+    fd = ::open(filename, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        goto fail;
+
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (p == MAP_FAILED)
+        goto fail;
+
+    // Textures and meshes are consumed front to back, so let the kernel read ahead
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    ptr = (const unsigned char *)p;
+    length = (size_t)st.st_size;
+
+    return true;
+
+fail:
+    close();
+
+    return false;
+}
+
+void mapped_file::close()
+{
+    if (ptr)
+        munmap((void *)ptr, length);
+    if (fd >= 0)
+        ::close(fd);
+
+    ptr = nullptr;
+    length = 0;
+    fd = -1;
+}
+
+#endif
+
+}
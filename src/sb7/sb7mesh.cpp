@@ -0,0 +1,1923 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sb7mesh.h>
+#include <sb7hash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace sb7
+{
+
+namespace mesh
+{
+
+cache_stats analyze_vertex_cache(const unsigned int * indices,
+                                 size_t index_count,
+                                 size_t vertex_count,
+                                 unsigned int cache_size)
+{
+    // A vertex is in a FIFO cache if fewer than cache_size misses have
+    // happened since it was last loaded
+    std::vector<unsigned int> loaded(vertex_count, 0);
+    unsigned int time = cache_size + 1;
+    cache_stats stats;
+    size_t i;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.triangles = (unsigned int)(index_count / 3);
+
+    for (i = 0; i < index_count; i++)
+    {
+        const unsigned int v = indices[i];
+
+        if (loaded[v] == 0)
+            stats.vertices++;
+
+        if (time - loaded[v] > cache_size)
+        {
+            loaded[v] = time++;
+            stats.misses++;
+        }
+    }
+
+    stats.acmr = stats.triangles ? (float)stats.misses / (float)stats.triangles : 0.0f;
+    stats.atvr = stats.vertices ? (float)stats.misses / (float)stats.vertices : 0.0f;
+
+    return stats;
+}
+
+static const unsigned int forsyth_cache_size = 32;
+
+static float forsyth_score(int cache_position, unsigned int live)
+{
+    float score = 0.0f;
+
+    if (live == 0)
+        return -1.0f;
+
+    if (cache_position >= 0)
+    {
+        // The last triangle's vertices all get the same score so that
+        // the order in which they were emitted doesn't matter
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cache_position - 3) / (float)(forsyth_cache_size - 3), 1.5f);
+    }
+
+    // Favor vertices with few triangles left, so they don't get stranded
+    return score + 2.0f / sqrtf((float)live);
+}
+
+void optimize_vertex_cache(unsigned int * dst,
+                           const unsigned int * indices,
+                           size_t index_count,
+                           size_t vertex_count)
+{
+    const size_t triangle_count = index_count / 3;
+    std::vector<unsigned int> live(vertex_count, 0);
+    std::vector<unsigned int> adjacency_offset(vertex_count + 1, 0);
+    std::vector<unsigned int> adjacency(triangle_count * 3);
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<char> emitted(triangle_count, 0);
+    unsigned int cache[forsyth_cache_size + 3];
+    unsigned int new_cache[forsyth_cache_size + 3];
+    unsigned int cache_count = 0;
+    size_t input_cursor = 0;
+    size_t i, t;
+    int best = -1;
+
+    // Triangles using each vertex
+    for (i = 0; i < triangle_count * 3; i++)
+    {
+        live[indices[i]]++;
+    }
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        adjacency_offset[i + 1] = adjacency_offset[i] + live[i];
+    }
+
+    {
+        std::vector<unsigned int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (i = 0; i < triangle_count * 3; i++)
+        {
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+        }
+    }
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        vertex_score[i] = forsyth_score(-1, live[i]);
+    }
+
+    for (t = 0; t < triangle_count; t++)
+    {
+        triangle_score[t] = vertex_score[indices[t * 3 + 0]] +
+                            vertex_score[indices[t * 3 + 1]] +
+                            vertex_score[indices[t * 3 + 2]];
+    }
+
+    for (t = 0; t < triangle_count; t++)
+    {
+        unsigned int new_count = 0;
+        unsigned int j, k;
+        float best_score = -1.0f;
+
+        // Nothing in the cache has triangles left; start again from the
+        // first triangle not yet emitted
+        if (best < 0)
+        {
+            while (emitted[input_cursor])
+                input_cursor++;
+            best = (int)input_cursor;
+        }
+
+        const unsigned int * tri = indices + best * 3;
+
+        memcpy(dst + t * 3, tri, 3 * sizeof(unsigned int));
+        emitted[best] = 1;
+
+        // Remove the triangle from its vertices' live lists
+        for (j = 0; j < 3; j++)
+        {
+            const unsigned int v = tri[j];
+            unsigned int * list = &adjacency[adjacency_offset[v]];
+
+            for (k = 0; k < live[v]; k++)
+            {
+                if (list[k] == (unsigned int)best)
+                {
+                    list[k] = list[live[v] - 1];
+                    break;
+                }
+            }
+
+            live[v]--;
+            new_cache[new_count++] = v;
+        }
+
+        // The triangle's vertices go to the front of the cache, followed by
+        // whatever was there before
+        for (j = 0; j < cache_count; j++)
+        {
+            const unsigned int v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                new_cache[new_count++] = v;
+        }
+
+        // Rescore everything that moved, including what fell off the end
+        for (j = 0; j < new_count; j++)
+        {
+            const unsigned int v = new_cache[j];
+            const int position = j < forsyth_cache_size ? (int)j : -1;
+            const float score = forsyth_score(position, live[v]);
+            const float delta = score - vertex_score[v];
+            const unsigned int * list = &adjacency[adjacency_offset[v]];
+
+            cache_position[v] = position;
+            vertex_score[v] = score;
+
+            for (k = 0; k < live[v]; k++)
+            {
+                triangle_score[list[k]] += delta;
+            }
+        }
+
+        // The next triangle is the best one that uses a cached vertex
+        best = -1;
+        cache_count = new_count < forsyth_cache_size ? new_count : forsyth_cache_size;
+
+        for (j = 0; j < cache_count; j++)
+        {
+            const unsigned int v = new_cache[j];
+            const unsigned int * list = &adjacency[adjacency_offset[v]];
+
+            cache[j] = v;
+
+            for (k = 0; k < live[v]; k++)
+            {
+                if (triangle_score[list[k]] > best_score)
+                {
+                    best_score = triangle_score[list[k]];
+                    best = (int)list[k];
+                }
+            }
+        }
+    }
+}
+
+struct cluster
+{
+    size_t          first;              // In triangles
+    size_t          count;
+    float           sort_key;
+};
+
+static bool cluster_order(const cluster& a, const cluster& b)
+{
+    return a.sort_key > b.sort_key;
+}
+
+// Counts the cache misses of one triangle against a FIFO cache kept as
+// load timestamps, as in analyze_vertex_cache
+static unsigned int triangle_misses(const unsigned int * tri,
+                                    std::vector<unsigned int>& loaded,
+                                    unsigned int& time,
+                                    unsigned int cache_size)
+{
+    unsigned int misses = 0;
+    unsigned int j;
+
+    for (j = 0; j < 3; j++)
+    {
+        if (time - loaded[tri[j]] > cache_size)
+        {
+            loaded[tri[j]] = time++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+void optimize_overdraw(unsigned int * dst,
+                       const unsigned int * indices,
+                       size_t index_count,
+                       const float * positions,
+                       size_t position_stride,
+                       size_t vertex_count,
+                       unsigned int cache_size,
+                       float threshold)
+{
+    const size_t triangle_count = index_count / 3;
+    std::vector<unsigned int> loaded(vertex_count, 0);
+    std::vector<size_t> hard;
+    std::vector<cluster> clusters;
+    unsigned int time = cache_size + 1;
+    float mesh_centroid[3] = { 0.0f, 0.0f, 0.0f };
+    float mesh_area = 0.0f;
+    size_t i, t;
+
+    if (triangle_count == 0)
+        return;
+
+    // Hard boundaries are where the cache has been flushed completely, so
+    // reordering there costs nothing
+    for (t = 0; t < triangle_count; t++)
+    {
+        if (triangle_misses(indices + t * 3, loaded, time, cache_size) == 3)
+            hard.push_back(t);
+    }
+
+    if (hard.empty() || hard[0] != 0)
+        hard.insert(hard.begin(), 0);
+    hard.push_back(triangle_count);
+
+    // Soft boundaries split hard clusters further wherever the running ACMR
+    // since the last split, starting from a cold cache, has dropped close to
+    // that of the whole cluster
+    for (i = 0; i + 1 < hard.size(); i++)
+    {
+        const size_t begin = hard[i];
+        const size_t end = hard[i + 1];
+        unsigned int cluster_misses = 0;
+        unsigned int misses = 0;
+        cluster c;
+
+        // Advancing time past the cache size flushes the cache
+        time += cache_size + 1;
+        for (t = begin; t < end; t++)
+        {
+            cluster_misses += triangle_misses(indices + t * 3, loaded, time, cache_size);
+        }
+
+        const float limit = threshold * (float)cluster_misses / (float)(end - begin);
+
+        time += cache_size + 1;
+        c.first = begin;
+
+        for (t = begin; t < end; t++)
+        {
+            misses += triangle_misses(indices + t * 3, loaded, time, cache_size);
+
+            if (t + 1 < end &&
+                (float)misses / (float)(t + 1 - c.first) <= limit)
+            {
+                c.count = t + 1 - c.first;
+                clusters.push_back(c);
+                c.first = t + 1;
+                misses = 0;
+                time += cache_size + 1;
+            }
+        }
+
+        c.count = end - c.first;
+        clusters.push_back(c);
+    }
+
+    // Sort key is how far the cluster faces away from the middle of the
+    // mesh: area weighted centroid relative to the mesh's, along the
+    // cluster's average normal
+    std::vector<float> centroids(clusters.size() * 3);
+    std::vector<float> normals(clusters.size() * 3);
+
+    for (i = 0; i < clusters.size(); i++)
+    {
+        float centroid[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+        int j;
+
+        for (t = clusters[i].first; t < clusters[i].first + clusters[i].count; t++)
+        {
+            const float * p0 = positions + indices[t * 3 + 0] * position_stride;
+            const float * p1 = positions + indices[t * 3 + 1] * position_stride;
+            const float * p2 = positions + indices[t * 3 + 2] * position_stride;
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                                 e1[2] * e2[0] - e1[0] * e2[2],
+                                 e1[0] * e2[1] - e1[1] * e2[0] };
+            const float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (j = 0; j < 3; j++)
+            {
+                centroid[j] += (p0[j] + p1[j] + p2[j]) * (a / 3.0f);
+                normal[j] += n[j];
+            }
+            area += a;
+        }
+
+        for (j = 0; j < 3; j++)
+        {
+            centroids[i * 3 + j] = area > 0.0f ? centroid[j] / area : 0.0f;
+            normals[i * 3 + j] = normal[j];
+            mesh_centroid[j] += centroid[j];
+        }
+        mesh_area += area;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        mesh_centroid[i] = mesh_area > 0.0f ? mesh_centroid[i] / mesh_area : 0.0f;
+    }
+
+    for (i = 0; i < clusters.size(); i++)
+    {
+        const float * c = &centroids[i * 3];
+        const float * n = &normals[i * 3];
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        clusters[i].sort_key = length > 0.0f ?
+                               ((c[0] - mesh_centroid[0]) * n[0] +
+                                (c[1] - mesh_centroid[1]) * n[1] +
+                                (c[2] - mesh_centroid[2]) * n[2]) / length : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), cluster_order);
+
+    for (i = 0, t = 0; i < clusters.size(); i++)
+    {
+        memcpy(dst + t * 3, indices + clusters[i].first * 3, clusters[i].count * 3 * sizeof(unsigned int));
+        t += clusters[i].count;
+    }
+}
+
+size_t optimize_vertex_fetch_remap(unsigned int * remap,
+                                   const unsigned int * indices,
+                                   size_t index_count,
+                                   size_t vertex_count)
+{
+    unsigned int next = 0;
+    size_t i;
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        remap[i] = ~0u;
+    }
+
+    for (i = 0; i < index_count; i++)
+    {
+        if (remap[indices[i]] == ~0u)
+            remap[indices[i]] = next++;
+    }
+
+    return next;
+}
+
+size_t generate_vertex_remap(unsigned int * remap,
+                             const void * vertices,
+                             size_t vertex_count,
+                             size_t vertex_size)
+{
+    const unsigned char * data = (const unsigned char *)vertices;
+    size_t table_size = 16;
+    unsigned int next = 0;
+    size_t i;
+
+    while (table_size < vertex_count * 2)
+        table_size *= 2;
+
+    // Open addressed table of the first vertex seen with each content
+    std::vector<unsigned int> table(table_size, ~0u);
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        const unsigned char * v = data + i * vertex_size;
+        size_t slot = (size_t)hash(v, vertex_size) & (table_size - 1);
+
+        for (;;)
+        {
+            const unsigned int entry = table[slot];
+
+            if (entry == ~0u)
+            {
+                table[slot] = (unsigned int)i;
+                remap[i] = next++;
+                break;
+            }
+
+            if (memcmp(data + entry * vertex_size, v, vertex_size) == 0)
+            {
+                remap[i] = remap[entry];
+                break;
+            }
+
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    return next;
+}
+
+void remap_indices(unsigned int * dst,
+                   const unsigned int * indices,
+                   size_t index_count,
+                   const unsigned int * remap)
+{
+    size_t i;
+
+    for (i = 0; i < index_count; i++)
+    {
+        dst[i] = remap[indices[i]];
+    }
+}
+
+void remap_vertices(void * dst,
+                    const void * vertices,
+                    size_t vertex_count,
+                    size_t vertex_size,
+                    const unsigned int * remap)
+{
+    const unsigned char * src = (const unsigned char *)vertices;
+    unsigned char * out = (unsigned char *)dst;
+    size_t i;
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        if (remap[i] != ~0u)
+            memcpy(out + (size_t)remap[i] * vertex_size, src + i * vertex_size, vertex_size);
+    }
+}
+
+size_t build_meshlets_bound(size_t index_count,
+                            unsigned int max_vertices,
+                            unsigned int max_triangles)
+{
+    // A meshlet is only closed when the next triangle doesn't fit, so every
+    // one but the last is full or has at least max_vertices - 2 vertices,
+    // which takes at least a third as many triangles
+    const size_t by_vertices = max_vertices / 3;
+    const size_t per_meshlet = std::max<size_t>(1, std::min<size_t>(max_triangles, by_vertices));
+
+    return (index_count / 3 + per_meshlet - 1) / per_meshlet + 1;
+}
+
+static void sub3(const float * a, const float * b, float r[3])
+{
+    r[0] = a[0] - b[0];
+    r[1] = a[1] - b[1];
+    r[2] = a[2] - b[2];
+}
+
+static float dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Unit normal of a counter-clockwise triangle, or false if it has no area
+static bool triangle_normal(const unsigned int * tri, const float * positions, size_t stride, float n[3])
+{
+    const float * p0 = positions + tri[0] * stride;
+    float e1[3], e2[3];
+
+    sub3(positions + tri[1] * stride, p0, e1);
+    sub3(positions + tri[2] * stride, p0, e2);
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    const float length = sqrtf(dot3(n, n));
+
+    if (length == 0.0f)
+        return false;
+
+    n[0] /= length;
+    n[1] /= length;
+    n[2] /= length;
+
+    return true;
+}
+
+static void compute_meshlet_bounds(meshlet& m, const unsigned int * indices, const float * positions, size_t stride)
+{
+    float lo[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    float hi[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    float radius2 = 0.0f;
+    float min_dot = 1.0f;
+    float max_t = 0.0f;
+    float n[3], d[3];
+    unsigned int i, j;
+
+    for (i = 0; i < m.count; i++)
+    {
+        const float * p = positions + indices[i] * stride;
+        for (j = 0; j < 3; j++)
+        {
+            lo[j] = std::min(lo[j], p[j]);
+            hi[j] = std::max(hi[j], p[j]);
+        }
+    }
+
+    for (j = 0; j < 3; j++)
+    {
+        m.center[j] = (lo[j] + hi[j]) * 0.5f;
+    }
+
+    for (i = 0; i < m.count; i++)
+    {
+        sub3(positions + indices[i] * stride, m.center, d);
+        radius2 = std::max(radius2, dot3(d, d));
+    }
+
+    m.radius = sqrtf(radius2);
+
+    // The cone axis is the average facing direction and its spread is set
+    // by the triangle that strays furthest from it
+    for (i = 0; i < m.count; i += 3)
+    {
+        if (triangle_normal(indices + i, positions, stride, n))
+        {
+            axis[0] += n[0];
+            axis[1] += n[1];
+            axis[2] += n[2];
+        }
+    }
+
+    const float length = sqrtf(dot3(axis, axis));
+
+    if (length > 0.0f)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            axis[j] /= length;
+        }
+
+        for (i = 0; i < m.count; i += 3)
+        {
+            if (triangle_normal(indices + i, positions, stride, n))
+                min_dot = std::min(min_dot, dot3(axis, n));
+        }
+    }
+
+    memcpy(m.cone_apex, m.center, sizeof(m.center));
+    memcpy(m.cone_axis, axis, sizeof(axis));
+    m.cone_cutoff = 1.0f;
+
+    // Nearly a hemisphere or worse can't be culled from anywhere useful
+    if (length == 0.0f || min_dot <= 0.1f)
+        return;
+
+    // The apex is the point on the axis behind the center that lies behind
+    // every triangle's plane
+    for (i = 0; i < m.count; i += 3)
+    {
+        if (triangle_normal(indices + i, positions, stride, n))
+        {
+            sub3(m.center, positions + indices[i] * stride, d);
+            max_t = std::max(max_t, dot3(d, n) / dot3(axis, n));
+        }
+    }
+
+    for (j = 0; j < 3; j++)
+    {
+        m.cone_apex[j] = m.center[j] - axis[j] * max_t;
+    }
+
+    m.cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+// Orders a finished meshlet's triangles for the vertex cache. The meshlet
+// is renumbered to local vertices first so the optimizer's tables are tiny.
+static void optimize_meshlet(unsigned int * indices, unsigned int count, unsigned int vertex_count)
+{
+    std::vector<unsigned int> global(vertex_count);
+    std::vector<unsigned int> local(count);
+    std::vector<unsigned int> ordered(count);
+    unsigned int i, j, used = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < used && global[j] != indices[i]; j++)
+        {
+        }
+
+        if (j == used)
+            global[used++] = indices[i];
+
+        local[i] = j;
+    }
+
+    optimize_vertex_cache(&ordered[0], &local[0], count, used);
+
+    for (i = 0; i < count; i++)
+    {
+        indices[i] = global[ordered[i]];
+    }
+}
+
+size_t build_meshlets(meshlet * meshlets,
+                      unsigned int * dst,
+                      const unsigned int * indices,
+                      size_t index_count,
+                      const float * positions,
+                      size_t position_stride,
+                      size_t vertex_count,
+                      unsigned int max_vertices,
+                      unsigned int max_triangles)
+{
+    const size_t triangle_count = index_count / 3;
+    std::vector<unsigned int> adjacency_offset(vertex_count + 1, 0);
+    std::vector<unsigned int> adjacency(triangle_count * 3);
+    std::vector<unsigned int> live(vertex_count, 0);
+    std::vector<unsigned int> in_meshlet(vertex_count, 0);
+    std::vector<unsigned int> vertices;
+    std::vector<bool> emitted(triangle_count, false);
+    size_t meshlet_count = 0;
+    size_t written = 0;
+    size_t cursor = 0;
+    size_t i;
+    int j;
+    unsigned int stamp = 1;
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    meshlet current;
+
+    if (triangle_count == 0 || max_vertices < 3 || max_triangles < 1)
+        return 0;
+
+    // Triangles that use each vertex
+    for (i = 0; i < triangle_count * 3; i++)
+    {
+        live[indices[i]]++;
+    }
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        adjacency_offset[i + 1] = adjacency_offset[i] + live[i];
+    }
+
+    for (i = 0; i < triangle_count * 3; i++)
+    {
+        const unsigned int v = indices[i];
+        adjacency[adjacency_offset[v + 1] - live[v]--] = (unsigned int)(i / 3);
+    }
+
+    for (i = 0; i < triangle_count * 3; i++)
+    {
+        live[indices[i]]++;
+    }
+
+    memset(&current, 0, sizeof(current));
+
+    while (written < triangle_count)
+    {
+        size_t best = triangle_count;
+        unsigned int best_new = 4;
+        float best_distance = HUGE_VALF;
+        float centroid[3];
+
+        for (i = 0; i < 3; i++)
+        {
+            centroid[i] = vertices.empty() ? 0.0f : sum[i] / (float)vertices.size();
+        }
+
+        // Grow towards the neighbouring triangle that adds the fewest new
+        // vertices, and of those the one nearest the middle of the meshlet
+        for (i = 0; i < vertices.size(); i++)
+        {
+            const unsigned int v = vertices[i];
+            unsigned int k;
+
+            if (live[v] == 0)
+                continue;
+
+            for (k = adjacency_offset[v]; k < adjacency_offset[v + 1]; k++)
+            {
+                const unsigned int * tri = indices + adjacency[k] * 3;
+                const unsigned int added = (in_meshlet[tri[0]] != stamp) +
+                                           (in_meshlet[tri[1]] != stamp) +
+                                           (in_meshlet[tri[2]] != stamp);
+                float d[3];
+
+                if (emitted[adjacency[k]] || added > best_new)
+                    continue;
+
+                for (j = 0; j < 3; j++)
+                {
+                    d[j] = (positions[tri[0] * position_stride + j] +
+                            positions[tri[1] * position_stride + j] +
+                            positions[tri[2] * position_stride + j]) / 3.0f - centroid[j];
+                }
+
+                const float distance = dot3(d, d);
+
+                if (added < best_new || distance < best_distance)
+                {
+                    best = adjacency[k];
+                    best_new = added;
+                    best_distance = distance;
+                }
+            }
+        }
+
+        // Nothing connected is left, so carry on from the next unused
+        // triangle in input order
+        if (best == triangle_count)
+        {
+            while (emitted[cursor])
+                cursor++;
+
+            best = cursor;
+            best_new = (in_meshlet[indices[best * 3 + 0]] != stamp) +
+                       (in_meshlet[indices[best * 3 + 1]] != stamp) +
+                       (in_meshlet[indices[best * 3 + 2]] != stamp);
+        }
+
+        if (current.count == max_triangles * 3 ||
+            vertices.size() + best_new > max_vertices)
+        {
+            current.vertex_count = (unsigned int)vertices.size();
+            meshlets[meshlet_count++] = current;
+
+            current.first = (unsigned int)(written * 3);
+            current.count = 0;
+            vertices.clear();
+            sum[0] = sum[1] = sum[2] = 0.0f;
+            stamp++;
+        }
+
+        const unsigned int * tri = indices + best * 3;
+
+        for (i = 0; i < 3; i++)
+        {
+            const unsigned int v = tri[i];
+
+            if (in_meshlet[v] != stamp)
+            {
+                in_meshlet[v] = stamp;
+                vertices.push_back(v);
+                sum[0] += positions[v * position_stride + 0];
+                sum[1] += positions[v * position_stride + 1];
+                sum[2] += positions[v * position_stride + 2];
+            }
+
+            live[v]--;
+            dst[written * 3 + i] = v;
+        }
+
+        emitted[best] = true;
+        current.count += 3;
+        written++;
+    }
+
+    current.vertex_count = (unsigned int)vertices.size();
+    meshlets[meshlet_count++] = current;
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (j = 0; j < (int)meshlet_count; j++)
+    {
+        meshlet& m = meshlets[j];
+
+        optimize_meshlet(dst + m.first, m.count, m.vertex_count);
+        compute_meshlet_bounds(m, dst + m.first, positions, position_stride);
+    }
+
+    return meshlet_count;
+}
+
+// Sum of squared distances to a set of planes, each weighted by the area of
+// the triangle it came from, so that error(p) / weight is the mean squared
+// distance of p from them
+struct quadric
+{
+    double          a2, b2, c2, d2;
+    double          ab, ac, ad;
+    double          bc, bd, cd;
+    double          weight;
+};
+
+static void add_quadric(quadric& q, const quadric& r)
+{
+    q.a2 += r.a2; q.b2 += r.b2; q.c2 += r.c2; q.d2 += r.d2;
+    q.ab += r.ab; q.ac += r.ac; q.ad += r.ad;
+    q.bc += r.bc; q.bd += r.bd; q.cd += r.cd;
+    q.weight += r.weight;
+}
+
+static double quadric_eval(const quadric& q, const float * p)
+{
+    const double x = p[0], y = p[1], z = p[2];
+
+    return q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+           2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z + q.ad * x + q.bd * y + q.cd * z);
+}
+
+static void cross3(const float a[3], const float b[3], float r[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Collapsing from onto to must not fold any of the triangles around from
+// over, or squash them flat
+static bool collapse_flips(unsigned int from, unsigned int to,
+                           const unsigned int * indices,
+                           const unsigned int * adjacency,
+                           unsigned int begin, unsigned int end,
+                           const float * positions, size_t stride)
+{
+    unsigned int k, j;
+
+    for (k = begin; k < end; k++)
+    {
+        const unsigned int * tri = indices + adjacency[k] * 3;
+        const float * p[3];
+        const float * q[3];
+        float e1[3], e2[3], before[3], after[3];
+
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+
+        for (j = 0; j < 3; j++)
+        {
+            p[j] = positions + tri[j] * stride;
+            q[j] = tri[j] == from ? positions + to * stride : p[j];
+        }
+
+        sub3(p[1], p[0], e1);
+        sub3(p[2], p[0], e2);
+        cross3(e1, e2, before);
+        sub3(q[1], q[0], e1);
+        sub3(q[2], q[0], e2);
+        cross3(e1, e2, after);
+
+        if (dot3(before, after) <= 0.25f * sqrtf(dot3(before, before) * dot3(after, after)))
+            return true;
+    }
+
+    return false;
+}
+
+struct collapse
+{
+    float           error;
+    unsigned int    from;
+    unsigned int    to;
+};
+
+static bool collapse_order(const collapse& a, const collapse& b)
+{
+    return a.error < b.error;
+}
+
+size_t simplify(unsigned int * dst,
+                const unsigned int * indices,
+                size_t index_count,
+                const float * positions,
+                size_t position_stride,
+                size_t vertex_count,
+                size_t target_index_count,
+                float max_error,
+                float * result_error)
+{
+    std::vector<unsigned int> current(indices, indices + index_count);
+    std::vector<float> packed(vertex_count * 3);
+    std::vector<unsigned int> position_group(vertex_count);
+    std::vector<unsigned int> group_size(vertex_count, 0);
+    std::vector<unsigned char> locked(vertex_count, 0);
+    std::vector<unsigned char> group_locked(vertex_count, 0);
+    std::vector<quadric> quadrics(vertex_count);
+    std::vector<unsigned int> adjacency_offset(vertex_count + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<unsigned int> remap(vertex_count);
+    std::vector<unsigned char> touched(vertex_count);
+    std::vector<unsigned int> mark(vertex_count, 0);
+    unsigned int stamp = 0;
+    std::vector<collapse> collapses;
+    std::vector<collapse> best(vertex_count);
+    std::vector<double> self_error(vertex_count);
+    std::vector<unsigned long long> edges;
+    float error = 0.0f;
+    size_t i, j;
+
+    // Vertices that share a position with another carry an attribute seam
+    // and stay put, as do vertices on open or non-manifold edges, so
+    // simplification never tears the surface or smears attributes across
+    // a seam
+    for (i = 0; i < vertex_count; i++)
+    {
+        memcpy(&packed[i * 3], positions + i * position_stride, 3 * sizeof(float));
+    }
+
+    generate_vertex_remap(&position_group[0], &packed[0], vertex_count, 3 * sizeof(float));
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        group_size[position_group[i]]++;
+    }
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        locked[i] = group_size[position_group[i]] > 1;
+    }
+
+    for (i = 0; i + 2 < index_count; i += 3)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            const unsigned long long a = position_group[indices[i + j]];
+            const unsigned long long b = position_group[indices[i + (j + 1) % 3]];
+
+            edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    }
+
+    std::sort(edges.begin(), edges.end());
+
+    for (i = 0; i < edges.size(); i = j)
+    {
+        for (j = i + 1; j < edges.size() && edges[j] == edges[i]; j++)
+        {
+        }
+
+        if (j - i != 2)
+        {
+            group_locked[(size_t)(edges[i] >> 32)] = 1;
+            group_locked[(size_t)(edges[i] & 0xFFFFFFFFu)] = 1;
+        }
+    }
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        locked[i] |= group_locked[position_group[i]];
+    }
+
+    // Each vertex starts with the planes of the triangles around it
+    memset(&quadrics[0], 0, vertex_count * sizeof(quadric));
+
+    for (i = 0; i + 2 < index_count; i += 3)
+    {
+        const float * p0 = positions + indices[i] * position_stride;
+        float e1[3], e2[3], n[3];
+
+        sub3(positions + indices[i + 1] * position_stride, p0, e1);
+        sub3(positions + indices[i + 2] * position_stride, p0, e2);
+        cross3(e1, e2, n);
+
+        const float length = sqrtf(dot3(n, n));
+
+        if (length == 0.0f)
+            continue;
+
+        const double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+        const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+        const double w = length * 0.5;
+        quadric q;
+
+        q.a2 = w * a * a; q.b2 = w * b * b; q.c2 = w * c * c; q.d2 = w * d * d;
+        q.ab = w * a * b; q.ac = w * a * c; q.ad = w * a * d;
+        q.bc = w * b * c; q.bd = w * b * d; q.cd = w * c * d;
+        q.weight = w;
+
+        for (j = 0; j < 3; j++)
+        {
+            add_quadric(quadrics[indices[i + j]], q);
+        }
+    }
+
+    // Collapse in passes. Each pass takes the cheapest collapses whose
+    // neighbourhoods don't overlap, which keeps every decision local and
+    // valid without maintaining a priority queue.
+    while (current.size() > target_index_count)
+    {
+        const size_t triangles = current.size() / 3;
+        size_t removed = 0;
+        size_t applied = 0;
+
+        std::fill(adjacency_offset.begin(), adjacency_offset.end(), 0);
+        for (i = 0; i < current.size(); i++)
+        {
+            adjacency_offset[current[i] + 1]++;
+        }
+        for (i = 0; i < vertex_count; i++)
+        {
+            adjacency_offset[i + 1] += adjacency_offset[i];
+        }
+        adjacency.resize(current.size());
+        {
+            std::vector<unsigned int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+            for (i = 0; i < current.size(); i++)
+            {
+                adjacency[fill[current[i]]++] = (unsigned int)(i / 3);
+            }
+        }
+
+        // The cheapest collapse out of each vertex, as mean squared distance
+        // from the planes of both ends
+        collapses.clear();
+        for (i = 0; i < vertex_count; i++)
+        {
+            best[i].error = HUGE_VALF;
+            self_error[i] = quadric_eval(quadrics[i], positions + i * position_stride);
+        }
+
+        for (i = 0; i < current.size(); i++)
+        {
+            const unsigned int u = current[i];
+            const unsigned int v = current[i - i % 3 + (i + 1) % 3];
+
+            for (j = 0; j < 2; j++)
+            {
+                const unsigned int from = j ? v : u;
+                const unsigned int to = j ? u : v;
+
+                if (!locked[from])
+                {
+                    const double weight = quadrics[from].weight + quadrics[to].weight;
+                    const double e = quadric_eval(quadrics[from], positions + to * position_stride) + self_error[to];
+                    const float mean = weight > 0.0 ? (float)(fabs(e) / weight) : 0.0f;
+
+                    if (mean < best[from].error)
+                    {
+                        best[from].error = mean;
+                        best[from].from = from;
+                        best[from].to = to;
+                    }
+                }
+            }
+        }
+
+        for (i = 0; i < vertex_count; i++)
+        {
+            if (best[i].error <= max_error * max_error)
+            {
+                best[i].error = sqrtf(best[i].error);
+                collapses.push_back(best[i]);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), collapse_order);
+
+        for (i = 0; i < vertex_count; i++)
+        {
+            remap[i] = (unsigned int)i;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+
+        for (i = 0; i < collapses.size() && (triangles - removed) * 3 > target_index_count; i++)
+        {
+            const collapse& c = collapses[i];
+            unsigned int k, shared = 0, common = 0;
+
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            // The edge must have exactly as many vertices in common around
+            // it as triangles on it, or the collapse pinches the surface
+            for (k = adjacency_offset[c.from]; k < adjacency_offset[c.from + 1]; k++)
+            {
+                const unsigned int * tri = &current[adjacency[k] * 3];
+
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                    shared++;
+            }
+
+            stamp += 2;
+
+            for (k = adjacency_offset[c.to]; k < adjacency_offset[c.to + 1]; k++)
+            {
+                const unsigned int * tri = &current[adjacency[k] * 3];
+
+                mark[tri[0]] = mark[tri[1]] = mark[tri[2]] = stamp;
+            }
+
+            for (k = adjacency_offset[c.from]; k < adjacency_offset[c.from + 1]; k++)
+            {
+                const unsigned int * tri = &current[adjacency[k] * 3];
+                unsigned int m;
+
+                for (m = 0; m < 3; m++)
+                {
+                    const unsigned int v = tri[m];
+
+                    if (v != c.from && v != c.to && mark[v] == stamp)
+                    {
+                        mark[v] = stamp + 1;
+                        common++;
+                    }
+                }
+            }
+
+            if (shared == 0 || common != shared ||
+                collapse_flips(c.from, c.to, &current[0], &adjacency[0],
+                               adjacency_offset[c.from], adjacency_offset[c.from + 1],
+                               positions, position_stride))
+            {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            add_quadric(quadrics[c.to], quadrics[c.from]);
+            error = std::max(error, c.error);
+            removed += shared;
+            applied++;
+
+            // Only the triangles around from change, so nothing on them can
+            // take part in another collapse until the next pass
+            for (k = adjacency_offset[c.from]; k < adjacency_offset[c.from + 1]; k++)
+            {
+                const unsigned int * tri = &current[adjacency[k] * 3];
+
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+        }
+
+        if (applied == 0)
+            break;
+
+        // Apply the pass and drop the triangles that collapsed to lines
+        for (i = 0, j = 0; i < current.size(); i += 3)
+        {
+            const unsigned int a = remap[current[i]];
+            const unsigned int b = remap[current[i + 1]];
+            const unsigned int c = remap[current[i + 2]];
+
+            if (a != b && b != c && c != a)
+            {
+                current[j++] = a;
+                current[j++] = b;
+                current[j++] = c;
+            }
+        }
+
+        current.resize(j);
+    }
+
+    if (!current.empty())
+        memcpy(dst, &current[0], current.size() * sizeof(unsigned int));
+
+    if (result_error != NULL)
+        *result_error = error;
+
+    return current.size();
+}
+
+// Lists the corners (triangle * 3 + corner) that touch each key, where
+// keys[v] is the key of vertex v, as offsets into corners
+static void build_corner_lists(std::vector<unsigned int>& offsets,
+                               std::vector<unsigned int>& corners,
+                               const unsigned int * indices,
+                               size_t index_count,
+                               const unsigned int * keys,
+                               size_t key_count)
+{
+    size_t i;
+
+    offsets.assign(key_count + 1, 0);
+    corners.resize(index_count);
+
+    for (i = 0; i < index_count; i++)
+    {
+        offsets[keys[indices[i]] + 1]++;
+    }
+
+    for (i = 0; i < key_count; i++)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+
+    for (i = 0; i < index_count; i++)
+    {
+        corners[fill[keys[indices[i]]]++] = (unsigned int)i;
+    }
+}
+
+// Angle at a corner of a triangle, between its two edges projected onto the
+// plane of n if it isn't NULL
+static float corner_angle(const float * p, const float * p1, const float * p2, const float * n)
+{
+    float e1[3], e2[3];
+    int j;
+
+    sub3(p1, p, e1);
+    sub3(p2, p, e2);
+
+    if (n != NULL)
+    {
+        const float d1 = dot3(e1, n);
+        const float d2 = dot3(e2, n);
+
+        for (j = 0; j < 3; j++)
+        {
+            e1[j] -= n[j] * d1;
+            e2[j] -= n[j] * d2;
+        }
+    }
+
+    const float l = sqrtf(dot3(e1, e1) * dot3(e2, e2));
+
+    if (!(l > 0.0f))
+        return 0.0f;
+
+    return acosf(std::max(-1.0f, std::min(1.0f, dot3(e1, e2) / l)));
+}
+
+static void normalize3(float v[3], const float fallback[3])
+{
+    const float length = sqrtf(dot3(v, v));
+    int j;
+
+    for (j = 0; j < 3; j++)
+    {
+        v[j] = length > 0.0f ? v[j] / length : fallback[j];
+    }
+}
+
+// Numbers vertices so that those with the same position get the same
+// number, and returns how many numbers were used
+static size_t group_positions(std::vector<unsigned int>& group,
+                              const float * positions,
+                              size_t position_stride,
+                              size_t vertex_count)
+{
+    std::vector<float> packed(vertex_count * 3);
+    size_t i;
+
+    group.resize(vertex_count);
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        memcpy(&packed[i * 3], positions + i * position_stride, 3 * sizeof(float));
+    }
+
+    return vertex_count ? generate_vertex_remap(&group[0], &packed[0], vertex_count, 3 * sizeof(float)) : 0;
+}
+
+void generate_normals(float * normals,
+                      const unsigned int * indices,
+                      size_t index_count,
+                      const float * positions,
+                      size_t position_stride,
+                      size_t vertex_count)
+{
+    static const float up[3] = { 0.0f, 0.0f, 1.0f };
+    const size_t triangle_count = index_count / 3;
+    std::vector<unsigned int> group;
+    std::vector<float> face_normals(triangle_count * 3);
+    std::vector<float> group_normals;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> corners;
+    int i;
+
+    const size_t group_count = group_positions(group, positions, position_stride, vertex_count);
+
+    build_corner_lists(offsets, corners, indices, triangle_count * 3, &group[0], group_count);
+
+#pragma omp parallel for
+    for (i = 0; i < (int)triangle_count; i++)
+    {
+        const float * p0 = positions + indices[i * 3 + 0] * position_stride;
+        float e1[3], e2[3];
+
+        sub3(positions + indices[i * 3 + 1] * position_stride, p0, e1);
+        sub3(positions + indices[i * 3 + 2] * position_stride, p0, e2);
+        cross3(e1, e2, &face_normals[i * 3]);
+        normalize3(&face_normals[i * 3], up);
+    }
+
+    // Each position sums the face normals around it weighted by the angle
+    // of the corner there, so vertices split by other attributes still
+    // get the same normal
+    group_normals.resize(group_count * 3);
+
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < (int)group_count; i++)
+    {
+        float * n = &group_normals[i * 3];
+        unsigned int c;
+
+        n[0] = n[1] = n[2] = 0.0f;
+
+        for (c = offsets[i]; c < offsets[i + 1]; c++)
+        {
+            const unsigned int corner = corners[c];
+            const unsigned int * tri = indices + corner - corner % 3;
+            const unsigned int k = corner % 3;
+            const float * f = &face_normals[(corner / 3) * 3];
+            const float angle = corner_angle(positions + tri[k] * position_stride,
+                                             positions + tri[(k + 1) % 3] * position_stride,
+                                             positions + tri[(k + 2) % 3] * position_stride,
+                                             NULL);
+
+            n[0] += f[0] * angle;
+            n[1] += f[1] * angle;
+            n[2] += f[2] * angle;
+        }
+
+        normalize3(n, up);
+    }
+
+#pragma omp parallel for
+    for (i = 0; i < (int)vertex_count; i++)
+    {
+        memcpy(normals + i * 3, &group_normals[group[i] * 3], 3 * sizeof(float));
+    }
+}
+
+void generate_tangents(float * tangents,
+                       const unsigned int * indices,
+                       size_t index_count,
+                       const float * positions,
+                       size_t position_stride,
+                       const float * normals,
+                       size_t normal_stride,
+                       const float * texcoords,
+                       size_t texcoord_stride,
+                       size_t vertex_count)
+{
+    const size_t triangle_count = index_count / 3;
+    std::vector<float> face_tangents(triangle_count * 4);
+    std::vector<unsigned int> identity(vertex_count);
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> corners;
+    int i;
+
+    for (i = 0; i < (int)vertex_count; i++)
+    {
+        identity[i] = i;
+    }
+
+    build_corner_lists(offsets, corners, indices, triangle_count * 3, &identity[0], vertex_count);
+
+    // The direction in which u grows across each triangle, and whether the
+    // texture is mirrored there. Triangles with no area in texture space
+    // have no direction and don't contribute.
+#pragma omp parallel for
+    for (i = 0; i < (int)triangle_count; i++)
+    {
+        const unsigned int * tri = indices + i * 3;
+        const float * p0 = positions + tri[0] * position_stride;
+        const float * t0 = texcoords + tri[0] * texcoord_stride;
+        const float * t1 = texcoords + tri[1] * texcoord_stride;
+        const float * t2 = texcoords + tri[2] * texcoord_stride;
+        float * t = &face_tangents[i * 4];
+        float d1[3], d2[3];
+        int j;
+
+        sub3(positions + tri[1] * position_stride, p0, d1);
+        sub3(positions + tri[2] * position_stride, p0, d2);
+
+        const float t21y = t1[1] - t0[1];
+        const float t31y = t2[1] - t0[1];
+        const float area = (t1[0] - t0[0]) * t31y - t21y * (t2[0] - t0[0]);
+        const float sign = area > 0.0f ? 1.0f : -1.0f;
+
+        for (j = 0; j < 3; j++)
+        {
+            t[j] = (t31y * d1[j] - t21y * d2[j]) * sign;
+        }
+
+        t[3] = area != 0.0f ? sign : 0.0f;
+    }
+
+    // Each vertex sums the corner tangents, made orthogonal to its normal,
+    // weighted by the corner's angle in the tangent plane
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < (int)vertex_count; i++)
+    {
+        const float * n = normals + i * normal_stride;
+        float * result = tangents + i * 4;
+        float sum[3] = { 0.0f, 0.0f, 0.0f };
+        float handedness = 0.0f;
+        unsigned int c;
+        int j;
+
+        for (c = offsets[i]; c < offsets[i + 1]; c++)
+        {
+            const unsigned int corner = corners[c];
+            const unsigned int * tri = indices + corner - corner % 3;
+            const unsigned int k = corner % 3;
+            const float * f = &face_tangents[(corner / 3) * 4];
+            float t[3];
+
+            if (f[3] == 0.0f)
+                continue;
+
+            const float d = dot3(f, n);
+            for (j = 0; j < 3; j++)
+            {
+                t[j] = f[j] - n[j] * d;
+            }
+
+            const float length = sqrtf(dot3(t, t));
+            if (!(length > 0.0f))
+                continue;
+
+            const float angle = corner_angle(positions + tri[k] * position_stride,
+                                             positions + tri[(k + 1) % 3] * position_stride,
+                                             positions + tri[(k + 2) % 3] * position_stride,
+                                             n);
+
+            for (j = 0; j < 3; j++)
+            {
+                sum[j] += t[j] / length * angle;
+            }
+
+            handedness += f[3] * angle;
+        }
+
+        // Anything orthogonal to the normal will do where there's no
+        // texture gradient
+        float fallback[3] = { 0.0f, 0.0f, 0.0f };
+        fallback[fabsf(n[0]) < 0.9f ? 0 : 1] = 1.0f;
+
+        const float d = dot3(fallback, n);
+        for (j = 0; j < 3; j++)
+        {
+            fallback[j] -= n[j] * d;
+        }
+        normalize3(fallback, fallback);
+
+        normalize3(sum, fallback);
+        memcpy(result, sum, 3 * sizeof(float));
+        result[3] = handedness < 0.0f ? -1.0f : 1.0f;
+    }
+}
+
+void generate_face_normals(float * normals,
+                           const unsigned int * indices,
+                           size_t index_count,
+                           const float * positions,
+                           size_t position_stride)
+{
+    int i;
+
+#pragma omp parallel for
+    for (i = 0; i < (int)(index_count / 3); i++)
+    {
+        float * n = normals + (size_t)i * 3;
+
+        if (!triangle_normal(indices + (size_t)i * 3, positions, position_stride, n))
+            n[0] = n[1] = n[2] = 0.0f;
+    }
+}
+
+// Bounds work on fixed-size runs of indices in parallel and then combine
+// the runs' results in order, so they don't depend on the thread count
+static const size_t bounds_run = 16384;
+
+void compute_box(float min[3],
+                 float max[3],
+                 const unsigned int * indices,
+                 size_t index_count,
+                 const float * positions,
+                 size_t position_stride)
+{
+    const size_t run_count = (index_count + bounds_run - 1) / bounds_run;
+    std::vector<float> runs(run_count * 6);
+    size_t r;
+    int i, j;
+
+    for (j = 0; j < 3; j++)
+    {
+        min[j] = index_count ? HUGE_VALF : 0.0f;
+        max[j] = index_count ? -HUGE_VALF : 0.0f;
+    }
+
+#pragma omp parallel for
+    for (i = 0; i < (int)run_count; i++)
+    {
+        const size_t end = std::min(index_count, (size_t)(i + 1) * bounds_run);
+        float lo[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+        float hi[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+        size_t k;
+
+        for (k = (size_t)i * bounds_run; k < end; k++)
+        {
+            const float * p = positions + indices[k] * position_stride;
+
+            lo[0] = std::min(lo[0], p[0]);
+            lo[1] = std::min(lo[1], p[1]);
+            lo[2] = std::min(lo[2], p[2]);
+            hi[0] = std::max(hi[0], p[0]);
+            hi[1] = std::max(hi[1], p[1]);
+            hi[2] = std::max(hi[2], p[2]);
+        }
+
+        memcpy(&runs[(size_t)i * 6], lo, sizeof(lo));
+        memcpy(&runs[(size_t)i * 6 + 3], hi, sizeof(hi));
+    }
+
+    for (r = 0; r < run_count; r++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            min[j] = std::min(min[j], runs[r * 6 + j]);
+            max[j] = std::max(max[j], runs[r * 6 + 3 + j]);
+        }
+    }
+}
+
+// Grows a sphere just enough to take in p
+static void grow_sphere(float center[3], float& radius, const float * p)
+{
+    float d[3];
+
+    sub3(p, center, d);
+
+    const float distance = sqrtf(dot3(d, d));
+
+    if (distance <= radius)
+        return;
+
+    const float new_radius = (radius + distance) * 0.5f;
+    const float t = (new_radius - radius) / distance;
+
+    center[0] += d[0] * t;
+    center[1] += d[1] * t;
+    center[2] += d[2] * t;
+    radius = new_radius;
+}
+
+void compute_sphere(float center[3],
+                    float * radius,
+                    const unsigned int * indices,
+                    size_t index_count,
+                    const float * positions,
+                    size_t position_stride)
+{
+    const size_t run_count = (index_count + bounds_run - 1) / bounds_run;
+    std::vector<unsigned int> extremes(run_count * 6);
+    std::vector<float> spheres(run_count * 4);
+    std::vector<float> distances(run_count * 2);
+    unsigned int extreme[6];
+    size_t r;
+    int i, j;
+
+    center[0] = center[1] = center[2] = 0.0f;
+    *radius = 0.0f;
+
+    if (index_count == 0)
+        return;
+
+    // The vertices furthest along each axis, in both directions
+#pragma omp parallel for
+    for (i = 0; i < (int)run_count; i++)
+    {
+        const size_t end = std::min(index_count, (size_t)(i + 1) * bounds_run);
+        unsigned int * e = &extremes[(size_t)i * 6];
+        size_t k;
+        int m;
+
+        for (m = 0; m < 6; m++)
+        {
+            e[m] = indices[(size_t)i * bounds_run];
+        }
+
+        for (k = (size_t)i * bounds_run; k < end; k++)
+        {
+            const float * p = positions + indices[k] * position_stride;
+
+            for (m = 0; m < 3; m++)
+            {
+                if (p[m] < positions[e[m] * position_stride + m])
+                    e[m] = indices[k];
+                if (p[m] > positions[e[m + 3] * position_stride + m])
+                    e[m + 3] = indices[k];
+            }
+        }
+    }
+
+    memcpy(extreme, &extremes[0], sizeof(extreme));
+    for (r = 1; r < run_count; r++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            if (positions[extremes[r * 6 + j] * position_stride + j] < positions[extreme[j] * position_stride + j])
+                extreme[j] = extremes[r * 6 + j];
+            if (positions[extremes[r * 6 + j + 3] * position_stride + j] > positions[extreme[j + 3] * position_stride + j])
+                extreme[j + 3] = extremes[r * 6 + j + 3];
+        }
+    }
+
+    // Start from the most distant of those pairs
+    int axis = 0;
+    float span = -1.0f;
+
+    for (j = 0; j < 3; j++)
+    {
+        float d[3];
+
+        sub3(positions + extreme[j + 3] * position_stride, positions + extreme[j] * position_stride, d);
+
+        if (dot3(d, d) > span)
+        {
+            span = dot3(d, d);
+            axis = j;
+        }
+    }
+
+    const float * a = positions + extreme[axis] * position_stride;
+    const float * b = positions + extreme[axis + 3] * position_stride;
+    float initial[4];
+
+    for (j = 0; j < 3; j++)
+    {
+        initial[j] = (a[j] + b[j]) * 0.5f;
+    }
+    initial[3] = sqrtf(span) * 0.5f;
+
+    // Each run grows its own copy to take in its vertices. The copies are
+    // then merged, which leaves a sphere that holds all of them.
+#pragma omp parallel for
+    for (i = 0; i < (int)run_count; i++)
+    {
+        const size_t end = std::min(index_count, (size_t)(i + 1) * bounds_run);
+        float * sphere = &spheres[(size_t)i * 4];
+        size_t k;
+
+        memcpy(sphere, initial, sizeof(initial));
+
+        for (k = (size_t)i * bounds_run; k < end; k++)
+        {
+            grow_sphere(sphere, sphere[3], positions + indices[k] * position_stride);
+        }
+    }
+
+    float c[3] = { spheres[0], spheres[1], spheres[2] };
+    float radius_so_far = spheres[3];
+
+    for (r = 1; r < run_count; r++)
+    {
+        const float * s = &spheres[r * 4];
+        float d[3];
+
+        sub3(s, c, d);
+
+        const float distance = sqrtf(dot3(d, d));
+
+        if (distance + s[3] <= radius_so_far)
+            continue;
+
+        if (distance + radius_so_far <= s[3])
+        {
+            memcpy(c, s, sizeof(c));
+            radius_so_far = s[3];
+            continue;
+        }
+
+        const float new_radius = (distance + radius_so_far + s[3]) * 0.5f;
+        const float t = (new_radius - radius_so_far) / distance;
+
+        c[0] += d[0] * t;
+        c[1] += d[1] * t;
+        c[2] += d[2] * t;
+        radius_so_far = new_radius;
+    }
+
+    // Ritter's sphere can come out larger than the one around the center of
+    // the box when the extremes are poorly placed, as on a cube, so both
+    // are measured and the smaller is kept
+    float box_center[3];
+
+    for (j = 0; j < 3; j++)
+    {
+        box_center[j] = (positions[extreme[j] * position_stride + j] +
+                         positions[extreme[j + 3] * position_stride + j]) * 0.5f;
+    }
+
+    // Rounding can leave a vertex a hair outside, and the merged sphere can
+    // be larger than it needs to be around its center, so the radius is
+    // measured again
+#pragma omp parallel for
+    for (i = 0; i < (int)run_count; i++)
+    {
+        const size_t end = std::min(index_count, (size_t)(i + 1) * bounds_run);
+        float farthest = 0.0f;
+        float farthest_box = 0.0f;
+        size_t k;
+
+        for (k = (size_t)i * bounds_run; k < end; k++)
+        {
+            const float * p = positions + indices[k] * position_stride;
+            float d[3];
+
+            sub3(p, c, d);
+            farthest = std::max(farthest, dot3(d, d));
+            sub3(p, box_center, d);
+            farthest_box = std::max(farthest_box, dot3(d, d));
+        }
+
+        distances[(size_t)i * 2] = farthest;
+        distances[(size_t)i * 2 + 1] = farthest_box;
+    }
+
+    float ritter = 0.0f;
+    float box = 0.0f;
+
+    for (r = 0; r < run_count; r++)
+    {
+        ritter = std::max(ritter, distances[r * 2]);
+        box = std::max(box, distances[r * 2 + 1]);
+    }
+
+    if (box < ritter)
+    {
+        memcpy(center, box_center, sizeof(box_center));
+        *radius = sqrtf(box);
+    }
+    else
+    {
+        memcpy(center, c, sizeof(c));
+        *radius = sqrtf(ritter);
+    }
+}
+
+void build_adjacency(unsigned int * dst,
+                     const unsigned int * indices,
+                     size_t index_count,
+                     const float * positions,
+                     size_t position_stride,
+                     size_t vertex_count)
+{
+    const size_t triangle_count = index_count / 3;
+    std::vector<unsigned int> group;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> corners;
+    int i;
+
+    const size_t group_count = group_positions(group, positions, position_stride, vertex_count);
+
+    build_corner_lists(offsets, corners, indices, triangle_count * 3, &group[0], group_count);
+
+    // The neighbour across edge a -> b runs the other way, b -> a, so it
+    // has a corner at b's position whose next vertex is at a's
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (i = 0; i < (int)triangle_count; i++)
+    {
+        const unsigned int * tri = indices + (size_t)i * 3;
+        unsigned int * out = dst + (size_t)i * 6;
+        int k;
+
+        for (k = 0; k < 3; k++)
+        {
+            const unsigned int a = group[tri[k]];
+            const unsigned int b = group[tri[(k + 1) % 3]];
+            unsigned int opposite = tri[(k + 2) % 3];
+            unsigned int c;
+
+            for (c = offsets[b]; c < offsets[b + 1]; c++)
+            {
+                const unsigned int corner = corners[c];
+                const unsigned int * other = indices + corner - corner % 3;
+
+                if (corner / 3 != (unsigned int)i && group[other[(corner + 1) % 3]] == a)
+                {
+                    opposite = other[(corner + 2) % 3];
+                    break;
+                }
+            }
+
+            out[k * 2] = tri[k];
+            out[k * 2 + 1] = opposite;
+        }
+    }
+}
+
+static float sign_not_zero(float f)
+{
+    return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+void decode_octahedral(const float e[2], float n[3])
+{
+    float x = e[0];
+    float y = e[1];
+    const float z = 1.0f - fabsf(x) - fabsf(y);
+
+    // The lower hemisphere is folded over the diagonals
+    if (z < 0.0f)
+    {
+        const float t = x;
+        x = (1.0f - fabsf(y)) * sign_not_zero(t);
+        y = (1.0f - fabsf(t)) * sign_not_zero(y);
+    }
+
+    const float length = sqrtf(x * x + y * y + z * z);
+
+    n[0] = x / length;
+    n[1] = y / length;
+    n[2] = z / length;
+}
+
+void encode_octahedral(const float n[3], unsigned int bits, int e[2])
+{
+    const float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    const float max_code = (float)((1 << (bits - 1)) - 1);
+    float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+    float best_dot = -2.0f;
+    int i, j;
+
+    if (n[2] < 0.0f)
+    {
+        const float t = x;
+        x = (1.0f - fabsf(y)) * sign_not_zero(t);
+        y = (1.0f - fabsf(t)) * sign_not_zero(y);
+    }
+
+    const int fx = (int)floorf(x * max_code);
+    const int fy = (int)floorf(y * max_code);
+
+    e[0] = fx;
+    e[1] = fy;
+
+    // Rounding each component separately isn't the closest code on the
+    // sphere, so try all four around the exact value
+    for (i = 0; i < 2; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            const int cx = std::max(-(int)max_code, std::min((int)max_code, fx + i));
+            const int cy = std::max(-(int)max_code, std::min((int)max_code, fy + j));
+            const float c[2] = { (float)cx / max_code, (float)cy / max_code };
+            float d[3];
+
+            decode_octahedral(c, d);
+
+            const float dot = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+            if (dot > best_dot)
+            {
+                best_dot = dot;
+                e[0] = cx;
+                e[1] = cy;
+            }
+        }
+    }
+}
+
+}
+
+}
@@ -25,123 +25,128 @@
 
 #include "GL/gl3w.h"
 #include <object.h>
+#include <sb7mappedfile.h>
+#include <sb7sbm.h>
 
-#include <stdio.h>
+#include <cstring>
+#include <vector>
 
 namespace sb7
 {
 
 object::object()
     : data_buffer(0),
+      vao(0),
       index_type(0),
-      vao(0)
+      index_offset(0),
+      quantized(false),
+      num_sub_objects(0),
+      sub_object(NULL)
 {
 
 }
 
 object::~object()
 {
-
+    delete [] sub_object;
 }
 
-void object::load(const char * filename)
+bool object::load(const char * filename, unsigned int flags)
 {
-    FILE * infile = fopen(filename, "rb");
-    size_t filesize;
-    char * data;
+    mapped_file file;
+    sbm::file_desc desc;
+    sbm::mesh expanded;
+    std::vector<unsigned char> expanded_vertices;
+    std::vector<SB6M_VERTEX_ATTRIB_DECL> expanded_decls;
+    const SB6M_VERTEX_ATTRIB_DECL * decls;
+    unsigned int attrib_count;
+    unsigned int i;
 
     this->free();
 
-    fseek(infile, 0, SEEK_END);
-    filesize = ftell(infile);
-    fseek(infile, 0, SEEK_SET);
+    // Everything is validated before any GL object is created, so a
+    // truncated or corrupt file fails cleanly instead of crashing or
+    // handing out of range offsets to the driver.
+    if (!file.open(filename) ||
+        !sbm::parse(file.data(), file.size(), desc))
+    {
+        return false;
+    }
 
-    data = new char[filesize];
+    decls = desc.vertex_attribs->attrib_data;
+    attrib_count = desc.vertex_attribs->attrib_count;
 
-    fread(data, filesize, 1, infile);
+    // Quantized files are expanded to floats unless the caller's shaders
+    // can decode them and there are attribute slots left for the scale
+    // and bias
+    if (desc.quantization != NULL)
+    {
+        quantized = (flags & keep_quantized) != 0 && attrib_count <= position_scale_location;
 
-    char * ptr = data;
-    SB6M_HEADER * header = (SB6M_HEADER *)ptr;
-    ptr += header->size;
+        if (!quantized)
+        {
+            sbm::extract(desc, expanded);
+            sbm::dequantize(expanded);
+            sbm::pack_vertices(expanded, expanded_vertices, expanded_decls);
+            decls = &expanded_decls[0];
+        }
+    }
 
-    SB6M_VERTEX_ATTRIB_CHUNK * vertex_attrib_chunk = NULL;
-    SB6M_CHUNK_VERTEX_DATA * vertex_data_chunk = NULL;
-    SB6M_CHUNK_INDEX_DATA * index_data_chunk = NULL;
-    SB6M_CHUNK_SUB_OBJECT_LIST * sub_object_chunk = NULL;
-    SB6M_DATA_CHUNK * data_chunk = NULL;
+    const unsigned char * vertices = expanded_vertices.empty() ? desc.vertices : &expanded_vertices[0];
+    const size_t vertex_size = expanded_vertices.empty() ? desc.vertex_size : expanded_vertices.size();
+    std::vector<unsigned char> narrowed;
+    const unsigned char * indices = desc.indices;
+    size_t index_size = desc.index_size;
 
-    unsigned int i;
-    for (i = 0; i < header->num_chunks; i++)
+    // Indices are narrowed to the smallest type that holds the largest one
+    if (desc.indices != NULL)
     {
-        SB6M_CHUNK_HEADER * chunk = (SB6M_CHUNK_HEADER *)ptr;
-        ptr += chunk->size;
-        switch (chunk->chunk_type)
+        index_type = sbm::narrowest_index_type(desc.max_index);
+
+        if (index_type != desc.index_data->index_type && desc.index_count != 0)
         {
-            case SB6M_CHUNK_TYPE_VERTEX_ATTRIBS:
-                vertex_attrib_chunk = (SB6M_VERTEX_ATTRIB_CHUNK *)chunk;
-                break;
-            case SB6M_CHUNK_TYPE_VERTEX_DATA:
-                vertex_data_chunk = (SB6M_CHUNK_VERTEX_DATA *)chunk;
-                break;
-            case SB6M_CHUNK_TYPE_INDEX_DATA:
-                index_data_chunk = (SB6M_CHUNK_INDEX_DATA *)chunk;
-                break;
-            case SB6M_CHUNK_TYPE_SUB_OBJECT_LIST:
-                sub_object_chunk = (SB6M_CHUNK_SUB_OBJECT_LIST *)chunk;
-                break;
-            case SB6M_CHUNK_TYPE_DATA:
-                data_chunk = (SB6M_DATA_CHUNK *)chunk;
-                break;
-            default:
-                break; // goto failed;
+            sbm::convert_indices(desc, index_type, narrowed);
+            indices = &narrowed[0];
+            index_size = narrowed.size();
         }
     }
-
-// failed:
+    else
+    {
+        index_type = GL_NONE;
+    }
 
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    if (data_chunk != NULL)
+    glGenBuffers(1, &data_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
+
+    if (desc.data != NULL && expanded_vertices.empty() &&
+        (indices == NULL ||
+         (indices == desc.indices && desc.index_data->index_data_offset % sbm::index_size(index_type) == 0)))
     {
-        glGenBuffers(1, &data_buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
-        glBufferData(GL_ARRAY_BUFFER, data_chunk->data_length, (unsigned char*)data_chunk + data_chunk->data_offset, GL_STATIC_DRAW);
+        // A DATA chunk is the whole buffer, indices included, and can go
+        // straight from the mapping
+        glBufferData(GL_ARRAY_BUFFER, vertex_size, vertices, GL_STATIC_DRAW);
+        index_offset = indices != NULL ? desc.index_data->index_data_offset : 0;
     }
     else
     {
-        unsigned int data_size = 0;
-        unsigned int size_used = 0;
-
-        if (vertex_data_chunk != NULL)
-        {
-            data_size += vertex_data_chunk->data_size;
-        }
-
-        if (index_data_chunk != NULL)
-        {
-            data_size += index_data_chunk->index_count * (index_data_chunk->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLubyte));
-        }
+        // Otherwise indices follow the vertices, aligned to four bytes
+        index_offset = (GLuint)((vertex_size + 3) & ~(size_t)3);
 
-        glGenBuffers(1, &data_buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
-        glBufferData(GL_ARRAY_BUFFER, data_size, NULL, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, index_offset + index_size, NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_size, vertices);
 
-        if (vertex_data_chunk != NULL)
+        if (indices != NULL)
         {
-            glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_data_chunk->data_size, data + vertex_data_chunk->data_offset);
-            size_used += vertex_data_chunk->data_offset;
-        }
-
-        if (index_data_chunk != NULL)
-        {
-            glBufferSubData(GL_ARRAY_BUFFER, size_used, index_data_chunk->index_count * (index_data_chunk->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLubyte)), data + index_data_chunk->index_data_offset);
+            glBufferSubData(GL_ARRAY_BUFFER, index_offset, index_size, indices);
         }
     }
 
-    for (i = 0; i < vertex_attrib_chunk->attrib_count; i++)
+    for (i = 0; i < attrib_count; i++)
     {
-        SB6M_VERTEX_ATTRIB_DECL &attrib_decl = vertex_attrib_chunk->attrib_data[i];
+        const SB6M_VERTEX_ATTRIB_DECL &attrib_decl = decls[i];
         glVertexAttribPointer(i,
                               attrib_decl.size,
                               attrib_decl.type,
@@ -151,44 +156,118 @@ void object::load(const char * filename)
         glEnableVertexAttribArray(i);
     }
 
-    if (index_data_chunk != NULL)
+    if (index_type != GL_NONE)
     {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data_buffer);
-        index_type = index_data_chunk->index_type;
-        index_offset = index_data_chunk->index_data_offset;
-    }
-    else
-    {
-        index_type = GL_NONE;
     }
 
-    if (sub_object_chunk != NULL)
+    if (desc.sub_objects != NULL)
     {
-        if (sub_object_chunk->count > MAX_SUB_OBJECTS)
-        {
-            sub_object_chunk->count = MAX_SUB_OBJECTS;
-        }
+        num_sub_objects = desc.sub_objects->count;
+        sub_object = new sub_object_t[num_sub_objects];
 
-        for (i = 0; i < sub_object_chunk->count; i++)
+        for (i = 0; i < num_sub_objects; i++)
         {
-            sub_object[i] = sub_object_chunk->sub_object[i];
+            sub_object[i].first = desc.sub_objects->sub_object[i].first;
+            sub_object[i].count = desc.sub_objects->sub_object[i].count;
         }
-
-        num_sub_objects = sub_object_chunk->count;
     }
     else
     {
-        sub_object[0].first = 0;
-        sub_object[0].count = index_type != GL_NONE ? index_data_chunk->index_count : vertex_data_chunk->total_vertices;
         num_sub_objects = 1;
+        sub_object = new sub_object_t[1];
+        sub_object[0].first = 0;
+        sub_object[0].count = index_type != GL_NONE ? desc.index_count : desc.vertex_count;
     }
 
-    delete[] data;
+    // Bounds come from the mapping while it's still open, so culling code
+    // never has to read vertices back
+    const bool scaled = sbm::attrib_encoding(desc, 0) == SB6M_ATTRIB_ENCODING_POSITION;
+    int j;
+#pragma omp parallel for schedule(dynamic, 16)
+    for (j = 0; j < (int)num_sub_objects; j++)
+    {
+        sub_object_t& sub = sub_object[j];
+
+        if (desc.quantization != NULL)
+            sub.dequant = desc.scale_bias[j];
+
+        sbm::compute_bounds(desc, sub.first, sub.count, sub.bounds, scaled ? &sub.dequant : NULL);
+    }
 
-    fclose(infile);
+    // Meshlet commands index the whole buffer, so they start wherever the
+    // indices landed in it
+    if (desc.meshlets != NULL)
+    {
+        meshlets.load(desc.meshlets->meshlet, desc.meshlets->count, num_sub_objects,
+                      index_offset / sbm::index_size(index_type));
+    }
+
+    if (index_type != GL_NONE)
+    {
+        std::vector<SB6M_SUB_OBJECT_DECL> ranges(num_sub_objects);
+        std::vector<float> radii(num_sub_objects);
+
+        for (i = 0; i < num_sub_objects; i++)
+        {
+            ranges[i].first = sub_object[i].first;
+            ranges[i].count = sub_object[i].count;
+            radii[i] = sub_object[i].bounds.radius;
+        }
+
+        lods.load(&ranges[0], &radii[0], num_sub_objects,
+                  desc.lods != NULL ? desc.lods->lod : NULL,
+                  desc.lods != NULL ? desc.lods->count : 0,
+                  index_offset / sbm::index_size(index_type));
+    }
+
+    if (flags & keep_cpu_copy)
+    {
+        keep_cpu_data(desc);
+    }
 
     glBindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void object::keep_cpu_data(const sbm::file_desc& desc)
+{
+    sbm::mesh m;
+    int i;
+
+    sbm::extract(desc, m);
+    sbm::dequantize(m);
+
+    cpu_positions.resize((size_t)m.vertex_count * 3);
+
+    if (!m.attribs.empty())
+    {
+        const sbm::attrib_array& a = m.attribs[0];
+
+#pragma omp parallel for
+        for (i = 0; i < (int)m.vertex_count; i++)
+        {
+            float value[4];
+
+            sbm::decode_attrib(a.decl, &a.data[(size_t)i * a.element_size], value);
+            memcpy(&cpu_positions[(size_t)i * 3], value, 3 * sizeof(float));
+        }
+    }
+
+    if (m.indexed)
+    {
+        cpu_indices.swap(m.indices);
+    }
+    else
+    {
+        cpu_indices.resize(m.vertex_count);
+        for (i = 0; i < (int)m.vertex_count; i++)
+        {
+            cpu_indices[i] = i;
+        }
+    }
 }
 
 void object::free()
@@ -198,18 +277,41 @@ void object::free()
 
     vao = 0;
     data_buffer = 0;
+    index_type = GL_NONE;
+    quantized = false;
+
+    delete [] sub_object;
+    sub_object = NULL;
+    num_sub_objects = 0;
+    meshlets.free();
+    lods.free();
+    cpu_positions.clear();
+    cpu_indices.clear();
 }
 
-void object::render_sub_object(unsigned int object_index, unsigned int instance_count, unsigned int base_instance)
+void object::bind_sub_object(unsigned int object_index)
 {
     glBindVertexArray(vao);
 
+    if (quantized)
+    {
+        glVertexAttrib3fv(position_scale_location, sub_object[object_index].dequant.scale);
+        glVertexAttrib3fv(position_bias_location, sub_object[object_index].dequant.bias);
+    }
+}
+
+void object::render_sub_object(unsigned int object_index, unsigned int instance_count, unsigned int base_instance)
+{
+    bind_sub_object(object_index);
+
     if (index_type != GL_NONE)
     {
+        const size_t offset = index_offset + (size_t)sub_object[object_index].first * sbm::index_size(index_type);
+
         glDrawElementsInstancedBaseInstance(GL_TRIANGLES,
                                             sub_object[object_index].count,
                                             index_type,
-                                            (void*)sub_object[object_index].first,
+                                            (void*)offset,
                                             instance_count,
                                             base_instance);
     }
@@ -223,4 +325,18 @@ void object::render_sub_object(unsigned int object_index, unsigned int instance_
     }
 }
 
+void object::render_meshlets_indirect(unsigned int object_index, GLsizei draw_count, GLintptr indirect_offset)
+{
+    if (object_index >= num_sub_objects || index_type == GL_NONE)
+        return;
+
+    bind_sub_object(object_index);
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES,
+                                index_type,
+                                (const void *)indirect_offset,
+                                draw_count,
+                                0);
+}
+
 }
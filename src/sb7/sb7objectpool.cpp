@@ -0,0 +1,510 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GL/gl3w.h"
+#include <sb7objectpool.h>
+#include <sb7mappedfile.h>
+
+#include <algorithm>
+
+namespace sb7
+{
+
+free_list::free_list()
+    : capacity(0)
+{
+
+}
+
+void free_list::reset(unsigned int new_capacity)
+{
+    ranges.clear();
+    capacity = 0;
+
+    grow(new_capacity);
+}
+
+void free_list::grow(unsigned int new_capacity)
+{
+    if (new_capacity <= capacity)
+        return;
+
+    const unsigned int old_capacity = capacity;
+
+    capacity = new_capacity;
+    release(old_capacity, new_capacity - old_capacity);
+}
+
+unsigned int free_list::allocate(unsigned int count)
+{
+    size_t i;
+
+    if (count == 0)
+        return 0;
+
+    for (i = 0; i < ranges.size(); i++)
+    {
+        range& r = ranges[i];
+
+        if (r.count >= count)
+        {
+            const unsigned int offset = r.offset;
+
+            r.offset += count;
+            r.count -= count;
+
+            if (r.count == 0)
+                ranges.erase(ranges.begin() + i);
+
+            return offset;
+        }
+    }
+
+    return invalid;
+}
+
+void free_list::release(unsigned int offset, unsigned int count)
+{
+    if (count == 0)
+        return;
+
+    // Find the first free range after this one and merge with it and the
+    // one before where they touch
+    std::vector<range>::iterator next = ranges.begin();
+
+    while (next != ranges.end() && next->offset < offset)
+    {
+        ++next;
+    }
+
+    if (next != ranges.begin())
+    {
+        std::vector<range>::iterator prev = next - 1;
+
+        if (prev->offset + prev->count == offset)
+        {
+            prev->count += count;
+
+            if (next != ranges.end() && prev->offset + prev->count == next->offset)
+            {
+                prev->count += next->count;
+                ranges.erase(next);
+            }
+
+            return;
+        }
+    }
+
+    if (next != ranges.end() && offset + count == next->offset)
+    {
+        next->offset = offset;
+        next->count += count;
+        return;
+    }
+
+    range r;
+    r.offset = offset;
+    r.count = count;
+    ranges.insert(next, r);
+}
+
+unsigned int free_list::get_free_count() const
+{
+    unsigned int total = 0;
+    size_t i;
+
+    for (i = 0; i < ranges.size(); i++)
+    {
+        total += ranges[i].count;
+    }
+
+    return total;
+}
+
+unsigned int free_list::get_largest_free() const
+{
+    unsigned int largest = 0;
+    size_t i;
+
+    for (i = 0; i < ranges.size(); i++)
+    {
+        largest = std::max(largest, ranges[i].count);
+    }
+
+    return largest;
+}
+
+object_pool::object_pool()
+    : vao(0),
+      vertex_buffer(0),
+      index_buffer(0),
+      vertex_size(0)
+{
+
+}
+
+object_pool::~object_pool()
+{
+
+}
+
+bool object_pool::init(const unsigned int * sizes,
+                       unsigned int attrib_count,
+                       unsigned int vertex_capacity,
+                       unsigned int index_capacity)
+{
+    unsigned int i;
+
+    this->free();
+
+    if (attrib_count == 0 || attrib_count > 16)
+        return false;
+
+    for (i = 0; i < attrib_count; i++)
+    {
+        if (sizes[i] < 1 || sizes[i] > 4)
+            return false;
+    }
+
+    attrib_sizes.assign(sizes, sizes + attrib_count);
+    vertex_size = 0;
+    for (i = 0; i < attrib_count; i++)
+    {
+        vertex_size += attrib_sizes[i] * sizeof(GLfloat);
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vertex_buffer);
+    glGenBuffers(1, &index_buffer);
+
+    // Uploads go through the copy targets so that nothing disturbs the
+    // element buffer of whatever VAO the application has bound
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)vertex_capacity * vertex_size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)index_capacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    vertices.reset(vertex_capacity);
+    indices.reset(index_capacity);
+
+    set_vertex_format();
+
+    return true;
+}
+
+void object_pool::free()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vertex_buffer);
+    glDeleteBuffers(1, &index_buffer);
+
+    vao = 0;
+    vertex_buffer = 0;
+    index_buffer = 0;
+    vertex_size = 0;
+
+    attrib_sizes.clear();
+    models.clear();
+    vertices.reset(0);
+    indices.reset(0);
+}
+
+// Called whenever a buffer is reallocated, which can happen in the middle of
+// the application's own setup, so whatever it had bound is put back
+void object_pool::set_vertex_format()
+{
+    GLint old_vao = 0;
+    GLint old_array_buffer = 0;
+    unsigned int i;
+    size_t offset = 0;
+
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_array_buffer);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+
+    for (i = 0; i < attrib_sizes.size(); i++)
+    {
+        glVertexAttribPointer(i, attrib_sizes[i], GL_FLOAT, GL_FALSE, vertex_size, (GLvoid *)offset);
+        glEnableVertexAttribArray(i);
+        offset += attrib_sizes[i] * sizeof(GLfloat);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+
+    glBindVertexArray((GLuint)old_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)old_array_buffer);
+}
+
+// Allocates count units from an arena, moving it to a buffer with at least
+// twice the room if it's too full or too fragmented
+bool object_pool::reserve(free_list& arena, GLuint& buffer,
+                          unsigned int count, unsigned int unit_size, unsigned int& offset)
+{
+    offset = arena.allocate(count);
+
+    if (offset != free_list::invalid)
+        return true;
+
+    const unsigned int old_capacity = arena.get_capacity();
+    unsigned int new_capacity = std::max(old_capacity, 1024u);
+
+    while (new_capacity - old_capacity < count)
+    {
+        if (new_capacity > 0x7FFFFFFF)
+            return false;
+        new_capacity *= 2;
+    }
+
+    GLuint new_buffer;
+
+    glGenBuffers(1, &new_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)new_capacity * unit_size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)old_capacity * unit_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    buffer = new_buffer;
+    arena.grow(new_capacity);
+    set_vertex_format();
+
+    offset = arena.allocate(count);
+
+    return offset != free_list::invalid;
+}
+
+unsigned int object_pool::load(const char * filename)
+{
+    mapped_file file;
+    sbm::file_desc desc;
+    sbm::mesh m;
+    model_t model;
+    std::vector<GLfloat> vertex_data;
+    unsigned int i, j, k;
+
+    if (vao == 0 ||
+        !file.open(filename) ||
+        !sbm::parse(file.data(), file.size(), desc))
+    {
+        return invalid_model;
+    }
+
+    sbm::extract(desc, m);
+    sbm::dequantize(m);
+
+    // Arrays are drawn as if they were indexed in order, so that every
+    // model in the pool can go through the same glMultiDrawElementsIndirect
+    if (!m.indexed)
+    {
+        m.indices.resize(m.vertex_count);
+        for (i = 0; i < m.vertex_count; i++)
+        {
+            m.indices[i] = i;
+        }
+    }
+
+    // Interleave the pool's layout. Slots the file doesn't have get GL's
+    // defaults for a missing attribute.
+    const unsigned int floats_per_vertex = vertex_size / sizeof(GLfloat);
+
+    vertex_data.resize((size_t)m.vertex_count * floats_per_vertex);
+
+    for (i = 0; i < m.vertex_count; i++)
+    {
+        GLfloat * dst = &vertex_data[(size_t)i * floats_per_vertex];
+
+        for (j = 0; j < attrib_sizes.size(); j++)
+        {
+            float value[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+            if (j < m.attribs.size())
+            {
+                const sbm::attrib_array& a = m.attribs[j];
+                sbm::decode_attrib(a.decl, &a.data[(size_t)i * a.element_size], value);
+            }
+
+            for (k = 0; k < attrib_sizes[j]; k++)
+            {
+                *dst++ = value[k];
+            }
+        }
+    }
+
+    model.in_use = true;
+    model.vertex_count = m.vertex_count;
+    model.index_count = (unsigned int)m.indices.size();
+
+    if (!reserve(vertices, vertex_buffer, model.vertex_count, vertex_size, model.first_vertex))
+        return invalid_model;
+
+    if (!reserve(indices, index_buffer, model.index_count, sizeof(GLuint), model.first_index))
+    {
+        vertices.release(model.first_vertex, model.vertex_count);
+        return invalid_model;
+    }
+
+    if (!vertex_data.empty())
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)model.first_vertex * vertex_size,
+                        vertex_data.size() * sizeof(GLfloat), &vertex_data[0]);
+    }
+
+    if (!m.indices.empty())
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)model.first_index * sizeof(GLuint),
+                        m.indices.size() * sizeof(GLuint), &m.indices[0]);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Bounds come from the file, before anything was expanded
+    const bool scaled = sbm::attrib_encoding(desc, 0) == SB6M_ATTRIB_ENCODING_POSITION;
+
+    model.sub_objects.resize(m.sub_objects.size());
+    for (i = 0; i < m.sub_objects.size(); i++)
+    {
+        sub_object_t& sub = model.sub_objects[i];
+
+        sub.first = m.sub_objects[i].first;
+        sub.count = m.sub_objects[i].count;
+        sbm::compute_bounds(desc, sub.first, sub.count, sub.bounds,
+                            scaled ? &desc.scale_bias[i] : NULL);
+    }
+
+    for (i = 0; i < models.size(); i++)
+    {
+        if (!models[i].in_use)
+        {
+            models[i] = model;
+            return i;
+        }
+    }
+
+    models.push_back(model);
+
+    return (unsigned int)models.size() - 1;
+}
+
+void object_pool::unload(unsigned int model)
+{
+    if (model >= models.size() || !models[model].in_use)
+        return;
+
+    model_t& m = models[model];
+
+    vertices.release(m.first_vertex, m.vertex_count);
+    indices.release(m.first_index, m.index_count);
+
+    m.in_use = false;
+    m.sub_objects.clear();
+}
+
+unsigned int object_pool::get_sub_object_count(unsigned int model) const
+{
+    if (model >= models.size() || !models[model].in_use)
+        return 0;
+
+    return (unsigned int)models[model].sub_objects.size();
+}
+
+void object_pool::get_sub_object_bounds(unsigned int model, unsigned int index, sbm::bounds &b) const
+{
+    if (index >= get_sub_object_count(model))
+    {
+        b = sbm::bounds();
+    }
+    else
+    {
+        b = models[model].sub_objects[index].bounds;
+    }
+}
+
+void object_pool::get_draw_command(unsigned int model,
+                                   unsigned int index,
+                                   draw_elements_indirect_command &command,
+                                   unsigned int instance_count,
+                                   unsigned int base_instance) const
+{
+    if (index >= get_sub_object_count(model))
+    {
+        command.count = 0;
+        command.instance_count = 0;
+        command.first_index = 0;
+        command.base_vertex = 0;
+        command.base_instance = 0;
+    }
+    else
+    {
+        const model_t& m = models[model];
+
+        command.count = m.sub_objects[index].count;
+        command.instance_count = instance_count;
+        command.first_index = m.first_index + m.sub_objects[index].first;
+        command.base_vertex = (int)m.first_vertex;
+        command.base_instance = base_instance;
+    }
+}
+
+void object_pool::bind() const
+{
+    glBindVertexArray(vao);
+}
+
+void object_pool::render_sub_object(unsigned int model,
+                                    unsigned int index,
+                                    unsigned int instance_count,
+                                    unsigned int base_instance) const
+{
+    draw_elements_indirect_command command;
+
+    get_draw_command(model, index, command, instance_count, base_instance);
+
+    if (command.count == 0)
+        return;
+
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                                                  command.count,
+                                                  GL_UNSIGNED_INT,
+                                                  (void *)((size_t)command.first_index * sizeof(GLuint)),
+                                                  command.instance_count,
+                                                  command.base_vertex,
+                                                  command.base_instance);
+}
+
+void object_pool::render_indirect(GLsizei draw_count, GLintptr indirect_offset) const
+{
+    glMultiDrawElementsIndirect(GL_TRIANGLES,
+                                GL_UNSIGNED_INT,
+                                (const void *)indirect_offset,
+                                draw_count,
+                                0);
+}
+
+}
@@ -0,0 +1,420 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include <sb7preprocessor.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace sb7
+{
+
+static bool read_file(const std::string& filename, std::string& text)
+{
+    FILE * fp = fopen(filename.c_str(), "rb");
+    long size;
+
+    if (!fp)
+        return false;
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    text.resize(size > 0 ? size : 0);
+
+    const bool ok = size >= 0 && (size == 0 || fread(&text[0], 1, size, fp) == (size_t)size);
+
+    fclose(fp);
+
+    return ok;
+}
+
+static const char * skip_space(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+    return p;
+}
+
+// If line is the preprocessor directive name, returns where its arguments
+// start, otherwise NULL
+static const char * directive(const char * line, const char * end, const char * name)
+{
+    const size_t length = strlen(name);
+    const char * p = skip_space(line, end);
+
+    if (p == end || *p++ != '#')
+        return NULL;
+
+    p = skip_space(p, end);
+
+    if ((size_t)(end - p) < length || strncmp(p, name, length) != 0)
+        return NULL;
+
+    p += length;
+
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        return NULL;
+
+    return skip_space(p, end);
+}
+
+// Returns the file named by an #include "file" line, or an empty string if
+// the line isn't one
+static std::string include_name(const char * line, const char * end)
+{
+    const char * p = directive(line, end, "include");
+
+    if (p == NULL || p == end || *p++ != '"')
+        return std::string();
+
+    const char * name = p;
+
+    while (p < end && *p != '"')
+        p++;
+
+    return p < end ? std::string(name, p) : std::string();
+}
+
+static bool is_pragma_once(const char * line, const char * end)
+{
+    const char * p = directive(line, end, "pragma");
+
+    if (p == NULL || (size_t)(end - p) < 4 || strncmp(p, "once", 4) != 0)
+        return false;
+
+    return p + 4 == end || p[4] == ' ' || p[4] == '\t' || p[4] == '\r';
+}
+
+preprocessor::preprocessor()
+{
+
+}
+
+void preprocessor::define(const char * name, const char * value)
+{
+    define_list::iterator it;
+
+    for (it = defines.begin(); it != defines.end(); ++it)
+    {
+        if (it->first == name)
+        {
+            it->second = value ? value : "";
+            return;
+        }
+    }
+
+    defines.push_back(std::make_pair(std::string(name), std::string(value ? value : "")));
+}
+
+void preprocessor::undefine(const char * name)
+{
+    define_list::iterator it;
+
+    for (it = defines.begin(); it != defines.end(); ++it)
+    {
+        if (it->first == name)
+        {
+            defines.erase(it);
+            return;
+        }
+    }
+}
+
+void preprocessor::add_file(const char * filename, const char * text)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    files[filename] = text;
+}
+
+void preprocessor::invalidate(const char * filename)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (filename)
+        files.erase(filename);
+    else
+        files.clear();
+}
+
+bool preprocessor::get_file(const std::string& filename, std::string& text)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<std::string, std::string>::const_iterator it = files.find(filename);
+
+        if (it != files.end())
+        {
+            text = it->second;
+            return true;
+        }
+    }
+
+    // Read outside the lock. If another thread gets there first, either
+    // copy will do.
+    if (!read_file(filename, text))
+        return false;
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    files.insert(std::make_pair(filename, text));
+
+    return true;
+}
+
+bool preprocessor::include(const std::string& filename,
+                           const char * text,
+                           const char * end,
+                           unsigned int line,           // Of text's first line
+                           output& out,
+                           std::vector<std::string>& once,
+                           int depth)
+{
+    const size_t slash = filename.find_last_of("/\\");
+    const std::string directory = slash != std::string::npos ? filename.substr(0, slash + 1) : std::string();
+    const unsigned int source_number = (unsigned int)out.files.size() - 1;
+    const char * p = text;
+    char buffer[64];
+
+    while (p < end)
+    {
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        const char * next = eol != NULL ? eol + 1 : end;
+        const std::string name = include_name(p, eol != NULL ? eol : end);
+
+        line++;
+
+        if (name.empty())
+        {
+            if (is_pragma_once(p, eol != NULL ? eol : end))
+            {
+                if (std::find(once.begin(), once.end(), filename) == once.end())
+                    once.push_back(filename);
+                out.source += '\n';
+            }
+            else
+            {
+                out.source.append(p, next);
+            }
+
+            p = next;
+            continue;
+        }
+
+        const std::string path = directory + name;
+        std::string included;
+
+        p = next;
+
+        if (std::find(once.begin(), once.end(), path) != once.end())
+        {
+            out.source += '\n';
+            continue;
+        }
+
+        if (depth >= 32)
+        {
+            fprintf(stderr, "%s:%u: includes nest too deeply\n", filename.c_str(), line - 1);
+            return false;
+        }
+
+        if (!get_file(path, included))
+        {
+            fprintf(stderr, "%s:%u: can't read %s\n", filename.c_str(), line - 1, path.c_str());
+            return false;
+        }
+
+        out.files.push_back(path);
+        sprintf(buffer, "#line 1 %u\n", (unsigned int)out.files.size() - 1);
+        out.source += buffer;
+
+        if (!include(path, included.c_str(), included.c_str() + included.size(), 1, out, once, depth + 1))
+            return false;
+
+        if (!out.source.empty() && out.source[out.source.size() - 1] != '\n')
+            out.source += '\n';
+
+        sprintf(buffer, "#line %u %u\n", line, source_number);
+        out.source += buffer;
+    }
+
+    return true;
+}
+
+bool preprocessor::expand(const char * filename, const char * extra_defines, output& out)
+{
+    define_list all = defines;
+    std::vector<std::string> once;
+    std::string text;
+    size_t i;
+
+    out.source.clear();
+    out.files.assign(1, filename);
+    out.hash = 0;
+
+    // Per expansion defines replace global ones of the same name
+    for (const char * p = extra_defines; p != NULL && *p != 0; )
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        const char * start = p;
+
+        while (*p != 0 && *p != ' ' && *p != '\t')
+            p++;
+
+        if (p == start)
+            break;
+
+        const std::string token(start, p);
+        const size_t equals = token.find('=');
+        const std::string name = token.substr(0, equals);
+        const std::string value = equals != std::string::npos ? token.substr(equals + 1) : std::string("1");
+
+        for (i = 0; i < all.size() && all[i].first != name; i++)
+            ;
+
+        if (i < all.size())
+            all[i].second = value;
+        else
+            all.push_back(std::make_pair(name, value));
+    }
+
+    if (!get_file(filename, text))
+    {
+        fprintf(stderr, "%s: can't read\n", filename);
+        return false;
+    }
+
+    const char * p = text.c_str();
+    const char * const end = p + text.size();
+    unsigned int line = 0;
+
+    // #version has to come before anything but comments and blank lines,
+    // so the defines go straight after it. Without one they go first. Only
+    // // comments are looked past.
+    if (!all.empty())
+    {
+        const char * q = p;
+        unsigned int n = 0;
+
+        while (q < end)
+        {
+            const char * eol = (const char *)memchr(q, '\n', end - q);
+            const char * next = eol != NULL ? eol + 1 : end;
+            const char * s = skip_space(q, eol != NULL ? eol : end);
+
+            n++;
+
+            if (directive(q, eol != NULL ? eol : end, "version") != NULL)
+            {
+                out.source.append(p, next);
+                if (eol == NULL)
+                    out.source += '\n';
+                p = next;
+                line = n;
+                break;
+            }
+
+            if (s < next && *s != '\n' && *s != '\r' && strncmp(s, "//", 2) != 0)
+                break;
+
+            q = next;
+        }
+
+        for (i = 0; i < all.size(); i++)
+        {
+            out.source += "#define ";
+            out.source += all[i].first;
+            out.source += ' ';
+            out.source += all[i].second;
+            out.source += '\n';
+        }
+
+        char buffer[32];
+
+        sprintf(buffer, "#line %u 0\n", line + 1);
+        out.source += buffer;
+    }
+
+    if (!include(filename, p, end, line + 1, out, once, 0))
+    {
+        out.source.clear();
+        return false;
+    }
+
+    out.hash = hash((const void *)out.source.data(), out.source.size());
+
+    return true;
+}
+
+std::vector<std::string> preprocessor::permutations(const std::vector<std::vector<std::string> >& options)
+{
+    std::vector<std::string> result;
+    std::vector<size_t> choice(options.size(), 0);
+    size_t i;
+
+    for (i = 0; i < options.size(); i++)
+    {
+        if (options[i].empty())
+            return result;
+    }
+
+    for (;;)
+    {
+        std::string set;
+
+        for (i = 0; i < options.size(); i++)
+        {
+            const std::string& option = options[i][choice[i]];
+
+            if (option.empty())
+                continue;
+
+            if (!set.empty())
+                set += ' ';
+            set += option;
+        }
+
+        result.push_back(set);
+
+        // Count in a mixed radix, the last set being the least significant
+        for (i = options.size(); i > 0; i--)
+        {
+            if (++choice[i - 1] < options[i - 1].size())
+                break;
+            choice[i - 1] = 0;
+        }
+
+        if (i == 0)
+            return result;
+    }
+}
+
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "GL/gl3w.h"
+#include <sb7ext.h>
+#include <sb7programbatch.h>
+#include <shader.h>
+
+#include <cstdio>
+
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR          0x91B0
+#define GL_COMPLETION_STATUS_KHR                    0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+namespace sb7
+{
+
+static void print_log(const std::string& filename, const char * log)
+{
+#ifdef _WIN32
+    OutputDebugStringA(filename.c_str());
+    OutputDebugStringA(":");
+    OutputDebugStringA(log);
+    OutputDebugStringA("\n");
+#else
+    fprintf(stderr, "%s: %s\n", filename.c_str(), log);
+#endif
+}
+
+program_batch::program_batch()
+    : parallel_compile(false)
+{
+
+}
+
+program_batch::~program_batch()
+{
+    workers.stop();
+}
+
+unsigned int program_batch::add(const stage * stages, unsigned int stage_count)
+{
+    program_t p;
+    unsigned int i;
+
+    p.stages.resize(stage_count);
+    for (i = 0; i < stage_count; i++)
+    {
+        p.stages[i].filename = stages[i].filename;
+        p.stages[i].type = stages[i].type;
+        p.stages[i].defines = stages[i].defines ? stages[i].defines : "";
+        p.stages[i].read = false;
+        p.stages[i].shader = 0;
+    }
+
+    p.pending = stage_count;
+    p.name = 0;
+    p.submitted = false;
+    p.checked = false;
+    p.linked = false;
+    p.from_cache = false;
+
+    programs.push_back(p);
+
+    return (unsigned int)programs.size() - 1;
+}
+
+void program_batch::read_stage(unsigned int program, unsigned int stage)
+{
+    stage_t& s = programs[program].stages[stage];
+    preprocessor::output out;
+
+    s.read = source.expand(s.filename.c_str(), s.defines.c_str(), out);
+
+    if (s.read)
+    {
+        s.source.swap(out.source);
+        s.files.swap(out.files);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        programs[program].pending--;
+    }
+
+    stage_read.notify_all();
+}
+
+void program_batch::build(program_t& p)
+{
+    std::vector<GLenum> types(p.stages.size());
+    std::vector<const char *> sources(p.stages.size());
+    size_t i;
+
+    p.submitted = true;
+
+    for (i = 0; i < p.stages.size(); i++)
+    {
+        if (!p.stages[i].read)
+        {
+            p.checked = true;
+            return;
+        }
+
+        types[i] = p.stages[i].type;
+        sources[i] = p.stages[i].source.c_str();
+    }
+
+    if (p.stages.empty())
+    {
+        p.checked = true;
+        return;
+    }
+
+    p.name = sb7::program::load_cached(&types[0], &sources[0], (int)p.stages.size());
+
+    if (p.name)
+    {
+        p.from_cache = true;
+        return;
+    }
+
+    p.name = glCreateProgram();
+
+    for (i = 0; i < p.stages.size(); i++)
+    {
+        stage_t& s = p.stages[i];
+
+        s.shader = glCreateShader(s.type);
+        glShaderSource(s.shader, 1, &sources[i], NULL);
+        glCompileShader(s.shader);
+        glAttachShader(p.name, s.shader);
+    }
+
+    glProgramParameteri(p.name, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(p.name);
+}
+
+void program_batch::submit()
+{
+    size_t i, j;
+
+    if (workers.thread_count() == 0)
+    {
+        workers.start();
+
+        if (sb6IsExtensionSupported("GL_KHR_parallel_shader_compile") ||
+            sb6IsExtensionSupported("GL_ARB_parallel_shader_compile"))
+        {
+            PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads =
+                (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)sb6GetProcAddress("glMaxShaderCompilerThreadsKHR");
+
+            if (max_threads == NULL)
+                max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)sb6GetProcAddress("glMaxShaderCompilerThreadsARB");
+
+            if (max_threads != NULL)
+            {
+                // All ones lets the driver decide
+                max_threads(0xFFFFFFFF);
+                parallel_compile = true;
+            }
+        }
+    }
+
+    for (i = 0; i < programs.size(); i++)
+    {
+        for (j = 0; !programs[i].submitted && j < programs[i].stages.size(); j++)
+        {
+            const unsigned int program = (unsigned int)i;
+            const unsigned int stage = (unsigned int)j;
+
+            workers.submit([this, program, stage]() { read_stage(program, stage); });
+        }
+    }
+
+    // Each program goes to GL as soon as its files are in, so the driver
+    // compiles it while the workers read the rest
+    for (i = 0; i < programs.size(); i++)
+    {
+        program_t& p = programs[i];
+
+        if (p.submitted)
+            continue;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            stage_read.wait(guard, [&p]() { return p.pending == 0; });
+        }
+
+        build(p);
+    }
+}
+
+GLuint program_batch::get_program(unsigned int index) const
+{
+    return index < programs.size() ? programs[index].name : 0;
+}
+
+bool program_batch::is_ready(unsigned int index) const
+{
+    GLint done = GL_TRUE;
+
+    if (index >= programs.size() || !programs[index].submitted)
+        return false;
+
+    if (parallel_compile && !programs[index].checked && programs[index].name != 0)
+    {
+        glGetProgramiv(programs[index].name, GL_COMPLETION_STATUS_KHR, &done);
+    }
+
+    return done != GL_FALSE;
+}
+
+bool program_batch::check(unsigned int index)
+{
+    GLint status = 0;
+    size_t i;
+
+    if (index >= programs.size() || !programs[index].submitted)
+        return false;
+
+    program_t& p = programs[index];
+
+    if (p.checked)
+        return p.linked;
+
+    p.checked = true;
+
+    glGetProgramiv(p.name, GL_LINK_STATUS, &status);
+    p.linked = status != GL_FALSE;
+
+    if (!p.linked)
+    {
+        char buffer[4096];
+
+        for (i = 0; i < p.stages.size(); i++)
+        {
+            const stage_t& s = p.stages[i];
+            size_t f;
+
+            if (s.shader == 0)
+                continue;
+
+            glGetShaderiv(s.shader, GL_COMPILE_STATUS, &status);
+
+            if (!status)
+            {
+                glGetShaderInfoLog(s.shader, sizeof(buffer), NULL, buffer);
+                print_log(s.filename, buffer);
+
+                for (f = 1; f < s.files.size(); f++)
+                {
+                    fprintf(stderr, "  source %u is %s\n", (unsigned int)f, s.files[f].c_str());
+                }
+            }
+        }
+
+        glGetProgramInfoLog(p.name, sizeof(buffer), NULL, buffer);
+        print_log(p.stages.empty() ? std::string() : p.stages[0].filename, buffer);
+
+        glDeleteProgram(p.name);
+        p.name = 0;
+    }
+    else if (!p.from_cache)
+    {
+        std::vector<GLenum> types(p.stages.size());
+        std::vector<const char *> sources(p.stages.size());
+
+        for (i = 0; i < p.stages.size(); i++)
+        {
+            types[i] = p.stages[i].type;
+            sources[i] = p.stages[i].source.c_str();
+        }
+
+        sb7::program::save_cached(p.name, &types[0], &sources[0], (int)p.stages.size());
+    }
+
+    // Nothing needs the shaders or their sources any more
+    for (i = 0; i < p.stages.size(); i++)
+    {
+        glDeleteShader(p.stages[i].shader);
+        p.stages[i].shader = 0;
+        std::string().swap(p.stages[i].source);
+    }
+
+    return p.linked;
+}
+
+GLuint program_batch::use(unsigned int index)
+{
+    const GLuint name = check(index) ? programs[index].name : 0;
+
+    glUseProgram(name);
+
+    return name;
+}
+
+void program_batch::free()
+{
+    size_t i, j;
+
+    workers.stop();
+
+    for (i = 0; i < programs.size(); i++)
+    {
+        for (j = 0; j < programs[i].stages.size(); j++)
+        {
+            glDeleteShader(programs[i].stages[j].shader);
+        }
+
+        glDeleteProgram(programs[i].name);
+    }
+
+    programs.clear();
+
+    // So that building them again picks up any edits
+    source.invalidate();
+}
+
+}
@@ -0,0 +1,1346 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sb7sbm.h>
+#include <sb7mappedfile.h>
+#include <sb7mesh.h>
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+
+// Only the enumerant values are needed here; nothing in this file calls GL.
+#include "GL/glcorearb.h"
+
+namespace sb7
+{
+
+namespace sbm
+{
+
+enum { max_attribs = 16 };
+
+static bool in_range(size_t offset, size_t length, size_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+unsigned int index_size(unsigned int index_type)
+{
+    switch (index_type)
+    {
+        case GL_UNSIGNED_BYTE:      return 1;
+        case GL_UNSIGNED_SHORT:     return 2;
+        case GL_UNSIGNED_INT:       return 4;
+        default:                    return 0;
+    }
+}
+
+unsigned int attrib_size(unsigned int size, unsigned int type)
+{
+    unsigned int components = size;
+
+    if (size == GL_BGRA)
+        components = 4;
+    else if (size < 1 || size > 4)
+        return 0;
+
+    switch (type)
+    {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return components;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return components * 2;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+        case GL_FIXED:
+            return components * 4;
+        case GL_DOUBLE:
+            return components * 8;
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+unsigned int narrowest_index_type(unsigned int max_index)
+{
+    return max_index <= 0xFF ? GL_UNSIGNED_BYTE : max_index <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+template <typename T>
+static bool check_indices(const unsigned char * data, unsigned int count, unsigned int vertex_count, unsigned int& max_index)
+{
+    unsigned int i;
+
+    max_index = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        T index;
+        memcpy(&index, data + i * sizeof(T), sizeof(T));
+        if (index >= vertex_count)
+            return false;
+        if (index > max_index)
+            max_index = index;
+    }
+
+    return true;
+}
+
+bool parse(const void * data, size_t size, file_desc& desc)
+{
+    const unsigned char * ptr = (const unsigned char *)data;
+    const SB6M_HEADER * header = (const SB6M_HEADER *)ptr;
+    size_t offset;
+    unsigned int i;
+
+    memset(&desc, 0, sizeof(desc));
+
+    if (size < sizeof(SB6M_HEADER) ||
+        header->magic != SB6M_MAGIC ||
+        header->size < sizeof(SB6M_HEADER) ||
+        header->size > size)
+    {
+        return false;
+    }
+
+    desc.header = header;
+
+    // Find the chunks, making sure each one lies entirely within the file
+    // and is at least as big as the structure it claims to be. Chunks are
+    // overlaid with structures of 32-bit fields, so they must be aligned.
+    offset = header->size;
+
+    for (i = 0; i < header->num_chunks; i++)
+    {
+        const SB6M_CHUNK_HEADER * chunk = (const SB6M_CHUNK_HEADER *)(ptr + offset);
+
+        if ((offset & 3) != 0 ||
+            !in_range(offset, sizeof(SB6M_CHUNK_HEADER), size) ||
+            chunk->size < sizeof(SB6M_CHUNK_HEADER) ||
+            !in_range(offset, chunk->size, size))
+        {
+            return false;
+        }
+
+        switch (chunk->chunk_type)
+        {
+            case SB6M_CHUNK_TYPE_VERTEX_ATTRIBS:
+                {
+                    const SB6M_VERTEX_ATTRIB_CHUNK * c = (const SB6M_VERTEX_ATTRIB_CHUNK *)chunk;
+                    const size_t decls = offsetof(SB6M_VERTEX_ATTRIB_CHUNK, attrib_data);
+                    if (chunk->size < decls ||
+                        c->attrib_count > max_attribs ||
+                        c->attrib_count * sizeof(SB6M_VERTEX_ATTRIB_DECL) > chunk->size - decls)
+                    {
+                        return false;
+                    }
+                    desc.vertex_attribs = c;
+                }
+                break;
+            case SB6M_CHUNK_TYPE_VERTEX_DATA:
+                if (chunk->size < sizeof(SB6M_CHUNK_VERTEX_DATA))
+                    return false;
+                desc.vertex_data = (const SB6M_CHUNK_VERTEX_DATA *)chunk;
+                break;
+            case SB6M_CHUNK_TYPE_INDEX_DATA:
+                if (chunk->size < sizeof(SB6M_CHUNK_INDEX_DATA))
+                    return false;
+                desc.index_data = (const SB6M_CHUNK_INDEX_DATA *)chunk;
+                break;
+            case SB6M_CHUNK_TYPE_SUB_OBJECT_LIST:
+                {
+                    const SB6M_CHUNK_SUB_OBJECT_LIST * c = (const SB6M_CHUNK_SUB_OBJECT_LIST *)chunk;
+                    const size_t decls = offsetof(SB6M_CHUNK_SUB_OBJECT_LIST, sub_object);
+                    if (chunk->size < decls ||
+                        c->count > (chunk->size - decls) / sizeof(SB6M_SUB_OBJECT_DECL))
+                    {
+                        return false;
+                    }
+                    desc.sub_objects = c;
+                }
+                break;
+            case SB6M_CHUNK_TYPE_DATA:
+                {
+                    const SB6M_DATA_CHUNK * c = (const SB6M_DATA_CHUNK *)chunk;
+                    if (chunk->size < sizeof(SB6M_DATA_CHUNK) ||
+                        c->encoding != SB6M_DATA_ENCODING_RAW ||
+                        !in_range(c->data_offset, c->data_length, chunk->size))
+                    {
+                        return false;
+                    }
+                    desc.data = c;
+                }
+                break;
+            case SB6M_CHUNK_TYPE_QUANTIZATION:
+                {
+                    const SB6M_CHUNK_QUANTIZATION * c = (const SB6M_CHUNK_QUANTIZATION *)chunk;
+                    if (chunk->size < sizeof(SB6M_CHUNK_QUANTIZATION) ||
+                        c->attrib_count > max_attribs)
+                    {
+                        return false;
+                    }
+                    const size_t table = chunk->size - sizeof(SB6M_CHUNK_QUANTIZATION);
+                    const size_t attribs = c->attrib_count * sizeof(SB6M_QUANTIZED_ATTRIB);
+                    if (attribs > table ||
+                        c->scale_bias_count > (table - attribs) / sizeof(SB6M_SCALE_BIAS))
+                    {
+                        return false;
+                    }
+                    desc.quantization = c;
+                    desc.quantized_attribs = (const SB6M_QUANTIZED_ATTRIB *)(c + 1);
+                    desc.scale_bias = (const SB6M_SCALE_BIAS *)(desc.quantized_attribs + c->attrib_count);
+                }
+                break;
+            case SB6M_CHUNK_TYPE_MESHLETS:
+                {
+                    const SB6M_CHUNK_MESHLETS * c = (const SB6M_CHUNK_MESHLETS *)chunk;
+                    const size_t decls = offsetof(SB6M_CHUNK_MESHLETS, meshlet);
+                    if (chunk->size < decls ||
+                        c->count > (chunk->size - decls) / sizeof(SB6M_MESHLET_DECL))
+                    {
+                        return false;
+                    }
+                    desc.meshlets = c;
+                }
+                break;
+            case SB6M_CHUNK_TYPE_LOD_LIST:
+                {
+                    const SB6M_CHUNK_LOD_LIST * c = (const SB6M_CHUNK_LOD_LIST *)chunk;
+                    const size_t decls = offsetof(SB6M_CHUNK_LOD_LIST, lod);
+                    if (chunk->size < decls ||
+                        c->count > (chunk->size - decls) / sizeof(SB6M_LOD_DECL))
+                    {
+                        return false;
+                    }
+                    desc.lods = c;
+                }
+                break;
+            default:
+                break;
+        }
+
+        offset += chunk->size;
+    }
+
+    if (desc.vertex_attribs == NULL ||
+        (desc.data == NULL && desc.vertex_data == NULL))
+    {
+        return false;
+    }
+
+    // Locate the vertex and index data. A DATA chunk holds the whole buffer,
+    // so everything else is addressed relative to its payload.
+    const unsigned char * base = ptr;
+    size_t base_size = size;
+
+    if (desc.data != NULL)
+    {
+        base = (const unsigned char *)desc.data + desc.data->data_offset;
+        base_size = desc.data->data_length;
+        desc.vertices = base;
+        desc.vertex_size = base_size;
+    }
+    else
+    {
+        if (!in_range(desc.vertex_data->data_offset, desc.vertex_data->data_size, size))
+            return false;
+        desc.vertices = ptr + desc.vertex_data->data_offset;
+        desc.vertex_size = desc.vertex_data->data_size;
+    }
+
+    if (desc.index_data != NULL)
+    {
+        const size_t stride = index_size(desc.index_data->index_type);
+        if (stride == 0 ||
+            desc.index_data->index_count > base_size / stride ||
+            !in_range(desc.index_data->index_data_offset, desc.index_data->index_count * stride, base_size))
+        {
+            return false;
+        }
+        desc.indices = base + desc.index_data->index_data_offset;
+        desc.index_size = desc.index_data->index_count * stride;
+        desc.index_count = desc.index_data->index_count;
+    }
+
+    // Every attribute must stay inside the vertex data for every vertex. If
+    // the file doesn't say how many vertices there are, the most that fit in
+    // the data is the count.
+    size_t capacity = (size_t)-1;
+
+    for (i = 0; i < desc.vertex_attribs->attrib_count; i++)
+    {
+        const SB6M_VERTEX_ATTRIB_DECL& attrib = desc.vertex_attribs->attrib_data[i];
+        const size_t element = attrib_size(attrib.size, attrib.type);
+        const size_t stride = attrib.stride ? attrib.stride : element;
+
+        if (element == 0 ||
+            !in_range(attrib.data_offset, element, desc.vertex_size))
+        {
+            return false;
+        }
+
+        const size_t fit = (desc.vertex_size - attrib.data_offset - element) / stride + 1;
+        if (fit < capacity)
+            capacity = fit;
+    }
+
+    if (desc.vertex_data != NULL)
+    {
+        if (desc.vertex_data->total_vertices > capacity)
+            return false;
+        desc.vertex_count = desc.vertex_data->total_vertices;
+    }
+    else if (capacity != (size_t)-1)
+    {
+        desc.vertex_count = capacity > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)capacity;
+    }
+
+    // Indices can't reach past the last vertex
+    if (desc.indices != NULL)
+    {
+        bool ok;
+
+        switch (desc.index_data->index_type)
+        {
+            case GL_UNSIGNED_BYTE:
+                ok = check_indices<unsigned char>(desc.indices, desc.index_count, desc.vertex_count, desc.max_index);
+                break;
+            case GL_UNSIGNED_SHORT:
+                ok = check_indices<unsigned short>(desc.indices, desc.index_count, desc.vertex_count, desc.max_index);
+                break;
+            default:
+                ok = check_indices<unsigned int>(desc.indices, desc.index_count, desc.vertex_count, desc.max_index);
+                break;
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    // Sub-objects are ranges of indices for indexed files, or of vertices.
+    // An empty list would leave nothing to draw.
+    const size_t limit = desc.index_data != NULL ? desc.index_count : desc.vertex_count;
+
+    if (desc.sub_objects != NULL)
+    {
+        if (desc.sub_objects->count == 0)
+            return false;
+
+        for (i = 0; i < desc.sub_objects->count; i++)
+        {
+            const SB6M_SUB_OBJECT_DECL& sub = desc.sub_objects->sub_object[i];
+            if (!in_range(sub.first, sub.count, limit))
+                return false;
+        }
+        desc.sub_object_count = desc.sub_objects->count;
+    }
+    else
+    {
+        desc.sub_object_count = 1;
+    }
+
+    // Quantized attributes must be stored in a form their encoding can
+    // decode, and positions need a scale and bias for every sub-object
+    if (desc.quantization != NULL)
+    {
+        if (desc.quantization->scale_bias_count != desc.sub_object_count)
+            return false;
+
+        for (i = 0; i < desc.quantization->attrib_count; i++)
+        {
+            const SB6M_QUANTIZED_ATTRIB& q = desc.quantized_attribs[i];
+
+            if (q.attrib >= desc.vertex_attribs->attrib_count)
+                return false;
+
+            const SB6M_VERTEX_ATTRIB_DECL& decl = desc.vertex_attribs->attrib_data[q.attrib];
+            const bool normalized = (decl.flags & SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED) != 0;
+
+            switch (q.encoding)
+            {
+                case SB6M_ATTRIB_ENCODING_POSITION:
+                    if (!normalized || decl.size != 3 ||
+                        (decl.type != GL_UNSIGNED_BYTE && decl.type != GL_UNSIGNED_SHORT))
+                    {
+                        return false;
+                    }
+                    break;
+                case SB6M_ATTRIB_ENCODING_OCTAHEDRAL:
+                case SB6M_ATTRIB_ENCODING_OCTAHEDRAL_SIGN:
+                    if (!normalized ||
+                        decl.size != (q.encoding == SB6M_ATTRIB_ENCODING_OCTAHEDRAL ? 2u : 3u) ||
+                        (decl.type != GL_BYTE && decl.type != GL_SHORT))
+                    {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    // Meshlets are whole triangles inside their sub-object, in sub-object
+    // order, and only exist for indexed files
+    if (desc.meshlets != NULL)
+    {
+        unsigned int previous = 0;
+
+        if (desc.indices == NULL)
+            return false;
+
+        for (i = 0; i < desc.meshlets->count; i++)
+        {
+            const SB6M_MESHLET_DECL& m = desc.meshlets->meshlet[i];
+
+            if (m.sub_object >= desc.sub_object_count ||
+                m.sub_object < previous ||
+                m.count % 3 != 0 ||
+                m.count > SB6M_MESHLET_MAX_TRIANGLES * 3 ||
+                m.vertex_count > SB6M_MESHLET_MAX_VERTICES ||
+                !(m.radius >= 0.0f))
+            {
+                return false;
+            }
+
+            const unsigned int first = desc.sub_objects != NULL ? desc.sub_objects->sub_object[m.sub_object].first : 0;
+            const unsigned int count = desc.sub_objects != NULL ? desc.sub_objects->sub_object[m.sub_object].count : desc.index_count;
+
+            if (m.first < first || !in_range(m.first - first, m.count, count))
+                return false;
+
+            previous = m.sub_object;
+        }
+    }
+
+    // Levels of detail are whole triangles of an indexed file, sorted by
+    // sub-object and then error
+    if (desc.lods != NULL)
+    {
+        if (desc.indices == NULL)
+            return false;
+
+        for (i = 0; i < desc.lods->count; i++)
+        {
+            const SB6M_LOD_DECL& lod = desc.lods->lod[i];
+            const SB6M_LOD_DECL * prev = i > 0 ? &desc.lods->lod[i - 1] : NULL;
+
+            if (lod.sub_object >= desc.sub_object_count ||
+                lod.count % 3 != 0 ||
+                !in_range(lod.first, lod.count, desc.index_count) ||
+                !(lod.error >= 0.0f) ||
+                (prev != NULL &&
+                 (lod.sub_object < prev->sub_object ||
+                  (lod.sub_object == prev->sub_object && lod.error < prev->error))))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+unsigned int attrib_encoding(const file_desc& desc, unsigned int attrib)
+{
+    unsigned int i;
+
+    if (desc.quantization != NULL)
+    {
+        for (i = 0; i < desc.quantization->attrib_count; i++)
+        {
+            if (desc.quantized_attribs[i].attrib == attrib)
+                return desc.quantized_attribs[i].encoding;
+        }
+    }
+
+    return SB6M_ATTRIB_ENCODING_NONE;
+}
+
+static float half_to_float(unsigned short h)
+{
+    const unsigned int sign = (h & 0x8000u) << 16;
+    const unsigned int exponent = (h >> 10) & 0x1F;
+    const unsigned int mantissa = h & 0x3FF;
+    union { unsigned int u; float f; } v;
+
+    if (exponent == 0)
+    {
+        // Zero or denormal
+        v.f = (float)mantissa * (1.0f / 16777216.0f);
+        v.u |= sign;
+        return v.f;
+    }
+    else if (exponent == 31)
+    {
+        v.u = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else
+    {
+        v.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    return v.f;
+}
+
+template <typename T>
+static float read_component(const unsigned char * ptr, unsigned int i, bool normalized)
+{
+    T value;
+    memcpy(&value, ptr + i * sizeof(T), sizeof(T));
+
+    float f = (float)value;
+
+    if (normalized && std::numeric_limits<T>::is_integer)
+    {
+        f /= (float)std::numeric_limits<T>::max();
+        if (f < -1.0f)
+            f = -1.0f;
+    }
+
+    return f;
+}
+
+void decode_attrib(const SB6M_VERTEX_ATTRIB_DECL& decl, const void * data, float value[4])
+{
+    const unsigned char * ptr = (const unsigned char *)data;
+    const bool normalized = (decl.flags & SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED) != 0;
+    const unsigned int components = decl.size == GL_BGRA ? 4 : decl.size;
+    unsigned int i;
+
+    value[0] = value[1] = value[2] = 0.0f;
+    value[3] = 1.0f;
+
+    switch (decl.type)
+    {
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+            {
+                static const unsigned int bits[4] = { 10, 10, 10, 2 };
+                const bool is_signed = decl.type == GL_INT_2_10_10_10_REV;
+                unsigned int packed;
+                unsigned int shift = 0;
+
+                memcpy(&packed, ptr, sizeof(packed));
+
+                for (i = 0; i < components; i++)
+                {
+                    const unsigned int mask = (1u << bits[i]) - 1;
+                    const unsigned int u = (packed >> shift) & mask;
+                    float f;
+
+                    if (is_signed)
+                    {
+                        const int s = (int)(u << (32 - bits[i])) >> (32 - bits[i]);
+                        f = normalized ? (float)s / (float)(mask >> 1) : (float)s;
+                        if (f < -1.0f && normalized)
+                            f = -1.0f;
+                    }
+                    else
+                    {
+                        f = normalized ? (float)u / (float)mask : (float)u;
+                    }
+
+                    value[i] = f;
+                    shift += bits[i];
+                }
+            }
+            break;
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            // Not used for anything we need to read back
+            break;
+        default:
+            for (i = 0; i < components; i++)
+            {
+                switch (decl.type)
+                {
+                    case GL_BYTE:           value[i] = read_component<signed char>(ptr, i, normalized); break;
+                    case GL_UNSIGNED_BYTE:  value[i] = read_component<unsigned char>(ptr, i, normalized); break;
+                    case GL_SHORT:          value[i] = read_component<short>(ptr, i, normalized); break;
+                    case GL_UNSIGNED_SHORT: value[i] = read_component<unsigned short>(ptr, i, normalized); break;
+                    case GL_INT:            value[i] = read_component<int>(ptr, i, normalized); break;
+                    case GL_UNSIGNED_INT:   value[i] = read_component<unsigned int>(ptr, i, normalized); break;
+                    case GL_FLOAT:          value[i] = read_component<float>(ptr, i, normalized); break;
+                    case GL_DOUBLE:         value[i] = read_component<double>(ptr, i, normalized); break;
+                    case GL_FIXED:          value[i] = read_component<int>(ptr, i, false) * (1.0f / 65536.0f); break;
+                    case GL_HALF_FLOAT:
+                        {
+                            unsigned short h;
+                            memcpy(&h, ptr + i * 2, 2);
+                            value[i] = half_to_float(h);
+                        }
+                        break;
+                }
+            }
+            break;
+    }
+
+    if (decl.size == GL_BGRA)
+    {
+        const float t = value[0];
+        value[0] = value[2];
+        value[2] = t;
+    }
+}
+
+void read_attrib(const file_desc& desc, unsigned int attrib, unsigned int vertex, float value[4])
+{
+    const SB6M_VERTEX_ATTRIB_DECL& decl = desc.vertex_attribs->attrib_data[attrib];
+    const unsigned int element = attrib_size(decl.size, decl.type);
+    const size_t stride = decl.stride ? decl.stride : element;
+
+    decode_attrib(decl, desc.vertices + decl.data_offset + stride * vertex, value);
+}
+
+static void read_position(const file_desc& desc, unsigned int vertex, const SB6M_SCALE_BIAS * dequant, float p[4])
+{
+    int j;
+
+    read_attrib(desc, 0, vertex, p);
+
+    if (dequant != NULL)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            p[j] = p[j] * dequant->scale[j] + dequant->bias[j];
+        }
+    }
+}
+
+static unsigned int vertex_index(const file_desc& desc, unsigned int i)
+{
+    if (desc.indices == NULL)
+        return i;
+
+    switch (desc.index_data->index_type)
+    {
+        case GL_UNSIGNED_BYTE:
+            return desc.indices[i];
+        case GL_UNSIGNED_SHORT:
+            {
+                unsigned short index;
+                memcpy(&index, desc.indices + i * 2, 2);
+                return index;
+            }
+        default:
+            {
+                unsigned int index;
+                memcpy(&index, desc.indices + i * 4, 4);
+                return index;
+            }
+    }
+}
+
+void convert_indices(const file_desc& desc, unsigned int index_type, std::vector<unsigned char>& out)
+{
+    const unsigned int stride = index_size(index_type);
+    unsigned int i;
+
+    out.resize((size_t)desc.index_count * stride);
+
+    for (i = 0; i < desc.index_count; i++)
+    {
+        const unsigned int index = vertex_index(desc, i);
+
+        switch (stride)
+        {
+            case 1:
+                out[i] = (unsigned char)index;
+                break;
+            case 2:
+                {
+                    const unsigned short narrow = (unsigned short)index;
+                    memcpy(&out[i * 2], &narrow, 2);
+                }
+                break;
+            default:
+                memcpy(&out[i * 4], &index, 4);
+                break;
+        }
+    }
+}
+
+void compute_bounds(const file_desc& desc, unsigned int first, unsigned int count, bounds& b,
+                    const SB6M_SCALE_BIAS * dequant)
+{
+    float radius2 = 0.0f;
+    unsigned int i;
+    int j;
+
+    memset(&b, 0, sizeof(b));
+
+    if (count == 0 || desc.vertex_attribs->attrib_count == 0)
+        return;
+
+    for (j = 0; j < 3; j++)
+    {
+        b.min[j] = HUGE_VALF;
+        b.max[j] = -HUGE_VALF;
+    }
+
+    for (i = first; i < first + count; i++)
+    {
+        float p[4];
+        read_position(desc, vertex_index(desc, i), dequant, p);
+        for (j = 0; j < 3; j++)
+        {
+            if (p[j] < b.min[j]) b.min[j] = p[j];
+            if (p[j] > b.max[j]) b.max[j] = p[j];
+        }
+    }
+
+    for (j = 0; j < 3; j++)
+    {
+        b.center[j] = (b.min[j] + b.max[j]) * 0.5f;
+    }
+
+    for (i = first; i < first + count; i++)
+    {
+        float p[4];
+        read_position(desc, vertex_index(desc, i), dequant, p);
+        const float dx = p[0] - b.center[0];
+        const float dy = p[1] - b.center[1];
+        const float dz = p[2] - b.center[2];
+        const float d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 > radius2)
+            radius2 = d2;
+    }
+
+    b.radius = sqrtf(radius2);
+}
+
+void extract(const file_desc& desc, mesh& m)
+{
+    unsigned int i, v;
+
+    m.attribs.resize(desc.vertex_attribs->attrib_count);
+    m.vertex_count = desc.vertex_count;
+    m.indexed = desc.indices != NULL;
+    m.indices.resize(desc.index_count);
+    m.sub_objects.clear();
+
+    for (i = 0; i < desc.vertex_attribs->attrib_count; i++)
+    {
+        const SB6M_VERTEX_ATTRIB_DECL& decl = desc.vertex_attribs->attrib_data[i];
+        attrib_array& a = m.attribs[i];
+        const unsigned int element = attrib_size(decl.size, decl.type);
+        const size_t stride = decl.stride ? decl.stride : element;
+
+        a.decl = decl;
+        a.decl.stride = 0;
+        a.decl.data_offset = 0;
+        a.element_size = element;
+        a.data.resize((size_t)element * m.vertex_count);
+
+        for (v = 0; v < m.vertex_count; v++)
+        {
+            memcpy(&a.data[(size_t)v * element], desc.vertices + decl.data_offset + stride * v, element);
+        }
+    }
+
+    for (i = 0; i < desc.index_count; i++)
+    {
+        m.indices[i] = vertex_index(desc, i);
+    }
+
+    if (desc.sub_objects != NULL)
+    {
+        m.sub_objects.assign(desc.sub_objects->sub_object,
+                             desc.sub_objects->sub_object + desc.sub_objects->count);
+    }
+    else
+    {
+        SB6M_SUB_OBJECT_DECL sub;
+        sub.first = 0;
+        sub.count = m.indexed ? desc.index_count : desc.vertex_count;
+        m.sub_objects.push_back(sub);
+    }
+
+    m.quantized.clear();
+    m.scale_bias.clear();
+
+    if (desc.quantization != NULL)
+    {
+        m.quantized.assign(desc.quantized_attribs, desc.quantized_attribs + desc.quantization->attrib_count);
+        m.scale_bias.assign(desc.scale_bias, desc.scale_bias + desc.quantization->scale_bias_count);
+    }
+
+    m.meshlets.clear();
+
+    if (desc.meshlets != NULL)
+    {
+        m.meshlets.assign(desc.meshlets->meshlet, desc.meshlets->meshlet + desc.meshlets->count);
+    }
+
+    m.lods.clear();
+
+    if (desc.lods != NULL)
+    {
+        m.lods.assign(desc.lods->lod, desc.lods->lod + desc.lods->count);
+    }
+}
+
+bool load(const char * filename, mesh& m)
+{
+    mapped_file file;
+    file_desc desc;
+
+    if (!file.open(filename) ||
+        !parse(file.data(), file.size(), desc))
+    {
+        return false;
+    }
+
+    extract(desc, m);
+
+    return true;
+}
+
+template <typename T>
+static void append(std::vector<unsigned char>& out, const T& value)
+{
+    const unsigned char * ptr = (const unsigned char *)&value;
+    out.insert(out.end(), ptr, ptr + sizeof(T));
+}
+
+static void align(std::vector<unsigned char>& out)
+{
+    out.resize((out.size() + 3) & ~(size_t)3, 0);
+}
+
+static unsigned int component_size(const SB6M_VERTEX_ATTRIB_DECL& decl)
+{
+    switch (decl.type)
+    {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        case GL_DOUBLE:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+void pack_vertices(const mesh& m,
+                   std::vector<unsigned char>& data,
+                   std::vector<SB6M_VERTEX_ATTRIB_DECL>& decls)
+{
+    unsigned int stride = 0;
+    size_t i, v;
+
+    decls.resize(m.attribs.size());
+
+    for (i = 0; i < m.attribs.size(); i++)
+    {
+        const unsigned int alignment = component_size(m.attribs[i].decl) < 4 ? component_size(m.attribs[i].decl) : 4;
+
+        stride = (stride + alignment - 1) & ~(alignment - 1);
+        decls[i] = m.attribs[i].decl;
+        decls[i].data_offset = stride;
+        stride += m.attribs[i].element_size;
+    }
+
+    stride = (stride + 3) & ~3u;
+
+    for (i = 0; i < decls.size(); i++)
+    {
+        decls[i].stride = stride;
+    }
+
+    data.assign((size_t)stride * m.vertex_count, 0);
+
+    for (v = 0; v < m.vertex_count; v++)
+    {
+        for (i = 0; i < m.attribs.size(); i++)
+        {
+            const attrib_array& a = m.attribs[i];
+            memcpy(&data[v * stride + decls[i].data_offset], &a.data[v * a.element_size], a.element_size);
+        }
+    }
+}
+
+bool write(const char * filename, const mesh& m)
+{
+    std::vector<unsigned char> out;
+    std::vector<unsigned char> vertices;
+    std::vector<SB6M_VERTEX_ATTRIB_DECL> decls;
+    unsigned int max_index = 0;
+    unsigned int index_type = GL_NONE;
+    unsigned int index_bytes = 0;
+    size_t vertex_data_chunk, index_data_chunk = 0;
+    const bool write_meshlets = m.indexed && !m.meshlets.empty();
+    const bool write_lods = m.indexed && !m.lods.empty();
+    size_t i;
+    FILE * fp;
+    bool ok = true;
+
+    if (m.attribs.empty() || m.sub_objects.empty())
+        return false;
+
+    pack_vertices(m, vertices, decls);
+
+    if (m.indexed)
+    {
+        for (i = 0; i < m.indices.size(); i++)
+        {
+            if (m.indices[i] > max_index)
+                max_index = m.indices[i];
+        }
+
+        index_type = narrowest_index_type(max_index);
+        index_bytes = index_size(index_type);
+    }
+
+    SB6M_HEADER header;
+    header.magic = SB6M_MAGIC;
+    header.size = sizeof(header);
+    header.num_chunks = 3 + (m.indexed ? 1 : 0) + (m.quantized.empty() ? 0 : 1) + (write_meshlets ? 1 : 0) + (write_lods ? 1 : 0);
+    header.flags = 0;
+    append(out, header);
+
+    SB6M_CHUNK_HEADER chunk;
+    chunk.chunk_type = SB6M_CHUNK_TYPE_VERTEX_ATTRIBS;
+    chunk.size = (unsigned int)(offsetof(SB6M_VERTEX_ATTRIB_CHUNK, attrib_data) + decls.size() * sizeof(SB6M_VERTEX_ATTRIB_DECL));
+    append(out, chunk);
+    append(out, (unsigned int)decls.size());
+    for (i = 0; i < decls.size(); i++)
+    {
+        append(out, decls[i]);
+    }
+
+    vertex_data_chunk = out.size();
+    SB6M_CHUNK_VERTEX_DATA vertex_data;
+    vertex_data.header.chunk_type = SB6M_CHUNK_TYPE_VERTEX_DATA;
+    vertex_data.header.size = sizeof(vertex_data);
+    vertex_data.data_size = (unsigned int)vertices.size();
+    vertex_data.data_offset = 0;
+    vertex_data.total_vertices = m.vertex_count;
+    append(out, vertex_data);
+
+    if (m.indexed)
+    {
+        index_data_chunk = out.size();
+        SB6M_CHUNK_INDEX_DATA index_data;
+        index_data.header.chunk_type = SB6M_CHUNK_TYPE_INDEX_DATA;
+        index_data.header.size = sizeof(index_data);
+        index_data.index_type = index_type;
+        index_data.index_count = (unsigned int)m.indices.size();
+        index_data.index_data_offset = 0;
+        append(out, index_data);
+    }
+
+    chunk.chunk_type = SB6M_CHUNK_TYPE_SUB_OBJECT_LIST;
+    chunk.size = (unsigned int)(offsetof(SB6M_CHUNK_SUB_OBJECT_LIST, sub_object) + m.sub_objects.size() * sizeof(SB6M_SUB_OBJECT_DECL));
+    append(out, chunk);
+    append(out, (unsigned int)m.sub_objects.size());
+    for (i = 0; i < m.sub_objects.size(); i++)
+    {
+        append(out, m.sub_objects[i]);
+    }
+
+    if (!m.quantized.empty())
+    {
+        SB6M_CHUNK_QUANTIZATION quantization;
+        quantization.header.chunk_type = SB6M_CHUNK_TYPE_QUANTIZATION;
+        quantization.header.size = (unsigned int)(sizeof(quantization) +
+                                                  m.quantized.size() * sizeof(SB6M_QUANTIZED_ATTRIB) +
+                                                  m.scale_bias.size() * sizeof(SB6M_SCALE_BIAS));
+        quantization.attrib_count = (unsigned int)m.quantized.size();
+        quantization.scale_bias_count = (unsigned int)m.scale_bias.size();
+        append(out, quantization);
+        for (i = 0; i < m.quantized.size(); i++)
+        {
+            append(out, m.quantized[i]);
+        }
+        for (i = 0; i < m.scale_bias.size(); i++)
+        {
+            append(out, m.scale_bias[i]);
+        }
+    }
+
+    if (write_meshlets)
+    {
+        chunk.chunk_type = SB6M_CHUNK_TYPE_MESHLETS;
+        chunk.size = (unsigned int)(offsetof(SB6M_CHUNK_MESHLETS, meshlet) + m.meshlets.size() * sizeof(SB6M_MESHLET_DECL));
+        append(out, chunk);
+        append(out, (unsigned int)m.meshlets.size());
+        for (i = 0; i < m.meshlets.size(); i++)
+        {
+            append(out, m.meshlets[i]);
+        }
+    }
+
+    if (write_lods)
+    {
+        chunk.chunk_type = SB6M_CHUNK_TYPE_LOD_LIST;
+        chunk.size = (unsigned int)(offsetof(SB6M_CHUNK_LOD_LIST, lod) + m.lods.size() * sizeof(SB6M_LOD_DECL));
+        append(out, chunk);
+        append(out, (unsigned int)m.lods.size());
+        for (i = 0; i < m.lods.size(); i++)
+        {
+            append(out, m.lods[i]);
+        }
+    }
+
+    // Interleaved vertices, then indices
+    align(out);
+    ((SB6M_CHUNK_VERTEX_DATA *)&out[vertex_data_chunk])->data_offset = (unsigned int)out.size();
+    out.insert(out.end(), vertices.begin(), vertices.end());
+
+    if (m.indexed)
+    {
+        align(out);
+        ((SB6M_CHUNK_INDEX_DATA *)&out[index_data_chunk])->index_data_offset = (unsigned int)out.size();
+        for (i = 0; i < m.indices.size(); i++)
+        {
+            const unsigned int index = m.indices[i];
+            if (index_bytes == 1)
+                append(out, (unsigned char)index);
+            else if (index_bytes == 2)
+                append(out, (unsigned short)index);
+            else
+                append(out, index);
+        }
+        align(out);
+    }
+
+    fp = fopen(filename, "wb");
+
+    if (!fp)
+        return false;
+
+    ok &= fwrite(&out[0], out.size(), 1, fp) == 1;
+    ok &= fclose(fp) == 0;
+
+    if (!ok)
+        remove(filename);
+
+    return ok;
+}
+
+static unsigned short float_to_half(float f)
+{
+    union { float f; unsigned int u; } v;
+    v.f = f;
+
+    const unsigned int sign = (v.u >> 16) & 0x8000u;
+    const int exponent = (int)((v.u >> 23) & 0xFF) - 127 + 15;
+    unsigned int mantissa = v.u & 0x7FFFFF;
+
+    if (((v.u >> 23) & 0xFF) == 0xFF)
+        return (unsigned short)(sign | 0x7C00u | (mantissa ? 0x200u : 0));
+
+    if (exponent >= 31)
+        return (unsigned short)(sign | 0x7C00u);
+
+    if (exponent <= 0)
+    {
+        // Denormal or zero, rounded to nearest
+        if (exponent < -10)
+            return (unsigned short)sign;
+        mantissa |= 0x800000;
+        const unsigned int shift = (unsigned int)(14 - exponent);
+        return (unsigned short)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+    }
+
+    // Rounding may carry into the exponent, which is still correct
+    return (unsigned short)((sign | ((unsigned int)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+static bool name_contains(const char * name, const char * what)
+{
+    std::string lower;
+    size_t i;
+
+    for (i = 0; i < sizeof(((SB6M_VERTEX_ATTRIB_DECL *)0)->name) && name[i]; i++)
+    {
+        lower += (char)tolower((unsigned char)name[i]);
+    }
+
+    return lower.find(what) != std::string::npos;
+}
+
+// Finds which sub-object uses each vertex. Returns false if any vertex is
+// used by more than one; vertices nobody uses belong to sub-object 0.
+static bool vertex_owners(const mesh& m, std::vector<unsigned int>& owner)
+{
+    bool exclusive = true;
+    size_t i, j;
+
+    owner.assign(m.vertex_count, ~0u);
+
+    for (i = 0; i < m.sub_objects.size(); i++)
+    {
+        const SB6M_SUB_OBJECT_DECL& sub = m.sub_objects[i];
+
+        for (j = sub.first; j < sub.first + sub.count; j++)
+        {
+            const unsigned int v = m.indexed ? m.indices[j] : (unsigned int)j;
+
+            if (owner[v] == ~0u)
+                owner[v] = (unsigned int)i;
+            else if (owner[v] != i)
+                exclusive = false;
+        }
+    }
+
+    for (i = 0; i < owner.size(); i++)
+    {
+        if (owner[i] == ~0u)
+            owner[i] = 0;
+    }
+
+    return exclusive;
+}
+
+void quantize(mesh& m, unsigned int normal_bits)
+{
+    std::vector<unsigned int> owner;
+    unsigned int a, v;
+    int j;
+
+    if (!m.quantized.empty() || m.attribs.empty())
+        return;
+
+    // Positions. Each sub-object gets its own box unless vertices are
+    // shared, in which case they all get the box around everything. A w
+    // can't be represented, so positions that have one stay as floats.
+    attrib_array& position = m.attribs[0];
+
+    if (position.decl.type == GL_FLOAT && position.decl.size == 3)
+    {
+        const bool exclusive = vertex_owners(m, owner);
+        std::vector<float> lo(m.sub_objects.size() * 3, HUGE_VALF);
+        std::vector<float> hi(m.sub_objects.size() * 3, -HUGE_VALF);
+        std::vector<unsigned char> data((size_t)m.vertex_count * 6);
+        SB6M_QUANTIZED_ATTRIB q;
+
+        if (!exclusive)
+            owner.assign(m.vertex_count, 0);
+
+        for (v = 0; v < m.vertex_count; v++)
+        {
+            const float * p = (const float *)&position.data[(size_t)v * position.element_size];
+            for (j = 0; j < 3; j++)
+            {
+                lo[owner[v] * 3 + j] = std::min(lo[owner[v] * 3 + j], p[j]);
+                hi[owner[v] * 3 + j] = std::max(hi[owner[v] * 3 + j], p[j]);
+            }
+        }
+
+        m.scale_bias.resize(m.sub_objects.size());
+
+        for (a = 0; a < m.sub_objects.size(); a++)
+        {
+            const unsigned int box = exclusive ? a : 0;
+            SB6M_SCALE_BIAS& sb = m.scale_bias[a];
+
+            for (j = 0; j < 3; j++)
+            {
+                float l = lo[box * 3 + j];
+                float h = hi[box * 3 + j];
+
+                // Sub-objects with no vertices
+                if (l > h)
+                    l = h = 0.0f;
+
+                sb.bias[j] = l;
+                sb.scale[j] = h - l;
+            }
+        }
+
+        for (v = 0; v < m.vertex_count; v++)
+        {
+            const float * p = (const float *)&position.data[(size_t)v * position.element_size];
+            const SB6M_SCALE_BIAS& sb = m.scale_bias[owner[v]];
+            unsigned short u[3];
+
+            for (j = 0; j < 3; j++)
+            {
+                const float t = sb.scale[j] > 0.0f ? (p[j] - sb.bias[j]) / sb.scale[j] : 0.0f;
+                u[j] = (unsigned short)(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f + 0.5f);
+            }
+
+            memcpy(&data[(size_t)v * 6], u, 6);
+        }
+
+        position.decl.size = 3;
+        position.decl.type = GL_UNSIGNED_SHORT;
+        position.decl.flags = SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED;
+        position.element_size = 6;
+        position.data.swap(data);
+
+        q.attrib = 0;
+        q.encoding = SB6M_ATTRIB_ENCODING_POSITION;
+        m.quantized.push_back(q);
+    }
+
+    for (a = 1; a < m.attribs.size(); a++)
+    {
+        attrib_array& attrib = m.attribs[a];
+
+        if (attrib.decl.type != GL_FLOAT)
+            continue;
+
+        // Tangents with a handedness in w keep its sign in a third component
+        if ((attrib.decl.size == 3 &&
+             (name_contains(attrib.decl.name, "normal") || name_contains(attrib.decl.name, "tangent"))) ||
+            (attrib.decl.size == 4 && name_contains(attrib.decl.name, "tangent")))
+        {
+            const unsigned int bytes = normal_bits > 8 ? 2 : 1;
+            const unsigned int components = attrib.decl.size == 4 ? 3 : 2;
+            const int one = bytes == 2 ? 32767 : 127;
+            std::vector<unsigned char> data((size_t)m.vertex_count * components * bytes);
+            SB6M_QUANTIZED_ATTRIB q;
+
+            for (v = 0; v < m.vertex_count; v++)
+            {
+                const float * n = (const float *)&attrib.data[(size_t)v * attrib.element_size];
+                int e[3];
+                unsigned int c;
+
+                sb7::mesh::encode_octahedral(n, bytes * 8, e);
+                e[2] = components == 3 && n[3] < 0.0f ? -one : one;
+
+                for (c = 0; c < components; c++)
+                {
+                    if (bytes == 2)
+                    {
+                        const short s = (short)e[c];
+                        memcpy(&data[((size_t)v * components + c) * 2], &s, 2);
+                    }
+                    else
+                    {
+                        data[(size_t)v * components + c] = (unsigned char)(signed char)e[c];
+                    }
+                }
+            }
+
+            attrib.decl.size = components;
+            attrib.decl.type = bytes == 2 ? GL_SHORT : GL_BYTE;
+            attrib.decl.flags = SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED;
+            attrib.element_size = components * bytes;
+            attrib.data.swap(data);
+
+            q.attrib = a;
+            q.encoding = components == 3 ? SB6M_ATTRIB_ENCODING_OCTAHEDRAL_SIGN : SB6M_ATTRIB_ENCODING_OCTAHEDRAL;
+            m.quantized.push_back(q);
+        }
+        else if (attrib.decl.size == 2 &&
+                 (name_contains(attrib.decl.name, "tex") || name_contains(attrib.decl.name, "uv")))
+        {
+            std::vector<unsigned char> data((size_t)m.vertex_count * 4);
+
+            for (v = 0; v < m.vertex_count; v++)
+            {
+                const float * t = (const float *)&attrib.data[(size_t)v * attrib.element_size];
+                const unsigned short h[2] = { float_to_half(t[0]), float_to_half(t[1]) };
+                memcpy(&data[(size_t)v * 4], h, 4);
+            }
+
+            attrib.decl.type = GL_HALF_FLOAT;
+            attrib.element_size = 4;
+            attrib.data.swap(data);
+        }
+    }
+
+    // Half float texture coordinates alone don't need the chunk
+    if (m.quantized.empty())
+        m.scale_bias.clear();
+    else if (m.scale_bias.empty())
+        m.scale_bias.resize(m.sub_objects.size());
+}
+
+void dequantize(mesh& m)
+{
+    std::vector<unsigned int> owner;
+    size_t i;
+    unsigned int v;
+    int j;
+
+    if (m.quantized.empty())
+        return;
+
+    vertex_owners(m, owner);
+
+    for (i = 0; i < m.quantized.size(); i++)
+    {
+        attrib_array& attrib = m.attribs[m.quantized[i].attrib];
+        const unsigned int components = m.quantized[i].encoding == SB6M_ATTRIB_ENCODING_OCTAHEDRAL_SIGN ? 4 : 3;
+        std::vector<unsigned char> data((size_t)m.vertex_count * components * 4);
+
+        for (v = 0; v < m.vertex_count; v++)
+        {
+            float value[4];
+            float out[4];
+
+            decode_attrib(attrib.decl, &attrib.data[(size_t)v * attrib.element_size], value);
+
+            if (m.quantized[i].encoding == SB6M_ATTRIB_ENCODING_POSITION)
+            {
+                const SB6M_SCALE_BIAS& sb = m.scale_bias[owner[v]];
+                for (j = 0; j < 3; j++)
+                {
+                    out[j] = value[j] * sb.scale[j] + sb.bias[j];
+                }
+            }
+            else
+            {
+                sb7::mesh::decode_octahedral(value, out);
+                out[3] = value[2] < 0.0f ? -1.0f : 1.0f;
+            }
+
+            memcpy(&data[(size_t)v * components * 4], out, components * 4);
+        }
+
+        attrib.decl.size = components;
+        attrib.decl.type = GL_FLOAT;
+        attrib.decl.flags = 0;
+        attrib.element_size = components * 4;
+        attrib.data.swap(data);
+    }
+
+    m.quantized.clear();
+    m.scale_bias.clear();
+}
+
+}
+
+}
@@ -24,8 +24,21 @@
 #define _CRT_SECURE_NO_WARNINGS 1
 
 #include "GL/gl3w.h"
+#include <sb7hash.h>
 
 #include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 
 namespace sb7
 {
@@ -146,6 +159,239 @@ fail_compile_shader:
 namespace program
 {
 
+static std::string cache_directory;
+
+void set_binary_cache(const char * directory)
+{
+    cache_directory = directory != NULL ? directory : "";
+
+    if (!cache_directory.empty())
+    {
+#ifdef _WIN32
+        _mkdir(directory);
+#else
+        mkdir(directory, 0777);
+#endif
+    }
+}
+
+// Cache entries start with this, followed by the program binary
+struct binary_header
+{
+    char                magic[4];
+    unsigned int        version;
+    hash_t              check;              // The key with another seed
+    GLenum              format;
+    unsigned int        length;
+};
+
+static const char binary_magic[4] = { 'S', 'B', '7', 'P' };
+
+// Hashes everything that decides whether a binary can be reused, with two
+// seeds: one names the file and the other is kept in it to catch the
+// unlikely case of two keys sharing a name
+static bool program_key(const GLenum * types, const char * const * sources, int shader_count, hash_t key[2])
+{
+    static const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    int i, j;
+
+    key[0] = 0;
+    key[1] = 1;
+
+    for (i = 0; i < (int)(sizeof(strings) / sizeof(strings[0])); i++)
+    {
+        const char * str = (const char *)glGetString(strings[i]);
+
+        if (str == NULL)
+            return false;
+
+        for (j = 0; j < 2; j++)
+        {
+            key[j] = hash(str, strlen(str) + 1, key[j]);
+        }
+    }
+
+    for (i = 0; i < shader_count; i++)
+    {
+        const GLint type = types[i];
+
+        for (j = 0; j < 2; j++)
+        {
+            key[j] = hash(&type, sizeof(type), key[j]);
+            key[j] = hash(sources[i], strlen(sources[i]), key[j]);
+        }
+    }
+
+    return true;
+}
+
+// Sources of compiled shaders as GL has them, for link_from_shaders()
+static bool shader_sources(const GLuint * shaders, int shader_count,
+                           std::vector<GLenum>& types, std::vector<std::string>& sources)
+{
+    std::vector<char> source;
+    int i;
+
+    types.resize(shader_count);
+    sources.resize(shader_count);
+
+    for (i = 0; i < shader_count; i++)
+    {
+        GLint type = 0;
+        GLint length = 0;
+
+        glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+        glGetShaderiv(shaders[i], GL_SHADER_SOURCE_LENGTH, &length);
+
+        if (length <= 0)
+            return false;
+
+        source.resize(length);
+        glGetShaderSource(shaders[i], length, NULL, &source[0]);
+
+        types[i] = (GLenum)type;
+        sources[i].assign(&source[0]);
+    }
+
+    return true;
+}
+
+static bool cache_enabled()
+{
+    GLint formats = 0;
+
+    if (cache_directory.empty())
+        return false;
+
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    return formats > 0;
+}
+
+static std::string binary_filename(hash_t key)
+{
+    char name[32];
+
+    sprintf(name, "/%016llx.bin", key);
+
+    return cache_directory + name;
+}
+
+static GLuint load_binary(const hash_t key[2])
+{
+    const std::string filename = binary_filename(key[0]);
+    FILE * fp = fopen(filename.c_str(), "rb");
+    binary_header header;
+    std::vector<unsigned char> binary;
+    GLuint program = 0;
+    GLint status = 0;
+
+    if (!fp)
+        return 0;
+
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header.magic, binary_magic, sizeof(binary_magic)) == 0 &&
+        header.version == 1 &&
+        header.check == key[1] &&
+        header.length != 0 &&
+        header.length <= (64 << 20))
+    {
+        binary.resize(header.length);
+
+        if (fread(&binary[0], 1, header.length, fp) == header.length)
+        {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, &binary[0], header.length);
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+            // Drivers reject binaries from other versions of themselves,
+            // which is the normal way for an entry to go stale
+            if (!status)
+            {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return program;
+}
+
+static void save_binary(GLuint program, const hash_t key[2])
+{
+    binary_header header;
+    std::vector<unsigned char> binary;
+    GLint length = 0;
+    GLsizei written = 0;
+    char suffix[32];
+
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length <= 0)
+        return;
+
+    binary.resize(length);
+    glGetProgramBinary(program, length, &written, &header.format, &binary[0]);
+
+    if (written <= 0)
+        return;
+
+    memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.version = 1;
+    header.check = key[1];
+    header.length = (unsigned int)written;
+
+    // Readers only ever see a whole file: it's written under a name no
+    // other process uses and renamed over the entry when complete
+    const std::string filename = binary_filename(key[0]);
+#ifdef _WIN32
+    sprintf(suffix, ".%d.tmp", _getpid());
+#else
+    sprintf(suffix, ".%d.tmp", (int)getpid());
+#endif
+    const std::string temp_filename = filename + suffix;
+    FILE * fp = fopen(temp_filename.c_str(), "wb");
+    bool ok;
+
+    if (!fp)
+        return;
+
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(&binary[0], 1, written, fp) == (size_t)written;
+    ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp_filename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_filename.c_str(), filename.c_str()) == 0;
+#endif
+
+    if (!ok)
+        remove(temp_filename.c_str());
+}
+
+GLuint load_cached(const GLenum * types, const char * const * sources, int shader_count)
+{
+    hash_t key[2];
+
+    if (!cache_enabled() || !program_key(types, sources, shader_count, key))
+        return 0;
+
+    return load_binary(key);
+}
+
+void save_cached(GLuint program, const GLenum * types, const char * const * sources, int shader_count)
+{
+    hash_t key[2];
+
+    if (cache_enabled() && program_key(types, sources, shader_count, key))
+    {
+        save_binary(program, key);
+    }
+}
+
 GLuint link_from_shaders(const GLuint * shaders,
                          int shader_count,
                          bool delete_shaders,
@@ -154,6 +400,36 @@ GLuint link_from_shaders(const GLuint * shaders,
     int i;
 
     GLuint program;
+    hash_t key[2];
+    std::vector<GLenum> types;
+    std::vector<std::string> sources;
+    std::vector<const char *> strings;
+    bool cached = cache_enabled() && shader_sources(shaders, shader_count, types, sources);
+
+    if (cached)
+    {
+        for (i = 0; i < shader_count; i++)
+        {
+            strings.push_back(sources[i].c_str());
+        }
+
+        cached = program_key(&types[0], &strings[0], shader_count, key);
+    }
+
+    program = cached ? load_binary(key) : 0;
+
+    if (program)
+    {
+        if (delete_shaders)
+        {
+            for (i = 0; i < shader_count; i++)
+            {
+                glDeleteShader(shaders[i]);
+            }
+        }
+
+        return program;
+    }
 
     program = glCreateProgram();
 
@@ -162,6 +438,11 @@ GLuint link_from_shaders(const GLuint * shaders,
         glAttachShader(program, shaders[i]);
     }
 
+    if (cached)
+    {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(program);
 
     if (check_errors)
@@ -182,6 +463,17 @@ GLuint link_from_shaders(const GLuint * shaders,
         }
     }
 
+    if (cached)
+    {
+        GLint status = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+        if (status)
+        {
+            save_binary(program, key);
+        }
+    }
+
     if (delete_shaders)
     {
         for (i = 0; i < shader_count; i++)
@@ -0,0 +1,463 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "GL/gl3w.h"
+#include <sb7shaderwatch.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _LINUX
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace sb7
+{
+
+static void print_log(const std::string& filename, const char * log)
+{
+#ifdef _WIN32
+    OutputDebugStringA(filename.c_str());
+    OutputDebugStringA(":");
+    OutputDebugStringA(log);
+    OutputDebugStringA("\n");
+#else
+    fprintf(stderr, "%s: %s\n", filename.c_str(), log);
+#endif
+}
+
+static void merge(std::vector<std::string>& files, const std::vector<std::string>& more)
+{
+    std::vector<std::string>::const_iterator it;
+
+    for (it = more.begin(); it != more.end(); ++it)
+    {
+        if (std::find(files.begin(), files.end(), *it) == files.end())
+            files.push_back(*it);
+    }
+}
+
+shader_watcher::shader_watcher()
+    : running(false),
+      notify_fd(-1)
+{
+
+}
+
+shader_watcher::~shader_watcher()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+
+    if (worker.joinable())
+        worker.join();
+
+#ifdef _LINUX
+    if (notify_fd >= 0)
+        close(notify_fd);
+#endif
+}
+
+bool shader_watcher::is_supported()
+{
+#ifdef _LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool shader_watcher::start(const std::function<void (bool)>& make_current)
+{
+#ifdef _LINUX
+    if (notify_fd >= 0)
+        return true;
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (notify_fd < 0)
+        return false;
+
+    running = true;
+    worker = std::thread(&shader_watcher::run, this, make_current);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void shader_watcher::stop()
+{
+    std::vector<result>::const_iterator it;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+
+    if (worker.joinable())
+        worker.join();
+
+    for (it = finished.begin(); it != finished.end(); ++it)
+    {
+        glDeleteProgram(it->name);
+    }
+
+    finished.clear();
+    entries.clear();
+    directories.clear();
+    source.invalidate();
+
+#ifdef _LINUX
+    if (notify_fd >= 0)
+        close(notify_fd);
+#endif
+
+    notify_fd = -1;
+}
+
+void shader_watcher::watch(GLuint * program, const program_batch::stage * stages, unsigned int stage_count)
+{
+    entry e;
+    unsigned int i;
+
+    if (notify_fd < 0)
+        return;
+
+    e.program = program;
+
+    for (i = 0; i < stage_count; i++)
+    {
+        preprocessor::output out;
+
+        e.filenames.push_back(stages[i].filename);
+        e.types.push_back(stages[i].type);
+        e.defines.push_back(stages[i].defines ? stages[i].defines : "");
+
+        // A file that doesn't read yet is still watched, so that it gets
+        // built once it does
+        if (source.expand(stages[i].filename, stages[i].defines, out))
+            merge(e.files, out.files);
+        else
+            merge(e.files, std::vector<std::string>(1, stages[i].filename));
+    }
+
+    add_watches(e.files);
+
+    unwatch(program);
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    entries.push_back(e);
+}
+
+void shader_watcher::unwatch(GLuint * program)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t i;
+
+    for (i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].program == program)
+        {
+            entries.erase(entries.begin() + i);
+            break;
+        }
+    }
+
+    for (i = 0; i < finished.size(); )
+    {
+        if (finished[i].program == program)
+        {
+            glDeleteProgram(finished[i].name);
+            finished.erase(finished.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+unsigned int shader_watcher::update()
+{
+    std::vector<result> ready;
+    std::vector<result>::const_iterator it;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ready.swap(finished);
+    }
+
+    for (it = ready.begin(); it != ready.end(); ++it)
+    {
+        glDeleteProgram(*it->program);
+        *it->program = it->name;
+    }
+
+    return (unsigned int)ready.size();
+}
+
+// Watches directories rather than files, as editors often save by writing
+// a new file and renaming it over the old one
+void shader_watcher::add_watches(const std::vector<std::string>& files)
+{
+#ifdef _LINUX
+    std::vector<std::string>::const_iterator it;
+    std::map<int, std::vector<std::string> >::const_iterator d;
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (it = files.begin(); it != files.end(); ++it)
+    {
+        const size_t slash = it->find_last_of('/');
+        const std::string prefix = slash != std::string::npos ? it->substr(0, slash + 1) : std::string();
+
+        for (d = directories.begin(); d != directories.end(); ++d)
+        {
+            if (std::find(d->second.begin(), d->second.end(), prefix) != d->second.end())
+                break;
+        }
+
+        if (d != directories.end())
+            continue;
+
+        // Watching a directory again returns the descriptor it already has
+        const int wd = inotify_add_watch(notify_fd, prefix.empty() ? "." : prefix.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+        if (wd >= 0)
+            directories[wd].push_back(prefix);
+    }
+#endif
+}
+
+// Runs on the worker with its context current, so it can wait on GL as
+// long as it likes
+GLuint shader_watcher::build(const entry& e, std::vector<std::string>& files)
+{
+    std::vector<GLuint> shaders;
+    GLuint program = 0;
+    GLint status = 0;
+    char buffer[4096];
+    size_t i, j;
+
+    for (i = 0; i < e.filenames.size(); i++)
+    {
+        preprocessor::output out;
+
+        if (!source.expand(e.filenames[i].c_str(), e.defines[i].c_str(), out))
+            break;
+
+        merge(files, out.files);
+
+        const char * text = out.source.c_str();
+        const GLuint shader = glCreateShader(e.types[i]);
+
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+        shaders.push_back(shader);
+
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+        if (!status)
+        {
+            glGetShaderInfoLog(shader, sizeof(buffer), NULL, buffer);
+            print_log(e.filenames[i], buffer);
+
+            for (j = 1; j < out.files.size(); j++)
+            {
+                fprintf(stderr, "  source %u is %s\n", (unsigned int)j, out.files[j].c_str());
+            }
+
+            break;
+        }
+    }
+
+    if (i == e.filenames.size())
+    {
+        program = glCreateProgram();
+
+        for (i = 0; i < shaders.size(); i++)
+        {
+            glAttachShader(program, shaders[i]);
+        }
+
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+        if (!status)
+        {
+            glGetProgramInfoLog(program, sizeof(buffer), NULL, buffer);
+            print_log(e.filenames[0], buffer);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    for (i = 0; i < shaders.size(); i++)
+    {
+        glDeleteShader(shaders[i]);
+    }
+
+    // Objects made in one context are only safe to use from another once
+    // the commands that made them have finished
+    if (program)
+        glFinish();
+
+    return program;
+}
+
+void shader_watcher::run(std::function<void (bool)> make_current)
+{
+#ifdef _LINUX
+    std::vector<std::string> changed;
+    std::vector<std::string>::const_iterator it;
+    std::map<int, std::vector<std::string> >::const_iterator d;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    size_t i, j;
+
+    make_current(true);
+
+    for (;;)
+    {
+        pollfd p = { notify_fd, POLLIN, 0 };
+
+        // Once something has changed, wait for things to go quiet, as
+        // saving a file can take several writes
+        const int ready = poll(&p, 1, changed.empty() ? 100 : 50);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            if (!running)
+                break;
+        }
+
+        if (ready > 0)
+        {
+            const ssize_t length = read(notify_fd, buffer, sizeof(buffer));
+            ssize_t offset = 0;
+
+            std::lock_guard<std::mutex> guard(lock);
+
+            while (offset < length)
+            {
+                const inotify_event * event = (const inotify_event *)(buffer + offset);
+
+                d = directories.find(event->wd);
+
+                if (event->len != 0 && d != directories.end())
+                {
+                    for (it = d->second.begin(); it != d->second.end(); ++it)
+                    {
+                        merge(changed, std::vector<std::string>(1, *it + event->name));
+                    }
+                }
+
+                offset += sizeof(inotify_event) + event->len;
+            }
+
+            continue;
+        }
+
+        if (changed.empty())
+            continue;
+
+        std::vector<entry> dirty;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            for (i = 0; i < entries.size(); i++)
+            {
+                for (it = changed.begin(); it != changed.end(); ++it)
+                {
+                    if (std::find(entries[i].files.begin(), entries[i].files.end(), *it) != entries[i].files.end())
+                    {
+                        dirty.push_back(entries[i]);
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (it = changed.begin(); it != changed.end(); ++it)
+        {
+            source.invalidate(it->c_str());
+        }
+
+        changed.clear();
+
+        for (i = 0; i < dirty.size(); i++)
+        {
+            std::vector<std::string> files = dirty[i].files;
+            const GLuint name = build(dirty[i], files);
+
+            add_watches(files);
+
+            std::lock_guard<std::mutex> guard(lock);
+
+            for (j = 0; j < entries.size() && entries[j].program != dirty[i].program; j++)
+                ;
+
+            // Unwatched while it was being built
+            if (j == entries.size())
+            {
+                glDeleteProgram(name);
+                continue;
+            }
+
+            entries[j].files.swap(files);
+
+            if (name == 0)
+                continue;
+
+            // Still waiting for update() to take the last one
+            for (j = 0; j < finished.size(); j++)
+            {
+                if (finished[j].program == dirty[i].program)
+                {
+                    glDeleteProgram(finished[j].name);
+                    finished.erase(finished.begin() + j);
+                    break;
+                }
+            }
+
+            result r = { dirty[i].program, name };
+
+            finished.push_back(r);
+        }
+    }
+
+    make_current(false);
+#endif
+}
+
+}
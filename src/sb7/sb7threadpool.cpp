@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sb7threadpool.h>
+
+namespace sb7
+{
+
+thread_pool::thread_pool()
+    : stopping(false)
+{
+
+}
+
+thread_pool::~thread_pool()
+{
+    stop();
+}
+
+void thread_pool::start(unsigned int num_threads)
+{
+    unsigned int i;
+
+    stop();
+
+    if (num_threads == 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+        num_threads = num_threads > 1 ? num_threads - 1 : 1;
+    }
+
+    stopping = false;
+
+    for (i = 0; i < num_threads; i++)
+    {
+        threads.push_back(std::thread(&thread_pool::worker, this));
+    }
+}
+
+void thread_pool::stop()
+{
+    size_t i;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    threads.clear();
+}
+
+void thread_pool::submit(const std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(job);
+    }
+
+    wake.notify_one();
+}
+
+void thread_pool::worker()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            while (jobs.empty() && !stopping)
+                wake.wait(guard);
+
+            if (jobs.empty())
+                return;
+
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+}
@@ -0,0 +1,586 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GL/gl3w.h"
+#include <sb7ext.h>
+#include <sb7uniforms.h>
+
+#include <cstring>
+
+namespace sb7
+{
+
+// Components per column and columns of a type, and the setter type that
+// matches it. Opaque types (samplers, images) are set as ints.
+static void type_info(GLenum type, int& components, int& columns, GLenum& value_type)
+{
+    columns = 1;
+
+    switch (type)
+    {
+        case GL_FLOAT:
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+            components = 1; value_type = type; break;
+        case GL_FLOAT_VEC2:
+        case GL_INT_VEC2:
+        case GL_UNSIGNED_INT_VEC2:
+            components = 2; value_type = type; break;
+        case GL_FLOAT_VEC3:
+        case GL_INT_VEC3:
+        case GL_UNSIGNED_INT_VEC3:
+            components = 3; value_type = type; break;
+        case GL_FLOAT_VEC4:
+        case GL_INT_VEC4:
+        case GL_UNSIGNED_INT_VEC4:
+            components = 4; value_type = type; break;
+        case GL_BOOL:
+            components = 1; value_type = GL_INT; break;
+        case GL_BOOL_VEC2:
+            components = 2; value_type = GL_INT_VEC2; break;
+        case GL_BOOL_VEC3:
+            components = 3; value_type = GL_INT_VEC3; break;
+        case GL_BOOL_VEC4:
+            components = 4; value_type = GL_INT_VEC4; break;
+        case GL_FLOAT_MAT2:
+            components = 2; columns = 2; value_type = type; break;
+        case GL_FLOAT_MAT3:
+            components = 3; columns = 3; value_type = type; break;
+        case GL_FLOAT_MAT4:
+            components = 4; columns = 4; value_type = type; break;
+        case GL_FLOAT_MAT2x3:
+            components = 3; columns = 2; value_type = type; break;
+        case GL_FLOAT_MAT2x4:
+            components = 4; columns = 2; value_type = type; break;
+        case GL_FLOAT_MAT3x2:
+            components = 2; columns = 3; value_type = type; break;
+        case GL_FLOAT_MAT3x4:
+            components = 4; columns = 3; value_type = type; break;
+        case GL_FLOAT_MAT4x2:
+            components = 2; columns = 4; value_type = type; break;
+        case GL_FLOAT_MAT4x3:
+            components = 3; columns = 4; value_type = type; break;
+        default:
+            components = 1; value_type = GL_INT; break;
+    }
+}
+
+// Whether values of type are sent with the float, int or unsigned int
+// functions
+static GLenum base_type(GLenum value_type)
+{
+    switch (value_type)
+    {
+        case GL_INT:
+        case GL_INT_VEC2:
+        case GL_INT_VEC3:
+        case GL_INT_VEC4:
+            return GL_INT;
+        case GL_UNSIGNED_INT:
+        case GL_UNSIGNED_INT_VEC2:
+        case GL_UNSIGNED_INT_VEC3:
+        case GL_UNSIGNED_INT_VEC4:
+            return GL_UNSIGNED_INT;
+        default:
+            return GL_FLOAT;
+    }
+}
+
+uniform_cache::uniform_cache()
+    : ring(0),
+      frame_size(0),
+      ring_ptr(NULL),
+      frame(0)
+{
+    memset(fences, 0, sizeof(fences));
+}
+
+uniform_cache::~uniform_cache()
+{
+
+}
+
+void uniform_cache::reflect(GLuint program)
+{
+    GLint count = 0;
+    GLint max_length = 0;
+    GLint alignment = 1;
+    int components, columns;
+    GLenum value_type;
+    int i, j;
+
+    free();
+
+    uniforms.clear();
+    blocks.clear();
+    values.clear();
+    dirty.clear();
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    if (count > 0)
+    {
+        std::vector<GLuint> indices(count);
+        std::vector<GLint> params(count * 7);
+        std::vector<char> name(max_length + 1);
+        static const GLenum pnames[] =
+        {
+            GL_UNIFORM_TYPE, GL_UNIFORM_SIZE, GL_UNIFORM_BLOCK_INDEX, GL_UNIFORM_OFFSET,
+            GL_UNIFORM_ARRAY_STRIDE, GL_UNIFORM_MATRIX_STRIDE, GL_UNIFORM_IS_ROW_MAJOR
+        };
+
+        for (i = 0; i < count; i++)
+        {
+            indices[i] = i;
+        }
+
+        for (j = 0; j < 7; j++)
+        {
+            glGetActiveUniformsiv(program, count, &indices[0], pnames[j], &params[j * count]);
+        }
+
+        uniforms.resize(count);
+
+        for (i = 0; i < count; i++)
+        {
+            uniform& u = uniforms[i];
+
+            name[0] = 0;
+            glGetActiveUniformName(program, i, max_length + 1, NULL, &name[0]);
+
+            u.name = &name[0];
+            u.type = params[i];
+            u.size = params[count + i];
+            u.block = params[count * 2 + i];
+            u.offset = params[count * 3 + i];
+            u.array_stride = params[count * 4 + i];
+            u.matrix_stride = params[count * 5 + i];
+            u.row_major = params[count * 6 + i] != 0;
+            u.location = -1;
+            u.dirty = false;
+
+            if (u.block >= 0)
+                continue;
+
+            // Plain uniforms are packed one after another. Their values are
+            // read back so that setting what's already there sends nothing.
+            type_info(u.type, components, columns, value_type);
+
+            u.location = glGetUniformLocation(program, u.name.c_str());
+            u.offset = (GLint)values.size();
+            values.resize(values.size() + u.size * components * columns * 4);
+
+            for (j = 0; u.location >= 0 && j < u.size; j++)
+            {
+                void * data = &values[u.offset + j * components * columns * 4];
+
+                switch (base_type(value_type))
+                {
+                    case GL_INT:
+                        glGetUniformiv(program, u.location + j, (GLint *)data);
+                        break;
+                    case GL_UNSIGNED_INT:
+                        glGetUniformuiv(program, u.location + j, (GLuint *)data);
+                        break;
+                    default:
+                        glGetUniformfv(program, u.location + j, (GLfloat *)data);
+                        break;
+                }
+            }
+        }
+    }
+
+    count = 0;
+    max_length = 0;
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    if (alignment < 1)
+        alignment = 1;
+
+    if (count > 0)
+    {
+        std::vector<char> name(max_length + 1);
+        bool clash = false;
+
+        blocks.resize(count);
+        frame_size = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            block& b = blocks[i];
+            GLint binding = 0;
+
+            name[0] = 0;
+            glGetActiveUniformBlockName(program, i, max_length + 1, NULL, &name[0]);
+            glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &b.size);
+            glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+
+            b.name = &name[0];
+            b.binding = binding;
+            b.slot = frame_size;
+            b.bound = 0;
+            b.data.assign(b.size, 0);
+            b.dirty = true;
+
+            frame_size += (b.size + alignment - 1) / alignment * alignment;
+
+            for (j = 0; j < i; j++)
+            {
+                clash = clash || blocks[j].binding == b.binding;
+            }
+        }
+
+        // Blocks left at the default binding would all read the same range
+        for (i = 0; clash && i < count; i++)
+        {
+            blocks[i].binding = i;
+            glUniformBlockBinding(program, i, i);
+        }
+    }
+
+    // Half full at most, so probes stay short
+    size_t table_size = 16;
+
+    while (table_size < uniforms.size() * 4)
+        table_size *= 2;
+
+    table.resize(table_size);
+
+    for (i = 0; i < (int)table_size; i++)
+    {
+        table[i].key = 0;
+        table[i].index = -1;
+    }
+
+    for (i = 0; i < (int)uniforms.size(); i++)
+    {
+        const std::string& name = uniforms[i].name;
+
+        insert(name, i);
+
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            insert(name.substr(0, name.size() - 3), i);
+    }
+}
+
+void uniform_cache::insert(const std::string& name, int index)
+{
+    const hash_t key = hash(name.c_str());
+    const size_t mask = table.size() - 1;
+    size_t i = (size_t)key & mask;
+
+    while (table[i].index != -1)
+    {
+        i = (i + 1) & mask;
+    }
+
+    table[i].key = key;
+    table[i].index = index;
+}
+
+int uniform_cache::find(const char * name) const
+{
+    if (table.empty())
+        return -1;
+
+    const hash_t key = hash(name);
+    const size_t mask = table.size() - 1;
+    const size_t length = strlen(name);
+    size_t i = (size_t)key & mask;
+
+    for (; table[i].index != -1; i = (i + 1) & mask)
+    {
+        if (table[i].key != key)
+            continue;
+
+        // Either the name itself or an array's name without "[0]"
+        const std::string& candidate = uniforms[table[i].index].name;
+
+        if (candidate == name ||
+            (candidate.size() == length + 3 && candidate.compare(0, length, name) == 0 &&
+             candidate.compare(length, 3, "[0]") == 0))
+        {
+            return table[i].index;
+        }
+    }
+
+    return -1;
+}
+
+bool uniform_cache::set_values(int index, GLenum type, const void * data, int count)
+{
+    int components, columns;
+    GLenum value_type;
+    int e, c, r;
+
+    if (index < 0 || index >= (int)uniforms.size())
+        return false;
+
+    uniform& u = uniforms[index];
+
+    type_info(u.type, components, columns, value_type);
+
+    if (value_type != type || count < 1)
+        return false;
+
+    if (count > u.size)
+        count = u.size;
+
+    const unsigned char * src = (const unsigned char *)data;
+
+    if (u.block < 0)
+    {
+        unsigned char * dst = &values[u.offset];
+        const size_t size = count * components * columns * 4;
+
+        if (memcmp(dst, src, size) != 0)
+        {
+            memcpy(dst, src, size);
+
+            if (!u.dirty)
+            {
+                u.dirty = true;
+                dirty.push_back(index);
+            }
+        }
+
+        return true;
+    }
+
+    // Block members are laid out as GL says, which is std140 or whatever
+    // the implementation chose for shared blocks
+    block& b = blocks[u.block];
+    bool changed = false;
+
+    for (e = 0; e < count; e++)
+    {
+        for (c = 0; c < columns; c++)
+        {
+            const unsigned char * column = src + (e * columns + c) * components * 4;
+            unsigned char * dst = &b.data[u.offset + e * u.array_stride];
+
+            if (!u.row_major)
+            {
+                dst += c * u.matrix_stride;
+
+                if (memcmp(dst, column, components * 4) != 0)
+                {
+                    memcpy(dst, column, components * 4);
+                    changed = true;
+                }
+
+                continue;
+            }
+
+            for (r = 0; r < components; r++)
+            {
+                unsigned char * element = dst + r * u.matrix_stride + c * 4;
+
+                if (memcmp(element, column + r * 4, 4) != 0)
+                {
+                    memcpy(element, column + r * 4, 4);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    b.dirty = b.dirty || changed;
+
+    return true;
+}
+
+void uniform_cache::create_ring()
+{
+    const GLsizeiptr size = (GLsizeiptr)frame_size * ring_frames;
+
+    glGenBuffers(1, &ring);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring);
+
+    if (gl3wIsSupported(4, 4) || sb6IsExtensionSupported("GL_ARB_buffer_storage"))
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+        ring_ptr = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+    }
+    else
+    {
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void uniform_cache::flush()
+{
+    int components, columns;
+    GLenum value_type;
+    size_t i;
+    bool any_dirty = false;
+
+    for (i = 0; i < dirty.size(); i++)
+    {
+        uniform& u = uniforms[dirty[i]];
+        const void * data = &values[u.offset];
+
+        u.dirty = false;
+
+        if (u.location < 0)
+            continue;
+
+        type_info(u.type, components, columns, value_type);
+
+        switch (value_type)
+        {
+            case GL_FLOAT:              glUniform1fv(u.location, u.size, (const GLfloat *)data); break;
+            case GL_FLOAT_VEC2:         glUniform2fv(u.location, u.size, (const GLfloat *)data); break;
+            case GL_FLOAT_VEC3:         glUniform3fv(u.location, u.size, (const GLfloat *)data); break;
+            case GL_FLOAT_VEC4:         glUniform4fv(u.location, u.size, (const GLfloat *)data); break;
+            case GL_INT:                glUniform1iv(u.location, u.size, (const GLint *)data); break;
+            case GL_INT_VEC2:           glUniform2iv(u.location, u.size, (const GLint *)data); break;
+            case GL_INT_VEC3:           glUniform3iv(u.location, u.size, (const GLint *)data); break;
+            case GL_INT_VEC4:           glUniform4iv(u.location, u.size, (const GLint *)data); break;
+            case GL_UNSIGNED_INT:       glUniform1uiv(u.location, u.size, (const GLuint *)data); break;
+            case GL_UNSIGNED_INT_VEC2:  glUniform2uiv(u.location, u.size, (const GLuint *)data); break;
+            case GL_UNSIGNED_INT_VEC3:  glUniform3uiv(u.location, u.size, (const GLuint *)data); break;
+            case GL_UNSIGNED_INT_VEC4:  glUniform4uiv(u.location, u.size, (const GLuint *)data); break;
+            case GL_FLOAT_MAT2:         glUniformMatrix2fv(u.location, u.size, GL_FALSE, (const GLfloat *)data); break;
+            case GL_FLOAT_MAT3:         glUniformMatrix3fv(u.location, u.size, GL_FALSE, (const GLfloat *)data); break;
+            case GL_FLOAT_MAT4:         glUniformMatrix4fv(u.location, u.size, GL_FALSE, (const GLfloat *)data); break;
+            default:                    break;
+        }
+    }
+
+    dirty.clear();
+
+    for (i = 0; i < blocks.size(); i++)
+    {
+        any_dirty = any_dirty || blocks[i].dirty;
+    }
+
+    if (any_dirty)
+    {
+        unsigned char * ptr;
+
+        if (ring == 0)
+        {
+            create_ring();
+        }
+        else
+        {
+            // Covers everything drawn from this frame's copies
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame = (frame + 1) % ring_frames;
+        }
+
+        if (fences[frame])
+        {
+            glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fences[frame]);
+            fences[frame] = NULL;
+        }
+
+        const GLint base = frame * frame_size;
+
+        if (ring_ptr)
+        {
+            ptr = ring_ptr + base;
+        }
+        else
+        {
+            // The fence makes this safe without synchronizing, and every
+            // block is rewritten, so the old contents can go
+            glBindBuffer(GL_UNIFORM_BUFFER, ring);
+            ptr = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, base, frame_size,
+                                                    GL_MAP_WRITE_BIT |
+                                                    GL_MAP_INVALIDATE_RANGE_BIT |
+                                                    GL_MAP_UNSYNCHRONIZED_BIT);
+        }
+
+        // Every block moves to this frame, changed or not. The fence on a
+        // frame only covers draws made while it was current, so a block
+        // left bound to an older copy could still be read when the ring
+        // comes back round and overwrites it.
+        for (i = 0; i < blocks.size(); i++)
+        {
+            block& b = blocks[i];
+
+            memcpy(ptr + b.slot, &b.data[0], b.size);
+            b.bound = base + b.slot;
+            b.dirty = false;
+        }
+
+        if (!ring_ptr)
+        {
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+    }
+
+    // Other programs may have bound something else to the same points
+    for (i = 0; i < blocks.size(); i++)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, blocks[i].binding, ring, blocks[i].bound, blocks[i].size);
+    }
+}
+
+void uniform_cache::free()
+{
+    int i;
+
+    for (i = 0; i < ring_frames; i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+        fences[i] = NULL;
+    }
+
+    if (ring)
+    {
+        if (ring_ptr)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, ring);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &ring);
+    }
+
+    ring = 0;
+    ring_ptr = NULL;
+    frame = 0;
+
+    // The buffer's gone, so every block has to be written again
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        blocks[b].dirty = true;
+    }
+}
+
+}
@@ -0,0 +1,552 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sb7vtex.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Only the enumerant values are needed here; nothing in this file calls GL.
+#include "GL/glcorearb.h"
+#include "GL/glext.h"
+
+namespace sb7
+{
+
+namespace vtex
+{
+
+static const char tiles_key[] = "sb7.tiles";
+
+page_table::page_table()
+    : num_levels(0),
+      tail(0),
+      page_w(0),
+      page_h(0),
+      changed(false)
+{
+
+}
+
+bool page_table::init(unsigned int width,
+                      unsigned int height,
+                      unsigned int page_width,
+                      unsigned int page_height,
+                      unsigned int levels,
+                      unsigned int tail_level)
+{
+    unsigned int level;
+
+    // Keys hold 12 bits of page position and 8 of level
+    if (width == 0 || height == 0 || page_width == 0 || page_height == 0 ||
+        (width + page_width - 1) / page_width > 4096 ||
+        (height + page_height - 1) / page_height > 4096 ||
+        levels == 0 || levels > 32 || tail_level > levels)
+    {
+        return false;
+    }
+
+    num_levels = levels;
+    tail = tail_level;
+    page_w = page_width;
+    page_h = page_height;
+    dims.resize(levels * 2);
+    states.resize(levels);
+
+    for (level = 0; level < levels; level++)
+    {
+        const unsigned int w = (width >> level) ? (width >> level) : 1;
+        const unsigned int h = (height >> level) ? (height >> level) : 1;
+
+        dims[level * 2] = (w + page_w - 1) / page_w;
+        dims[level * 2 + 1] = (h + page_h - 1) / page_h;
+
+        // The tail is committed up front and never leaves
+        states[level].assign(dims[level * 2] * dims[level * 2 + 1],
+                             level >= tail ? (unsigned char)resident : (unsigned char)non_resident);
+    }
+
+    changed = true;
+
+    return true;
+}
+
+bool page_table::valid(page_key key) const
+{
+    const unsigned int level = key_level(key);
+
+    return level < num_levels &&
+           key_x(key) < dims[level * 2] &&
+           key_y(key) < dims[level * 2 + 1];
+}
+
+page_key page_table::parent(page_key key) const
+{
+    const unsigned int level = key_level(key);
+
+    if (level + 1 >= num_levels)
+        return key;
+
+    return make_key(level + 1, key_x(key) >> 1, key_y(key) >> 1);
+}
+
+page_table::state page_table::get(page_key key) const
+{
+    const unsigned int level = key_level(key);
+
+    if (!valid(key))
+        return non_resident;
+
+    return (state)states[level][key_y(key) * dims[level * 2] + key_x(key)];
+}
+
+void page_table::set(page_key key, state s)
+{
+    const unsigned int level = key_level(key);
+    unsigned char& current = states[level][key_y(key) * dims[level * 2] + key_x(key)];
+
+    // Only moving in or out of residency changes what shaders can see
+    if ((current == resident) != (s == resident))
+        changed = true;
+
+    current = (unsigned char)s;
+}
+
+unsigned int page_table::min_level(unsigned int x, unsigned int y) const
+{
+    unsigned int result = tail;
+    unsigned int level;
+
+    for (level = tail; level-- > 0; )
+    {
+        if (get(make_key(level, x >> level, y >> level)) != resident)
+            break;
+        result = level;
+    }
+
+    return result;
+}
+
+void page_table::build_min_level_map(std::vector<unsigned char>& map) const
+{
+    const unsigned int w = pages_x(0);
+    const unsigned int h = pages_y(0);
+    unsigned int x, y;
+
+    map.resize(w * h);
+
+    for (y = 0; y < h; y++)
+    {
+        for (x = 0; x < w; x++)
+        {
+            map[y * w + x] = (unsigned char)min_level(x, y);
+        }
+    }
+}
+
+residency_cache::residency_cache()
+    : table(nullptr),
+      budget(0),
+      frame(0)
+{
+
+}
+
+void residency_cache::init(page_table * t, unsigned int budget_pages)
+{
+    table = t;
+    budget = budget_pages;
+    frame = 0;
+    lru.clear();
+    positions.clear();
+    wanted.clear();
+}
+
+void residency_cache::begin_frame()
+{
+    frame++;
+    wanted.clear();
+}
+
+void residency_cache::touch(page_key key)
+{
+    std::unordered_map<page_key, std::list<entry>::iterator>::iterator it = positions.find(key);
+
+    if (it == positions.end())
+        return;
+
+    it->second->frame = frame;
+    lru.splice(lru.begin(), lru, it->second);
+}
+
+void residency_cache::request(page_key key)
+{
+    if (!table->valid(key))
+        return;
+
+    // Everything coarser is wanted too, so that there's always a resident
+    // level to fall back to while the finer one loads.
+    while (!table->in_tail(key))
+    {
+        switch (table->get(key))
+        {
+            case page_table::resident:
+                touch(key);
+                break;
+            case page_table::non_resident:
+                wanted.insert(key);
+                break;
+            default:
+                break;
+        }
+
+        if (table->parent(key) == key)
+            break;
+        key = table->parent(key);
+    }
+}
+
+void residency_cache::request_feedback(const unsigned int * texels, size_t count)
+{
+    unsigned int last = 0;
+    size_t i;
+
+    // Neighbouring texels nearly always ask for the same page
+    for (i = 0; i < count; i++)
+    {
+        if (texels[i] != 0 && texels[i] != last)
+        {
+            request(texels[i] - 1);
+            last = texels[i];
+        }
+    }
+}
+
+static bool coarser_first(page_key a, page_key b)
+{
+    if (key_level(a) != key_level(b))
+        return key_level(a) > key_level(b);
+
+    return a < b;
+}
+
+void residency_cache::schedule(std::vector<page_key>& loads, unsigned int max_loads)
+{
+    std::unordered_set<page_key>::const_iterator it;
+    size_t i;
+
+    loads.clear();
+
+    for (it = wanted.begin(); it != wanted.end(); ++it)
+    {
+        if (table->get(*it) == page_table::non_resident)
+            loads.push_back(*it);
+    }
+
+    if (loads.size() > max_loads)
+    {
+        std::partial_sort(loads.begin(), loads.begin() + max_loads, loads.end(), coarser_first);
+        loads.resize(max_loads);
+    }
+    else
+    {
+        std::sort(loads.begin(), loads.end(), coarser_first);
+    }
+
+    for (i = 0; i < loads.size(); i++)
+    {
+        table->set(loads[i], page_table::loading);
+        wanted.erase(loads[i]);
+    }
+}
+
+bool residency_cache::oldest(page_key& key) const
+{
+    // Pages seen in this frame's feedback are never candidates
+    if (lru.empty() || lru.back().frame == frame)
+        return false;
+
+    key = lru.back().key;
+
+    return true;
+}
+
+bool residency_cache::make_resident(page_key key, std::vector<page_key>& evicted)
+{
+    entry e;
+
+    if (table->get(key) != page_table::loading)
+        return false;
+
+    while (lru.size() >= budget)
+    {
+        page_key victim;
+
+        if (!oldest(victim))
+        {
+            table->set(key, page_table::non_resident);
+            return false;
+        }
+
+        lru.pop_back();
+        positions.erase(victim);
+        table->set(victim, page_table::non_resident);
+        evicted.push_back(victim);
+    }
+
+    e.key = key;
+    e.frame = frame;
+    lru.push_front(e);
+    positions[key] = lru.begin();
+    table->set(key, page_table::resident);
+
+    return true;
+}
+
+void residency_cache::cancel(page_key key)
+{
+    if (table->get(key) == page_table::loading)
+        table->set(key, page_table::non_resident);
+}
+
+tile_reader::tile_reader()
+    : texel_size(0),
+      page_w(0),
+      page_h(0),
+      tile_w(0),
+      tile_h(0),
+      tile_major(false)
+{
+    memset(&d, 0, sizeof(d));
+}
+
+bool tile_reader::open(const char * filename, unsigned int page_width, unsigned int page_height)
+{
+    ktx::file::texture_info info;
+    const char * tiles;
+    unsigned int level;
+
+    close();
+
+    if (page_width == 0 || page_height == 0 || !file.open(filename))
+        return false;
+
+    if (!ktx::file::inspect(file.data(), file.size(), info))
+        goto fail;
+
+    d = info.desc;
+    texel_size = ktx::file::pixel_size(d.h.glformat, d.h.gltype);
+
+    // Pages are cut out texel by texel, so block compressed and packed
+    // files are out, as is anything but a plain 2D texture.
+    if (d.target != GL_TEXTURE_2D ||
+        d.h.gltype == GL_NONE ||
+        texel_size == 0 ||
+        d.swap ||
+        d.generate_mips ||
+        d.supercompression != ktx::file::supercompression_none)
+    {
+        goto fail;
+    }
+
+    tiles = ktx::file::find_key(info, tiles_key);
+    if (tiles)
+    {
+        if (sscanf(tiles, "%ux%u", &tile_w, &tile_h) != 2 || tile_w == 0 || tile_h == 0)
+            goto fail;
+        tile_major = true;
+
+        for (level = 0; level < d.levels; level++)
+        {
+            const ktx::file::level_layout& l = d.level[level];
+
+            if ((unsigned long long)l.width * l.height * texel_size > l.size)
+                goto fail;
+        }
+    }
+
+    page_w = page_width;
+    page_h = page_height;
+
+    return true;
+
+fail:
+    close();
+
+    return false;
+}
+
+void tile_reader::close()
+{
+    file.close();
+    memset(&d, 0, sizeof(d));
+    texel_size = 0;
+    page_w = page_h = 0;
+    tile_w = tile_h = 0;
+    tile_major = false;
+}
+
+void tile_reader::read_region(unsigned int level,
+                              unsigned int x, unsigned int y,
+                              unsigned int width, unsigned int height,
+                              unsigned char * dst, size_t dst_stride) const
+{
+    const ktx::file::level_layout& l = d.level[level];
+    const unsigned char * base = file.data() + l.offset;
+    unsigned int row;
+
+    if (!tile_major)
+    {
+        const size_t pitch = ((size_t)l.width * texel_size + 3) & ~(size_t)3;
+
+        for (row = 0; row < height; row++)
+        {
+            memcpy(dst + row * dst_stride,
+                   base + (y + row) * pitch + (size_t)x * texel_size,
+                   (size_t)width * texel_size);
+        }
+
+        return;
+    }
+
+    // Rows of tiles are stored one after the other. Within a row of tiles
+    // each tile is tile_w wide (less at the right edge) and as tall as the
+    // row (less at the bottom edge).
+    for (row = 0; row < height; row++)
+    {
+        const unsigned int yy = y + row;
+        const unsigned int ty = yy / tile_h;
+        const unsigned int th = std::min(tile_h, l.height - ty * tile_h);
+        const size_t row_base = (size_t)ty * tile_h * l.width * texel_size;
+        unsigned int xx = x;
+        unsigned char * out = dst + row * dst_stride;
+
+        while (xx < x + width)
+        {
+            const unsigned int tx = xx / tile_w;
+            const unsigned int tw = std::min(tile_w, l.width - tx * tile_w);
+            const unsigned int run = std::min(x + width, tx * tile_w + tw) - xx;
+            const size_t offset = row_base +
+                                  ((size_t)tx * tile_w * th +
+                                   (size_t)(yy - ty * tile_h) * tw +
+                                   (xx - tx * tile_w)) * texel_size;
+
+            memcpy(out, base + offset, (size_t)run * texel_size);
+            out += (size_t)run * texel_size;
+            xx += run;
+        }
+    }
+}
+
+bool tile_reader::read_page(page_key key, void * dst) const
+{
+    const unsigned int level = key_level(key);
+    unsigned int x0, y0, w, h;
+
+    if (!file.is_open() || level >= d.levels)
+        return false;
+
+    const ktx::file::level_layout& l = d.level[level];
+
+    x0 = key_x(key) * page_w;
+    y0 = key_y(key) * page_h;
+
+    if (x0 >= l.width || y0 >= l.height)
+        return false;
+
+    w = std::min(page_w, l.width - x0);
+    h = std::min(page_h, l.height - y0);
+
+    if (w != page_w || h != page_h)
+        memset(dst, 0, page_bytes());
+
+    read_region(level, x0, y0, w, h, (unsigned char *)dst, (size_t)page_w * texel_size);
+
+    return true;
+}
+
+bool tile_reader::read_level(unsigned int level, void * dst) const
+{
+    if (!file.is_open() || level >= d.levels)
+        return false;
+
+    const ktx::file::level_layout& l = d.level[level];
+
+    read_region(level, 0, 0, l.width, l.height, (unsigned char *)dst, (size_t)l.width * texel_size);
+
+    return true;
+}
+
+bool write_tiled(const char * filename,
+                 const ktx::file::texture_desc& desc,
+                 const void * data,
+                 unsigned int tile_width,
+                 unsigned int tile_height)
+{
+    const unsigned int texel_size = ktx::file::pixel_size(desc.h.glformat, desc.h.gltype);
+    const unsigned char * src_base = (const unsigned char *)data;
+    std::vector<ktx::file::key_value> key_values(1);
+    std::vector<unsigned char> tiled(desc.data_size);
+    unsigned char * dst_base = &tiled[0];
+    char value[32];
+    unsigned int level;
+
+    if (desc.target != GL_TEXTURE_2D || texel_size == 0 || tile_width == 0 || tile_height == 0)
+        return false;
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        const ktx::file::level_layout& l = desc.level[level];
+        const size_t pitch = ((size_t)l.width * texel_size + 3) & ~(size_t)3;
+        const unsigned char * src = src_base + (l.offset - desc.data_offset);
+        unsigned char * dst = dst_base + (l.offset - desc.data_offset);
+        unsigned int tx, ty, row;
+
+        for (ty = 0; ty < l.height; ty += tile_height)
+        {
+            const unsigned int th = std::min(tile_height, l.height - ty);
+
+            for (tx = 0; tx < l.width; tx += tile_width)
+            {
+                const unsigned int tw = std::min(tile_width, l.width - tx);
+
+                for (row = 0; row < th; row++)
+                {
+                    memcpy(dst, src + (ty + row) * pitch + (size_t)tx * texel_size, (size_t)tw * texel_size);
+                    dst += (size_t)tw * texel_size;
+                }
+            }
+        }
+    }
+
+    sprintf(value, "%ux%u", tile_width, tile_height);
+    key_values[0].key = tiles_key;
+    key_values[0].value.assign(value, strlen(value) + 1);
+
+    return ktx::file::write(filename, desc, &tiled[0], &key_values);
+}
+
+}
+
+}
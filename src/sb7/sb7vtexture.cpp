@@ -0,0 +1,410 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GL/gl3w.h"
+#include <sb7vtex.h>
+
+#include <cstring>
+
+namespace sb7
+{
+
+namespace vtex
+{
+
+texture::texture()
+    : tex(0),
+      min_level_tex(0),
+      in_flight(0)
+{
+
+}
+
+texture::~texture()
+{
+    size_t i;
+
+    // GL objects belong to the context and are only freed by shutdown(),
+    // but pages still in flight have to be waited for.
+    workers.stop();
+
+    for (i = 0; i < arrived.size(); i++)
+    {
+        delete [] arrived[i].data;
+    }
+}
+
+bool texture::init(const char * filename, unsigned int budget_pages, unsigned int num_threads)
+{
+    ktx::file::texture_info info;
+    GLint page_x = 0;
+    GLint page_y = 0;
+    GLint sparse_levels = 0;
+    std::vector<unsigned char> level_data;
+    unsigned int level;
+
+    shutdown();
+
+    if (!ktx::file::inspect(filename, info))
+        return false;
+
+    const ktx::file::texture_desc& desc = info.desc;
+
+    glGetInternalformativ(GL_TEXTURE_2D, desc.h.glinternalformat, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &page_x);
+    glGetInternalformativ(GL_TEXTURE_2D, desc.h.glinternalformat, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &page_y);
+
+    if (page_x <= 0 || page_y <= 0 || !reader.open(filename, page_x, page_y))
+        return false;
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+    glTexParameteri(GL_TEXTURE_2D, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+    glTexStorage2D(GL_TEXTURE_2D, desc.levels, desc.h.glinternalformat, desc.h.pixelwidth, desc.h.pixelheight);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_NUM_SPARSE_LEVELS_ARB, &sparse_levels);
+
+    if (!table.init(desc.h.pixelwidth, desc.h.pixelheight, page_x, page_y,
+                    desc.levels, (unsigned int)sparse_levels < desc.levels ? sparse_levels : desc.levels))
+    {
+        shutdown();
+        return false;
+    }
+
+    residency.init(&table, budget_pages);
+
+    // The mip tail is committed as a unit, so it's loaded once and kept
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (level = table.tail_level(); level < desc.levels; level++)
+    {
+        const ktx::file::level_layout& l = reader.desc().level[level];
+
+        level_data.resize((size_t)l.width * l.height * reader.pixel_size());
+        reader.read_level(level, &level_data[0]);
+
+        glTexPageCommitmentARB(GL_TEXTURE_2D, level, 0, 0, 0, l.width, l.height, 1, GL_TRUE);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height,
+                        desc.h.glformat, desc.h.gltype, &level_data[0]);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glGenTextures(1, &min_level_tex);
+    glBindTexture(GL_TEXTURE_2D, min_level_tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, table.pages_x(0), table.pages_y(0));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    workers.start(num_threads);
+
+    return true;
+}
+
+void texture::shutdown()
+{
+    size_t i;
+
+    workers.stop();
+
+    for (i = 0; i < arrived.size(); i++)
+    {
+        delete [] arrived[i].data;
+    }
+    arrived.clear();
+    in_flight = 0;
+
+    reader.close();
+
+    glDeleteTextures(1, &min_level_tex);
+    glDeleteTextures(1, &tex);
+    min_level_tex = 0;
+    tex = 0;
+}
+
+void texture::feedback(const unsigned int * texels, size_t count)
+{
+    residency.request_feedback(texels, count);
+}
+
+void texture::commit(page_key key, GLboolean state)
+{
+    const unsigned int level = key_level(key);
+    const ktx::file::level_layout& l = reader.desc().level[level];
+    const unsigned int x = key_x(key) * table.page_width();
+    const unsigned int y = key_y(key) * table.page_height();
+    const unsigned int w = l.width - x < table.page_width() ? l.width - x : table.page_width();
+    const unsigned int h = l.height - y < table.page_height() ? l.height - y : table.page_height();
+
+    glTexPageCommitmentARB(GL_TEXTURE_2D, level, x, y, 0, w, h, 1, state);
+}
+
+void texture::update(unsigned int max_loads, unsigned int max_uploads)
+{
+    const ktx::file::texture_desc& desc = reader.desc();
+    std::vector<tile> ready;
+    size_t i, j;
+
+    if (!tex)
+        return;
+
+    // Start reading whatever feedback asked for, keeping the number of
+    // pages in flight bounded
+    residency.schedule(loads, max_loads > in_flight ? max_loads - in_flight : 0);
+
+    for (i = 0; i < loads.size(); i++)
+    {
+        const page_key key = loads[i];
+
+        in_flight++;
+
+        workers.submit([this, key]()
+        {
+            tile t;
+
+            t.key = key;
+            t.data = new unsigned char [reader.page_bytes()];
+            t.ok = reader.read_page(key, t.data);
+
+            std::lock_guard<std::mutex> guard(lock);
+            arrived.push_back(t);
+        });
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        const size_t count = arrived.size() < max_uploads ? arrived.size() : max_uploads;
+
+        ready.assign(arrived.begin(), arrived.begin() + count);
+        arrived.erase(arrived.begin(), arrived.begin() + count);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, table.page_width());
+
+    for (i = 0; i < ready.size(); i++)
+    {
+        const tile& t = ready[i];
+
+        in_flight--;
+
+        if (!t.ok)
+        {
+            residency.cancel(t.key);
+        }
+        else
+        {
+            evicted.clear();
+
+            if (residency.make_resident(t.key, evicted))
+            {
+                const unsigned int level = key_level(t.key);
+                const ktx::file::level_layout& l = desc.level[level];
+                const unsigned int x = key_x(t.key) * table.page_width();
+                const unsigned int y = key_y(t.key) * table.page_height();
+
+                // Release before committing so we never hold more than the budget
+                for (j = 0; j < evicted.size(); j++)
+                {
+                    commit(evicted[j], GL_FALSE);
+                }
+
+                commit(t.key, GL_TRUE);
+                glTexSubImage2D(GL_TEXTURE_2D, level, x, y,
+                                l.width - x < table.page_width() ? l.width - x : table.page_width(),
+                                l.height - y < table.page_height() ? l.height - y : table.page_height(),
+                                desc.h.glformat, desc.h.gltype, t.data);
+            }
+        }
+
+        delete [] t.data;
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (table.dirty())
+    {
+        table.build_min_level_map(min_levels);
+        table.clear_dirty();
+
+        glBindTexture(GL_TEXTURE_2D, min_level_tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, table.pages_x(0), table.pages_y(0),
+                        GL_RED_INTEGER, GL_UNSIGNED_BYTE, &min_levels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    residency.begin_frame();
+}
+
+feedback_buffer::feedback_buffer()
+    : w(0),
+      h(0),
+      fbo(0),
+      color(0),
+      depth(0),
+      next(0)
+{
+    memset(buffers, 0, sizeof(buffers));
+    memset(fences, 0, sizeof(fences));
+}
+
+feedback_buffer::~feedback_buffer()
+{
+
+}
+
+bool feedback_buffer::init(unsigned int width, unsigned int height)
+{
+    unsigned int i;
+    GLenum status;
+
+    shutdown();
+
+    w = width;
+    h = height;
+
+    glGenTextures(1, &color);
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, w, h);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(num_buffers, buffers);
+    for (i = 0; i < num_buffers; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, w * h * sizeof(GLuint), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void feedback_buffer::shutdown()
+{
+    unsigned int i;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+
+    if (fbo)
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteTextures(1, &color);
+        glDeleteBuffers(num_buffers, buffers);
+    }
+
+    fbo = depth = color = 0;
+    memset(buffers, 0, sizeof(buffers));
+    next = 0;
+}
+
+void feedback_buffer::bind()
+{
+    static const GLuint zero[] = { 0, 0, 0, 0 };
+    static const GLfloat one = 1.0f;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, w, h);
+    glClearBufferuiv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_DEPTH, 0, &one);
+}
+
+void feedback_buffer::read()
+{
+    // If nobody collected the readback that was here, it's stale anyway
+    if (fences[next])
+        glDeleteSync(fences[next]);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[next]);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, w, h, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % num_buffers;
+}
+
+bool feedback_buffer::collect(texture& vt)
+{
+    unsigned int i;
+
+    // Readbacks finish in order, so only the oldest one is worth asking about
+    for (i = 0; i < num_buffers; i++)
+    {
+        const unsigned int index = (next + i) % num_buffers;
+        const GLuint * texels;
+        GLenum result;
+
+        if (!fences[index])
+            continue;
+
+        result = glClientWaitSync(fences[index], 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            return false;
+
+        glDeleteSync(fences[index]);
+        fences[index] = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[index]);
+        texels = (const GLuint *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, w * h * sizeof(GLuint), GL_MAP_READ_BIT);
+        if (texels)
+        {
+            vt.feedback(texels, w * h);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        return texels != nullptr;
+    }
+
+    return false;
+}
+
+}
+
+}
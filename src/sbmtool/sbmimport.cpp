@@ -0,0 +1,1864 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sbmimport.h"
+
+#include <sb7mappedfile.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+static const unsigned int none = ~0u;
+
+// Number parsing that doesn't depend on the locale and is much faster than
+// strtod(). It's exact to within a unit in the last place or so, which is
+// plenty for vertex data.
+static const char * parse_float(const char * p, const char * end, float& value)
+{
+    static const double powers[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool negative = false;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    const char * start = p;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+                if (mantissa != 0)
+                    digits++;
+            }
+        }
+    }
+
+    if (p == start || (p == start + 1 && *start == '.'))
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char * q = p + 1;
+        bool negative_exponent = false;
+        int e = 0;
+
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            negative_exponent = *q == '-';
+            q++;
+        }
+
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+            {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double d = (double)mantissa;
+
+    if (exponent < 0)
+        d = exponent >= -22 ? d / powers[-exponent] : d * pow(10.0, exponent);
+    else if (exponent > 0)
+        d = exponent <= 22 ? d * powers[exponent] : d * pow(10.0, exponent);
+
+    value = (float)(negative ? -d : d);
+
+    return p;
+}
+
+static const char * parse_int(const char * p, const char * end, long long& value)
+{
+    bool negative = false;
+    const char * start;
+
+    value = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    for (start = p; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        if (value < 0x7FFFFFFFFFFFLL)
+            value = value * 10 + (*p - '0');
+    }
+
+    if (p == start)
+        return NULL;
+
+    if (negative)
+        value = -value;
+
+    return p;
+}
+
+static const char * skip_space(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+
+    return p;
+}
+
+static const char * next_line(const char * p, const char * end)
+{
+    const char * newline = (const char *)memchr(p, '\n', end - p);
+
+    return newline != NULL ? newline + 1 : end;
+}
+
+static bool has_extension(const char * filename, const char * extension)
+{
+    const size_t length = strlen(filename);
+    const size_t ext_length = strlen(extension);
+    size_t i;
+
+    if (length < ext_length)
+        return false;
+
+    for (i = 0; i < ext_length; i++)
+    {
+        if (tolower((unsigned char)filename[length - ext_length + i]) != extension[i])
+            return false;
+    }
+
+    return true;
+}
+
+// Stitches per-chunk or per-primitive corners and group starts together.
+// Group starts that land on the same triangle as the previous one, or
+// after the last triangle, are dropped.
+static void add_group(source_mesh& out, unsigned int first_triangle)
+{
+    if (out.groups.empty() || out.groups.back() != first_triangle)
+        out.groups.push_back(first_triangle);
+}
+
+static void finish_groups(source_mesh& out)
+{
+    const unsigned int triangle_count = (unsigned int)(out.corners.size() / 3);
+
+    while (out.groups.size() > 1 && out.groups.back() >= triangle_count)
+        out.groups.pop_back();
+
+    if (out.groups.empty())
+        out.groups.push_back(0);
+}
+
+// OBJ ///////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+enum
+{
+    obj_position,
+    obj_normal,
+    obj_texcoord,
+    obj_kinds
+};
+
+struct obj_chunk
+{
+    const char *                begin;
+    const char *                end;
+    unsigned int                counts[obj_kinds];
+    unsigned int                bases[obj_kinds];
+    std::vector<source_corner>  corners;
+    std::vector<unsigned int>   groups;         // First triangle within the chunk
+    unsigned int                error_line;     // Line within the chunk, 1-based
+};
+
+}
+
+static int obj_line_kind(const char * p, const char * end)
+{
+    if (end - p < 2 || p[0] != 'v')
+        return -1;
+
+    if (p[1] == ' ' || p[1] == '\t')
+        return obj_position;
+
+    if (end - p < 3 || (p[2] != ' ' && p[2] != '\t'))
+        return -1;
+
+    if (p[1] == 'n')
+        return obj_normal;
+
+    if (p[1] == 't')
+        return obj_texcoord;
+
+    return -1;
+}
+
+// Resolves a 1-based or negative (relative) OBJ index given how many of
+// that kind came before
+static bool obj_index(long long index, unsigned int count_so_far, unsigned int& result)
+{
+    if (index > 0)
+        result = (unsigned int)(index - 1);
+    else if (index < 0 && -index <= (long long)count_so_far)
+        result = (unsigned int)(count_so_far + index);
+    else
+        return false;
+
+    return true;
+}
+
+static bool parse_obj_chunk(obj_chunk& chunk, source_mesh& out)
+{
+    unsigned int local[obj_kinds] = { 0, 0, 0 };
+    std::vector<source_corner> polygon;
+    const char * p = chunk.begin;
+    const char * const end = chunk.end;
+    unsigned int line = 0;
+
+    while (p < end)
+    {
+        const char * const eol = (const char *)memchr(p, '\n', end - p);
+        const char * const line_end = eol != NULL ? eol : end;
+        const char * q = skip_space(p, line_end);
+        const int kind = obj_line_kind(q, line_end);
+
+        line++;
+
+        if (kind == obj_position || kind == obj_normal)
+        {
+            float * v = kind == obj_position
+                      ? &out.positions[(chunk.bases[kind] + local[kind]) * 3]
+                      : &out.normals[(chunk.bases[kind] + local[kind]) * 3];
+            int j;
+
+            q += kind == obj_position ? 1 : 2;
+
+            for (j = 0; j < 3; j++)
+            {
+                q = parse_float(skip_space(q, line_end), line_end, v[j]);
+                if (q == NULL)
+                {
+                    chunk.error_line = line;
+                    return false;
+                }
+            }
+
+            local[kind]++;
+        }
+        else if (kind == obj_texcoord)
+        {
+            float * v = &out.texcoords[(chunk.bases[kind] + local[kind]) * 2];
+
+            q = parse_float(skip_space(q + 2, line_end), line_end, v[0]);
+            if (q == NULL)
+            {
+                chunk.error_line = line;
+                return false;
+            }
+
+            // The second coordinate is optional
+            v[1] = 0.0f;
+            q = skip_space(q, line_end);
+            if (q < line_end)
+                parse_float(q, line_end, v[1]);
+
+            local[kind]++;
+        }
+        else if (line_end - q >= 2 && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+        {
+            polygon.clear();
+            q = skip_space(q + 1, line_end);
+
+            while (q < line_end)
+            {
+                source_corner c = { none, none, none };
+                long long index;
+
+                q = parse_int(q, line_end, index);
+                if (q == NULL || !obj_index(index, chunk.bases[obj_position] + local[obj_position], c.position))
+                {
+                    chunk.error_line = line;
+                    return false;
+                }
+
+                if (q < line_end && *q == '/')
+                {
+                    q++;
+
+                    if (q < line_end && *q != '/')
+                    {
+                        q = parse_int(q, line_end, index);
+                        if (q == NULL || !obj_index(index, chunk.bases[obj_texcoord] + local[obj_texcoord], c.texcoord))
+                        {
+                            chunk.error_line = line;
+                            return false;
+                        }
+                    }
+
+                    if (q < line_end && *q == '/')
+                    {
+                        q = parse_int(q + 1, line_end, index);
+                        if (q == NULL || !obj_index(index, chunk.bases[obj_normal] + local[obj_normal], c.normal))
+                        {
+                            chunk.error_line = line;
+                            return false;
+                        }
+                    }
+                }
+
+                polygon.push_back(c);
+                q = skip_space(q, line_end);
+            }
+
+            for (size_t j = 2; j < polygon.size(); j++)
+            {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[j - 1]);
+                chunk.corners.push_back(polygon[j]);
+            }
+        }
+        else if ((line_end - q >= 2 && (q[0] == 'o' || q[0] == 'g') && (q[1] == ' ' || q[1] == '\t')) ||
+                 (line_end - q >= 7 && strncmp(q, "usemtl", 6) == 0 && (q[6] == ' ' || q[6] == '\t')))
+        {
+            chunk.groups.push_back((unsigned int)(chunk.corners.size() / 3));
+        }
+
+        p = eol != NULL ? eol + 1 : end;
+    }
+
+    return true;
+}
+
+bool load_obj(const char * filename, source_mesh& out)
+{
+    sb7::mapped_file file;
+    std::vector<obj_chunk> chunks;
+    size_t totals[obj_kinds] = { 0, 0, 0 };
+    size_t i, triangle_count = 0;
+    int c;
+    bool ok = true;
+
+    if (!file.open(filename))
+    {
+        fprintf(stderr, "%s: can't open\n", filename);
+        return false;
+    }
+
+    const char * const data = (const char *)file.data();
+    const char * const end = data + file.size();
+
+    // Chunks of about a megabyte, each starting on a line
+    const size_t chunk_count = std::max((size_t)1, file.size() >> 20);
+
+    chunks.resize(chunk_count);
+    for (i = 0; i < chunk_count; i++)
+    {
+        const char * begin = data + file.size() * i / chunk_count;
+
+        if (i > 0)
+            begin = next_line(begin - 1, end);
+
+        chunks[i].begin = begin;
+        chunks[i].error_line = 0;
+        if (i > 0)
+            chunks[i - 1].end = begin;
+    }
+    chunks.back().end = end;
+
+    // Counting vertices first tells each chunk where its own go and what
+    // its relative indices are relative to
+#pragma omp parallel for schedule(dynamic)
+    for (c = 0; c < (int)chunk_count; c++)
+    {
+        obj_chunk& chunk = chunks[c];
+        const char * p = chunk.begin;
+
+        chunk.counts[0] = chunk.counts[1] = chunk.counts[2] = 0;
+
+        while (p < chunk.end)
+        {
+            const int kind = obj_line_kind(skip_space(p, chunk.end), chunk.end);
+
+            if (kind >= 0)
+                chunk.counts[kind]++;
+
+            p = next_line(p, chunk.end);
+        }
+    }
+
+    for (i = 0; i < chunk_count; i++)
+    {
+        for (c = 0; c < obj_kinds; c++)
+        {
+            chunks[i].bases[c] = (unsigned int)totals[c];
+            totals[c] += chunks[i].counts[c];
+        }
+    }
+
+    if (totals[obj_position] >= none || totals[obj_normal] >= none || totals[obj_texcoord] >= none)
+    {
+        fprintf(stderr, "%s: too many vertices\n", filename);
+        return false;
+    }
+
+    out.positions.resize(totals[obj_position] * 3);
+    out.normals.resize(totals[obj_normal] * 3);
+    out.texcoords.resize(totals[obj_texcoord] * 2);
+
+#pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+    for (c = 0; c < (int)chunk_count; c++)
+    {
+        ok = parse_obj_chunk(chunks[c], out) && ok;
+    }
+
+    if (!ok)
+    {
+        for (i = 0; i < chunk_count; i++)
+        {
+            if (chunks[i].error_line != 0)
+            {
+                unsigned int line = chunks[i].error_line;
+                const char * p;
+
+                for (p = data; p < chunks[i].begin; p = next_line(p, end))
+                    line++;
+
+                fprintf(stderr, "%s:%u: can't parse\n", filename, line);
+                break;
+            }
+        }
+
+        return false;
+    }
+
+    // Stitch the chunks together in order
+    std::vector<size_t> first_triangle(chunk_count);
+
+    out.groups.clear();
+    out.groups.push_back(0);
+
+    for (i = 0; i < chunk_count; i++)
+    {
+        first_triangle[i] = triangle_count;
+
+        for (size_t g = 0; g < chunks[i].groups.size(); g++)
+        {
+            add_group(out, (unsigned int)(triangle_count + chunks[i].groups[g]));
+        }
+
+        triangle_count += chunks[i].corners.size() / 3;
+    }
+
+    out.corners.resize(triangle_count * 3);
+
+#pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+    for (c = 0; c < (int)chunk_count; c++)
+    {
+        const std::vector<source_corner>& corners = chunks[c].corners;
+        size_t j;
+
+        for (j = 0; j < corners.size(); j++)
+        {
+            const source_corner& corner = corners[j];
+
+            ok = ok &&
+                 corner.position < totals[obj_position] &&
+                 (corner.normal == none || corner.normal < totals[obj_normal]) &&
+                 (corner.texcoord == none || corner.texcoord < totals[obj_texcoord]);
+        }
+
+        if (!corners.empty())
+            memcpy(&out.corners[first_triangle[c] * 3], &corners[0], corners.size() * sizeof(source_corner));
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: a face refers to a vertex that doesn't exist\n", filename);
+        return false;
+    }
+
+    finish_groups(out);
+    out.bytes_read = file.size();
+
+    return true;
+}
+
+// PLY ///////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+struct ply_property
+{
+    std::string         name;
+    unsigned int        type_size;          // Of the value, or of list items
+    bool                is_float;
+    bool                is_signed;
+    unsigned int        count_size;         // Of a list's count; 0 for scalars
+};
+
+struct ply_element
+{
+    std::string                 name;
+    size_t                      count;
+    std::vector<ply_property>   properties;
+};
+
+}
+
+static bool ply_type(const std::string& name, ply_property& p)
+{
+    static const struct
+    {
+        const char *    name;
+        unsigned int    size;
+        bool            is_float;
+        bool            is_signed;
+    } types[] =
+    {
+        { "char",    1, false, true  }, { "int8",    1, false, true  },
+        { "uchar",   1, false, false }, { "uint8",   1, false, false },
+        { "short",   2, false, true  }, { "int16",   2, false, true  },
+        { "ushort",  2, false, false }, { "uint16",  2, false, false },
+        { "int",     4, false, true  }, { "int32",   4, false, true  },
+        { "uint",    4, false, false }, { "uint32",  4, false, false },
+        { "float",   4, true,  true  }, { "float32", 4, true,  true  },
+        { "double",  8, true,  true  }, { "float64", 8, true,  true  },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        if (name == types[i].name)
+        {
+            p.type_size = types[i].size;
+            p.is_float = types[i].is_float;
+            p.is_signed = types[i].is_signed;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static double ply_read(const unsigned char * p, unsigned int size, bool is_float, bool is_signed, bool big_endian)
+{
+    unsigned char bytes[8];
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        bytes[i] = big_endian ? p[size - 1 - i] : p[i];
+    }
+
+    if (is_float)
+    {
+        if (size == 4)
+        {
+            float f;
+            memcpy(&f, bytes, 4);
+            return f;
+        }
+
+        double d;
+        memcpy(&d, bytes, 8);
+        return d;
+    }
+
+    switch (size)
+    {
+        case 1:
+            return is_signed ? (double)(signed char)bytes[0] : (double)bytes[0];
+        case 2:
+        {
+            unsigned short u;
+            memcpy(&u, bytes, 2);
+            return is_signed ? (double)(short)u : (double)u;
+        }
+        default:
+        {
+            unsigned int u;
+            memcpy(&u, bytes, 4);
+            return is_signed ? (double)(int)u : (double)u;
+        }
+    }
+}
+
+static int ply_find(const ply_element& e, const char * a, const char * b = NULL, const char * c = NULL)
+{
+    size_t i;
+
+    for (i = 0; i < e.properties.size(); i++)
+    {
+        const std::string& name = e.properties[i].name;
+
+        if (e.properties[i].count_size == 0 &&
+            (name == a || (b != NULL && name == b) || (c != NULL && name == c)))
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+bool load_ply(const char * filename, source_mesh& out)
+{
+    sb7::mapped_file file;
+    std::vector<ply_element> elements;
+    bool big_endian = false;
+    bool have_format = false;
+    size_t i;
+    int v;
+
+    if (!file.open(filename))
+    {
+        fprintf(stderr, "%s: can't open\n", filename);
+        return false;
+    }
+
+    const char * const text = (const char *)file.data();
+    const char * const text_end = text + file.size();
+    const char * p = text;
+
+    if (file.size() < 4 || strncmp(text, "ply", 3) != 0 || (text[3] != '\n' && text[3] != '\r'))
+    {
+        fprintf(stderr, "%s: not a PLY file\n", filename);
+        return false;
+    }
+
+    // The header is lines of words up to end_header
+    for (p = next_line(p, text_end); ; p = next_line(p, text_end))
+    {
+        const char * line_end = (const char *)memchr(p, '\n', text_end - p);
+        std::vector<std::string> words;
+        const char * q = p;
+
+        if (line_end == NULL)
+        {
+            fprintf(stderr, "%s: header doesn't end\n", filename);
+            return false;
+        }
+
+        while (q < line_end)
+        {
+            q = skip_space(q, line_end);
+            const char * word = q;
+            while (q < line_end && *q != ' ' && *q != '\t' && *q != '\r')
+                q++;
+            if (q > word)
+                words.push_back(std::string(word, q));
+        }
+
+        if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+            continue;
+
+        if (words[0] == "end_header")
+        {
+            p = line_end + 1;
+            break;
+        }
+
+        if (words[0] == "format" && words.size() >= 2)
+        {
+            if (words[1] == "ascii")
+            {
+                fprintf(stderr, "%s: only binary PLY files are supported\n", filename);
+                return false;
+            }
+
+            big_endian = words[1] == "binary_big_endian";
+            have_format = big_endian || words[1] == "binary_little_endian";
+        }
+        else if (words[0] == "element" && words.size() == 3)
+        {
+            ply_element e;
+            e.name = words[1];
+            e.count = (size_t)strtoull(words[2].c_str(), NULL, 10);
+            elements.push_back(e);
+        }
+        else if (words[0] == "property" && !elements.empty())
+        {
+            ply_property prop;
+
+            if (words.size() == 5 && words[1] == "list")
+            {
+                ply_property count_type;
+
+                if (!ply_type(words[2], count_type) || count_type.is_float || !ply_type(words[3], prop) || prop.is_float)
+                {
+                    fprintf(stderr, "%s: bad list property %s\n", filename, words[4].c_str());
+                    return false;
+                }
+
+                prop.count_size = count_type.type_size;
+                prop.name = words[4];
+            }
+            else if (words.size() == 3 && ply_type(words[1], prop))
+            {
+                prop.count_size = 0;
+                prop.name = words[2];
+            }
+            else
+            {
+                fprintf(stderr, "%s: bad property\n", filename);
+                return false;
+            }
+
+            elements.back().properties.push_back(prop);
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown header line %s\n", filename, words[0].c_str());
+            return false;
+        }
+    }
+
+    if (!have_format)
+    {
+        fprintf(stderr, "%s: no format\n", filename);
+        return false;
+    }
+
+    const unsigned char * data = (const unsigned char *)p;
+    const unsigned char * const end = file.data() + file.size();
+    size_t vertex_count = 0;
+    bool have_faces = false;
+
+    out.groups.assign(1, 0);
+
+    for (i = 0; i < elements.size(); i++)
+    {
+        const ply_element& e = elements[i];
+        size_t stride = 0;
+        bool fixed = true;
+        size_t j;
+
+        for (j = 0; j < e.properties.size(); j++)
+        {
+            if (e.properties[j].count_size != 0)
+                fixed = false;
+            stride += e.properties[j].type_size;
+        }
+
+        if (e.name == "vertex" && fixed)
+        {
+            const int x = ply_find(e, "x");
+            const int y = ply_find(e, "y");
+            const int z = ply_find(e, "z");
+            const int nx = ply_find(e, "nx");
+            const int ny = ply_find(e, "ny");
+            const int nz = ply_find(e, "nz");
+            const int s = ply_find(e, "u", "s", "texture_u");
+            const int t = ply_find(e, "v", "t", "texture_v");
+            const int attribs[7] = { x, y, z, nx, ny, nz, s };
+            size_t offsets[8];
+            size_t offset = 0;
+            int k;
+
+            if (x < 0 || y < 0 || z < 0)
+            {
+                fprintf(stderr, "%s: vertices have no position\n", filename);
+                return false;
+            }
+
+            if (e.count >= none || (size_t)(end - data) / std::max(stride, (size_t)1) < e.count)
+            {
+                fprintf(stderr, "%s: truncated\n", filename);
+                return false;
+            }
+
+            std::vector<size_t> property_offset(e.properties.size());
+            for (j = 0; j < e.properties.size(); j++)
+            {
+                property_offset[j] = offset;
+                offset += e.properties[j].type_size;
+            }
+
+            for (k = 0; k < 7; k++)
+            {
+                offsets[k] = attribs[k] >= 0 ? property_offset[attribs[k]] : 0;
+            }
+            offsets[7] = t >= 0 ? property_offset[t] : 0;
+
+            const bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+            const bool has_texcoords = s >= 0 && t >= 0;
+
+            vertex_count = e.count;
+            out.positions.resize(vertex_count * 3);
+            out.normals.resize(has_normals ? vertex_count * 3 : 0);
+            out.texcoords.resize(has_texcoords ? vertex_count * 2 : 0);
+
+#pragma omp parallel for
+            for (v = 0; v < (int)vertex_count; v++)
+            {
+                const unsigned char * vertex = data + (size_t)v * stride;
+                const int columns[8] = { x, y, z, nx, ny, nz, s, t };
+                float values[8];
+                int c;
+
+                for (c = 0; c < 8; c++)
+                {
+                    if (columns[c] >= 0)
+                    {
+                        const ply_property& prop = e.properties[columns[c]];
+                        values[c] = (float)ply_read(vertex + offsets[c], prop.type_size, prop.is_float, prop.is_signed, big_endian);
+                    }
+                }
+
+                memcpy(&out.positions[(size_t)v * 3], values, 3 * sizeof(float));
+                if (has_normals)
+                    memcpy(&out.normals[(size_t)v * 3], values + 3, 3 * sizeof(float));
+                if (has_texcoords)
+                    memcpy(&out.texcoords[(size_t)v * 2], values + 6, 2 * sizeof(float));
+            }
+
+            data += e.count * stride;
+        }
+        else if (fixed)
+        {
+            if ((size_t)(end - data) / std::max(stride, (size_t)1) < e.count)
+            {
+                fprintf(stderr, "%s: truncated\n", filename);
+                return false;
+            }
+
+            data += e.count * stride;
+        }
+        else
+        {
+            // Lists make records different sizes, so find them all first.
+            // Faces then decode in parallel.
+            int list = -1;
+            std::vector<const unsigned char *> records;
+            std::vector<size_t> first_corner;
+            size_t corners = 0;
+
+            if (e.name == "face")
+            {
+                for (j = 0; j < e.properties.size(); j++)
+                {
+                    if (e.properties[j].count_size != 0 &&
+                        (e.properties[j].name == "vertex_indices" || e.properties[j].name == "vertex_index"))
+                    {
+                        list = (int)j;
+                    }
+                }
+            }
+
+            if (list >= 0)
+            {
+                records.reserve(e.count);
+                first_corner.reserve(e.count);
+            }
+
+            for (size_t r = 0; r < e.count; r++)
+            {
+                for (j = 0; j < e.properties.size(); j++)
+                {
+                    const ply_property& prop = e.properties[j];
+                    size_t size = prop.type_size;
+
+                    if (prop.count_size != 0)
+                    {
+                        if ((size_t)(end - data) < prop.count_size)
+                        {
+                            fprintf(stderr, "%s: truncated\n", filename);
+                            return false;
+                        }
+
+                        const size_t n = (size_t)ply_read(data, prop.count_size, false, false, big_endian);
+
+                        if ((int)j == list)
+                        {
+                            records.push_back(data);
+                            first_corner.push_back(corners);
+                            corners += n >= 3 ? (n - 2) * 3 : 0;
+                        }
+
+                        size = prop.count_size + n * prop.type_size;
+                    }
+
+                    if ((size_t)(end - data) < size)
+                    {
+                        fprintf(stderr, "%s: truncated\n", filename);
+                        return false;
+                    }
+
+                    data += size;
+                }
+            }
+
+            if (list < 0)
+                continue;
+
+            const ply_property& prop = e.properties[list];
+            bool ok = true;
+            int f;
+
+            have_faces = true;
+            out.corners.resize(corners);
+
+#pragma omp parallel for reduction(&&:ok)
+            for (f = 0; f < (int)records.size(); f++)
+            {
+                const unsigned char * record = records[f];
+                const size_t n = (size_t)ply_read(record, prop.count_size, false, false, big_endian);
+                const unsigned char * items = record + prop.count_size;
+                source_corner * c = &out.corners[first_corner[f]];
+                size_t k;
+
+                for (k = 2; k < n; k++)
+                {
+                    const size_t fan[3] = { 0, k - 1, k };
+                    int m;
+
+                    for (m = 0; m < 3; m++)
+                    {
+                        const double index = ply_read(items + fan[m] * prop.type_size, prop.type_size, false, prop.is_signed, big_endian);
+                        const unsigned int vertex = index >= 0.0 && index < (double)vertex_count ? (unsigned int)index : 0;
+
+                        ok = ok && index >= 0.0 && index < (double)vertex_count;
+
+                        c->position = vertex;
+                        c->normal = out.normals.empty() ? none : vertex;
+                        c->texcoord = out.texcoords.empty() ? none : vertex;
+                        c++;
+                    }
+                }
+            }
+
+            if (!ok)
+            {
+                fprintf(stderr, "%s: a face refers to a vertex that doesn't exist\n", filename);
+                return false;
+            }
+        }
+    }
+
+    if (!have_faces)
+    {
+        fprintf(stderr, "%s: no faces\n", filename);
+        return false;
+    }
+
+    finish_groups(out);
+    out.bytes_read = file.size();
+
+    return true;
+}
+
+// glTF //////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+struct json_value
+{
+    enum type_t
+    {
+        null_value,
+        bool_value,
+        number_value,
+        string_value,
+        array_value,
+        object_value
+    };
+
+    json_value() : type(null_value), number(0.0) { }
+
+    type_t                                          type;
+    double                                          number;     // Also 0 or 1 for bools
+    std::string                                     string;
+    std::vector<json_value>                         array;
+    std::vector<std::pair<std::string, json_value> > object;
+
+    const json_value * get(const char * key) const
+    {
+        size_t i;
+
+        for (i = 0; type == object_value && i < object.size(); i++)
+        {
+            if (object[i].first == key)
+                return &object[i].second;
+        }
+
+        return NULL;
+    }
+
+    const json_value * at(double index) const
+    {
+        if (type != array_value || !(index >= 0.0) || index >= (double)array.size())
+            return NULL;
+
+        return &array[(size_t)index];
+    }
+
+    double number_or(const char * key, double fallback) const
+    {
+        const json_value * v = get(key);
+
+        return v != NULL && v->type == number_value ? v->number : fallback;
+    }
+};
+
+struct json_parser
+{
+    const char *    p;
+    const char *    end;
+
+    void skip()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool literal(const char * word)
+    {
+        const size_t length = strlen(word);
+
+        if ((size_t)(end - p) < length || strncmp(p, word, length) != 0)
+            return false;
+
+        p += length;
+        return true;
+    }
+
+    static void append_utf8(std::string& s, unsigned int c)
+    {
+        if (c < 0x80)
+        {
+            s += (char)c;
+        }
+        else if (c < 0x800)
+        {
+            s += (char)(0xC0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            s += (char)(0xE0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            s += (char)(0xF0 | (c >> 18));
+            s += (char)(0x80 | ((c >> 12) & 0x3F));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+    }
+
+    bool hex4(unsigned int& c)
+    {
+        int i;
+
+        c = 0;
+        for (i = 0; i < 4; i++)
+        {
+            if (p >= end || !isxdigit((unsigned char)*p))
+                return false;
+            c = c * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+            p++;
+        }
+
+        return true;
+    }
+
+    bool parse_string(std::string& s)
+    {
+        if (p >= end || *p != '"')
+            return false;
+
+        for (p++; p < end && *p != '"'; p++)
+        {
+            if (*p != '\\')
+            {
+                s += *p;
+                continue;
+            }
+
+            if (++p >= end)
+                return false;
+
+            switch (*p)
+            {
+                case '"': case '\\': case '/': s += *p; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'u':
+                {
+                    unsigned int c, low;
+
+                    p++;
+                    if (!hex4(c))
+                        return false;
+
+                    if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        p += 2;
+                        if (!hex4(low))
+                            return false;
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    append_utf8(s, c);
+                    p--;
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        if (p >= end)
+            return false;
+
+        p++;
+        return true;
+    }
+
+    bool parse(json_value& v, int depth)
+    {
+        if (depth > 64)
+            return false;
+
+        skip();
+        if (p >= end)
+            return false;
+
+        if (*p == '{')
+        {
+            v.type = json_value::object_value;
+            p++;
+            skip();
+
+            if (p < end && *p == '}')
+            {
+                p++;
+                return true;
+            }
+
+            for (;;)
+            {
+                std::pair<std::string, json_value> member;
+
+                skip();
+                if (!parse_string(member.first))
+                    return false;
+
+                skip();
+                if (p >= end || *p != ':')
+                    return false;
+                p++;
+
+                v.object.push_back(member);
+                if (!parse(v.object.back().second, depth + 1))
+                    return false;
+
+                skip();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+
+                if (p < end && *p == '}')
+                {
+                    p++;
+                    return true;
+                }
+
+                return false;
+            }
+        }
+
+        if (*p == '[')
+        {
+            v.type = json_value::array_value;
+            p++;
+            skip();
+
+            if (p < end && *p == ']')
+            {
+                p++;
+                return true;
+            }
+
+            for (;;)
+            {
+                v.array.push_back(json_value());
+                if (!parse(v.array.back(), depth + 1))
+                    return false;
+
+                skip();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+
+                if (p < end && *p == ']')
+                {
+                    p++;
+                    return true;
+                }
+
+                return false;
+            }
+        }
+
+        if (*p == '"')
+        {
+            v.type = json_value::string_value;
+            return parse_string(v.string);
+        }
+
+        if (literal("true"))
+        {
+            v.type = json_value::bool_value;
+            v.number = 1.0;
+            return true;
+        }
+
+        if (literal("false"))
+        {
+            v.type = json_value::bool_value;
+            return true;
+        }
+
+        if (literal("null"))
+            return true;
+
+        float f;
+        const char * q = parse_float(p, end, f);
+
+        if (q == NULL)
+            return false;
+
+        // Indices and byte offsets need every digit, so whole numbers are
+        // read again exactly
+        long long whole;
+        const char * r = parse_int(p, end, whole);
+
+        v.type = json_value::number_value;
+        v.number = r == q ? (double)whole : (double)f;
+        p = q;
+
+        return true;
+    }
+};
+
+struct gltf_buffer
+{
+    const unsigned char *       data;
+    size_t                      size;
+    std::vector<unsigned char>  owned;
+};
+
+struct gltf_file
+{
+    json_value                  root;
+    std::vector<gltf_buffer>    buffers;
+    std::vector<sb7::mapped_file *> mappings;
+
+    ~gltf_file()
+    {
+        size_t i;
+
+        for (i = 0; i < mappings.size(); i++)
+        {
+            delete mappings[i];
+        }
+    }
+};
+
+}
+
+static bool decode_base64(const char * p, const char * end, std::vector<unsigned char>& out)
+{
+    unsigned int bits = 0;
+    int count = 0;
+
+    out.reserve((end - p) / 4 * 3);
+
+    for (; p < end && *p != '='; p++)
+    {
+        const char c = *p;
+        unsigned int value;
+
+        if (c >= 'A' && c <= 'Z')
+            value = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            value = c - '0' + 52;
+        else if (c == '+' || c == '-')
+            value = 62;
+        else if (c == '/' || c == '_')
+            value = 63;
+        else
+            return false;
+
+        bits = (bits << 6) | value;
+        count += 6;
+
+        if (count >= 8)
+        {
+            count -= 8;
+            out.push_back((unsigned char)(bits >> count));
+        }
+    }
+
+    return true;
+}
+
+static std::string decode_uri(const std::string& uri)
+{
+    std::string result;
+    size_t i;
+
+    for (i = 0; i < uri.size(); i++)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size() &&
+            isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2]))
+        {
+            result += (char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        }
+        else
+        {
+            result += uri[i];
+        }
+    }
+
+    return result;
+}
+
+static bool load_gltf_buffers(const char * filename, gltf_file& g,
+                              const unsigned char * bin, size_t bin_size)
+{
+    const json_value * buffers = g.root.get("buffers");
+    size_t i;
+
+    if (buffers == NULL)
+        return true;
+
+    g.buffers.resize(buffers->array.size());
+
+    for (i = 0; i < buffers->array.size(); i++)
+    {
+        const json_value& b = buffers->array[i];
+        const json_value * uri = b.get("uri");
+        gltf_buffer& buffer = g.buffers[i];
+        const double length = b.number_or("byteLength", 0.0);
+
+        if (uri == NULL)
+        {
+            // The first buffer of a .glb can be its binary chunk
+            if (i != 0 || bin == NULL)
+            {
+                fprintf(stderr, "%s: buffer %u has no data\n", filename, (unsigned int)i);
+                return false;
+            }
+
+            buffer.data = bin;
+            buffer.size = bin_size;
+        }
+        else if (uri->string.compare(0, 5, "data:") == 0)
+        {
+            const size_t comma = uri->string.find(";base64,");
+
+            if (comma == std::string::npos ||
+                !decode_base64(uri->string.c_str() + comma + 8,
+                               uri->string.c_str() + uri->string.size(),
+                               buffer.owned))
+            {
+                fprintf(stderr, "%s: buffer %u has a bad data URI\n", filename, (unsigned int)i);
+                return false;
+            }
+
+            buffer.data = buffer.owned.empty() ? NULL : &buffer.owned[0];
+            buffer.size = buffer.owned.size();
+        }
+        else
+        {
+            std::string path(filename);
+            const size_t slash = path.find_last_of("/\\");
+
+            path = (slash == std::string::npos ? std::string() : path.substr(0, slash + 1)) + decode_uri(uri->string);
+
+            sb7::mapped_file * mapping = new sb7::mapped_file;
+            g.mappings.push_back(mapping);
+
+            if (!mapping->open(path.c_str()))
+            {
+                fprintf(stderr, "%s: can't open buffer %s\n", filename, path.c_str());
+                return false;
+            }
+
+            buffer.data = mapping->data();
+            buffer.size = mapping->size();
+        }
+
+        if (length > (double)buffer.size)
+        {
+            fprintf(stderr, "%s: buffer %u is too short\n", filename, (unsigned int)i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Reads count elements of an accessor as floats, components each,
+// normalizing integers if the accessor says to. Returns false if it's
+// missing, the wrong shape or runs out of its buffer.
+static bool read_accessor(const gltf_file& g, const json_value * accessor, unsigned int components,
+                          std::vector<float>& out, size_t& count)
+{
+    static const struct
+    {
+        const char *    name;
+        unsigned int    components;
+    } shapes[] =
+    {
+        { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }
+    };
+    unsigned int shape = 0;
+    size_t i;
+
+    if (accessor == NULL || accessor->get("sparse") != NULL)
+        return false;
+
+    const json_value * type = accessor->get("type");
+
+    for (i = 0; type != NULL && i < sizeof(shapes) / sizeof(shapes[0]); i++)
+    {
+        if (type->string == shapes[i].name)
+            shape = shapes[i].components;
+    }
+
+    if (shape != components)
+        return false;
+
+    const double component_type = accessor->number_or("componentType", 0.0);
+    const bool normalized = accessor->get("normalized") != NULL && accessor->get("normalized")->number != 0.0;
+    unsigned int component_size;
+
+    switch ((int)component_type)
+    {
+        case 5120: case 5121: component_size = 1; break;
+        case 5122: case 5123: component_size = 2; break;
+        case 5125: case 5126: component_size = 4; break;
+        default: return false;
+    }
+
+    const double element_count = accessor->number_or("count", -1.0);
+
+    if (!(element_count >= 0.0) || element_count >= (double)none)
+        return false;
+
+    count = (size_t)element_count;
+    out.assign(count * components, 0.0f);
+
+    const json_value * view_index = accessor->get("bufferView");
+
+    // Accessors without a view are all zeros
+    if (view_index == NULL)
+        return true;
+
+    const json_value * views = g.root.get("bufferViews");
+    const json_value * view = views != NULL ? views->at(view_index->number) : NULL;
+
+    if (view == NULL)
+        return false;
+
+    const double buffer_index = view->number_or("buffer", -1.0);
+
+    if (!(buffer_index >= 0.0) || buffer_index >= (double)g.buffers.size())
+        return false;
+
+    const gltf_buffer& buffer = g.buffers[(size_t)buffer_index];
+    const double view_offset = view->number_or("byteOffset", 0.0);
+    const double view_length = view->number_or("byteLength", -1.0);
+    const double element_size = (double)component_size * components;
+    const double stride = view->number_or("byteStride", 0.0) != 0.0 ? view->number_or("byteStride", 0.0) : element_size;
+    const double offset = accessor->number_or("byteOffset", 0.0);
+
+    if (view_offset < 0.0 || view_length < 0.0 || view_offset + view_length > (double)buffer.size ||
+        offset < 0.0 || stride < element_size ||
+        (count != 0 && offset + stride * (count - 1) + element_size > view_length))
+    {
+        return false;
+    }
+
+    const unsigned char * base = buffer.data + (size_t)view_offset + (size_t)offset;
+    const size_t byte_stride = (size_t)stride;
+    const int type_id = (int)component_type;
+    int e;
+
+#pragma omp parallel for
+    for (e = 0; e < (int)count; e++)
+    {
+        const unsigned char * element = base + (size_t)e * byte_stride;
+        float * result = &out[(size_t)e * components];
+        unsigned int c;
+
+        for (c = 0; c < components; c++)
+        {
+            const unsigned char * p = element + c * component_size;
+            float value;
+
+            switch (type_id)
+            {
+                case 5120:
+                    value = normalized ? std::max((signed char)*p / 127.0f, -1.0f) : (float)(signed char)*p;
+                    break;
+                case 5121:
+                    value = normalized ? *p / 255.0f : (float)*p;
+                    break;
+                case 5122:
+                {
+                    short s;
+                    memcpy(&s, p, 2);
+                    value = normalized ? std::max(s / 32767.0f, -1.0f) : (float)s;
+                    break;
+                }
+                case 5123:
+                {
+                    unsigned short s;
+                    memcpy(&s, p, 2);
+                    value = normalized ? s / 65535.0f : (float)s;
+                    break;
+                }
+                case 5125:
+                {
+                    unsigned int u;
+                    memcpy(&u, p, 4);
+                    value = (float)u;
+                    break;
+                }
+                default:
+                    memcpy(&value, p, 4);
+                    break;
+            }
+
+            result[c] = value;
+        }
+    }
+
+    return true;
+}
+
+// Indices are read separately so that 32-bit ones stay exact
+static bool read_indices(const gltf_file& g, const json_value * accessor, std::vector<unsigned int>& out)
+{
+    std::vector<float> unused;
+    size_t count;
+
+    if (accessor == NULL)
+        return false;
+
+    const int component_type = (int)accessor->number_or("componentType", 0.0);
+
+    if (component_type != 5121 && component_type != 5123 && component_type != 5125)
+        return false;
+
+    // Validate the accessor's shape and range with the generic reader, then
+    // read the exact values
+    if (!read_accessor(g, accessor, 1, unused, count))
+        return false;
+
+    out.resize(count);
+
+    const json_value * view_index = accessor->get("bufferView");
+
+    if (view_index == NULL)
+    {
+        std::fill(out.begin(), out.end(), 0);
+        return true;
+    }
+
+    const json_value * view = g.root.get("bufferViews")->at(view_index->number);
+    const gltf_buffer& buffer = g.buffers[(size_t)view->number_or("buffer", 0.0)];
+    const unsigned int size = component_type == 5121 ? 1 : component_type == 5123 ? 2 : 4;
+    const size_t stride = view->number_or("byteStride", 0.0) != 0.0 ? (size_t)view->number_or("byteStride", 0.0) : size;
+    const unsigned char * base = buffer.data + (size_t)view->number_or("byteOffset", 0.0) +
+                                 (size_t)accessor->number_or("byteOffset", 0.0);
+    int i;
+
+#pragma omp parallel for
+    for (i = 0; i < (int)count; i++)
+    {
+        unsigned int value = 0;
+
+        memcpy(&value, base + (size_t)i * stride, size);
+        out[i] = value;
+    }
+
+    return true;
+}
+
+bool load_gltf(const char * filename, source_mesh& out)
+{
+    sb7::mapped_file file;
+    gltf_file g;
+    json_parser parser;
+    const unsigned char * bin = NULL;
+    size_t bin_size = 0;
+    size_t m, i;
+
+    if (!file.open(filename))
+    {
+        fprintf(stderr, "%s: can't open\n", filename);
+        return false;
+    }
+
+    parser.p = (const char *)file.data();
+    parser.end = parser.p + file.size();
+
+    // A .glb is a header and then a JSON chunk and an optional binary one
+    if (file.size() >= 12 && memcmp(file.data(), "glTF", 4) == 0)
+    {
+        const unsigned char * p = file.data() + 12;
+        const unsigned char * end = file.data() + file.size();
+        unsigned int header[2];
+
+        parser.p = parser.end = NULL;
+
+        while (end - p >= 8)
+        {
+            memcpy(header, p, 8);
+            p += 8;
+
+            if ((size_t)(end - p) < header[0])
+                break;
+
+            if (header[1] == 0x4E4F534A && parser.p == NULL)
+            {
+                parser.p = (const char *)p;
+                parser.end = parser.p + header[0];
+            }
+            else if (header[1] == 0x004E4942 && bin == NULL)
+            {
+                bin = p;
+                bin_size = header[0];
+            }
+
+            p += (header[0] + 3) & ~3u;
+        }
+
+        if (parser.p == NULL)
+        {
+            fprintf(stderr, "%s: no JSON chunk\n", filename);
+            return false;
+        }
+    }
+
+    if (!parser.parse(g.root, 0) || g.root.type != json_value::object_value)
+    {
+        fprintf(stderr, "%s: bad JSON\n", filename);
+        return false;
+    }
+
+    if (!load_gltf_buffers(filename, g, bin, bin_size))
+        return false;
+
+    const json_value * meshes = g.root.get("meshes");
+    const json_value * accessors = g.root.get("accessors");
+
+    if (meshes == NULL || accessors == NULL)
+    {
+        fprintf(stderr, "%s: no meshes\n", filename);
+        return false;
+    }
+
+    out.groups.clear();
+
+    for (m = 0; m < meshes->array.size(); m++)
+    {
+        const json_value * primitives = meshes->array[m].get("primitives");
+
+        for (i = 0; primitives != NULL && i < primitives->array.size(); i++)
+        {
+            const json_value& primitive = primitives->array[i];
+            const json_value * attributes = primitive.get("attributes");
+            const json_value * position = attributes != NULL ? attributes->get("POSITION") : NULL;
+            const json_value * normal = attributes != NULL ? attributes->get("NORMAL") : NULL;
+            const json_value * texcoord = attributes != NULL ? attributes->get("TEXCOORD_0") : NULL;
+            const json_value * index_accessor = primitive.get("indices");
+            std::vector<float> positions, normals, texcoords;
+            std::vector<unsigned int> indices;
+            size_t vertex_count, count;
+            bool ok = true;
+            int t;
+
+            if (primitive.number_or("mode", 4.0) != 4.0)
+            {
+                fprintf(stderr, "%s: skipping mesh %u primitive %u, which isn't triangles\n",
+                        filename, (unsigned int)m, (unsigned int)i);
+                continue;
+            }
+
+            if (position == NULL ||
+                !read_accessor(g, accessors->at(position->number), 3, positions, vertex_count) ||
+                (normal != NULL && (!read_accessor(g, accessors->at(normal->number), 3, normals, count) || count != vertex_count)) ||
+                (texcoord != NULL && (!read_accessor(g, accessors->at(texcoord->number), 2, texcoords, count) || count != vertex_count)) ||
+                (index_accessor != NULL && !read_indices(g, accessors->at(index_accessor->number), indices)))
+            {
+                fprintf(stderr, "%s: mesh %u primitive %u has a bad accessor\n",
+                        filename, (unsigned int)m, (unsigned int)i);
+                return false;
+            }
+
+            if (index_accessor == NULL)
+            {
+                indices.resize(vertex_count);
+                for (count = 0; count < vertex_count; count++)
+                {
+                    indices[count] = (unsigned int)count;
+                }
+            }
+
+            const size_t position_base = out.positions.size() / 3;
+            const size_t normal_base = out.normals.size() / 3;
+            const size_t texcoord_base = out.texcoords.size() / 2;
+            const size_t corner_base = out.corners.size();
+            const size_t triangle_count = indices.size() / 3;
+
+            if (position_base + vertex_count >= none)
+            {
+                fprintf(stderr, "%s: too many vertices\n", filename);
+                return false;
+            }
+
+            add_group(out, (unsigned int)(corner_base / 3));
+            out.positions.insert(out.positions.end(), positions.begin(), positions.end());
+            out.normals.insert(out.normals.end(), normals.begin(), normals.end());
+            out.texcoords.insert(out.texcoords.end(), texcoords.begin(), texcoords.end());
+            out.corners.resize(corner_base + triangle_count * 3);
+
+#pragma omp parallel for reduction(&&:ok)
+            for (t = 0; t < (int)(triangle_count * 3); t++)
+            {
+                const unsigned int v = indices[t];
+                source_corner& c = out.corners[corner_base + t];
+
+                ok = ok && v < vertex_count;
+
+                c.position = (unsigned int)position_base + v;
+                c.normal = normals.empty() ? none : (unsigned int)normal_base + v;
+                c.texcoord = texcoords.empty() ? none : (unsigned int)texcoord_base + v;
+            }
+
+            if (!ok)
+            {
+                fprintf(stderr, "%s: mesh %u primitive %u has an index out of range\n",
+                        filename, (unsigned int)m, (unsigned int)i);
+                return false;
+            }
+        }
+    }
+
+    if (out.corners.empty())
+    {
+        fprintf(stderr, "%s: no triangles\n", filename);
+        return false;
+    }
+
+    finish_groups(out);
+    out.bytes_read = file.size();
+    for (i = 0; i < g.mappings.size(); i++)
+    {
+        out.bytes_read += g.mappings[i]->size();
+    }
+
+    return true;
+}
+
+bool load_source(const char * filename, source_mesh& out)
+{
+    out.positions.clear();
+    out.normals.clear();
+    out.texcoords.clear();
+    out.corners.clear();
+    out.groups.clear();
+    out.bytes_read = 0;
+
+    if (has_extension(filename, ".obj"))
+        return load_obj(filename, out);
+
+    if (has_extension(filename, ".ply"))
+        return load_ply(filename, out);
+
+    if (has_extension(filename, ".gltf") || has_extension(filename, ".glb"))
+        return load_gltf(filename, out);
+
+    fprintf(stderr, "%s: unknown format; expected .obj, .ply, .gltf or .glb\n", filename);
+    return false;
+}
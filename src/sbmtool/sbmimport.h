@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Readers for the source formats sbmtool converts to .sbm
+
+#ifndef __SBMIMPORT_H__
+#define __SBMIMPORT_H__
+
+#include <cstddef>
+#include <vector>
+
+// A triangle corner, as indices into the arrays of a source_mesh. Missing
+// normals or texture coordinates are ~0u.
+struct source_corner
+{
+    unsigned int        position;
+    unsigned int        normal;
+    unsigned int        texcoord;
+};
+
+// Geometry as the source formats describe it: separate arrays of each
+// attribute and triangles whose corners pick from each, the way OBJ does.
+// Each group becomes a sub-object.
+struct source_mesh
+{
+    std::vector<float>          positions;      // xyz
+    std::vector<float>          normals;        // xyz
+    std::vector<float>          texcoords;      // uv
+    std::vector<source_corner>  corners;        // Three per triangle
+    std::vector<unsigned int>   groups;         // First triangle of each group
+    size_t                      bytes_read;     // Including external buffers
+};
+
+// Each reader prints what's wrong with a file it can't read and returns
+// false. They split their work across threads with OpenMP.
+//
+// load_obj()   Wavefront OBJ. Polygons are split into fans and o, g and
+//              usemtl lines start new groups.
+// load_ply()   Binary PLY, either byte order. Vertices can have nx, ny, nz
+//              and u, v (or s, t) properties.
+// load_gltf()  glTF 2.0 as .gltf with external or data: buffers, or .glb.
+//              Every triangle primitive of every mesh becomes a group, in
+//              mesh space; the node hierarchy isn't applied.
+bool load_obj(const char * filename, source_mesh& out);
+bool load_ply(const char * filename, source_mesh& out);
+bool load_gltf(const char * filename, source_mesh& out);
+
+// Picks a reader by the file's extension
+bool load_source(const char * filename, source_mesh& out);
+
+#endif /* __SBMIMPORT_H__ */
@@ -0,0 +1,1166 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Offline processing of .sbm models. Run with no arguments for usage.
+
+#include <sb7cull.h>
+#include <sb7sbm.h>
+#include <sb7mesh.h>
+#include <vmath.h>
+
+#include "sbmimport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "GL/glcorearb.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: sbmtool stats [-c cache] in.sbm\n"
+            "       sbmtool optimize [-c cache] [-t threshold] [-i] in.sbm out.sbm\n"
+            "       sbmtool quantize [-n bits] in.sbm out.sbm\n"
+            "       sbmtool meshlets [-v vertices] [-p triangles] [-i] in.sbm out.sbm\n"
+            "       sbmtool cull [-r views] in.sbm\n"
+            "       sbmtool lod [-l levels] [-e error] [-i] in.sbm out.sbm\n"
+            "       sbmtool select [-r views] in.sbm\n"
+            "       sbmtool convert [-g] in.(obj|ply|gltf|glb) out.sbm\n"
+            "\n"
+            "  -c cache       FIFO cache size used for statistics and overdraw clustering (default 32)\n"
+            "  -t threshold   ACMR increase allowed when splitting for overdraw (default 1.05)\n"
+            "  -i             weld non-indexed models into indexed ones; sub-objects then index\n"
+            "                 into the new index buffer, so only do this for models drawn with\n"
+            "                 object::render_sub_object\n"
+            "  -n bits        bits per component of octahedral normals and tangents, 8 or 16\n"
+            "                 (default 16)\n"
+            "  -v vertices    most vertices in a meshlet (default and limit 64)\n"
+            "  -p triangles   most triangles in a meshlet (default and limit 124)\n"
+            "  -r views       random views to time culling or LOD selection with (default 1000)\n"
+            "  -l levels      simplified levels to add, each with half the triangles of the\n"
+            "                 one before (default 4)\n"
+            "  -e error       largest simplification error allowed, as a fraction of each\n"
+            "                 sub-object's radius (default 0.05)\n"
+            "  -g             generate normals even if the source has them\n");
+}
+
+struct options
+{
+    unsigned int        cache_size;
+    float               threshold;
+    bool                make_indexed;
+    unsigned int        normal_bits;
+    unsigned int        max_vertices;
+    unsigned int        max_triangles;
+    unsigned int        views;
+    unsigned int        levels;
+    float               max_error;
+    bool                generate_normals;
+    const char *        files[2];
+    int                 num_files;
+};
+
+static bool parse_options(int argc, char ** argv, options& opts)
+{
+    int i;
+
+    opts.cache_size = 32;
+    opts.threshold = 1.05f;
+    opts.make_indexed = false;
+    opts.normal_bits = 16;
+    opts.max_vertices = SB6M_MESHLET_MAX_VERTICES;
+    opts.max_triangles = SB6M_MESHLET_MAX_TRIANGLES;
+    opts.views = 1000;
+    opts.levels = 4;
+    opts.max_error = 0.05f;
+    opts.generate_normals = false;
+    opts.num_files = 0;
+
+    for (i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            opts.cache_size = (unsigned int)atoi(argv[++i]);
+            if (opts.cache_size < 3)
+                return false;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            opts.threshold = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            opts.normal_bits = (unsigned int)atoi(argv[++i]);
+            if (opts.normal_bits != 8 && opts.normal_bits != 16)
+                return false;
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+        {
+            opts.max_vertices = (unsigned int)atoi(argv[++i]);
+            if (opts.max_vertices < 3 || opts.max_vertices > SB6M_MESHLET_MAX_VERTICES)
+                return false;
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            opts.max_triangles = (unsigned int)atoi(argv[++i]);
+            if (opts.max_triangles < 1 || opts.max_triangles > SB6M_MESHLET_MAX_TRIANGLES)
+                return false;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            opts.views = (unsigned int)atoi(argv[++i]);
+            if (opts.views < 1)
+                return false;
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            opts.levels = (unsigned int)atoi(argv[++i]);
+            if (opts.levels < 1 || opts.levels > 16)
+                return false;
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            opts.max_error = (float)atof(argv[++i]);
+            if (!(opts.max_error > 0.0f))
+                return false;
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            opts.make_indexed = true;
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            opts.generate_normals = true;
+        }
+        else if (argv[i][0] != '-' && opts.num_files < 2)
+        {
+            opts.files[opts.num_files++] = argv[i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Triangle lists of non-indexed models are their vertices in order. Only
+// the sub-objects of indexed models count, not their levels of detail.
+static std::vector<unsigned int> draw_indices(const sb7::sbm::mesh& m)
+{
+    std::vector<unsigned int> indices;
+    unsigned int i;
+
+    if (m.indexed && m.lods.empty())
+        return m.indices;
+
+    if (m.indexed)
+    {
+        for (i = 0; i < m.sub_objects.size(); i++)
+        {
+            const SB6M_SUB_OBJECT_DECL& sub = m.sub_objects[i];
+            indices.insert(indices.end(), m.indices.begin() + sub.first, m.indices.begin() + sub.first + sub.count);
+        }
+
+        return indices;
+    }
+
+    indices.resize(m.vertex_count);
+    for (i = 0; i < m.vertex_count; i++)
+    {
+        indices[i] = i;
+    }
+
+    return indices;
+}
+
+static void print_stats(const char * label, const sb7::sbm::mesh& m, unsigned int cache_size)
+{
+    std::vector<unsigned int> indices = draw_indices(m);
+    sb7::mesh::cache_stats stats = sb7::mesh::analyze_vertex_cache(indices.empty() ? NULL : &indices[0],
+                                                                   indices.size(),
+                                                                   m.vertex_count,
+                                                                   cache_size);
+
+    printf("%-8s %9u vertices %9u triangles  ACMR %.3f  ATVR %.3f  (%u-entry FIFO)\n",
+           label, m.vertex_count, stats.triangles, stats.acmr, stats.atvr, cache_size);
+}
+
+static void remap_mesh(sb7::sbm::mesh& m, const std::vector<unsigned int>& remap, size_t new_count)
+{
+    size_t i;
+
+    for (i = 0; i < m.attribs.size(); i++)
+    {
+        sb7::sbm::attrib_array& a = m.attribs[i];
+        std::vector<unsigned char> data(new_count * a.element_size);
+
+        sb7::mesh::remap_vertices(data.empty() ? NULL : &data[0], &a.data[0], m.vertex_count, a.element_size, &remap[0]);
+        a.data.swap(data);
+    }
+
+    if (!m.indices.empty())
+        sb7::mesh::remap_indices(&m.indices[0], &m.indices[0], m.indices.size(), &remap[0]);
+    m.vertex_count = (unsigned int)new_count;
+}
+
+// Merges vertices whose attributes are identical in every byte
+static void weld(sb7::sbm::mesh& m)
+{
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned int> remap(m.vertex_count);
+    size_t vertex_size = 0;
+    size_t i, v, offset;
+
+    for (i = 0; i < m.attribs.size(); i++)
+    {
+        vertex_size += m.attribs[i].element_size;
+    }
+
+    vertices.resize(vertex_size * m.vertex_count);
+
+    for (i = 0, offset = 0; i < m.attribs.size(); i++)
+    {
+        const sb7::sbm::attrib_array& a = m.attribs[i];
+        for (v = 0; v < m.vertex_count; v++)
+        {
+            memcpy(&vertices[v * vertex_size + offset], &a.data[v * a.element_size], a.element_size);
+        }
+        offset += a.element_size;
+    }
+
+    const size_t unique = sb7::mesh::generate_vertex_remap(&remap[0], &vertices[0], m.vertex_count, vertex_size);
+
+    // Each distinct vertex lands on its first occurrence's new slot; the
+    // duplicates just write the same bytes again
+    remap_mesh(m, remap, unique);
+}
+
+static bool sub_objects_disjoint(const sb7::sbm::mesh& m)
+{
+    std::vector<SB6M_SUB_OBJECT_DECL> sorted(m.sub_objects);
+    size_t i;
+
+    std::sort(sorted.begin(), sorted.end(),
+              [](const SB6M_SUB_OBJECT_DECL& a, const SB6M_SUB_OBJECT_DECL& b) { return a.first < b.first; });
+
+    for (i = 0; i < sorted.size(); i++)
+    {
+        if (sorted[i].count % 3 != 0)
+            return false;
+        if (i > 0 && sorted[i - 1].first + sorted[i - 1].count > sorted[i].first)
+            return false;
+    }
+
+    return true;
+}
+
+static int stats(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!sb7::sbm::load(opts.files[0], m))
+    {
+        fprintf(stderr, "%s: not a valid .sbm file\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    print_stats("input", m, opts.cache_size);
+
+    return EXIT_SUCCESS;
+}
+
+// Loads a model and makes sure it's indexed, welded and has sub-objects
+// that don't overlap
+static bool load_indexed(const options& opts, sb7::sbm::mesh& m)
+{
+    if (!sb7::sbm::load(opts.files[0], m))
+    {
+        fprintf(stderr, "%s: not a valid .sbm file\n", opts.files[0]);
+        return false;
+    }
+
+    print_stats("before", m, opts.cache_size);
+
+    if (m.vertex_count == 0)
+    {
+        fprintf(stderr, "%s: no vertices\n", opts.files[0]);
+        return false;
+    }
+
+    if (!m.indexed)
+    {
+        if (!opts.make_indexed)
+        {
+            fprintf(stderr, "%s: not indexed; pass -i to weld it\n", opts.files[0]);
+            return false;
+        }
+
+        m.indices = draw_indices(m);
+        m.indexed = true;
+    }
+
+    if (!sub_objects_disjoint(m))
+    {
+        fprintf(stderr, "%s: sub-objects overlap or aren't whole triangles\n", opts.files[0]);
+        return false;
+    }
+
+    weld(m);
+
+    return true;
+}
+
+// Gets a model ready for triangles to be reordered within its sub-objects
+static bool load_for_reordering(const options& opts, sb7::sbm::mesh& m)
+{
+    if (!load_indexed(opts, m))
+        return false;
+
+    // Any meshlets describe the old triangle order
+    if (!m.meshlets.empty())
+    {
+        fprintf(stderr, "%s: dropping meshlets; run meshlets again afterwards\n", opts.files[0]);
+        m.meshlets.clear();
+    }
+
+    return true;
+}
+
+// Unquantized positions as plain floats, three per vertex
+static void float_positions(const sb7::sbm::mesh& m, std::vector<float>& positions)
+{
+    sb7::sbm::mesh expanded;
+    const sb7::sbm::mesh * src = &m;
+    unsigned int v;
+
+    if (!m.quantized.empty())
+    {
+        expanded = m;
+        sb7::sbm::dequantize(expanded);
+        src = &expanded;
+    }
+
+    const sb7::sbm::attrib_array& a = src->attribs[0];
+
+    positions.resize((size_t)m.vertex_count * 3);
+    for (v = 0; v < m.vertex_count; v++)
+    {
+        float p[4];
+
+        sb7::sbm::decode_attrib(a.decl, &a.data[(size_t)v * a.element_size], p);
+        memcpy(&positions[v * 3], p, 3 * sizeof(float));
+    }
+}
+
+// Lays vertices out in the order they're first used
+static void optimize_vertex_fetch(sb7::sbm::mesh& m)
+{
+    std::vector<unsigned int> remap(m.vertex_count);
+    const size_t used = sb7::mesh::optimize_vertex_fetch_remap(&remap[0], &m.indices[0], m.indices.size(), m.vertex_count);
+
+    remap_mesh(m, remap, used);
+}
+
+static int optimize(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+    std::vector<float> positions;
+    int i;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!load_for_reordering(opts, m))
+        return EXIT_FAILURE;
+
+    // Overdraw sorting needs positions as plain floats
+    float_positions(m, positions);
+
+    // Triangles never move between sub-objects, so each one is optimized
+    // on its own
+#pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < (int)m.sub_objects.size(); i++)
+    {
+        const SB6M_SUB_OBJECT_DECL& sub = m.sub_objects[i];
+        std::vector<unsigned int> reordered(sub.count);
+
+        if (sub.count == 0)
+            continue;
+
+        sb7::mesh::optimize_vertex_cache(&reordered[0], &m.indices[sub.first], sub.count, m.vertex_count);
+        sb7::mesh::optimize_overdraw(&m.indices[sub.first], &reordered[0], sub.count,
+                                     &positions[0], 3, m.vertex_count,
+                                     opts.cache_size, opts.threshold);
+    }
+
+    optimize_vertex_fetch(m);
+
+    print_stats("after", m, opts.cache_size);
+
+    if (!sb7::sbm::write(opts.files[1], m))
+    {
+        fprintf(stderr, "%s: couldn't write\n", opts.files[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static size_t vertex_bytes(const sb7::sbm::mesh& m, size_t& stride)
+{
+    std::vector<unsigned char> data;
+    std::vector<SB6M_VERTEX_ATTRIB_DECL> decls;
+
+    sb7::sbm::pack_vertices(m, data, decls);
+    stride = decls.empty() ? 0 : decls[0].stride;
+
+    return data.size();
+}
+
+static int quantize(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+    size_t before, after, stride;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!sb7::sbm::load(opts.files[0], m))
+    {
+        fprintf(stderr, "%s: not a valid .sbm file\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    before = vertex_bytes(m, stride);
+    printf("before   %9u vertices %4u bytes each %10u bytes\n", m.vertex_count, (unsigned int)stride, (unsigned int)before);
+
+    sb7::sbm::quantize(m, opts.normal_bits);
+
+    after = vertex_bytes(m, stride);
+    printf("after    %9u vertices %4u bytes each %10u bytes  (%.2fx smaller)\n",
+           m.vertex_count, (unsigned int)stride, (unsigned int)after, after ? (double)before / (double)after : 0.0);
+
+    if (!sb7::sbm::write(opts.files[1], m))
+    {
+        fprintf(stderr, "%s: couldn't write\n", opts.files[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int meshlets(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+    std::vector<float> positions;
+    std::vector<unsigned int> reordered;
+    std::vector<sb7::mesh::meshlet> built;
+    size_t i, j, vertices = 0, triangles = 0, open_cones = 0;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!load_for_reordering(opts, m))
+        return EXIT_FAILURE;
+
+    float_positions(m, positions);
+
+    for (i = 0; i < m.sub_objects.size(); i++)
+    {
+        const SB6M_SUB_OBJECT_DECL& sub = m.sub_objects[i];
+
+        if (sub.count == 0)
+            continue;
+
+        reordered.resize(sub.count);
+        built.resize(sb7::mesh::build_meshlets_bound(sub.count, opts.max_vertices, opts.max_triangles));
+
+        const size_t count = sb7::mesh::build_meshlets(&built[0], &reordered[0], &m.indices[sub.first], sub.count,
+                                                       &positions[0], 3, m.vertex_count,
+                                                       opts.max_vertices, opts.max_triangles);
+
+        std::copy(reordered.begin(), reordered.end(), m.indices.begin() + sub.first);
+
+        for (j = 0; j < count; j++)
+        {
+            const sb7::mesh::meshlet& b = built[j];
+            SB6M_MESHLET_DECL decl;
+
+            memset(&decl, 0, sizeof(decl));
+            decl.first = sub.first + b.first;
+            decl.count = b.count;
+            decl.sub_object = (unsigned int)i;
+            decl.vertex_count = b.vertex_count;
+            memcpy(decl.center, b.center, sizeof(decl.center));
+            decl.radius = b.radius;
+            memcpy(decl.cone_apex, b.cone_apex, sizeof(decl.cone_apex));
+            decl.cone_cutoff = b.cone_cutoff;
+            memcpy(decl.cone_axis, b.cone_axis, sizeof(decl.cone_axis));
+            m.meshlets.push_back(decl);
+
+            vertices += b.vertex_count;
+            triangles += b.count / 3;
+            open_cones += b.cone_cutoff >= 1.0f;
+        }
+    }
+
+    optimize_vertex_fetch(m);
+
+    print_stats("after", m, opts.cache_size);
+
+    if (!m.meshlets.empty())
+    {
+        printf("meshlets %9u  %.1f vertices and %.1f triangles each, %u with no useful cone\n",
+               (unsigned int)m.meshlets.size(),
+               (double)vertices / m.meshlets.size(),
+               (double)triangles / m.meshlets.size(),
+               (unsigned int)open_cones);
+    }
+
+    if (!sb7::sbm::write(opts.files[1], m))
+    {
+        fprintf(stderr, "%s: couldn't write\n", opts.files[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Times meshlet culling from random views around the model, all looking at
+// its middle from two to four radii away with a 50 degree field of view
+static int cull(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+    sb7::meshlet_culler culler;
+    std::vector<sb7::draw_elements_indirect_command> commands;
+    std::vector<float> planes;
+    std::vector<float> eyes;
+    float lo[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    float hi[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+    unsigned int i, j, sub;
+    size_t tested = 0, visible = 0, visible_scalar = 0;
+    double simd_ms, scalar_ms;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!sb7::sbm::load(opts.files[0], m))
+    {
+        fprintf(stderr, "%s: not a valid .sbm file\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (m.meshlets.empty())
+    {
+        fprintf(stderr, "%s: no meshlets; run meshlets first\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    culler.load(&m.meshlets[0], (unsigned int)m.meshlets.size(), (unsigned int)m.sub_objects.size(), 0);
+    commands.resize(m.meshlets.size());
+
+    for (i = 0; i < m.meshlets.size(); i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            lo[j] = std::min(lo[j], m.meshlets[i].center[j] - m.meshlets[i].radius);
+            hi[j] = std::max(hi[j], m.meshlets[i].center[j] + m.meshlets[i].radius);
+        }
+    }
+
+    const vmath::vec3 center((lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f);
+    const float radius = vmath::length(vmath::vec3(hi[0], hi[1], hi[2]) - center);
+    const vmath::mat4 proj = vmath::perspective(50.0f, 16.0f / 9.0f, radius * 0.01f, radius * 10.0f);
+
+    srand(1);
+    planes.resize(opts.views * 24);
+    eyes.resize(opts.views * 3);
+
+    for (i = 0; i < opts.views; i++)
+    {
+        vmath::vec3 dir((float)rand() / RAND_MAX * 2.0f - 1.0f,
+                        (float)rand() / RAND_MAX * 2.0f - 1.0f,
+                        (float)rand() / RAND_MAX * 2.0f - 1.0f);
+
+        if (vmath::length(dir) < 0.001f)
+            dir = vmath::vec3(0.0f, 0.0f, 1.0f);
+
+        const vmath::vec3 eye = center + vmath::normalize(dir) * radius * (2.0f + 2.0f * (float)rand() / RAND_MAX);
+        const vmath::vec3 up = fabsf(dir[1]) > 0.99f * vmath::length(dir) ? vmath::vec3(1.0f, 0.0f, 0.0f) : vmath::vec3(0.0f, 1.0f, 0.0f);
+        const vmath::mat4 mvp = proj * vmath::lookat(eye, center, up);
+
+        sb7::extract_frustum_planes(mvp, (float (*)[4])&planes[i * 24]);
+        memcpy(&eyes[i * 3], &eye[0], 3 * sizeof(float));
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    for (i = 0; i < opts.views; i++)
+    {
+        for (sub = 0; sub < m.sub_objects.size(); sub++)
+        {
+            visible += culler.cull(sub, (const float (*)[4])&planes[i * 24], &eyes[i * 3], &commands[0]);
+        }
+    }
+
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    simd_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+
+    for (i = 0; i < opts.views; i++)
+    {
+        for (sub = 0; sub < m.sub_objects.size(); sub++)
+        {
+            visible_scalar += culler.cull_scalar(sub, (const float (*)[4])&planes[i * 24], &eyes[i * 3], &commands[0]);
+        }
+    }
+
+    end = std::chrono::high_resolution_clock::now();
+    scalar_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    tested = m.meshlets.size() * opts.views;
+
+    printf("%u meshlets, %u views, %.1f%% drawn\n",
+           (unsigned int)m.meshlets.size(), opts.views, 100.0 * visible / tested);
+    printf("simd     %12.0f clusters/ms\n", tested / std::max(simd_ms, 1e-6));
+    printf("scalar   %12.0f clusters/ms\n", tested / std::max(scalar_ms, 1e-6));
+
+    if (visible != visible_scalar)
+    {
+        fprintf(stderr, "simd and scalar culling disagree (%u and %u drawn)\n",
+                (unsigned int)visible, (unsigned int)visible_scalar);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Radius of the sphere around the middle of the bounding box of the
+// vertices that a range of indices uses
+static float sub_object_radius(const sb7::sbm::mesh& m, const std::vector<float>& positions, const SB6M_SUB_OBJECT_DECL& sub)
+{
+    float lo[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    float hi[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+    float center[3];
+    float radius2 = 0.0f;
+    unsigned int i, j;
+
+    for (i = sub.first; i < sub.first + sub.count; i++)
+    {
+        const float * p = &positions[m.indices[i] * 3];
+        for (j = 0; j < 3; j++)
+        {
+            lo[j] = std::min(lo[j], p[j]);
+            hi[j] = std::max(hi[j], p[j]);
+        }
+    }
+
+    for (j = 0; j < 3; j++)
+    {
+        center[j] = (lo[j] + hi[j]) * 0.5f;
+    }
+
+    for (i = sub.first; i < sub.first + sub.count; i++)
+    {
+        const float * p = &positions[m.indices[i] * 3];
+        const float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+
+        radius2 = std::max(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+
+    return sqrtf(radius2);
+}
+
+static int lod(int argc, char ** argv)
+{
+    options opts;
+    sb7::sbm::mesh m;
+    std::vector<float> positions;
+    std::vector<float> radii;
+    std::vector<std::vector<unsigned int> > simplified;
+    std::vector<float> errors;
+    std::vector<size_t> level_triangles;
+    std::vector<float> level_error;
+    size_t i, base_triangles = 0;
+    unsigned int level;
+    int task;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!load_indexed(opts, m))
+        return EXIT_FAILURE;
+
+    if (!m.lods.empty())
+    {
+        fprintf(stderr, "%s: already has levels of detail\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    float_positions(m, positions);
+
+    const size_t sub_count = m.sub_objects.size();
+
+    radii.resize(sub_count);
+    for (i = 0; i < sub_count; i++)
+    {
+        radii[i] = m.sub_objects[i].count ? sub_object_radius(m, positions, m.sub_objects[i]) : 0.0f;
+        base_triangles += m.sub_objects[i].count / 3;
+    }
+
+    // Every level is simplified from the original so that its error is
+    // measured against it, which also makes them independent of each other
+    simplified.resize(sub_count * opts.levels);
+    errors.resize(sub_count * opts.levels);
+
+#pragma omp parallel for schedule(dynamic)
+    for (task = 0; task < (int)(sub_count * opts.levels); task++)
+    {
+        const SB6M_SUB_OBJECT_DECL& sub = m.sub_objects[task / opts.levels];
+        const size_t target = (size_t)(sub.count / 3 * ldexp(1.0, -(int)(task % opts.levels + 1))) * 3;
+        std::vector<unsigned int>& out = simplified[task];
+
+        if (sub.count == 0)
+            continue;
+
+        out.resize(sub.count);
+        out.resize(sb7::mesh::simplify(&out[0], &m.indices[sub.first], sub.count,
+                                       &positions[0], 3, m.vertex_count, target,
+                                       opts.max_error * radii[task / opts.levels], &errors[task]));
+
+        if (!out.empty())
+        {
+            std::vector<unsigned int> ordered(out.size());
+            sb7::mesh::optimize_vertex_cache(&ordered[0], &out[0], out.size(), m.vertex_count);
+            out.swap(ordered);
+        }
+    }
+
+    // Levels go after all of the sub-objects' indices. A sub-object's chain
+    // ends at the first level that couldn't get meaningfully smaller.
+    level_triangles.assign(opts.levels, 0);
+    level_error.assign(opts.levels, 0.0f);
+
+    for (i = 0; i < sub_count; i++)
+    {
+        size_t previous = m.sub_objects[i].count;
+        float error = 0.0f;
+
+        for (level = 0; level < opts.levels; level++)
+        {
+            const std::vector<unsigned int>& out = simplified[i * opts.levels + level];
+            SB6M_LOD_DECL decl;
+
+            if (out.empty() || out.size() > previous * 9 / 10)
+                break;
+
+            error = std::max(error, errors[i * opts.levels + level]);
+
+            decl.sub_object = (unsigned int)i;
+            decl.first = (unsigned int)m.indices.size();
+            decl.count = (unsigned int)out.size();
+            decl.error = error;
+            m.indices.insert(m.indices.end(), out.begin(), out.end());
+            m.lods.push_back(decl);
+
+            level_triangles[level] += out.size() / 3;
+            if (radii[i] > 0.0f)
+                level_error[level] = std::max(level_error[level], error / radii[i]);
+            previous = out.size();
+        }
+    }
+
+    optimize_vertex_fetch(m);
+
+    if (m.lods.empty())
+        printf("no sub-object could be simplified within the error allowed\n");
+
+    for (level = 0; level < opts.levels && level_triangles[level] != 0; level++)
+    {
+        printf("level %u  %9u triangles (%5.1f%%)  error up to %.3f%% of the radius\n",
+               level + 1, (unsigned int)level_triangles[level],
+               base_triangles ? 100.0 * level_triangles[level] / base_triangles : 0.0,
+               100.0 * level_error[level]);
+    }
+
+    if (!sb7::sbm::write(opts.files[1], m))
+    {
+        fprintf(stderr, "%s: couldn't write\n", opts.files[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Times level of detail selection for 50,000 instances scattered in front
+// of a 1080 pixel high, 50 degree view, with one pixel of error allowed
+static int select(int argc, char ** argv)
+{
+    enum { num_instances = 50000 };
+
+    options opts;
+    sb7::sbm::mesh m;
+    sb7::lod_selector selector;
+    std::vector<float> positions;
+    std::vector<float> radii;
+    std::vector<float> spheres(num_instances * 4);
+    std::vector<unsigned int> sub_objects(num_instances);
+    std::vector<sb7::draw_elements_indirect_command> commands(num_instances);
+    std::vector<unsigned char> levels(num_instances);
+    double full = 0.0, drawn = 0.0;
+    unsigned int i, histogram[256] = { 0 };
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!sb7::sbm::load(opts.files[0], m))
+    {
+        fprintf(stderr, "%s: not a valid .sbm file\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (m.lods.empty())
+    {
+        fprintf(stderr, "%s: no levels of detail; run lod first\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    float_positions(m, positions);
+    radii.resize(m.sub_objects.size());
+    for (i = 0; i < m.sub_objects.size(); i++)
+    {
+        radii[i] = m.sub_objects[i].count ? sub_object_radius(m, positions, m.sub_objects[i]) : 0.0f;
+    }
+
+    selector.load(&m.sub_objects[0], &radii[0], (unsigned int)m.sub_objects.size(),
+                  &m.lods[0], (unsigned int)m.lods.size(), 0);
+
+    const float pixel_scale = 1080.0f * 0.5f / tanf(vmath::radians(25.0f));
+
+    srand(1);
+    for (i = 0; i < num_instances; i++)
+    {
+        const float z = -(10.0f + 990.0f * (float)rand() / RAND_MAX);
+        float * s = &spheres[i * 4];
+
+        sub_objects[i] = i % m.sub_objects.size();
+        s[0] = z * (float)rand() / RAND_MAX * 0.8f - z * 0.4f;
+        s[1] = z * (float)rand() / RAND_MAX * 0.45f - z * 0.225f;
+        s[2] = z;
+        s[3] = 1.0f;
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    for (i = 0; i < opts.views; i++)
+    {
+        selector.select(&spheres[0], &sub_objects[0], num_instances, pixel_scale, 1.0f, &commands[0], 0, &levels[0]);
+    }
+
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    for (i = 0; i < num_instances; i++)
+    {
+        full += m.sub_objects[sub_objects[i]].count / 3;
+        drawn += commands[i].count / 3;
+        histogram[levels[i]]++;
+    }
+
+    printf("%u instances of radius 1 at 10 to 1000 units, %u runs\n", (unsigned int)num_instances, opts.views);
+    for (i = 0; i < 256; i++)
+    {
+        if (histogram[i] != 0)
+            printf("level %u  %6u instances\n", i, histogram[i]);
+    }
+    printf("triangles %12.0f of %.0f at full detail (%.1f%%)\n",
+           drawn, full, full ? 100.0 * drawn / full : 0.0);
+    printf("selected  %12.0f instances/ms\n", (double)num_instances * opts.views / std::max(ms, 1e-6));
+
+    return EXIT_SUCCESS;
+}
+
+static void add_attrib(sb7::sbm::mesh& m, const char * name, unsigned int size, const std::vector<float>& data)
+{
+    sb7::sbm::attrib_array a;
+
+    memset(&a.decl, 0, sizeof(a.decl));
+    strncpy(a.decl.name, name, sizeof(a.decl.name) - 1);
+    a.decl.size = size;
+    a.decl.type = GL_FLOAT;
+    a.element_size = size * sizeof(float);
+    a.data.assign((const unsigned char *)&data[0], (const unsigned char *)&data[0] + data.size() * sizeof(float));
+
+    m.attribs.push_back(a);
+}
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point& start)
+{
+    const std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(now - start).count();
+
+    start = now;
+
+    return ms;
+}
+
+static int convert(int argc, char ** argv)
+{
+    options opts;
+    source_mesh source;
+    sb7::sbm::mesh m;
+    std::vector<unsigned int> keys;
+    std::vector<unsigned int> first_corner;
+    std::vector<float> positions, normals, texcoords, tangents;
+    size_t i;
+    int c;
+
+    if (!parse_options(argc, argv, opts) || opts.num_files != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    if (!load_source(opts.files[0], source))
+        return EXIT_FAILURE;
+
+    const double parse_ms = elapsed_ms(start);
+    const size_t corner_count = source.corners.size();
+    const bool has_texcoords = !source.texcoords.empty();
+    bool has_normals = !opts.generate_normals && !source.normals.empty();
+
+    for (i = 0; has_normals && i < corner_count; i++)
+    {
+        has_normals = source.corners[i].normal != ~0u;
+    }
+
+    // Corners that use the same position, normal and texture coordinate
+    // become one vertex. Where the texture is mirrored, tangents point the
+    // other way, so the triangle's handedness is part of the key too.
+    keys.resize(corner_count * 4);
+
+#pragma omp parallel for
+    for (c = 0; c < (int)corner_count; c++)
+    {
+        const source_corner& corner = source.corners[c];
+        unsigned int * key = &keys[(size_t)c * 4];
+        unsigned int mirrored = 0;
+
+        if (has_texcoords)
+        {
+            const source_corner * t = &source.corners[c - c % 3];
+            float uv[3][2] = { { 0.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f } };
+            int k;
+
+            for (k = 0; k < 3; k++)
+            {
+                if (t[k].texcoord != ~0u)
+                    memcpy(uv[k], &source.texcoords[t[k].texcoord * 2], sizeof(uv[k]));
+            }
+
+            mirrored = (uv[1][0] - uv[0][0]) * (uv[2][1] - uv[0][1]) -
+                       (uv[2][0] - uv[0][0]) * (uv[1][1] - uv[0][1]) < 0.0f;
+        }
+
+        key[0] = corner.position;
+        key[1] = has_normals ? corner.normal : ~0u;
+        key[2] = corner.texcoord;
+        key[3] = mirrored;
+    }
+
+    m.indexed = true;
+    m.indices.resize(corner_count);
+
+    const size_t vertex_count = corner_count ? sb7::mesh::generate_vertex_remap(&m.indices[0], &keys[0], corner_count, 4 * sizeof(unsigned int)) : 0;
+
+    first_corner.assign(vertex_count, ~0u);
+    for (i = 0; i < corner_count; i++)
+    {
+        if (first_corner[m.indices[i]] == ~0u)
+            first_corner[m.indices[i]] = (unsigned int)i;
+    }
+
+    positions.resize(vertex_count * 3);
+    normals.resize(vertex_count * 3);
+    texcoords.resize(has_texcoords ? vertex_count * 2 : 0);
+
+#pragma omp parallel for
+    for (c = 0; c < (int)vertex_count; c++)
+    {
+        const source_corner& corner = source.corners[first_corner[c]];
+
+        memcpy(&positions[(size_t)c * 3], &source.positions[(size_t)corner.position * 3], 3 * sizeof(float));
+
+        if (has_normals)
+            memcpy(&normals[(size_t)c * 3], &source.normals[(size_t)corner.normal * 3], 3 * sizeof(float));
+
+        if (has_texcoords)
+        {
+            if (corner.texcoord != ~0u)
+                memcpy(&texcoords[(size_t)c * 2], &source.texcoords[(size_t)corner.texcoord * 2], 2 * sizeof(float));
+            else
+                texcoords[(size_t)c * 2] = texcoords[(size_t)c * 2 + 1] = 0.0f;
+        }
+    }
+
+    const double weld_ms = elapsed_ms(start);
+
+    if (!has_normals && vertex_count != 0)
+        sb7::mesh::generate_normals(&normals[0], &m.indices[0], corner_count, &positions[0], 3, vertex_count);
+
+    const double normals_ms = elapsed_ms(start);
+
+    if (has_texcoords && vertex_count != 0)
+    {
+        tangents.resize(vertex_count * 4);
+        sb7::mesh::generate_tangents(&tangents[0], &m.indices[0], corner_count,
+                                     &positions[0], 3, &normals[0], 3, &texcoords[0], 2, vertex_count);
+    }
+
+    const double tangents_ms = elapsed_ms(start);
+
+    if (vertex_count == 0)
+    {
+        fprintf(stderr, "%s: no triangles\n", opts.files[0]);
+        return EXIT_FAILURE;
+    }
+
+    m.vertex_count = (unsigned int)vertex_count;
+    add_attrib(m, "position", 3, positions);
+    add_attrib(m, "normal", 3, normals);
+    if (has_texcoords)
+    {
+        add_attrib(m, "texcoord", 2, texcoords);
+        add_attrib(m, "tangent", 4, tangents);
+    }
+
+    for (i = 0; i < source.groups.size(); i++)
+    {
+        const size_t end = i + 1 < source.groups.size() ? source.groups[i + 1] : corner_count / 3;
+        SB6M_SUB_OBJECT_DECL sub;
+
+        sub.first = source.groups[i] * 3;
+        sub.count = (unsigned int)(end - source.groups[i]) * 3;
+        m.sub_objects.push_back(sub);
+    }
+
+    // Freshly welded vertices are in order of first use, which is already
+    // what the pre-transform cache wants
+    if (!sb7::sbm::write(opts.files[1], m))
+    {
+        fprintf(stderr, "%s: can't write\n", opts.files[1]);
+        return EXIT_FAILURE;
+    }
+
+    const double write_ms = elapsed_ms(start);
+    const double total_ms = parse_ms + weld_ms + normals_ms + tangents_ms + write_ms;
+    const double triangles = (double)(corner_count / 3);
+
+    printf("%s: %.1f MB, %u positions, %u normals, %u texture coordinates\n",
+           opts.files[0], source.bytes_read / 1048576.0, (unsigned int)(source.positions.size() / 3),
+           (unsigned int)(source.normals.size() / 3), (unsigned int)(source.texcoords.size() / 2));
+    printf("%s: %u vertices, %.0f triangles, %u sub-objects\n",
+           opts.files[1], (unsigned int)vertex_count, triangles, (unsigned int)m.sub_objects.size());
+    printf("read     %9.1f ms  %8.1f MB/s\n", parse_ms, source.bytes_read / 1048576.0 / std::max(parse_ms / 1000.0, 1e-9));
+    printf("weld     %9.1f ms\n", weld_ms);
+    printf("normals  %9.1f ms%s\n", normals_ms, has_normals ? "  (from source)" : "");
+    printf("tangents %9.1f ms%s\n", tangents_ms, has_texcoords ? "" : "  (no texture coordinates)");
+    printf("write    %9.1f ms\n", write_ms);
+    printf("total    %9.1f ms  %8.2f M triangles/s\n", total_ms, triangles / 1000.0 / std::max(total_ms, 1e-9));
+
+    return EXIT_SUCCESS;
+}
+
+struct command
+{
+    const char *        name;
+    int                 (*run)(int argc, char ** argv);
+};
+
+static const command commands[] =
+{
+    { "stats",          stats },
+    { "optimize",       optimize },
+    { "quantize",       quantize },
+    { "meshlets",       meshlets },
+    { "cull",           cull },
+    { "lod",            lod },
+    { "select",         select },
+    { "convert",        convert },
+};
+
+int main(int argc, char ** argv)
+{
+    size_t i;
+
+    if (argc >= 2)
+    {
+        for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        {
+            if (strcmp(argv[1], commands[i].name) == 0)
+                return commands[i].run(argc - 2, argv + 2);
+        }
+    }
+
+    usage();
+
+    return EXIT_FAILURE;
+}
@@ -25,6 +25,9 @@
 #include <shader.h>
 #include <vmath.h>
 #include <sb7color.h>
+#include <sb7vtex.h>
+
+#include <vector>
 
 class sparsetexture_app : public sb7::application
 {
@@ -49,84 +52,171 @@ public:
 
 protected:
     void load_shaders();
+    bool generate_texture(const char * filename);
 
     enum
     {
         PAGE_SIZE       = 128,
-        TEX_SIZE        = 16 * PAGE_SIZE
+        TEX_SIZE        = 16 * PAGE_SIZE,
+        TEX_LEVELS      = 12,
+        PAGE_BUDGET     = 64,
+        FEEDBACK_SCALE  = 8
     };
 
-    GLuint      texture;
     GLuint      program;
+    GLuint      feedback_program;
     GLuint      vao;
 
     struct
     {
         GLint   mv_matrix;
         GLint   vp_matrix;
-    } uniforms;
-
-    unsigned char * texture_data;
+    } uniforms, feedback_uniforms;
 
-    static const unsigned char bit_reversal_table[256];
+    sb7::vtex::texture          vt;
+    sb7::vtex::feedback_buffer  feedback;
 };
 
-const unsigned char sparsetexture_app::bit_reversal_table[256] =
-{
-    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
-    0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
-    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
-    0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
-    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4,
-    0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
-    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec,
-    0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
-    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
-    0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
-    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea,
-    0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
-    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6,
-    0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
-    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
-    0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
-    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1,
-    0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
-    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9,
-    0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
-    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
-    0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
-    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed,
-    0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
-    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3,
-    0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
-    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
-    0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
-    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7,
-    0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
-    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
-    0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
-};
+// Both passes draw the same quad
+static const char quad_vs_source[] =
+    "#version 450 core\n"
+    "uniform mat4 mv_matrix;\n"
+    "uniform mat4 vp_matrix;\n"
+    "out vec2 tc;\n"
+    "void main(void)\n"
+    "{\n"
+    "    vec2 p = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    tc = p;\n"
+    "    gl_Position = vp_matrix * mv_matrix * vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Never sample finer than the level whose pages are all resident. The min
+// level map has one texel per level 0 page; without the clamp, sampling a
+// page that isn't committed yet returns undefined data.
+static const char render_fs_source[] =
+    "#version 450 core\n"
+    "layout (binding = 0) uniform sampler2D tex;\n"
+    "layout (binding = 1) uniform usampler2D min_level_tex;\n"
+    "in vec2 tc;\n"
+    "layout (location = 0) out vec4 color;\n"
+    "void main(void)\n"
+    "{\n"
+    "    ivec2 pages = textureSize(min_level_tex, 0);\n"
+    "    ivec2 page = clamp(ivec2(tc * vec2(pages)), ivec2(0), pages - 1);\n"
+    "    float min_level = float(texelFetch(min_level_tex, page, 0).r);\n"
+    "    float lod = textureQueryLod(tex, tc).y;\n"
+    "    color = textureLod(tex, tc, max(lod, min_level));\n"
+    "}\n";
+
+// Feedback pass: instead of a color, write which page of which level each
+// pixel would sample. The buffer is rendered at a fraction of the window
+// size, so the LOD is biased back down to what the full size view needs.
+static const char feedback_fs_source[] =
+    "#version 450 core\n"
+    "layout (binding = 0) uniform sampler2D tex;\n"
+    "uniform float lod_bias;\n"
+    "uniform vec2 page_size;\n"
+    "in vec2 tc;\n"
+    "layout (location = 0) out uint key;\n"
+    "void main(void)\n"
+    "{\n"
+    "    int levels = textureQueryLevels(tex);\n"
+    "    int level = clamp(int(textureQueryLod(tex, tc).y + lod_bias), 0, levels - 1);\n"
+    "    ivec2 size = textureSize(tex, level);\n"
+    "    uvec2 page = uvec2(clamp(tc * vec2(size), vec2(0.0), vec2(size - 1)) / page_size);\n"
+    "    key = ((uint(level) << 24) | (page.y << 12) | page.x) + 1u;\n"
+    "}\n";
 
 void sparsetexture_app::startup()
 {
-    FILE* f;
+    static const char filename[] = "media/textures/sparsetexture.ktx";
 
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // The tiled source image is built from smiley.raw the first time round
+    if (!vt.init(filename, PAGE_BUDGET, 2))
+    {
+        if (!generate_texture(filename) || !vt.init(filename, PAGE_BUDGET, 2))
+            return;
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+    glBindTexture(GL_TEXTURE_2D, vt.name());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexStorage2D(GL_TEXTURE_2D, 11, GL_RGBA8, TEX_SIZE, TEX_SIZE);
+    feedback.init(info.windowWidth / FEEDBACK_SCALE, info.windowHeight / FEEDBACK_SCALE);
 
     glGenVertexArrays(1, &vao);
 
     load_shaders();
+}
 
-    texture_data = new unsigned char [PAGE_SIZE * PAGE_SIZE * 4];
+bool sparsetexture_app::generate_texture(const char * filename)
+{
+    sb7::ktx::file::texture_desc desc;
+    std::vector<unsigned char> data;
+    std::vector<unsigned char> smiley(PAGE_SIZE * PAGE_SIZE * 4);
+    unsigned int level, x, y, c;
+    FILE * f;
 
     f = fopen("media/textures/smiley.raw", "rb");
-    fread(texture_data, 128 * 128 * 4, 1, f);
+    if (!f)
+        return false;
+    fread(&smiley[0], smiley.size(), 1, f);
     fclose(f);
+
+    memset(&desc, 0, sizeof(desc));
+    sb7::ktx::file::init_header(desc.h, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    desc.h.pixelwidth = TEX_SIZE;
+    desc.h.pixelheight = TEX_SIZE;
+    desc.h.miplevels = TEX_LEVELS;
+
+    if (!sb7::ktx::file::layout(desc))
+        return false;
+
+    data.resize(desc.data_size);
+
+    // One tinted smiley per page, so it's easy to see pages arrive
+    unsigned char * base = &data[0] + desc.level[0].offset - desc.data_offset;
+
+    for (y = 0; y < TEX_SIZE; y++)
+    {
+        for (x = 0; x < TEX_SIZE; x++)
+        {
+            const unsigned int tile = (y / PAGE_SIZE) * 16 + (x / PAGE_SIZE);
+            const unsigned char * src = &smiley[((y % PAGE_SIZE) * PAGE_SIZE + (x % PAGE_SIZE)) * 4];
+            unsigned char * dst = base + (y * TEX_SIZE + x) * 4;
+
+            dst[0] = (unsigned char)(src[0] * (128 + (tile * 37 & 127)) / 255);
+            dst[1] = (unsigned char)(src[1] * (128 + (tile * 91 & 127)) / 255);
+            dst[2] = (unsigned char)(src[2] * (128 + (tile * 53 & 127)) / 255);
+            dst[3] = src[3];
+        }
+    }
+
+    // Box filter the rest of the chain
+    for (level = 1; level < desc.levels; level++)
+    {
+        const sb7::ktx::file::level_layout& s = desc.level[level - 1];
+        const sb7::ktx::file::level_layout& d = desc.level[level];
+        const unsigned char * src = &data[0] + s.offset - desc.data_offset;
+        unsigned char * dst = &data[0] + d.offset - desc.data_offset;
+
+        for (y = 0; y < d.height; y++)
+        {
+            for (x = 0; x < d.width; x++)
+            {
+                for (c = 0; c < 4; c++)
+                {
+                    dst[(y * d.width + x) * 4 + c] =
+                        (unsigned char)((src[((y * 2) * s.width + x * 2) * 4 + c] +
+                                         src[((y * 2) * s.width + x * 2 + 1) * 4 + c] +
+                                         src[((y * 2 + 1) * s.width + x * 2) * 4 + c] +
+                                         src[((y * 2 + 1) * s.width + x * 2 + 1) * 4 + c] + 2) / 4);
+                }
+            }
+        }
+    }
+
+    return sb7::vtex::write_tiled(filename, desc, &data[0], PAGE_SIZE, PAGE_SIZE);
 }
 
 void sparsetexture_app::render(double currentTime)
@@ -134,6 +224,9 @@ void sparsetexture_app::render(double currentTime)
     static double last_time = 0.0;
     static double total_time = 0.0;
 
+    total_time += (currentTime - last_time);
+    last_time = currentTime;
+
     const float f = (float)total_time;
 
     vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -2.0f) *
@@ -143,53 +236,42 @@ void sparsetexture_app::render(double currentTime)
                                                (float)info.windowWidth / (float)info.windowHeight,
                                                0.1f, 1000.0f);
 
-    glViewport(0, 0, info.windowWidth, info.windowHeight);
-    glClearBufferfv(GL_COLOR, 0, sb7::color::Black);
+    // Pick up feedback from a frame or two ago and stream in what it asked for
+    feedback.collect(vt);
+    vt.update();
 
     glBindVertexArray(vao);
-    glUseProgram(program);
-
-    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, vt.name());
 
-    static int t = 0;
-    int r = (t & 0x100);
-    int tile = bit_reversal_table[(t & 0xFF)];
+    feedback.bind();
+    glUseProgram(feedback_program);
+    glUniformMatrix4fv(feedback_uniforms.mv_matrix, 1, GL_FALSE, mv_matrix);
+    glUniformMatrix4fv(feedback_uniforms.vp_matrix, 1, GL_FALSE, vp_matrix);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    feedback.read();
 
-    int x = (tile >> 0) & 0xF;
-    int y = (tile >> 4) & 0xF;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, info.windowWidth, info.windowHeight);
+    glClearBufferfv(GL_COLOR, 0, sb7::color::Black);
 
-    if (r == 0)
-    {
-        glTexPageCommitmentARB(GL_TEXTURE_2D,
-                               0,
-                               x * PAGE_SIZE, y * PAGE_SIZE, 0,
-                               PAGE_SIZE, PAGE_SIZE, 1,
-                               GL_TRUE);
-        glTexSubImage2D(GL_TEXTURE_2D,
-                        0,
-                        x * PAGE_SIZE, y * PAGE_SIZE,
-                        PAGE_SIZE, PAGE_SIZE,
-                        GL_RGBA, GL_UNSIGNED_BYTE,
-                        texture_data);
-    }
-    else
-    {
-        glTexPageCommitmentARB(GL_TEXTURE_2D,
-                               0,
-                               x * PAGE_SIZE, y * PAGE_SIZE, 0,
-                               PAGE_SIZE, PAGE_SIZE, 1,
-                               GL_FALSE);
-    }
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, vt.min_level_texture());
+    glActiveTexture(GL_TEXTURE0);
 
-    t += 17;
+    glUseProgram(program);
+    glUniformMatrix4fv(uniforms.mv_matrix, 1, GL_FALSE, mv_matrix);
+    glUniformMatrix4fv(uniforms.vp_matrix, 1, GL_FALSE, vp_matrix);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
 void sparsetexture_app::shutdown()
 {
-    delete [] texture_data;
+    feedback.shutdown();
+    vt.shutdown();
 
+    glDeleteProgram(feedback_program);
     glDeleteProgram(program);
     glDeleteVertexArrays(1, &vao);
 }
@@ -198,10 +280,26 @@ void sparsetexture_app::load_shaders()
 {
     GLuint shaders[2];
 
-    shaders[0] = sb7::shader::load("media/shaders/sparsetexture/render.vs.glsl", GL_VERTEX_SHADER);
-    shaders[1] = sb7::shader::load("media/shaders/sparsetexture/render.fs.glsl", GL_FRAGMENT_SHADER);
+    shaders[0] = sb7::shader::from_string(quad_vs_source, GL_VERTEX_SHADER);
+    shaders[1] = sb7::shader::from_string(render_fs_source, GL_FRAGMENT_SHADER);
 
     program = sb7::program::link_from_shaders(shaders, 2, true);
+
+    uniforms.mv_matrix = glGetUniformLocation(program, "mv_matrix");
+    uniforms.vp_matrix = glGetUniformLocation(program, "vp_matrix");
+
+    shaders[0] = sb7::shader::from_string(quad_vs_source, GL_VERTEX_SHADER);
+    shaders[1] = sb7::shader::from_string(feedback_fs_source, GL_FRAGMENT_SHADER);
+
+    feedback_program = sb7::program::link_from_shaders(shaders, 2, true);
+
+    feedback_uniforms.mv_matrix = glGetUniformLocation(feedback_program, "mv_matrix");
+    feedback_uniforms.vp_matrix = glGetUniformLocation(feedback_program, "vp_matrix");
+
+    glUseProgram(feedback_program);
+    glUniform1f(glGetUniformLocation(feedback_program, "lod_bias"), -3.0f);
+    glUniform2f(glGetUniformLocation(feedback_program, "page_size"),
+                (float)vt.pages().page_width(), (float)vt.pages().page_height());
 }
 
 DECLARE_MAIN(sparsetexture_app)
@@ -24,7 +24,7 @@
 #include <sb7.h>
 
 #include <shader.h>
-#include <object.h>
+#include <sb7objectpool.h>
 #include <vmath.h>
 
 // Random number generator
@@ -86,8 +86,10 @@ protected:
     GLuint      quad_vao;
     GLuint      points_buffer;
 
-    sb7::object object;
-    sb7::object cube;
+    // The dragon and the floor share one VAO
+    sb7::object_pool    objects;
+    unsigned int        dragon;
+    unsigned int        cube;
 
     struct
     {
@@ -161,8 +163,11 @@ void ssao_app::startup()
     glGenVertexArrays(1, &quad_vao);
     glBindVertexArray(quad_vao);
 
-    object.load("media/objects/dragon.sbm");
-    cube.load("media/objects/cube.sbm");
+    static const unsigned int layout[] = { 4, 3 };
+
+    objects.init(layout, 2);
+    dragon = objects.load("media/objects/dragon.sbm");
+    cube = objects.load("media/objects/cube.sbm");
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -239,7 +244,8 @@ void ssao_app::render(double currentTime)
 
     glUniform1f(uniforms.render.shading_level, show_shading ? (show_ao ? 0.7f : 1.0f) : 0.0f);
 
-    object.render();
+    objects.bind();
+    objects.render_sub_object(dragon, 0);
 
     mv_matrix = vmath::translate(0.0f, -4.5f, 0.0f) *
                 vmath::rotate(f * 5.0f, 0.0f, 1.0f, 0.0f) *
@@ -247,7 +253,7 @@ void ssao_app::render(double currentTime)
                 vmath::mat4::identity();
     glUniformMatrix4fv(uniforms.render.mv_matrix, 1, GL_FALSE, lookat_matrix * mv_matrix);
 
-    cube.render();
+    objects.render_sub_object(cube, 0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
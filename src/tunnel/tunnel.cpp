@@ -22,7 +22,7 @@
  */
 
 #include <sb7.h>
-#include <sb7ktx.h>
+#include <sb7ktxstreamer.h>
 #include <vmath.h>
 
 class tunnel_app : public sb7::application
@@ -112,9 +112,12 @@ class tunnel_app : public sb7::application
         glGenVertexArrays(1, &render_vao);
         glBindVertexArray(render_vao);
 
-        tex_wall = sb7::ktx::file::load("media/textures/brick.ktx");
-        tex_ceiling = sb7::ktx::file::load("media/textures/ceiling.ktx");
-        tex_floor = sb7::ktx::file::load("media/textures/floor.ktx");
+        // Textures arrive over the next few frames; until then they're black
+        loader.init();
+
+        tex_wall = loader.load("media/textures/brick.ktx");
+        tex_ceiling = loader.load("media/textures/ceiling.ktx");
+        tex_floor = loader.load("media/textures/floor.ktx");
 
         int i;
         GLuint textures[] = { tex_floor, tex_wall, tex_ceiling };
@@ -134,6 +137,8 @@ class tunnel_app : public sb7::application
         static const GLfloat black[] = { 0.0f, 0.0f, 0.0f, 0.0f };
         float t = (float)currentTime;
 
+        loader.update();
+
         glViewport(0, 0, info.windowWidth, info.windowHeight);
         glClearBufferfv(GL_COLOR, 0, black);
 
@@ -162,6 +167,17 @@ class tunnel_app : public sb7::application
         }
     }
 
+    void shutdown()
+    {
+        loader.shutdown();
+
+        glDeleteTextures(1, &tex_wall);
+        glDeleteTextures(1, &tex_ceiling);
+        glDeleteTextures(1, &tex_floor);
+        glDeleteVertexArrays(1, &render_vao);
+        glDeleteProgram(render_prog);
+    }
+
 protected:
     GLuint          render_prog;
     GLuint          render_vao;
@@ -174,6 +190,8 @@ protected:
     GLuint          tex_wall;
     GLuint          tex_ceiling;
     GLuint          tex_floor;
+
+    sb7::ktx::streamer  loader;
 };
 
 DECLARE_MAIN(tunnel_app)
@@ -0,0 +1,396 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks the geometry routines in sb7::mesh that derive data from a mesh:
+// adjacency, normals, tangents and bounds. Most of it runs on a cube split
+// along its edges, as a loader would produce for per-face normals or
+// texture coordinates, so every corner position is shared by three
+// vertices.
+
+#include <sb7mesh.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace sb7;
+
+static int failures;
+
+#define CHECK(x)                                                        \
+    do                                                                  \
+    {                                                                   \
+        if (!(x))                                                       \
+        {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+// Four vertices per face, counter-clockwise seen from outside. Positions
+// are xyz, normals are the face's and texcoords run along the face's u and
+// v axes, with u mirrored on the faces listed in mirrored.
+struct cube
+{
+    std::vector<float>          positions;
+    std::vector<float>          normals;
+    std::vector<float>          texcoords;
+    std::vector<float>          u_axes;
+    std::vector<unsigned int>   indices;
+};
+
+static void make_cube(cube& c, unsigned int mirrored = 0)
+{
+    // n, u and v with cross(u, v) == n
+    static const float faces[6][3][3] =
+    {
+        { {  1,  0,  0 }, {  0,  0, -1 }, {  0,  1,  0 } },
+        { { -1,  0,  0 }, {  0,  0,  1 }, {  0,  1,  0 } },
+        { {  0,  1,  0 }, {  1,  0,  0 }, {  0,  0, -1 } },
+        { {  0, -1,  0 }, {  1,  0,  0 }, {  0,  0,  1 } },
+        { {  0,  0,  1 }, {  1,  0,  0 }, {  0,  1,  0 } },
+        { {  0,  0, -1 }, { -1,  0,  0 }, {  0,  1,  0 } }
+    };
+    static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+    unsigned int f, k, j;
+
+    c = cube();
+
+    for (f = 0; f < 6; f++)
+    {
+        const float (*axes)[3] = faces[f];
+        const bool mirror = (mirrored & (1u << f)) != 0;
+        const unsigned int base = f * 4;
+
+        for (k = 0; k < 4; k++)
+        {
+            const float s = corners[k][0];
+            const float t = corners[k][1];
+
+            for (j = 0; j < 3; j++)
+            {
+                c.positions.push_back(axes[0][j] + s * axes[1][j] + t * axes[2][j]);
+                c.normals.push_back(axes[0][j]);
+                c.u_axes.push_back(axes[1][j]);
+            }
+
+            c.texcoords.push_back(mirror ? (1.0f - s) * 0.5f : (s + 1.0f) * 0.5f);
+            c.texcoords.push_back((t + 1.0f) * 0.5f);
+        }
+
+        const unsigned int tris[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+        c.indices.insert(c.indices.end(), tris, tris + 6);
+    }
+}
+
+static bool same_position(const std::vector<float>& positions, unsigned int a, unsigned int b)
+{
+    return memcmp(&positions[a * 3], &positions[b * 3], 3 * sizeof(float)) == 0;
+}
+
+static bool near(const float * a, const float * b, float tolerance)
+{
+    return fabsf(a[0] - b[0]) <= tolerance &&
+           fabsf(a[1] - b[1]) <= tolerance &&
+           fabsf(a[2] - b[2]) <= tolerance;
+}
+
+static float length(const float * v)
+{
+    return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static float dot(const float * a, const float * b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void test_adjacency_closed()
+{
+    cube c;
+    size_t t, u;
+    int k, j;
+
+    make_cube(c);
+
+    const size_t index_count = c.indices.size();
+    std::vector<unsigned int> adjacency(index_count * 2);
+
+    mesh::build_adjacency(&adjacency[0], &c.indices[0], index_count, &c.positions[0], 3, c.positions.size() / 3);
+
+    for (t = 0; t < index_count / 3; t++)
+    {
+        const unsigned int * tri = &c.indices[t * 3];
+        const unsigned int * out = &adjacency[t * 6];
+
+        for (k = 0; k < 3; k++)
+        {
+            const unsigned int a = tri[k];
+            const unsigned int b = tri[(k + 1) % 3];
+            const unsigned int far = out[k * 2 + 1];
+            bool found = false;
+
+            CHECK(out[k * 2] == a);
+
+            // The cube is closed, so every edge has a neighbour, and it is
+            // the triangle that runs the same edge the other way even when
+            // it's made of different vertices
+            CHECK(!same_position(c.positions, far, tri[(k + 2) % 3]));
+
+            for (u = 0; u < index_count / 3 && !found; u++)
+            {
+                const unsigned int * other = &c.indices[u * 3];
+
+                if (u == t)
+                    continue;
+
+                for (j = 0; j < 3; j++)
+                {
+                    if (same_position(c.positions, other[j], b) &&
+                        same_position(c.positions, other[(j + 1) % 3], a) &&
+                        other[(j + 2) % 3] == far)
+                    {
+                        found = true;
+                    }
+                }
+            }
+
+            CHECK(found);
+        }
+    }
+
+    // Edges between faces are made of different vertices on each side
+    CHECK(adjacency[1] >= 4);
+}
+
+static void test_adjacency_open()
+{
+    cube c;
+    int k;
+
+    make_cube(c);
+
+    // Just the first face: the diagonal is shared, the four sides are open
+    // and give each triangle's own opposite vertex.
+    std::vector<unsigned int> adjacency(12);
+
+    mesh::build_adjacency(&adjacency[0], &c.indices[0], 6, &c.positions[0], 3, c.positions.size() / 3);
+
+    for (k = 0; k < 2; k++)
+    {
+        const unsigned int * tri = &c.indices[k * 3];
+        const unsigned int * out = &adjacency[k * 6];
+
+        CHECK(out[0] == tri[0] && out[2] == tri[1] && out[4] == tri[2]);
+    }
+
+    // 0, 1, 2: edges 0-1 and 1-2 are open, 2-0 is shared with 0, 2, 3
+    CHECK(adjacency[1] == 2);
+    CHECK(adjacency[3] == 0);
+    CHECK(adjacency[5] == 3);
+    // 0, 2, 3: 0-2 is shared with 0, 1, 2, the others are open
+    CHECK(adjacency[7] == 1);
+    CHECK(adjacency[9] == 0);
+    CHECK(adjacency[11] == 2);
+}
+
+static void test_normals()
+{
+    cube c;
+    size_t v, i;
+
+    make_cube(c);
+
+    const size_t vertex_count = c.positions.size() / 3;
+    std::vector<float> normals(vertex_count * 3);
+
+    // Every corner has a right angle from each of its three faces, so the
+    // smooth normal points straight out through the corner, and all three
+    // split vertices there get it
+    mesh::generate_normals(&normals[0], &c.indices[0], c.indices.size(), &c.positions[0], 3, vertex_count);
+
+    for (v = 0; v < vertex_count; v++)
+    {
+        const float * p = &c.positions[v * 3];
+        const float expected[3] = { p[0] / sqrtf(3.0f), p[1] / sqrtf(3.0f), p[2] / sqrtf(3.0f) };
+
+        CHECK(near(&normals[v * 3], expected, 1e-5f));
+    }
+
+    // Wound the other way, the cube is inside out
+    std::vector<unsigned int> reversed(c.indices);
+    std::vector<float> inward(vertex_count * 3);
+
+    for (i = 0; i < reversed.size(); i += 3)
+    {
+        const unsigned int t = reversed[i + 1];
+        reversed[i + 1] = reversed[i + 2];
+        reversed[i + 2] = t;
+    }
+
+    mesh::generate_normals(&inward[0], &reversed[0], reversed.size(), &c.positions[0], 3, vertex_count);
+
+    for (v = 0; v < vertex_count; v++)
+    {
+        const float flipped[3] = { -normals[v * 3], -normals[v * 3 + 1], -normals[v * 3 + 2] };
+
+        CHECK(near(&inward[v * 3], flipped, 1e-5f));
+    }
+}
+
+static void test_tangents()
+{
+    // Faces 1 and 4 have their texture mirrored in u
+    const unsigned int mirrored = (1u << 1) | (1u << 4);
+    cube c;
+    size_t v;
+
+    make_cube(c, mirrored);
+
+    const size_t vertex_count = c.positions.size() / 3;
+    std::vector<float> tangents(vertex_count * 4);
+
+    mesh::generate_tangents(&tangents[0], &c.indices[0], c.indices.size(),
+                            &c.positions[0], 3, &c.normals[0], 3, &c.texcoords[0], 2,
+                            vertex_count);
+
+    for (v = 0; v < vertex_count; v++)
+    {
+        const float * tangent = &tangents[v * 4];
+        const float * normal = &c.normals[v * 3];
+        const float * u = &c.u_axes[v * 3];
+        const bool mirror = (mirrored & (1u << (v / 4))) != 0;
+        const float expected[3] = { mirror ? -u[0] : u[0], mirror ? -u[1] : u[1], mirror ? -u[2] : u[2] };
+
+        CHECK(fabsf(length(tangent) - 1.0f) < 1e-5f);
+        CHECK(fabsf(dot(tangent, normal)) < 1e-5f);
+        CHECK(near(tangent, expected, 1e-5f));
+
+        // v still runs along the face's v axis, so on mirrored faces
+        // bitangent = w * cross(normal, tangent) needs w = -1
+        CHECK(tangent[3] == (mirror ? -1.0f : 1.0f));
+    }
+}
+
+static void test_bounds()
+{
+    const size_t vertex_count = 500;
+    std::vector<float> positions(vertex_count * 4);
+    std::vector<unsigned int> indices;
+    unsigned int seed = 12345;
+    size_t v, i;
+    int j;
+
+    // Stride 4 with a w that must be ignored, and a far away vertex that no
+    // index refers to
+    for (v = 0; v < vertex_count; v++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            positions[v * 4 + j] = (float)(seed >> 8) / (float)(1 << 24) * 20.0f - 7.0f;
+        }
+    }
+
+    positions[7 * 4] = 1000.0f;
+
+    for (i = 0; i < vertex_count * 2; i++)
+    {
+        if (i % vertex_count != 7)
+            indices.push_back((unsigned int)((i * 37) % vertex_count));
+    }
+
+    float min[3], max[3];
+    float expected_min[3] = { 1e30f, 1e30f, 1e30f };
+    float expected_max[3] = { -1e30f, -1e30f, -1e30f };
+
+    for (i = 0; i < indices.size(); i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            const float p = positions[indices[i] * 4 + j];
+            expected_min[j] = p < expected_min[j] ? p : expected_min[j];
+            expected_max[j] = p > expected_max[j] ? p : expected_max[j];
+        }
+    }
+
+    mesh::compute_box(min, max, &indices[0], indices.size(), &positions[0], 4);
+    CHECK(near(min, expected_min, 0.0f));
+    CHECK(near(max, expected_max, 0.0f));
+
+    float center[3], radius;
+    bool enclosed = true;
+
+    mesh::compute_sphere(center, &radius, &indices[0], indices.size(), &positions[0], 4);
+
+    for (i = 0; i < indices.size(); i++)
+    {
+        const float * p = &positions[indices[i] * 4];
+        const float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+
+        enclosed = enclosed && length(d) <= radius * (1.0f + 1e-5f);
+    }
+
+    CHECK(enclosed);
+
+    // No bigger than the sphere around the box
+    const float half[3] = { (max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f, (max[2] - min[2]) * 0.5f };
+    CHECK(radius <= length(half) * (1.0f + 1e-5f));
+
+    // The split cube: the smallest sphere is the one through the corners
+    cube c;
+    make_cube(c);
+    mesh::compute_sphere(center, &radius, &c.indices[0], c.indices.size(), &c.positions[0], 3);
+    CHECK(length(center) < 1e-5f);
+    CHECK(fabsf(radius - sqrtf(3.0f)) < 1e-5f);
+
+    mesh::compute_box(min, max, &c.indices[0], c.indices.size(), &c.positions[0], 3);
+    CHECK(min[0] == -1.0f && min[1] == -1.0f && min[2] == -1.0f);
+    CHECK(max[0] == 1.0f && max[1] == 1.0f && max[2] == 1.0f);
+
+    // Nothing to enclose gives zeros
+    mesh::compute_box(min, max, NULL, 0, &positions[0], 4);
+    mesh::compute_sphere(center, &radius, NULL, 0, &positions[0], 4);
+    CHECK(min[0] == 0.0f && max[2] == 0.0f);
+    CHECK(center[0] == 0.0f && radius == 0.0f);
+}
+
+int main()
+{
+    test_adjacency_closed();
+    test_adjacency_open();
+    test_normals();
+    test_tangents();
+    test_bounds();
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+
+    return 0;
+}
@@ -0,0 +1,715 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Loads generated .sbm files into sb7::object with the GL entry points
+// stubbed out. The stubs keep a copy of the buffer the object uploads and
+// replay every draw from it, so the test sees exactly what the GPU would:
+// which index type was chosen, where the indices landed and which
+// positions each sub-object draws.
+
+#include "GL/gl3w.h"
+#include <object.h>
+#include <sb7sbm.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct stub_draw
+{
+    bool            indexed;
+    GLenum          type;
+    size_t          offset;
+    GLint           first;
+    GLsizei         count;
+};
+
+static std::vector<unsigned char> buffer;
+static GLuint element_buffer;
+static SB6M_VERTEX_ATTRIB_DECL position_decl;
+static size_t position_offset;
+static float position_scale[3];
+static float position_bias[3];
+static std::vector<stub_draw> draws;
+static std::vector<float> drawn;
+static int failures;
+
+#define CHECK(x)                                                        \
+    do                                                                  \
+    {                                                                   \
+        if (!(x))                                                       \
+        {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static void APIENTRY stub_GenVertexArrays(GLsizei n, GLuint * arrays)
+{
+    for (GLsizei i = 0; i < n; i++)
+        arrays[i] = 1;
+}
+
+static void APIENTRY stub_GenBuffers(GLsizei n, GLuint * buffers)
+{
+    for (GLsizei i = 0; i < n; i++)
+        buffers[i] = 2;
+}
+
+static void APIENTRY stub_BindVertexArray(GLuint)
+{
+
+}
+
+static void APIENTRY stub_BindBuffer(GLenum target, GLuint name)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER && name != 0)
+        element_buffer = name;
+}
+
+static void APIENTRY stub_BufferData(GLenum, GLsizeiptr size, const void * data, GLenum)
+{
+    // Anything the object doesn't write stands out in the replay
+    buffer.assign(size, 0xCD);
+
+    if (data != NULL)
+        memcpy(&buffer[0], data, size);
+}
+
+static void APIENTRY stub_BufferSubData(GLenum, GLintptr offset, GLsizeiptr size, const void * data)
+{
+    CHECK(offset >= 0 && (size_t)offset + size <= buffer.size());
+
+    if (offset >= 0 && (size_t)offset + size <= buffer.size())
+        memcpy(&buffer[offset], data, size);
+}
+
+static void APIENTRY stub_VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer)
+{
+    if (index != 0)
+        return;
+
+    memset(&position_decl, 0, sizeof(position_decl));
+    position_decl.size = size;
+    position_decl.type = type;
+    position_decl.flags = normalized ? SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED : 0;
+    position_decl.stride = stride ? stride : sb7::sbm::attrib_size(size, type);
+    position_offset = (size_t)pointer;
+}
+
+static void APIENTRY stub_EnableVertexAttribArray(GLuint)
+{
+
+}
+
+static void APIENTRY stub_VertexAttrib3fv(GLuint index, const GLfloat * v)
+{
+    if (index == sb7::object::position_scale_location)
+        memcpy(position_scale, v, sizeof(position_scale));
+    else if (index == sb7::object::position_bias_location)
+        memcpy(position_bias, v, sizeof(position_bias));
+}
+
+static void fetch_vertex(unsigned int vertex)
+{
+    const size_t offset = position_offset + (size_t)vertex * position_decl.stride;
+    const size_t element = sb7::sbm::attrib_size(position_decl.size, position_decl.type);
+    float value[4];
+    int i;
+
+    CHECK(offset + element <= buffer.size());
+    if (offset + element > buffer.size())
+        return;
+
+    sb7::sbm::decode_attrib(position_decl, &buffer[offset], value);
+
+    for (i = 0; i < 3; i++)
+        drawn.push_back(value[i] * position_scale[i] + position_bias[i]);
+}
+
+static void APIENTRY stub_DrawElementsInstancedBaseInstance(GLenum, GLsizei count, GLenum type, const void * indices, GLsizei, GLuint)
+{
+    const size_t offset = (size_t)indices;
+    const unsigned int size = sb7::sbm::index_size(type);
+    stub_draw d = { true, type, offset, 0, count };
+    GLsizei i;
+
+    draws.push_back(d);
+
+    CHECK(element_buffer == 2);
+    CHECK(size != 0 && offset % size == 0);
+    CHECK(offset + (size_t)count * size <= buffer.size());
+    if (size == 0 || offset + (size_t)count * size > buffer.size())
+        return;
+
+    for (i = 0; i < count; i++)
+    {
+        unsigned int index = 0;
+
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE:
+                index = buffer[offset + i];
+                break;
+            case GL_UNSIGNED_SHORT:
+                {
+                    unsigned short s;
+                    memcpy(&s, &buffer[offset + i * 2], 2);
+                    index = s;
+                }
+                break;
+            default:
+                memcpy(&index, &buffer[offset + i * 4], 4);
+                break;
+        }
+
+        fetch_vertex(index);
+    }
+}
+
+static void APIENTRY stub_DrawArraysInstancedBaseInstance(GLenum, GLint first, GLsizei count, GLsizei, GLuint)
+{
+    stub_draw d = { false, GL_NONE, 0, first, count };
+    GLsizei i;
+
+    draws.push_back(d);
+
+    for (i = 0; i < count; i++)
+        fetch_vertex(first + i);
+}
+
+static void APIENTRY stub_DeleteVertexArrays(GLsizei, const GLuint *)
+{
+
+}
+
+static void APIENTRY stub_DeleteBuffers(GLsizei, const GLuint *)
+{
+
+}
+
+static void install_stubs()
+{
+    gl3wGenVertexArrays = stub_GenVertexArrays;
+    gl3wGenBuffers = stub_GenBuffers;
+    gl3wBindVertexArray = stub_BindVertexArray;
+    gl3wBindBuffer = stub_BindBuffer;
+    gl3wBufferData = stub_BufferData;
+    gl3wBufferSubData = stub_BufferSubData;
+    gl3wVertexAttribPointer = stub_VertexAttribPointer;
+    gl3wEnableVertexAttribArray = stub_EnableVertexAttribArray;
+    gl3wVertexAttrib3fv = stub_VertexAttrib3fv;
+    gl3wDrawElementsInstancedBaseInstance = stub_DrawElementsInstancedBaseInstance;
+    gl3wDrawArraysInstancedBaseInstance = stub_DrawArraysInstancedBaseInstance;
+    gl3wDeleteVertexArrays = stub_DeleteVertexArrays;
+    gl3wDeleteBuffers = stub_DeleteBuffers;
+}
+
+static void reset_stubs()
+{
+    int i;
+
+    buffer.clear();
+    element_buffer = 0;
+    memset(&position_decl, 0, sizeof(position_decl));
+    position_offset = 0;
+    draws.clear();
+    drawn.clear();
+
+    for (i = 0; i < 3; i++)
+    {
+        position_scale[i] = 1.0f;
+        position_bias[i] = 0.0f;
+    }
+}
+
+// Generated files. Every vertex has a position that can be worked out from
+// its index, so a draw can be checked without keeping the file around.
+static void vertex_position(unsigned int vertex, float p[3])
+{
+    p[0] = (float)(vertex % 101) * 0.25f;
+    p[1] = (float)(vertex / 101 % 97) * 0.5f;
+    p[2] = (float)(vertex / 9797) - 3.0f;
+}
+
+static const char test_file[] = "objecttest.sbm";
+
+static void append(std::vector<unsigned char>& out, const void * data, size_t size)
+{
+    out.insert(out.end(), (const unsigned char *)data, (const unsigned char *)data + size);
+}
+
+static void append_index(std::vector<unsigned char>& out, unsigned int index, GLenum type)
+{
+    const unsigned char b = (unsigned char)index;
+    const unsigned short s = (unsigned short)index;
+
+    switch (type)
+    {
+        case GL_UNSIGNED_BYTE:
+            append(out, &b, 1);
+            break;
+        case GL_UNSIGNED_SHORT:
+            append(out, &s, 2);
+            break;
+        default:
+            append(out, &index, 4);
+            break;
+    }
+}
+
+static void pad(std::vector<unsigned char>& out, size_t alignment)
+{
+    while (out.size() % alignment)
+        out.push_back(0);
+}
+
+// Writes vertex_count float positions and, if index_type isn't GL_NONE,
+// indices stored as index_type. With a DATA chunk, index_pad bytes go
+// between the vertices and the indices.
+static bool write_file(unsigned int vertex_count,
+                       const std::vector<unsigned int>& indices,
+                       GLenum index_type,
+                       const std::vector<SB6M_SUB_OBJECT_DECL>& sub_objects,
+                       bool data_chunk,
+                       unsigned int index_pad = 0)
+{
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> index_data;
+    std::vector<unsigned char> chunks;
+    std::vector<unsigned char> file;
+    SB6M_HEADER header;
+    SB6M_VERTEX_ATTRIB_CHUNK attribs;
+    SB6M_CHUNK_INDEX_DATA index_chunk;
+    unsigned int num_chunks = 1;
+    unsigned int i;
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        float p[3];
+        vertex_position(i, p);
+        append(vertices, p, sizeof(p));
+    }
+
+    for (i = 0; i < indices.size(); i++)
+        append_index(index_data, indices[i], index_type);
+
+    memset(&attribs, 0, sizeof(attribs));
+    attribs.header.chunk_type = SB6M_CHUNK_TYPE_VERTEX_ATTRIBS;
+    attribs.header.size = sizeof(attribs);
+    attribs.attrib_count = 1;
+    strcpy(attribs.attrib_data[0].name, "position");
+    attribs.attrib_data[0].size = 3;
+    attribs.attrib_data[0].type = GL_FLOAT;
+    attribs.attrib_data[0].stride = 12;
+    append(chunks, &attribs, sizeof(attribs));
+
+    memset(&index_chunk, 0, sizeof(index_chunk));
+    index_chunk.header.chunk_type = SB6M_CHUNK_TYPE_INDEX_DATA;
+    index_chunk.header.size = sizeof(index_chunk);
+    index_chunk.index_type = index_type;
+    index_chunk.index_count = (unsigned int)indices.size();
+
+    if (!sub_objects.empty())
+    {
+        SB6M_CHUNK_HEADER list;
+        const unsigned int count = (unsigned int)sub_objects.size();
+
+        list.chunk_type = SB6M_CHUNK_TYPE_SUB_OBJECT_LIST;
+        list.size = (unsigned int)(offsetof(SB6M_CHUNK_SUB_OBJECT_LIST, sub_object) + count * sizeof(SB6M_SUB_OBJECT_DECL));
+        append(chunks, &list, sizeof(list));
+        append(chunks, &count, sizeof(count));
+        append(chunks, &sub_objects[0], count * sizeof(SB6M_SUB_OBJECT_DECL));
+        num_chunks++;
+    }
+
+    if (data_chunk)
+    {
+        SB6M_DATA_CHUNK data;
+        std::vector<unsigned char> payload(vertices);
+
+        payload.resize(payload.size() + index_pad);
+        index_chunk.index_data_offset = (unsigned int)payload.size();
+        append(payload, index_data.empty() ? NULL : &index_data[0], index_data.size());
+
+        if (index_type != GL_NONE)
+        {
+            append(chunks, &index_chunk, sizeof(index_chunk));
+            num_chunks++;
+        }
+
+        data.header.chunk_type = SB6M_CHUNK_TYPE_DATA;
+        data.header.size = (unsigned int)((sizeof(data) + payload.size() + 3) & ~(size_t)3);
+        data.encoding = SB6M_DATA_ENCODING_RAW;
+        data.data_offset = sizeof(data);
+        data.data_length = (unsigned int)payload.size();
+        append(chunks, &data, sizeof(data));
+        append(chunks, &payload[0], payload.size());
+        pad(chunks, 4);
+        num_chunks++;
+    }
+    else
+    {
+        SB6M_CHUNK_VERTEX_DATA vertex_chunk;
+        const size_t data_start = sizeof(header) + chunks.size() + sizeof(vertex_chunk) +
+                                  (index_type != GL_NONE ? sizeof(index_chunk) : 0);
+
+        vertex_chunk.header.chunk_type = SB6M_CHUNK_TYPE_VERTEX_DATA;
+        vertex_chunk.header.size = sizeof(vertex_chunk);
+        vertex_chunk.data_size = (unsigned int)vertices.size();
+        vertex_chunk.data_offset = (unsigned int)data_start;
+        vertex_chunk.total_vertices = vertex_count;
+        append(chunks, &vertex_chunk, sizeof(vertex_chunk));
+        num_chunks++;
+
+        if (index_type != GL_NONE)
+        {
+            index_chunk.index_data_offset = (unsigned int)(data_start + vertices.size());
+            append(chunks, &index_chunk, sizeof(index_chunk));
+            num_chunks++;
+        }
+
+        append(chunks, &vertices[0], vertices.size());
+        append(chunks, index_data.empty() ? NULL : &index_data[0], index_data.size());
+    }
+
+    header.magic = SB6M_MAGIC;
+    header.size = sizeof(header);
+    header.num_chunks = num_chunks;
+    header.flags = 0;
+    append(file, &header, sizeof(header));
+    append(file, &chunks[0], chunks.size());
+
+    FILE * f = fopen(test_file, "wb");
+    if (f == NULL)
+        return false;
+
+    const bool ok = fwrite(&file[0], 1, file.size(), f) == file.size();
+    fclose(f);
+
+    return ok;
+}
+
+// Indices that jump around but end on the last vertex, so that it sets
+// the index type
+static void make_indices(unsigned int vertex_count, unsigned int count, std::vector<unsigned int>& indices)
+{
+    unsigned int i;
+
+    indices.resize(count);
+
+    for (i = 0; i < count; i++)
+        indices[i] = (unsigned int)(((unsigned long long)i * 7919) % vertex_count);
+
+    indices[count - 1] = vertex_count - 1;
+}
+
+static void split(unsigned int count, std::vector<SB6M_SUB_OBJECT_DECL>& sub_objects)
+{
+    const unsigned int half = count / 3 / 2 * 3;
+    const SB6M_SUB_OBJECT_DECL first = { 0, half };
+    const SB6M_SUB_OBJECT_DECL second = { half, count - half };
+
+    sub_objects.clear();
+    sub_objects.push_back(first);
+    sub_objects.push_back(second);
+}
+
+// Draws every sub-object and checks the positions that come out against
+// the vertices the file says it draws
+static bool draws_match(sb7::object& o,
+                        const std::vector<unsigned int>& indices,
+                        const std::vector<SB6M_SUB_OBJECT_DECL>& sub_objects,
+                        float tolerance)
+{
+    unsigned int s, i;
+    int j;
+
+    for (s = 0; s < o.get_sub_object_count(); s++)
+    {
+        const SB6M_SUB_OBJECT_DECL& sub = sub_objects[s];
+
+        drawn.clear();
+        o.render_sub_object(s);
+
+        if (drawn.size() != (size_t)sub.count * 3)
+            return false;
+
+        for (i = 0; i < sub.count; i++)
+        {
+            const unsigned int vertex = indices.empty() ? sub.first + i : indices[sub.first + i];
+            float p[3];
+
+            vertex_position(vertex, p);
+
+            for (j = 0; j < 3; j++)
+            {
+                if (fabsf(drawn[i * 3 + j] - p[j]) > tolerance)
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// 32-bit indices in a file without a DATA chunk are narrowed and copied
+// after the vertices, four byte aligned
+static void test_narrowing(unsigned int vertex_count, unsigned int index_count, GLenum expected)
+{
+    std::vector<unsigned int> indices;
+    std::vector<SB6M_SUB_OBJECT_DECL> sub_objects;
+    sb7::object o;
+
+    make_indices(vertex_count, index_count, indices);
+    split(index_count, sub_objects);
+    CHECK(write_file(vertex_count, indices, GL_UNSIGNED_INT, sub_objects, false));
+
+    reset_stubs();
+    CHECK(o.load(test_file));
+    CHECK(o.get_index_type() == expected);
+    CHECK(o.get_sub_object_count() == 2);
+
+    const size_t index_offset = ((size_t)vertex_count * 12 + 3) & ~(size_t)3;
+    const unsigned int size = sb7::sbm::index_size(expected);
+
+    CHECK(buffer.size() == index_offset + (size_t)index_count * size);
+    CHECK(draws_match(o, indices, sub_objects, 0.0f));
+    CHECK(draws.size() == 2);
+    CHECK(draws.size() == 2 && draws[0].type == expected && draws[0].offset == index_offset);
+    CHECK(draws.size() == 2 && draws[1].offset == index_offset + sub_objects[1].first * size);
+
+    o.free();
+}
+
+// 16-bit indices inside a DATA chunk. When they're aligned the chunk is
+// uploaded as it is and the draws use the file's offset; otherwise they're
+// copied after the payload.
+static void test_data_chunk(unsigned int index_pad)
+{
+    const unsigned int vertex_count = 300;
+    const unsigned int index_count = 600;
+    std::vector<unsigned int> indices;
+    std::vector<SB6M_SUB_OBJECT_DECL> sub_objects;
+    sb7::object o;
+
+    make_indices(vertex_count, index_count, indices);
+    split(index_count, sub_objects);
+    CHECK(write_file(vertex_count, indices, GL_UNSIGNED_SHORT, sub_objects, true, index_pad));
+
+    reset_stubs();
+    CHECK(o.load(test_file));
+    CHECK(o.get_index_type() == GL_UNSIGNED_SHORT);
+
+    const size_t file_offset = vertex_count * 12 + index_pad;
+    const size_t payload = file_offset + index_count * 2;
+    const size_t index_offset = index_pad % 2 == 0 ? file_offset : (payload + 3) & ~(size_t)3;
+
+    CHECK(buffer.size() == (index_pad % 2 == 0 ? payload : index_offset + index_count * 2));
+    CHECK(draws_match(o, indices, sub_objects, 0.0f));
+    CHECK(draws.size() == 2);
+    CHECK(draws.size() == 2 && draws[0].offset == index_offset);
+    CHECK(draws.size() == 2 && draws[1].offset == index_offset + sub_objects[1].first * 2);
+
+    o.free();
+}
+
+static void test_non_indexed()
+{
+    const unsigned int vertex_count = 900;
+    const std::vector<unsigned int> no_indices;
+    std::vector<SB6M_SUB_OBJECT_DECL> sub_objects;
+    sb7::object o;
+
+    split(vertex_count, sub_objects);
+    CHECK(write_file(vertex_count, no_indices, GL_NONE, sub_objects, false));
+
+    reset_stubs();
+    CHECK(o.load(test_file));
+    CHECK(o.get_index_type() == GL_NONE);
+    CHECK(element_buffer == 0);
+    CHECK(draws_match(o, no_indices, sub_objects, 0.0f));
+    CHECK(draws.size() == 2);
+    CHECK(draws.size() == 2 && !draws[1].indexed &&
+          draws[1].first == (GLint)sub_objects[1].first &&
+          draws[1].count == (GLsizei)sub_objects[1].count);
+
+    o.free();
+
+    // The same without a sub-object list is one draw of everything
+    sub_objects.clear();
+    CHECK(write_file(vertex_count, no_indices, GL_NONE, sub_objects, true));
+
+    reset_stubs();
+    CHECK(o.load(test_file));
+    CHECK(o.get_sub_object_count() == 1);
+    o.render();
+    CHECK(draws.size() == 1 && draws[0].first == 0 && draws[0].count == (GLsizei)vertex_count);
+
+    o.free();
+}
+
+// An indexed file whose sub-object list is there but empty has nothing to
+// draw and must not load
+static void test_empty_sub_object_list()
+{
+    const unsigned int vertex_count = 30;
+    std::vector<unsigned int> indices;
+    std::vector<SB6M_SUB_OBJECT_DECL> sub_objects;
+    std::vector<unsigned char> file;
+    unsigned int count = 0;
+    size_t offset;
+    sb7::object o;
+    FILE * f;
+
+    make_indices(vertex_count, 30, indices);
+    split(30, sub_objects);
+    CHECK(write_file(vertex_count, indices, GL_UNSIGNED_INT, sub_objects, false));
+
+    f = fopen(test_file, "r+b");
+    CHECK(f != NULL);
+    if (f == NULL)
+        return;
+
+    // Chunks follow the header back to back; zero the list's count
+    fseek(f, 0, SEEK_END);
+    file.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    CHECK(fread(&file[0], 1, file.size(), f) == file.size());
+
+    for (offset = sizeof(SB6M_HEADER); offset + sizeof(SB6M_CHUNK_HEADER) <= file.size(); )
+    {
+        SB6M_CHUNK_HEADER chunk;
+
+        memcpy(&chunk, &file[offset], sizeof(chunk));
+        if (chunk.chunk_type == SB6M_CHUNK_TYPE_SUB_OBJECT_LIST || chunk.size == 0)
+            break;
+        offset += chunk.size;
+    }
+
+    CHECK(offset + sizeof(SB6M_CHUNK_HEADER) < file.size());
+    fseek(f, (long)(offset + sizeof(SB6M_CHUNK_HEADER)), SEEK_SET);
+    CHECK(fwrite(&count, sizeof(count), 1, f) == 1);
+    fclose(f);
+
+    reset_stubs();
+    CHECK(!o.load(test_file));
+    CHECK(o.get_sub_object_count() == 0);
+
+    // Nor can one be written
+    sb7::sbm::mesh m;
+    m.attribs.resize(1);
+    memset(&m.attribs[0].decl, 0, sizeof(m.attribs[0].decl));
+    m.attribs[0].decl.size = 3;
+    m.attribs[0].decl.type = GL_FLOAT;
+    m.attribs[0].element_size = 12;
+    m.attribs[0].data.resize(12);
+    m.vertex_count = 1;
+    m.indexed = false;
+    CHECK(!sb7::sbm::write(test_file, m));
+}
+
+// A quantized file drawn either as it is, with the scale and bias of each
+// sub-object passed as generic attributes, or expanded back to floats
+static void test_quantized(unsigned int flags)
+{
+    const unsigned int vertex_count = 500;
+    const unsigned int index_count = 1200;
+    std::vector<unsigned int> indices;
+    sb7::sbm::mesh m;
+    sb7::object o;
+    unsigned int i;
+
+    make_indices(vertex_count, index_count, indices);
+
+    m.attribs.resize(1);
+    memset(&m.attribs[0].decl, 0, sizeof(m.attribs[0].decl));
+    strcpy(m.attribs[0].decl.name, "position");
+    m.attribs[0].decl.size = 3;
+    m.attribs[0].decl.type = GL_FLOAT;
+    m.attribs[0].element_size = 12;
+
+    for (i = 0; i < vertex_count; i++)
+    {
+        float p[3];
+        vertex_position(i, p);
+        append(m.attribs[0].data, p, sizeof(p));
+    }
+
+    m.vertex_count = vertex_count;
+    m.indexed = true;
+    m.indices = indices;
+    split(index_count, m.sub_objects);
+
+    sb7::sbm::quantize(m, 8);
+    CHECK(!m.quantized.empty());
+    CHECK(sb7::sbm::write(test_file, m));
+
+    reset_stubs();
+    CHECK(o.load(test_file, flags));
+    CHECK(o.is_quantized() == ((flags & sb7::object::keep_quantized) != 0));
+    CHECK(o.get_index_type() == GL_UNSIGNED_SHORT);
+
+    if (o.is_quantized())
+        CHECK(position_decl.type == GL_UNSIGNED_SHORT && (position_decl.flags & SB6M_VERTEX_ATTRIB_FLAG_NORMALIZED));
+    else
+        CHECK(position_decl.type == GL_FLOAT);
+
+    // 16 bits over a range of 25 units
+    CHECK(draws_match(o, indices, m.sub_objects, 1e-3f));
+
+    o.free();
+}
+
+int main()
+{
+    install_stubs();
+
+    test_narrowing(200, 600, GL_UNSIGNED_BYTE);
+    test_narrowing(1000, 3000, GL_UNSIGNED_SHORT);
+    test_narrowing(65536, 3000, GL_UNSIGNED_SHORT);
+    test_narrowing(70000, 3000, GL_UNSIGNED_INT);
+
+    test_data_chunk(0);
+    test_data_chunk(1);
+
+    test_non_indexed();
+    test_empty_sub_object_list();
+
+    test_quantized(0);
+    test_quantized(sb7::object::keep_quantized);
+
+    remove(test_file);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+
+    return 0;
+}
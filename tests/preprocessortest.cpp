@@ -0,0 +1,304 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Expands shaders held in memory with sb7::preprocessor::add_file(), so no
+// files or context are needed, and checks the text that comes out: where
+// the defines go, the #line directives that keep GL's line numbers right,
+// #pragma once, the source string table and the hash.
+
+#include <sb7preprocessor.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace sb7;
+
+static int failures;
+
+#define CHECK(x)                                                        \
+    do                                                                  \
+    {                                                                   \
+        if (!(x))                                                       \
+        {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static void test_plain()
+{
+    static const char text[] = "#version 450 core\nvoid main() {}\n";
+    preprocessor pp;
+    preprocessor::output out;
+    preprocessor::output again;
+
+    pp.add_file("plain.glsl", text);
+
+    // Nothing to insert or include leaves the text alone
+    CHECK(pp.expand("plain.glsl", NULL, out));
+    CHECK(out.source == text);
+    CHECK(out.files.size() == 1 && out.files[0] == "plain.glsl");
+    CHECK(out.hash == hash(text));
+
+    CHECK(pp.expand("plain.glsl", "", again));
+    CHECK(again.source == out.source);
+    CHECK(again.hash == out.hash);
+
+    // Different defines are a different shader
+    CHECK(pp.expand("plain.glsl", "A", again));
+    CHECK(again.hash != out.hash);
+
+    // Replacing the file changes the result; invalidating an in-memory
+    // file means it is looked for on disk, where it isn't
+    pp.add_file("plain.glsl", "#version 450 core\nvoid main() { }\n");
+    CHECK(pp.expand("plain.glsl", NULL, again));
+    CHECK(again.hash != out.hash);
+
+    pp.invalidate("plain.glsl");
+    CHECK(!pp.expand("plain.glsl", NULL, again));
+    CHECK(again.source.empty());
+}
+
+static void test_defines()
+{
+    preprocessor pp;
+    preprocessor::output out;
+
+    pp.add_file("a.glsl", "#version 450 core\nvoid main() {}\n");
+    pp.add_file("b.glsl", "// comment\n\n  #  version 330\nx\n");
+    pp.add_file("c.glsl", "x\ny\n");
+    pp.add_file("d.glsl", "#version 450");
+    pp.add_file("e.glsl", "float f;\n#version 450\n");
+
+    // Global defines come first, overridden in place by the set passed to
+    // expand(), then the rest of the set in order. The #line puts the line
+    // after #version back to being line 2 of source string 0.
+    pp.define("GLOBAL", "2");
+    pp.define("OTHER");
+
+    CHECK(pp.expand("a.glsl", "A  B=3 GLOBAL=5", out));
+    CHECK(out.source ==
+          "#version 450 core\n"
+          "#define GLOBAL 5\n"
+          "#define OTHER 1\n"
+          "#define A 1\n"
+          "#define B 3\n"
+          "#line 2 0\n"
+          "void main() {}\n");
+
+    pp.undefine("GLOBAL");
+    pp.undefine("OTHER");
+
+    // Comments and blank lines may come before #version
+    CHECK(pp.expand("b.glsl", "A", out));
+    CHECK(out.source ==
+          "// comment\n"
+          "\n"
+          "  #  version 330\n"
+          "#define A 1\n"
+          "#line 4 0\n"
+          "x\n");
+
+    // Without a #version the defines go first
+    CHECK(pp.expand("c.glsl", "A", out));
+    CHECK(out.source ==
+          "#define A 1\n"
+          "#line 1 0\n"
+          "x\n"
+          "y\n");
+
+    // A #version on the last line gets its newline
+    CHECK(pp.expand("d.glsl", "A", out));
+    CHECK(out.source ==
+          "#version 450\n"
+          "#define A 1\n"
+          "#line 2 0\n");
+
+    // Anything else before #version means there isn't a valid one to
+    // follow, so the defines still go first
+    CHECK(pp.expand("e.glsl", "A", out));
+    CHECK(out.source ==
+          "#define A 1\n"
+          "#line 1 0\n"
+          "float f;\n"
+          "#version 450\n");
+}
+
+static void test_includes()
+{
+    preprocessor pp;
+    preprocessor::output out;
+
+    // Includes are relative to the including file
+    pp.add_file("dir/main.glsl",
+                "#version 450 core\n"
+                "#include \"common.glsl\"\n"
+                "void main() {}\n");
+    pp.add_file("dir/common.glsl",
+                "float f;\n"
+                "#include \"sub/inner.glsl\"\n"
+                "float h;\n");
+    pp.add_file("dir/sub/inner.glsl",
+                "float g;");
+
+    // Each file gets a source string number. Entering one restarts at its
+    // line 1; returning goes back to the line after the #include.
+    CHECK(pp.expand("dir/main.glsl", NULL, out));
+    CHECK(out.source ==
+          "#version 450 core\n"
+          "#line 1 1\n"
+          "float f;\n"
+          "#line 1 2\n"
+          "float g;\n"
+          "#line 3 1\n"
+          "float h;\n"
+          "#line 3 0\n"
+          "void main() {}\n");
+    CHECK(out.files.size() == 3);
+    CHECK(out.files.size() == 3 &&
+          out.files[0] == "dir/main.glsl" &&
+          out.files[1] == "dir/common.glsl" &&
+          out.files[2] == "dir/sub/inner.glsl");
+    CHECK(out.hash == hash(out.source.c_str()));
+
+    // With defines, numbering in the main file carries on from them
+    CHECK(pp.expand("dir/main.glsl", "A", out));
+    CHECK(out.source ==
+          "#version 450 core\n"
+          "#define A 1\n"
+          "#line 2 0\n"
+          "#line 1 1\n"
+          "float f;\n"
+          "#line 1 2\n"
+          "float g;\n"
+          "#line 3 1\n"
+          "float h;\n"
+          "#line 3 0\n"
+          "void main() {}\n");
+
+    // Missing files fail the whole expansion
+    pp.add_file("dir/broken.glsl", "#include \"missing.glsl\"\n");
+    CHECK(!pp.expand("dir/broken.glsl", NULL, out));
+    CHECK(out.source.empty());
+
+    // As does a file that includes itself
+    pp.add_file("loop.glsl", "#include \"loop.glsl\"\n");
+    CHECK(!pp.expand("loop.glsl", NULL, out));
+}
+
+static void test_pragma_once()
+{
+    preprocessor pp;
+    preprocessor::output out;
+
+    pp.add_file("main.glsl",
+                "#include \"once.glsl\"\n"
+                "#include \"twice.glsl\"\n"
+                "#include \"once.glsl\"\n"
+                "#include \"twice.glsl\"\n"
+                "x\n");
+    pp.add_file("once.glsl",
+                "#pragma once\n"
+                "a\n");
+    pp.add_file("twice.glsl",
+                "b\n");
+
+    // The #pragma and the second include of once.glsl become blank lines,
+    // so line numbers don't move. twice.glsl goes in both times, as a
+    // source string of its own each time.
+    CHECK(pp.expand("main.glsl", NULL, out));
+    CHECK(out.source ==
+          "#line 1 1\n"
+          "\n"
+          "a\n"
+          "#line 2 0\n"
+          "#line 1 2\n"
+          "b\n"
+          "#line 3 0\n"
+          "\n"
+          "#line 1 3\n"
+          "b\n"
+          "#line 5 0\n"
+          "x\n");
+    CHECK(out.files.size() == 4);
+    CHECK(out.files.size() == 4 && out.files[1] == "once.glsl" && out.files[3] == "twice.glsl");
+
+    // A file guarding itself may be the one being expanded
+    pp.add_file("self.glsl",
+                "#pragma once\n"
+                "#include \"self.glsl\"\n"
+                "y\n");
+    CHECK(pp.expand("self.glsl", NULL, out));
+    CHECK(out.source == "\n\ny\n");
+    CHECK(out.files.size() == 1);
+}
+
+static void test_permutations()
+{
+    std::vector<std::vector<std::string> > options(2);
+    std::vector<std::string> sets;
+
+    options[0].push_back("");
+    options[0].push_back("NORMAL_MAP");
+    options[1].push_back("SAMPLES=1");
+    options[1].push_back("SAMPLES=2");
+    options[1].push_back("SAMPLES=4");
+
+    // The last option changes fastest and empty choices add nothing
+    sets = preprocessor::permutations(options);
+    CHECK(sets.size() == 6);
+    CHECK(sets.size() == 6 &&
+          sets[0] == "SAMPLES=1" &&
+          sets[1] == "SAMPLES=2" &&
+          sets[2] == "SAMPLES=4" &&
+          sets[3] == "NORMAL_MAP SAMPLES=1" &&
+          sets[4] == "NORMAL_MAP SAMPLES=2" &&
+          sets[5] == "NORMAL_MAP SAMPLES=4");
+
+    // No options is one set with nothing in it; an option with no choices
+    // leaves nothing to combine
+    CHECK(preprocessor::permutations(std::vector<std::vector<std::string> >()) == std::vector<std::string>(1));
+
+    options.push_back(std::vector<std::string>());
+    CHECK(preprocessor::permutations(options).empty());
+}
+
+int main()
+{
+    test_plain();
+    test_defines();
+    test_includes();
+    test_pragma_once();
+    test_permutations();
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+
+    return 0;
+}
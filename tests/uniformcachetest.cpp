@@ -0,0 +1,342 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Runs sb7::uniform_cache against stubbed GL entry points, so no context is
+// needed. The stub program has two plain uniforms and two uniform blocks:
+//
+//     uniform float zoom;
+//     uniform float arr[3];
+//     uniform Block { vec4 a; };
+//     uniform Other { float b; };
+
+#include "GL/gl3w.h"
+#include <sb7ext.h>
+#include <sb7uniforms.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct stub_uniform
+{
+    const char *    name;
+    GLenum          type;
+    GLint           size;
+    GLint           block;
+    GLint           offset;
+};
+
+static const stub_uniform stub_uniforms[] =
+{
+    { "zoom",       GL_FLOAT,       1,  -1, -1 },
+    { "arr[0]",     GL_FLOAT,       3,  -1, -1 },
+    { "Block.a",    GL_FLOAT_VEC4,  1,   0,  0 },
+    { "Other.b",    GL_FLOAT,       1,   1,  0 }
+};
+
+static const char * const stub_blocks[] = { "Block", "Other" };
+static const GLint stub_block_sizes[] = { 16, 4 };
+
+static const GLint num_stub_uniforms = sizeof(stub_uniforms) / sizeof(stub_uniforms[0]);
+static const GLint num_stub_blocks = sizeof(stub_blocks) / sizeof(stub_blocks[0]);
+
+static bool buffer_storage = true;
+static std::vector<unsigned char> buffer;
+static std::vector<std::string> uniform_calls;
+static int maps;
+static int failures;
+
+#define CHECK(x)                                                        \
+    do                                                                  \
+    {                                                                   \
+        if (!(x))                                                       \
+        {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+int sb6IsExtensionSupported(const char * extname)
+{
+    return buffer_storage && strcmp(extname, "GL_ARB_buffer_storage") == 0;
+}
+
+static void APIENTRY stub_GetProgramiv(GLuint, GLenum pname, GLint * params)
+{
+    switch (pname)
+    {
+        case GL_ACTIVE_UNIFORMS:                        *params = num_stub_uniforms; break;
+        case GL_ACTIVE_UNIFORM_BLOCKS:                  *params = num_stub_blocks; break;
+        default:                                        *params = 16; break;
+    }
+}
+
+static void APIENTRY stub_GetActiveUniformsiv(GLuint, GLsizei count, const GLuint * indices, GLenum pname, GLint * params)
+{
+    GLsizei i;
+
+    for (i = 0; i < count; i++)
+    {
+        const stub_uniform& u = stub_uniforms[indices[i]];
+
+        switch (pname)
+        {
+            case GL_UNIFORM_TYPE:                       params[i] = u.type; break;
+            case GL_UNIFORM_SIZE:                       params[i] = u.size; break;
+            case GL_UNIFORM_BLOCK_INDEX:                params[i] = u.block; break;
+            case GL_UNIFORM_OFFSET:                     params[i] = u.offset; break;
+            default:                                    params[i] = u.block >= 0 ? 0 : -1; break;
+        }
+    }
+}
+
+static void APIENTRY stub_GetActiveUniformName(GLuint, GLuint index, GLsizei size, GLsizei *, GLchar * name)
+{
+    snprintf(name, size, "%s", stub_uniforms[index].name);
+}
+
+static GLint APIENTRY stub_GetUniformLocation(GLuint, const GLchar * name)
+{
+    // zoom is at 0, arr at 1 to 3
+    return strcmp(name, "zoom") == 0 ? 0 : strcmp(name, "arr[0]") == 0 ? 1 : -1;
+}
+
+static void APIENTRY stub_GetUniformfv(GLuint, GLint, GLfloat * params)
+{
+    *params = 0.0f;
+}
+
+static void APIENTRY stub_GetActiveUniformBlockName(GLuint, GLuint index, GLsizei size, GLsizei *, GLchar * name)
+{
+    snprintf(name, size, "%s", stub_blocks[index]);
+}
+
+static void APIENTRY stub_GetActiveUniformBlockiv(GLuint, GLuint index, GLenum pname, GLint * params)
+{
+    *params = pname == GL_UNIFORM_BLOCK_DATA_SIZE ? stub_block_sizes[index] : 0;
+}
+
+static void APIENTRY stub_GetIntegerv(GLenum pname, GLint * data)
+{
+    *data = pname == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT ? 256 : 0;
+}
+
+static void APIENTRY stub_UniformBlockBinding(GLuint, GLuint, GLuint)
+{
+
+}
+
+static void APIENTRY stub_Uniform1fv(GLint location, GLsizei count, const GLfloat * value)
+{
+    char call[64];
+
+    sprintf(call, "%d:%d:%g", location, count, value[0]);
+    uniform_calls.push_back(call);
+}
+
+static void APIENTRY stub_GenBuffers(GLsizei, GLuint * buffers)
+{
+    *buffers = 1;
+}
+
+static void APIENTRY stub_BindBuffer(GLenum, GLuint)
+{
+
+}
+
+static void APIENTRY stub_BufferStorage(GLenum, GLsizeiptr size, const void *, GLbitfield)
+{
+    buffer.assign(size, 0xCD);
+}
+
+static void APIENTRY stub_BufferData(GLenum, GLsizeiptr size, const void *, GLenum)
+{
+    buffer.assign(size, 0xCD);
+}
+
+static void * APIENTRY stub_MapBufferRange(GLenum, GLintptr offset, GLsizeiptr, GLbitfield)
+{
+    maps++;
+    return &buffer[offset];
+}
+
+static GLboolean APIENTRY stub_UnmapBuffer(GLenum)
+{
+    return GL_TRUE;
+}
+
+static GLsync APIENTRY stub_FenceSync(GLenum, GLbitfield)
+{
+    static int fence;
+
+    return (GLsync)(size_t)++fence;
+}
+
+static GLenum APIENTRY stub_ClientWaitSync(GLsync, GLbitfield, GLuint64)
+{
+    return GL_ALREADY_SIGNALED;
+}
+
+static void APIENTRY stub_DeleteSync(GLsync)
+{
+
+}
+
+static void APIENTRY stub_DeleteBuffers(GLsizei, const GLuint *)
+{
+
+}
+
+static void APIENTRY stub_BindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr)
+{
+
+}
+
+static void install_stubs()
+{
+    gl3wGetProgramiv = stub_GetProgramiv;
+    gl3wGetActiveUniformsiv = stub_GetActiveUniformsiv;
+    gl3wGetActiveUniformName = stub_GetActiveUniformName;
+    gl3wGetUniformLocation = stub_GetUniformLocation;
+    gl3wGetUniformfv = stub_GetUniformfv;
+    gl3wGetActiveUniformBlockName = stub_GetActiveUniformBlockName;
+    gl3wGetActiveUniformBlockiv = stub_GetActiveUniformBlockiv;
+    gl3wGetIntegerv = stub_GetIntegerv;
+    gl3wUniformBlockBinding = stub_UniformBlockBinding;
+    gl3wUniform1fv = stub_Uniform1fv;
+    gl3wGenBuffers = stub_GenBuffers;
+    gl3wBindBuffer = stub_BindBuffer;
+    gl3wBufferStorage = stub_BufferStorage;
+    gl3wBufferData = stub_BufferData;
+    gl3wMapBufferRange = stub_MapBufferRange;
+    gl3wUnmapBuffer = stub_UnmapBuffer;
+    gl3wFenceSync = stub_FenceSync;
+    gl3wClientWaitSync = stub_ClientWaitSync;
+    gl3wDeleteSync = stub_DeleteSync;
+    gl3wDeleteBuffers = stub_DeleteBuffers;
+    gl3wBindBufferRange = stub_BindBufferRange;
+}
+
+static float block_value(const sb7::uniform_cache& cache, unsigned int index)
+{
+    float value;
+
+    memcpy(&value, &buffer[cache.get_block(index).bound], sizeof(value));
+
+    return value;
+}
+
+static void test_lookup()
+{
+    sb7::uniform_cache cache;
+
+    cache.reflect(1);
+
+    CHECK(cache.find("zoom") == 0);
+    CHECK(cache.find("arr") == 1);
+    CHECK(cache.find("arr[0]") == 1);
+    CHECK(cache.find("ar") == -1);
+    CHECK(cache.find("Block.a") == 2);
+    CHECK(cache.find("missing") == -1);
+
+    // Wrong type and unknown names are refused, as with location -1
+    CHECK(!cache.set("zoom", 1));
+    CHECK(!cache.set("missing", 1.0f));
+}
+
+static void test_flush()
+{
+    sb7::uniform_cache cache;
+    const float arr[3] = { 1.0f, 2.0f, 3.0f };
+    int zoom;
+    int maps_before;
+
+    cache.reflect(1);
+    zoom = cache.find("zoom");
+
+    // Blocks go out the first time regardless
+    cache.set("Other.b", 5.0f);
+    cache.flush();
+    CHECK(uniform_calls.empty());
+    CHECK(block_value(cache, 1) == 5.0f);
+
+    // The value read back from the program is already there
+    cache.set(zoom, 0.0f);
+    maps_before = maps;
+    cache.flush();
+    CHECK(uniform_calls.empty());
+    CHECK(maps == maps_before);
+
+    // Only what changed is sent
+    cache.set(zoom, 2.0f);
+    cache.set(cache.find("arr"), arr, 3);
+    cache.flush();
+    CHECK(uniform_calls.size() == 2);
+    CHECK(uniform_calls.size() == 2 && uniform_calls[0] == "0:1:2");
+    CHECK(uniform_calls.size() == 2 && uniform_calls[1] == "1:3:1");
+    CHECK(maps == maps_before);
+    uniform_calls.clear();
+
+    cache.set(zoom, 2.0f);
+    cache.set(cache.find("arr"), arr, 3);
+    cache.flush();
+    CHECK(uniform_calls.empty());
+
+    // A changed block moves every block to the new frame, so nothing stays
+    // bound to a copy the ring will come back round to
+    maps_before = maps;
+    cache.set("Block.a", vmath::vec4(1.0f, 2.0f, 3.0f, 4.0f));
+    cache.flush();
+    CHECK(uniform_calls.empty());
+    CHECK(buffer_storage || maps == maps_before + 1);
+    CHECK(cache.get_block(0).bound - cache.get_block(0).slot ==
+          cache.get_block(1).bound - cache.get_block(1).slot);
+    CHECK(block_value(cache, 0) == 1.0f);
+    CHECK(block_value(cache, 1) == 5.0f);
+
+    cache.free();
+}
+
+int main()
+{
+    install_stubs();
+
+    test_lookup();
+
+    buffer_storage = true;
+    test_flush();
+
+    buffer_storage = false;
+    test_flush();
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright © 2012-2015 Graham Sellers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Drives the CPU side of sb7::vtex: page_table, residency_cache and
+// tile_reader. Nothing here needs a context; the reader tests write a row
+// major and a tiled KTX into the working directory and read pages back out
+// of both.
+
+#include <sb7vtex.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace sb7;
+
+static int failures;
+
+#define CHECK(x)                                                        \
+    do                                                                  \
+    {                                                                   \
+        if (!(x))                                                       \
+        {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static const char rows_file[] = "vtextest_rows.ktx";
+static const char tiled_file[] = "vtextest_tiled.ktx";
+
+static bool contains(const std::vector<vtex::page_key>& keys, vtex::page_key key)
+{
+    size_t i;
+
+    for (i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] == key)
+            return true;
+    }
+
+    return false;
+}
+
+static void test_page_table()
+{
+    vtex::page_table table;
+    std::vector<unsigned char> map;
+
+    // 1024x1024 in 128x128 pages: 8x8 pages at level 0, levels 4 and up
+    // are the tail.
+    CHECK(!table.init(1024, 1024, 0, 128, 11, 4));
+    CHECK(!table.init(1024, 1024, 128, 128, 11, 12));
+    CHECK(table.init(1024, 1024, 128, 128, 11, 4));
+
+    CHECK(table.pages_x(0) == 8 && table.pages_y(0) == 8);
+    CHECK(table.pages_x(3) == 1 && table.pages_y(3) == 1);
+    CHECK(table.pages_x(10) == 1 && table.pages_x(11) == 0);
+
+    CHECK(table.valid(vtex::make_key(0, 7, 7)));
+    CHECK(!table.valid(vtex::make_key(0, 8, 0)));
+    CHECK(!table.valid(vtex::make_key(11, 0, 0)));
+    CHECK(table.parent(vtex::make_key(0, 5, 3)) == vtex::make_key(1, 2, 1));
+    CHECK(table.parent(vtex::make_key(10, 0, 0)) == vtex::make_key(10, 0, 0));
+
+    // The tail starts out resident, nothing else does
+    CHECK(table.in_tail(vtex::make_key(4, 0, 0)));
+    CHECK(table.get(vtex::make_key(4, 0, 0)) == vtex::page_table::resident);
+    CHECK(table.get(vtex::make_key(3, 0, 0)) == vtex::page_table::non_resident);
+    CHECK(table.min_level(0, 0) == 4);
+
+    table.clear_dirty();
+    table.set(vtex::make_key(3, 0, 0), vtex::page_table::loading);
+    CHECK(!table.dirty());
+    table.set(vtex::make_key(3, 0, 0), vtex::page_table::resident);
+    CHECK(table.dirty());
+
+    CHECK(table.min_level(0, 0) == 3);
+    CHECK(table.min_level(7, 7) == 3);
+
+    // Level 2 page (1,1) covers level 0 pages 4-7 in each direction
+    table.set(vtex::make_key(2, 1, 1), vtex::page_table::resident);
+    CHECK(table.min_level(5, 5) == 2);
+    CHECK(table.min_level(3, 3) == 3);
+
+    // A resident level 0 page doesn't count until level 1 above it is
+    table.set(vtex::make_key(0, 5, 5), vtex::page_table::resident);
+    CHECK(table.min_level(5, 5) == 2);
+    table.set(vtex::make_key(1, 2, 2), vtex::page_table::resident);
+    CHECK(table.min_level(5, 5) == 0);
+    CHECK(table.min_level(4, 5) == 1);
+
+    // Losing a coarse page hides everything finer beneath it
+    table.set(vtex::make_key(2, 1, 1), vtex::page_table::non_resident);
+    CHECK(table.min_level(5, 5) == 3);
+
+    table.build_min_level_map(map);
+    CHECK(map.size() == 64);
+    CHECK(map[5 * 8 + 5] == 3);
+    CHECK(map[0] == 3);
+}
+
+static void test_residency_cache()
+{
+    vtex::page_table table;
+    vtex::residency_cache cache;
+    std::vector<vtex::page_key> loads;
+    std::vector<vtex::page_key> evicted;
+    size_t i;
+
+    table.init(1024, 1024, 128, 128, 11, 4);
+    cache.init(&table, 4);
+
+    // Asking for a level 0 page asks for everything above it down to the
+    // tail, and the coarsest pages are handed out first.
+    cache.begin_frame();
+    cache.request(vtex::make_key(0, 5, 5));
+    cache.schedule(loads, 2);
+    CHECK(loads.size() == 2);
+    CHECK(loads.size() == 2 && loads[0] == vtex::make_key(3, 0, 0));
+    CHECK(loads.size() == 2 && loads[1] == vtex::make_key(2, 1, 1));
+    CHECK(table.get(vtex::make_key(3, 0, 0)) == vtex::page_table::loading);
+
+    for (i = 0; i < loads.size(); i++)
+        CHECK(cache.make_resident(loads[i], evicted));
+
+    cache.begin_frame();
+    cache.request(vtex::make_key(0, 5, 5));
+    cache.schedule(loads, 8);
+    CHECK(loads.size() == 2);
+    CHECK(loads.size() == 2 && loads[0] == vtex::make_key(1, 2, 2));
+    CHECK(loads.size() == 2 && loads[1] == vtex::make_key(0, 5, 5));
+
+    for (i = 0; i < loads.size(); i++)
+        CHECK(cache.make_resident(loads[i], evicted));
+
+    CHECK(evicted.empty());
+    CHECK(cache.resident_pages() == 4);
+    CHECK(table.min_level(5, 5) == 0);
+
+    // The next frame only looks at the corner. (3,0,0) is shared, so it is
+    // touched rather than evicted and the other three go, oldest first.
+    cache.begin_frame();
+    cache.request(vtex::make_key(0, 0, 0));
+    cache.schedule(loads, 8);
+    CHECK(loads.size() == 3);
+
+    for (i = 0; i < loads.size(); i++)
+        CHECK(cache.make_resident(loads[i], evicted));
+
+    CHECK(evicted.size() == 3);
+    CHECK(evicted.size() == 3 && evicted[0] == vtex::make_key(2, 1, 1));
+    CHECK(evicted.size() == 3 && evicted[1] == vtex::make_key(1, 2, 2));
+    CHECK(evicted.size() == 3 && evicted[2] == vtex::make_key(0, 5, 5));
+    CHECK(table.get(vtex::make_key(3, 0, 0)) == vtex::page_table::resident);
+    CHECK(table.get(vtex::make_key(0, 5, 5)) == vtex::page_table::non_resident);
+    CHECK(cache.resident_pages() == 4);
+    CHECK(table.min_level(0, 0) == 0);
+    CHECK(table.min_level(5, 5) == 3);
+
+    // Everything resident is in use this frame, so there's no room
+    evicted.clear();
+    cache.begin_frame();
+    cache.request(vtex::make_key(0, 0, 0));
+    cache.request(vtex::make_key(0, 7, 7));
+    cache.schedule(loads, 8);
+    CHECK(loads.size() == 3);
+    CHECK(loads.size() == 3 && !cache.make_resident(loads[0], evicted));
+    CHECK(evicted.empty());
+    CHECK(table.get(loads[0]) == vtex::page_table::non_resident);
+
+    // Cancelled loads go back to being requestable
+    cache.cancel(loads[1]);
+    CHECK(table.get(loads[1]) == vtex::page_table::non_resident);
+
+    // Feedback texels are key + 1, with zero meaning nothing; repeats of
+    // the same page only count once.
+    const unsigned int texels[] =
+    {
+        0,
+        vtex::make_key(0, 6, 1) + 1,
+        vtex::make_key(0, 6, 1) + 1,
+        0,
+        vtex::make_key(0, 99, 0) + 1
+    };
+
+    cache.begin_frame();
+    cache.request_feedback(texels, sizeof(texels) / sizeof(texels[0]));
+    cache.schedule(loads, 8);
+    CHECK(loads.size() == 3);
+    CHECK(contains(loads, vtex::make_key(0, 6, 1)));
+    CHECK(contains(loads, vtex::make_key(1, 3, 0)));
+    CHECK(contains(loads, vtex::make_key(2, 1, 0)));
+}
+
+static void test_tile_reader()
+{
+    ktx::file::texture_desc desc;
+    std::vector<unsigned char> data;
+    unsigned int level;
+    size_t i;
+
+    // RGB8 with an odd width, so that row major levels have padded rows and
+    // the edge tiles are partial.
+    memset(&desc, 0, sizeof(desc));
+    ktx::file::init_header(desc.h, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE);
+    desc.h.pixelwidth = 301;
+    desc.h.pixelheight = 203;
+    desc.h.miplevels = 5;
+    CHECK(ktx::file::layout(desc));
+
+    data.resize(desc.data_size);
+    for (i = 0; i < data.size(); i++)
+        data[i] = (unsigned char)(i * 7 + i / 13);
+
+    CHECK(ktx::file::write(rows_file, desc, &data[0]));
+    CHECK(vtex::write_tiled(tiled_file, desc, &data[0], 48, 32));
+
+    vtex::tile_reader rows;
+    vtex::tile_reader tiled;
+
+    CHECK(rows.open(rows_file, 64, 40));
+    CHECK(tiled.open(tiled_file, 64, 40));
+    CHECK(!rows.tiled());
+    CHECK(tiled.tiled());
+    CHECK(rows.pixel_size() == 3);
+    CHECK(rows.page_bytes() == 64 * 40 * 3);
+
+    if (!rows.pixel_size() || !tiled.pixel_size())
+        return;
+
+    std::vector<unsigned char> page(rows.page_bytes());
+    std::vector<unsigned char> tiled_page(tiled.page_bytes());
+
+    for (level = 0; level < desc.levels; level++)
+    {
+        const ktx::file::level_layout& l = desc.level[level];
+        const unsigned char * src = &data[l.offset - desc.data_offset];
+        const size_t pitch = ((size_t)l.width * 3 + 3) & ~(size_t)3;
+        unsigned int px, py, x, y;
+        bool same = true;
+
+        for (py = 0; py * 40 < l.height; py++)
+        {
+            for (px = 0; px * 64 < l.width; px++)
+            {
+                CHECK(rows.read_page(vtex::make_key(level, px, py), &page[0]));
+                CHECK(tiled.read_page(vtex::make_key(level, px, py), &tiled_page[0]));
+                CHECK(page == tiled_page);
+
+                // Every texel comes from the right place in the level and
+                // the part hanging off the edge is zero.
+                for (y = 0; y < 40; y++)
+                {
+                    for (x = 0; x < 64; x++)
+                    {
+                        const unsigned int sx = px * 64 + x;
+                        const unsigned int sy = py * 40 + y;
+                        const unsigned char * texel = &tiled_page[(y * 64 + x) * 3];
+
+                        if (sx < l.width && sy < l.height)
+                            same = same && memcmp(texel, src + sy * pitch + sx * 3, 3) == 0;
+                        else
+                            same = same && texel[0] == 0 && texel[1] == 0 && texel[2] == 0;
+                    }
+                }
+            }
+        }
+
+        CHECK(same);
+        CHECK(!tiled.read_page(vtex::make_key(level, px, 0), &page[0]));
+
+        std::vector<unsigned char> a((size_t)l.width * l.height * 3);
+        std::vector<unsigned char> b(a.size());
+
+        CHECK(rows.read_level(level, &a[0]));
+        CHECK(tiled.read_level(level, &b[0]));
+        CHECK(a == b);
+        CHECK(memcmp(&b[0], src, (size_t)l.width * 3) == 0);
+    }
+
+    CHECK(!tiled.read_page(vtex::make_key(desc.levels, 0, 0), &page[0]));
+
+    rows.close();
+    tiled.close();
+
+    remove(rows_file);
+    remove(tiled_file);
+}
+
+int main()
+{
+    test_page_table();
+    test_residency_cache();
+    test_tile_reader();
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+
+    return 0;
+}